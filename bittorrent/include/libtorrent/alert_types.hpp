@@ -41,6 +41,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/identify_client.hpp"
 #include "libtorrent/address.hpp"
 #include "libtorrent/stat.hpp"
+#include "libtorrent/session_metrics.hpp"
 #include "libtorrent/rss.hpp" // for feed_handle
 
 // lines reserved for future includes
@@ -227,6 +228,7 @@ namespace libtorrent
 			too_high_disk_queue_limit,
 			too_few_outgoing_ports,
 			too_few_file_descriptors,
+			large_pages_unavailable,
 
 
 
@@ -1333,6 +1335,22 @@ namespace libtorrent
 		std::vector<torrent_status> status;
 	};
 
+	// posted in response to session::post_session_stats()
+	struct TORRENT_EXPORT session_stats_alert : alert
+	{
+		session_stats_alert(session_metrics const& m)
+			: metrics(m)
+		{}
+
+		TORRENT_DEFINE_ALERT(session_stats_alert);
+
+		const static int static_category = alert::stats_notification;
+		virtual std::string message() const;
+		virtual bool discardable() const { return false; }
+
+		session_metrics metrics;
+	};
+
 #undef TORRENT_DEFINE_ALERT
 
 }
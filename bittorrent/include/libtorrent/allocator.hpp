@@ -50,6 +50,24 @@ namespace libtorrent
 		static void free(char* const block);
 	};
 
+	// allocates large regions, backed by large (huge) pages if
+	// large_pages is set and the OS lets us. large_pages is cleared if
+	// the region got normal pages, and has to be passed back to free().
+	// Regions are aligned to 2 MiB where the OS may back them with huge
+	// pages on its own
+	struct TORRENT_EXTRA_EXPORT large_page_allocator
+	{
+		typedef std::size_t size_type;
+
+		// on windows, enables SeLockMemoryPrivilege in the process token,
+		// which large page allocations need. The account must hold the
+		// privilege. Returns false if large pages can't be had at all
+		static bool enable_large_pages();
+
+		static char* malloc(const size_type bytes, bool& large_pages);
+		static void free(char* const block, const size_type bytes, bool large_pages);
+	};
+
 	struct TORRENT_EXTRA_EXPORT aligned_holder
 	{
 		aligned_holder(): m_buf(0) {}
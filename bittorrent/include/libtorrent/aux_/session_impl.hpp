@@ -38,14 +38,6 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <set>
 #include <list>
 
-#ifndef TORRENT_DISABLE_GEO_IP
-#ifdef WITH_SHIPPED_GEOIP_H
-#include "libtorrent/GeoIP.h"
-#else
-#include <GeoIP.h>
-#endif
-#endif
-
 #ifdef _MSC_VER
 #pragma warning(push, 1)
 #endif
@@ -74,6 +66,10 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/socket_type.hpp"
 #include "libtorrent/connection_queue.hpp"
 #include "libtorrent/disk_io_thread.hpp"
+#include "libtorrent/dh_key_pool.hpp"
+#include "libtorrent/geoip_table.hpp"
+#include "libtorrent/status_table.hpp"
+#include "libtorrent/session_metrics.hpp"
 #include "libtorrent/udp_socket.hpp"
 #include "libtorrent/assert.hpp"
 #include "libtorrent/thread.hpp"
@@ -272,6 +268,10 @@ namespace libtorrent
 			void set_settings(session_settings const& s);
 			session_settings const& settings() const { return m_settings; }
 
+			// the network thread's metrics, or 0 if they're not collected
+			session_metrics* metrics()
+			{ return m_settings.collect_metrics ? &m_metrics : 0; }
+
 #ifndef TORRENT_DISABLE_DHT	
 			void add_dht_node_name(std::pair<std::string, int> const& node);
 			void add_dht_node(udp::endpoint n);
@@ -326,8 +326,10 @@ namespace libtorrent
 
 			torrent_handle add_torrent(add_torrent_params const&, error_code& ec);
 			void async_add_torrent(add_torrent_params* params);
+			void async_add_torrents(std::vector<add_torrent_params>* params);
 
 			void remove_torrent(torrent_handle const& h, int options);
+			void remove_torrents(std::vector<torrent_handle> const& h, int options);
 			void remove_torrent_impl(boost::shared_ptr<torrent> tptr, int options);
 
 			void get_torrent_status(std::vector<torrent_status>* ret
@@ -341,6 +343,8 @@ namespace libtorrent
 			
 			void queue_check_torrent(boost::shared_ptr<torrent> const& t);
 			void dequeue_check_torrent(boost::shared_ptr<torrent> const& t);
+			bool is_checking_device(boost::uint64_t device) const;
+			void start_queued_checks();
 
 			void set_alert_mask(boost::uint32_t m);
 			size_t set_alert_queue_size_limit(size_t queue_size_limit_);
@@ -379,6 +383,7 @@ namespace libtorrent
 			void choke_peer(peer_connection& c);
 
 			session_status status() const;
+			void post_session_stats();
 			void set_peer_id(peer_id const& id);
 			void set_key(int key);
 			address listen_address() const;
@@ -433,6 +438,8 @@ namespace libtorrent
 			std::string as_name_for_ip(address const& a);
 			int as_for_ip(address const& a);
 			std::pair<const int, int>* lookup_as(int as);
+			// has_asnum_db() and has_country_db() only return true once a
+			// database has been loaded, which is after load_*_db() returns
 			void load_asnum_db(std::string file);
 			bool has_asnum_db() const { return m_asnum_db ? true : false; }
 
@@ -440,6 +447,15 @@ namespace libtorrent
 			bool has_country_db() const { return m_country_db ? true : false; }
 			char const* country_for_ip(address const& a);
 
+			// the databases are compiled on a thread of their own, and
+			// installed by on_geoip_loaded() back on the network thread
+			void load_geoip_db(std::string const& file, geoip_table::db_type t);
+			void geoip_loader(std::string file, geoip_table::db_type t, int generation);
+			void on_geoip_loaded(boost::shared_ptr<geoip_table const> db
+				, geoip_table::db_type t, int generation);
+			static int geoip_key(geoip_table::db_type t, int generation)
+			{ return generation * 2 + int(t); }
+
 #if TORRENT_USE_WSTRING
 			void load_asnum_dbw(std::wstring file);
 			void load_country_dbw(std::wstring file);
@@ -463,6 +479,14 @@ namespace libtorrent
 				m_redundant_bytes[reason] += b;
 			}
 
+			// bytes the peer connections copied or moved in memory
+			// after reading them from the socket
+			void add_recv_copied_bytes(int b) { m_total_recv_copied_bytes += b; }
+
+			// called when a peer connection completes the encrypted
+			// part of its handshake, ms milliseconds after connecting
+			void record_handshake_latency(int ms);
+
 			void add_failed_bytes(size_type b)
 			{
 				TORRENT_ASSERT(b > 0);
@@ -625,6 +649,12 @@ namespace libtorrent
 			// constructed after it.
 			disk_io_thread m_disk_thread;
 
+#ifndef TORRENT_DISABLE_ENCRYPTION
+			// precomputes DH keys and computes shared secrets
+			// for encrypted handshakes, off the network thread
+			dh_key_pool m_dh_key_pool;
+#endif
+
 			// this is a list of half-open tcp connections
 			// (only outgoing connections)
 			// this has to be one of the last
@@ -667,7 +697,17 @@ namespace libtorrent
 			// and download_channel is waiting to write to disk
 			int m_disk_queues[2];
 
+			// the counters and histograms updated by the network thread.
+			// The disk thread keeps its own
+			session_metrics m_metrics;
+
 			tracker_manager m_tracker_manager;
+
+			// every torrent publishes its status here once a second.
+			// It's declared before m_torrents since torrents release
+			// their slots when they're destructed
+			status_table m_status_table;
+
 			torrent_map m_torrents;
 			std::map<std::string, boost::shared_ptr<torrent> > m_uuids;
 
@@ -1111,8 +1151,19 @@ namespace libtorrent
 #endif
 
 #ifndef TORRENT_DISABLE_GEO_IP
-			GeoIP* m_asnum_db;
-			GeoIP* m_country_db;
+			boost::shared_ptr<geoip_table const> m_asnum_db;
+			boost::shared_ptr<geoip_table const> m_country_db;
+
+			// incremented for every load of the database of that type,
+			// so that only the latest requested file is installed, even
+			// if an earlier load finishes after it
+			int m_geoip_generation[2];
+
+			// the threads compiling databases, by generation and type (see
+			// geoip_key()). They're joined by on_geoip_loaded() when they're
+			// done, and the ones still running are joined on abort
+			typedef std::map<int, boost::shared_ptr<thread> > geoip_threads_t;
+			geoip_threads_t m_geoip_threads;
 
 			// maps AS number to the peak download rate
 			// we've seen from it. Entries are never removed
@@ -1121,9 +1172,17 @@ namespace libtorrent
 			std::map<int, int> m_as_peak;
 #endif
 
-			// total redundant and failed bytes
+			// total redundant and failed bytes, and bytes
+			// copied by the receive path
 			size_type m_total_failed_bytes;
 			size_type m_total_redundant_bytes;
+			size_type m_total_recv_copied_bytes;
+
+			// the handshake latencies of the most recent encrypted
+			// connections, in milliseconds. Used as a ring buffer,
+			// m_handshake_latency_cursor is the next slot to write
+			std::vector<int> m_handshake_latency;
+			int m_handshake_latency_cursor;
 
 			// redundant bytes per category
 			size_type m_redundant_bytes[7];
@@ -48,6 +48,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/thread.hpp"
 #include "libtorrent/bandwidth_socket.hpp"
 #include "libtorrent/ptime.hpp"
+#include "libtorrent/session_metrics.hpp"
 
 using boost::intrusive_ptr;
 
@@ -102,6 +103,9 @@ struct TORRENT_EXTRA_EXPORT bandwidth_manager
 
 	bool m_abort;
 
+	// the metrics to record wait times into, or 0
+	session_metrics* m_metrics;
+
 #ifdef TORRENT_VERBOSE_BANDWIDTH_LIMIT
 	std::ofstream m_log;
 	ptime m_start;
@@ -36,6 +36,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <boost/intrusive_ptr.hpp>
 #include "libtorrent/bandwidth_limit.hpp"
 #include "libtorrent/bandwidth_socket.hpp"
+#include "libtorrent/time.hpp"
 
 namespace libtorrent {
 
@@ -58,6 +59,10 @@ struct TORRENT_EXTRA_EXPORT bw_request
 	// time to satisfy
 	int ttl;
 
+	// when the request was queued. This is min_time() unless the
+	// bandwidth manager was collecting metrics at the time
+	ptime queued;
+
 	// loops over the bandwidth channels and assigns bandwidth
 	// from the most limiting one
 	int assign_bandwidth();
@@ -280,6 +280,11 @@ namespace libtorrent
 
 		void write_pe1_2_dhkey();
 		void write_pe3_sync();
+
+		// continues the handshake once the DH shared secret has been
+		// computed. ret is the return value of compute_secret()
+		void on_dh_secret(int ret);
+		void on_dh_secret_async(int ret);
 		void write_pe4_sync(int crypto_select);
 
 		void write_pe_vc_cryptofield(char* write_buf, int len
@@ -292,22 +297,35 @@ namespace libtorrent
 
 public:
 
-		// these functions encrypt the send buffer if m_rc4_encrypted
-		// is true, otherwise it passes the call to the
-		// peer_connection functions of the same names
+		// if m_rc4_encrypted is true, these functions mark the bytes they
+		// queue as pending encryption. They are encrypted in place, in one
+		// pass, by encrypt_pending_buffer() right before they're sent.
+		// Otherwise the calls are passed on to the peer_connection
+		// functions of the same names
 		virtual void append_const_send_buffer(char const* buffer, int size);
 		virtual void send_buffer(char const* begin, int size, int flags = 0
 			, void (*fun)(char*, int, void*) = 0, void* userdata = 0);
 		template <class Destructor>
 		void append_send_buffer(char* buffer, int size, Destructor const& destructor)
 		{
+			peer_connection::append_send_buffer(buffer, size, destructor, true);
 #ifndef TORRENT_DISABLE_ENCRYPTION
 			if (m_rc4_encrypted)
-				m_enc_handler->encrypt(buffer, size);
+				m_unencrypted_bytes += size;
 #endif
-			peer_connection::append_send_buffer(buffer, size, destructor, true);
 		}
 
+		// queues a buffer that's shared between connections, such as a
+		// pre-encoded pex message. holder keeps it alive until it has
+		// been sent. If the connection is RC4 encrypted, the buffer is
+		// copied instead, since it's encrypted in place
+		void append_shared_send_buffer(char const* buffer, int size
+			, boost::shared_ptr<void const> const& holder);
+
+#ifndef TORRENT_DISABLE_ENCRYPTION
+		virtual void encrypt_pending_buffer();
+#endif
+
 private:
 
 		// Returns offset at which bytestream (src, src + src_size)
@@ -413,6 +431,19 @@ private:
 		// true if rc4, false if plaintext
 		bool m_rc4_encrypted;
 
+		// the number of bytes at the end of the send buffer
+		// that have not been encrypted yet
+		int m_unencrypted_bytes;
+
+		// scratch space for the iovec of the bytes to encrypt.
+		// kept around to not allocate it for every send
+		std::vector<asio::mutable_buffer> m_encrypt_vec;
+
+		// when the connection was established, or accepted. The time
+		// until the encrypted handshake completes is reported to the
+		// session
+		ptime m_handshake_start;
+
 		// used to disconnect peer if sync points are not found within
 		// the maximum number of bytes
 		int m_sync_bytes_read;
@@ -43,6 +43,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <boost/asio/buffer.hpp>
 #endif
 #include <list>
+#include <vector>
 #include <string.h> // for memcpy
 
 namespace libtorrent
@@ -94,6 +95,11 @@ namespace libtorrent
 
 		std::list<asio::const_buffer> const& build_iovec(int to_send);
 
+		// fills in vec with the last 'bytes' bytes of the
+		// chain, in order. Used to modify the tail of the
+		// buffer in place, e.g. to encrypt it
+		void build_mutable_iovec(int bytes, std::vector<asio::mutable_buffer>& vec);
+
 		~chained_buffer();
 
 	private:
@@ -0,0 +1,128 @@
+/*
+
+Copyright (c) 2012, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_DH_KEY_POOL_HPP_INCLUDED
+#define TORRENT_DH_KEY_POOL_HPP_INCLUDED
+
+#ifndef TORRENT_DISABLE_ENCRYPTION
+
+#include <vector>
+#include <deque>
+#include <boost/function/function1.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/cstdint.hpp>
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/thread.hpp"
+#include "libtorrent/io_service.hpp"
+#include "libtorrent/pe_crypto.hpp"
+
+namespace libtorrent
+{
+	// generating a DH key pair and computing the shared secret are both
+	// modular exponentiations, and by far the most expensive part of
+	// accepting an encrypted connection. This pool moves them off the
+	// network thread. It keeps a number of key pairs precomputed, refilled
+	// by a background thread, and that thread can also compute the shared
+	// secret of a key exchange, posting the result back to the io_service.
+	class TORRENT_EXTRA_EXPORT dh_key_pool : boost::noncopyable
+	{
+	public:
+		dh_key_pool(io_service& ios);
+		~dh_key_pool();
+
+		// the number of key pairs to keep precomputed. 0 turns the
+		// precomputation off
+		void set_size(int n);
+
+		// hands out a precomputed key pair. Returns false if the pool
+		// is empty, in which case the caller has to generate one itself
+		bool pop(dh_key_pair& k);
+
+		// computes the shared secret of e on the pool's thread and
+		// posts handler, with the return value of compute_secret(),
+		// to the io_service. e must stay alive until handler is called.
+		// Returns false if the pool has been stopped, in which case
+		// handler is never called
+		bool async_compute_secret(dh_key_exchange* e, char const* remote_key
+			, boost::function<void(int)> const& handler);
+
+		// stops the thread and drops any outstanding jobs. Must be
+		// called from the network thread
+		void abort();
+
+	private:
+
+		void thread_fun();
+		void start_thread(mutex::scoped_lock& l);
+
+		// only used by the pool's thread
+		boost::uint32_t next_random();
+
+		struct secret_job
+		{
+			dh_key_exchange* exchange;
+			char remote_key[96];
+			boost::function<void(int)> handler;
+		};
+
+		io_service& m_ios;
+
+		mutex m_mutex;
+		condition m_cond;
+
+		// precomputed key pairs, ready to be handed out
+		std::vector<dh_key_pair> m_keys;
+
+		// shared secrets to compute. These take priority
+		// over refilling the pool
+		std::deque<secret_job> m_jobs;
+
+		// the number of key pairs to keep in m_keys
+		int m_size;
+
+		bool m_abort;
+
+		// the state of the xorshift generator the private keys are
+		// made from. random() isn't thread safe, so the pool's thread
+		// has its own
+		boost::uint32_t m_rand[4];
+
+		boost::scoped_ptr<thread> m_thread;
+	};
+}
+
+#endif // TORRENT_DISABLE_ENCRYPTION
+
+#endif // TORRENT_DH_KEY_POOL_HPP_INCLUDED
+
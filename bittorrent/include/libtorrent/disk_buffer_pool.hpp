@@ -39,7 +39,9 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/allocator.hpp"
 
 #ifndef TORRENT_DISABLE_POOL_ALLOCATOR
-#include <boost/pool/pool.hpp>
+#include <map>
+#include <set>
+#include "libtorrent/bitfield.hpp"
 #endif
 
 #ifdef TORRENT_DISK_STATS
@@ -52,12 +54,43 @@ POSSIBILITY OF SUCH DAMAGE.
 
 namespace libtorrent
 {
+	// how the disk buffers are laid out in the regions they're carved
+	// out of. Free blocks in regions that also have blocks in use can't
+	// be given back to the OS, that's the pool's fragmentation
+	struct disk_pool_status
+	{
+		disk_pool_status()
+			: regions(0)
+			, large_page_regions(0)
+			, large_page_failures(0)
+			, partial_regions(0)
+			, blocks_per_region(0)
+			, free_blocks(0)
+			, largest_free_run(0)
+		{}
+
+		// the number of regions, and how many of them
+		// are backed by large pages
+		int regions;
+		int large_page_regions;
+		// the number of regions that were meant to get large
+		// pages but got normal ones, since the pool was created
+		int large_page_failures;
+		// the number of regions with some, but not all,
+		// blocks in use
+		int partial_regions;
+		int blocks_per_region;
+		// the number of blocks in the regions that aren't in use
+		int free_blocks;
+		// the most blocks allocate_buffers() can hand out
+		// without adding a region
+		int largest_free_run;
+	};
+
 	struct TORRENT_EXTRA_EXPORT disk_buffer_pool : boost::noncopyable
 	{
 		disk_buffer_pool(int block_size);
-#if defined TORRENT_DEBUG || TORRENT_RELEASE_ASSERTS
 		~disk_buffer_pool();
-#endif
 
 #if defined TORRENT_DEBUG || TORRENT_RELEASE_ASSERTS
 		bool is_disk_buffer(char* buffer
@@ -66,6 +99,14 @@ namespace libtorrent
 #endif
 
 		char* allocate_buffer(char const* category);
+
+		// allocates num_blocks blocks laid out back to back and returns
+		// the first one, so they can be read into with a single call.
+		// Each block is still a buffer of its own, freed with
+		// free_buffer(). Returns 0 if there's no such run, in which case
+		// the blocks have to be allocated one at a time
+		char* allocate_buffers(int num_blocks, char const* category);
+
 		void free_buffer(char* buf);
 		void free_multiple_buffers(char** bufvec, int numbufs);
 
@@ -84,6 +125,8 @@ namespace libtorrent
 
 		int in_use() const { return m_in_use; }
 
+		disk_pool_status pool_status() const;
+
 	protected:
 
 		void free_buffer_impl(char* buf, mutex::scoped_lock& l);
@@ -99,12 +142,40 @@ namespace libtorrent
 
 	private:
 
+		void on_allocated(char* buf, int num_blocks, char const* category
+			, mutex::scoped_lock& l);
+
 		mutable mutex m_pool_mutex;
 
 #ifndef TORRENT_DISABLE_POOL_ALLOCATOR
-		// memory pool for read and write operations
-		// and disk cache
-		boost::pool<page_aligned_allocator> m_pool;
+		// the blocks for read and write operations and the disk cache
+		// are carved out of regions of 2 MiB, which is the large page
+		// size on x86. Having few, large allocations keeps the
+		// allocator overhead and TLB misses down with large caches
+		struct region
+		{
+			region(): large_pages(false), num_used(0) {}
+			bool large_pages;
+			// one bit per block, set if it's in use
+			bitfield used;
+			int num_used;
+		};
+
+		char* allocate_blocks(int num_blocks);
+		void free_block(char* buf);
+		char* add_region();
+
+		// all regions, by start address
+		typedef std::map<char*, region> region_map_t;
+		region_map_t m_regions;
+
+		// the regions with at least one free block. Blocks are taken
+		// from the lowest address first, which keeps the blocks in use
+		// packed into as few regions as possible
+		std::set<char*> m_partial_regions;
+
+		int m_blocks_per_region;
+		int m_large_page_failures;
 #endif
 
 #if defined TORRENT_DISK_STATS || defined TORRENT_STATS
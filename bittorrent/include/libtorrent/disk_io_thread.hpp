@@ -46,6 +46,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/config.hpp"
 #include "libtorrent/thread.hpp"
 #include "libtorrent/disk_buffer_pool.hpp"
+#include "libtorrent/session_metrics.hpp"
 
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/member.hpp>
@@ -175,6 +176,9 @@ namespace libtorrent
 			, cumulative_sort_time(0)
 			, total_read_back(0)
 			, read_queue_size(0)
+			, read_cache_limit(0)
+			, cache_expiry(0)
+			, write_queue_limit(0)
 		{}
 
 		// the number of 16kB blocks written
@@ -220,6 +224,17 @@ namespace libtorrent
 		boost::uint32_t cumulative_sort_time;
 		int total_read_back;
 		int read_queue_size;
+
+		// the limits the cache works with. They're the settings, unless
+		// adaptive_disk_cache is on. The number of blocks the read cache
+		// may use, the seconds idle write blocks stay in the cache and
+		// the number of bytes that may be queued for writing
+		int read_cache_limit;
+		int cache_expiry;
+		int write_queue_limit;
+
+		// how the disk buffers are laid out in memory
+		disk_pool_status buffer_pool;
 	};
 	
 	// this is a singleton consisting of the thread and a queue
@@ -255,7 +270,29 @@ namespace libtorrent
 
 		cache_status status() const;
 
+		// a snapshot of the disk thread's metrics. They're updated
+		// while session_settings::collect_metrics is set
+		session_metrics metrics() const;
+
+		// the file check read-ahead. The full check hands batches of
+		// slots to a pool of check threads, which read and hash them
+		// in parallel while the disk thread identifies the pieces.
+		// These may only be called from the disk thread
+		void add_check_batch(boost::shared_ptr<check_batch> const& b);
+		void wait_for_check_batch(check_batch const& b);
+		// removes the batches that no check thread has picked up yet
+		// from the queue. Batches already being hashed are finished
+		void cancel_check_batches(std::deque<boost::shared_ptr<check_batch> > const& batches);
+		int num_check_threads() const;
+		// the number of bytes the batches of all checks may hold
+		// at a time, counted against the cache size
+		size_type check_buffer_limit() const;
+		// what's left of the limit, after the batches that have been
+		// added and not hashed yet
+		size_type check_buffer_left() const;
+
 		void thread_fun();
+		void check_thread_fun();
 
 #ifdef TORRENT_DEBUG
 		void check_invariant() const;
@@ -388,6 +425,12 @@ namespace libtorrent
 
 		void flip_stats(ptime now);
 
+		// moves the cache limits based on the cache_status counters
+		// since the last call. Only used with adaptive_disk_cache
+		void adjust_cache(ptime now);
+		// sets the cache limits to the settings
+		void reset_cache_limits();
+
 		// total number of blocks in use by both the read
 		// and the write cache. This is not supposed to
 		// exceed m_cache_size
@@ -412,6 +455,10 @@ namespace libtorrent
 		// and insert into queue
 		average_accumulator m_sort_time;
 
+		// only written to by the disk thread, protected by
+		// m_piece_mutex so other threads can take a snapshot
+		session_metrics m_metrics;
+
 		// the last time we reset the average time and store the
 		// latest value in m_cache_stats
 		ptime m_last_stats_flip;
@@ -431,6 +478,25 @@ namespace libtorrent
 		// queue is smaller than the low watermark
 		bool m_exceeded_write_queue;
 
+		// the limits the cache works with, see cache_status.
+		// m_write_queue_limit and m_write_queue_hit_limit are protected
+		// by m_queue_mutex, the rest is only used by the disk thread
+		int m_read_cache_limit;
+		int m_cache_expiry;
+		int m_write_queue_limit;
+
+		// set when the write queue reaches its limit,
+		// cleared by adjust_cache()
+		bool m_write_queue_hit_limit;
+
+		// the last time adjust_cache() ran, and the counters then
+		ptime m_last_cache_adjust;
+		cache_status m_last_adjust_stats;
+
+		// a running average of the time a write call takes, in
+		// microseconds, or -1 before there's been one
+		int m_average_write_time;
+
 		io_service& m_ios;
 
 		boost::function<void()> m_queue_callback;
@@ -455,6 +521,25 @@ namespace libtorrent
 		// in this list
 		std::list<std::pair<disk_io_job, int> > m_queued_completions;
 
+		// protects m_check_queue, m_abort_check and the done
+		// flag of the batches in flight
+		mutable mutex m_check_mutex;
+		// signalled when a batch is queued or when aborting
+		condition m_check_cond;
+		// signalled when a batch has been hashed
+		condition m_check_done;
+		bool m_abort_check;
+		std::deque<boost::shared_ptr<check_batch> > m_check_queue;
+		// the bytes held by the buffers of the batches that have
+		// been added and not hashed (or cancelled) yet, for all
+		// torrents being checked
+		size_type m_check_buffer_bytes;
+
+		// the threads hashing check batches. They're started the
+		// first time a full check needs them and live until the
+		// disk thread is joined
+		std::vector<boost::shared_ptr<thread> > m_check_threads;
+
 		// thread for performing blocking disk io operations
 		thread m_disk_io_thread;
 	};
@@ -103,6 +103,11 @@ namespace libtorrent
 		virtual void on_piece_pass(int index) {}
 		virtual void on_piece_failed(int index) {}
 
+		// called when a piece couldn't be written to disk, or read back
+		// to check its hash. It neither passed nor failed, and is
+		// downloaded again
+		virtual void on_piece_error(int index) {}
+
 		// called aproximately once every second
 		virtual void tick() {}
 
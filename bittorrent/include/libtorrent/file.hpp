@@ -106,6 +106,8 @@ namespace libtorrent
 #endif
 		} modes_t;
 		int mode;
+		// identifies the device (volume) the file is on
+		boost::uint64_t device;
 	};
 
 	enum stat_flags_t { dont_follow_links = 1 };
@@ -38,16 +38,21 @@ POSSIBILITY OF SUCH DAMAGE.
 #endif
 
 #include <boost/intrusive_ptr.hpp>
+#include <boost/detail/atomic_count.hpp>
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/member.hpp>
+#include <boost/multi_index/hashed_index.hpp>
+#include <boost/multi_index/sequenced_index.hpp>
 
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
 
-#include <map>
 #include "libtorrent/file.hpp"
 #include "libtorrent/ptime.hpp"
 #include "libtorrent/thread.hpp"
 #include "libtorrent/file_storage.hpp"
+#include "libtorrent/session_status.hpp"
 
 namespace libtorrent
 {
@@ -64,28 +69,68 @@ namespace libtorrent
 		int size_limit() const { return m_size; }
 		void set_low_prio_io(bool b) { m_low_prio_io = b; }
 
+		void get_status(file_pool_status& s) const;
+
 	private:
 
-		void remove_oldest();
+		// the open files are spread over this many
+		// independently locked shards, to let multiple
+		// disk threads open files concurrently
+		enum { num_shards = 8 };
+
+		// closes the least recently used file. Returns false
+		// if there was no file to close
+		bool remove_oldest();
 
 		int m_size;
 		bool m_low_prio_io;
 
 		struct lru_file_entry
 		{
-			lru_file_entry(): key(0), last_use(time_now()), mode(0) {}
+			lru_file_entry(void* st, int file_index)
+				: key(st), file_key(st, file_index), last_use(time_now()), mode(0) {}
 			mutable boost::intrusive_ptr<file> file_ptr;
-			void* key;
-			ptime last_use;
-			int mode;
+			mutable void* key;
+			// storage pointer, file index pair
+			std::pair<void*, int> file_key;
+			mutable ptime last_use;
+			mutable int mode;
+		};
+
+		// the first index is the LRU list, with the least
+		// recently used file at the front. The second index maps
+		// storage pointer, file index pairs to the lru entry for
+		// the file
+		typedef boost::multi_index::multi_index_container<
+			lru_file_entry, boost::multi_index::indexed_by<
+				boost::multi_index::sequenced<>
+				, boost::multi_index::hashed_unique<boost::multi_index::member<
+					lru_file_entry, std::pair<void*, int>, &lru_file_entry::file_key> >
+				>
+			> file_set;
+
+		typedef file_set::nth_index<0>::type lru_index_t;
+		typedef file_set::nth_index<1>::type key_index_t;
+
+		struct shard
+		{
+			shard(): total_opens(0), total_closes(0), total_evictions(0) {}
+			file_set files;
+			mutable mutex m_mutex;
+			size_type total_opens;
+			size_type total_closes;
+			size_type total_evictions;
 		};
 
-		// maps storage pointer, file index pairs to the
-		// lru entry for the file
-		typedef std::map<std::pair<void*, int>, lru_file_entry> file_set;
-		
-		file_set m_files;
-		mutex m_mutex;
+		shard& shard_for(std::pair<void*, int> const& k);
+
+		// queues the file to be closed, if closing it may block
+		void close_file(lru_file_entry const& e);
+
+		shard m_shards[num_shards];
+
+		// the total number of files open across all shards
+		boost::detail::atomic_count m_num_open;
 
 #if TORRENT_CLOSE_MAY_BLOCK
 		void closer_thread_fun();
@@ -0,0 +1,102 @@
+/*
+
+Copyright (c) 2012, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_GEOIP_TABLE_HPP_INCLUDED
+#define TORRENT_GEOIP_TABLE_HPP_INCLUDED
+
+#ifndef TORRENT_DISABLE_GEO_IP
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <boost/cstdint.hpp>
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/ip_filter.hpp"
+
+namespace libtorrent
+{
+	// an in-memory copy of a GeoIP country or AS-number database.
+	// The database is a binary tree over the bits of the address,
+	// which GeoIP walks, reading from the file, for every lookup.
+	// Here the tree is flattened into a table of IPv4 ranges when
+	// the file is loaded, so a lookup is a search in a flat array
+	// that doesn't touch the disk or allocate memory. Loading reads
+	// the whole file and is meant to be done off the network thread
+	struct TORRENT_EXTRA_EXPORT geoip_table
+	{
+		enum db_type { country_db, asnum_db };
+
+		geoip_table(): m_type(country_db) {}
+
+		// reads and compiles the database in file. Returns false if
+		// the file can't be read, is corrupt or isn't of type t
+		bool load(std::string const& file, db_type t);
+
+		db_type type() const { return m_type; }
+
+		// the AS number the address belongs to, or 0 if it's
+		// not known. Only valid for AS-number databases
+		int as_for_ip(boost::uint32_t ip) const
+		{
+			TORRENT_ASSERT(m_type == asnum_db);
+			return m_ranges.access(ip);
+		}
+
+		// the two letter country code of the address, or 0 if it's
+		// not known. Only valid for country databases
+		char const* country_for_ip(boost::uint32_t ip) const;
+
+		// the name of the organization the AS number is assigned to,
+		// or 0 if there isn't one
+		char const* as_name(int as) const;
+
+		// the number of distinct ranges in the table
+		int num_ranges() const { return m_ranges.size(); }
+
+	private:
+
+		db_type m_type;
+
+		// maps the start of every range to the AS number or the
+		// country id of that range
+		detail::flat_filter<boost::uint32_t> m_ranges;
+
+		// AS number -> name, sorted by AS number
+		std::vector<std::pair<int, std::string> > m_as_names;
+	};
+}
+
+#endif // TORRENT_DISABLE_GEO_IP
+
+#endif // TORRENT_GEOIP_TABLE_HPP_INCLUDED
+
@@ -0,0 +1,92 @@
+/*
+
+Copyright (c) 2012, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_HANDLE_BATCH_HPP_INCLUDED
+#define TORRENT_HANDLE_BATCH_HPP_INCLUDED
+
+#include <vector>
+#include <boost/weak_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/cstdint.hpp>
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/torrent_handle.hpp"
+#include "libtorrent/size_type.hpp"
+
+namespace libtorrent
+{
+	class torrent;
+	struct announce_entry;
+
+	// every blocking call on a torrent_handle is a round trip to the
+	// network thread. handle_batch queues queries on any number of
+	// torrents and runs all of them in a single trip instead. Each
+	// query writes its result into the object passed to it, which
+	// must stay valid until run() returns. The results of handles
+	// that are no longer valid are left untouched
+	class TORRENT_EXPORT handle_batch
+	{
+	public:
+		void status(torrent_handle const& h, torrent_status& ret
+			, boost::uint32_t flags = 0xffffffff);
+		void get_peer_info(torrent_handle const& h, PeerInfos& ret);
+		void trackers(torrent_handle const& h, std::vector<announce_entry>& ret);
+		void file_progress(torrent_handle const& h, std::vector<size_type>& ret
+			, int flags = 0);
+		void get_download_queue(torrent_handle const& h
+			, std::vector<partial_piece_info>& ret);
+
+		// runs the queued queries and blocks until all of them are done.
+		// The batch is empty afterwards, and can be reused
+		void run();
+
+		bool empty() const { return m_calls.empty(); }
+		int size() const { return int(m_calls.size()); }
+
+	private:
+
+		void execute();
+
+		struct call
+		{
+			call(boost::weak_ptr<torrent> const& t_
+				, boost::function<void(torrent&)> const& f_)
+				: t(t_), f(f_) {}
+			boost::weak_ptr<torrent> t;
+			boost::function<void(torrent&)> f;
+		};
+
+		std::vector<call> m_calls;
+	};
+}
+
+#endif // TORRENT_HANDLE_BATCH_HPP_INCLUDED
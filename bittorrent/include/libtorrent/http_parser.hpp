@@ -68,20 +68,18 @@ namespace libtorrent
 		enum flags_t { dont_parse_chunks = 1 };
 		http_parser(int flags = 0);
 		~http_parser();
-		std::string const& header(char const* key) const
-		{
-			static std::string empty;
-			std::multimap<std::string, std::string>::const_iterator i
-				= m_header.find(key);
-			if (i == m_header.end()) return empty;
-			return i->second;
-		}
 
-		std::string const& protocol() const { return m_protocol; }
+		// the header fields and the status line are not copied out of the
+		// receive buffer, they are kept as offsets into it. These accessors
+		// build strings on demand, so they are only valid as long as the
+		// buffer last passed to incoming() is
+		std::string header(char const* key) const;
+
+		std::string protocol() const { return get_string(m_protocol); }
 		int status_code() const { return m_status_code; }
-		std::string const& method() const { return m_method; }
-		std::string const& path() const { return m_path; }
-		std::string const& message() const { return m_server_message; }
+		std::string method() const;
+		std::string path() const { return get_string(m_path); }
+		std::string message() const { return get_string(m_server_message); }
 		buffer::const_interval get_body() const;
 		bool header_finished() const { return m_state == read_body; }
 		bool finished() const { return m_finished; }
@@ -124,16 +122,60 @@ namespace libtorrent
 		// reset the whole state and start over
 		void reset();
 
-		std::multimap<std::string, std::string> const& headers() const { return m_header; }
+		// builds a copy of all headers, with lower case names
+		std::multimap<std::string, std::string> headers() const;
 		std::vector<std::pair<size_type, size_type> > const& chunks() const { return m_chunked_ranges; }
 		
 	private:
+
+		// a range of the receive buffer, relative to its start
+		struct string_ref
+		{
+			int start;
+			int len;
+		};
+
+		struct header_field
+		{
+			string_ref name;
+			string_ref value;
+		};
+
+		// the headers we look at ourselves, or that are asked for
+		// once per response. m_known_headers has the index into
+		// m_header_fields for each of them
+		enum known_header_t
+		{
+			content_length_header,
+			content_range_header,
+			location_header,
+			transfer_encoding_header,
+			num_known_headers
+		};
+
+		std::string get_string(string_ref const& r) const
+		{
+			if (r.len == 0) return std::string();
+			return std::string(m_recv_buffer.begin + r.start, r.len);
+		}
+
+		string_ref make_ref(char const* begin, char const* end) const
+		{
+			string_ref ret = { int(begin - m_recv_buffer.begin), int(end - begin) };
+			return ret;
+		}
+
+		bool name_equal(string_ref const& name, char const* key) const;
+		// returns the known_header_t it is, or -1
+		int add_header(char const* name, char const* name_end
+			, char const* value, char const* value_end);
+
 		size_type m_recv_pos;
 		int m_status_code;
-		std::string m_method;
-		std::string m_path;
-		std::string m_protocol;
-		std::string m_server_message;
+		string_ref m_method;
+		string_ref m_path;
+		string_ref m_protocol;
+		string_ref m_server_message;
 
 		size_type m_content_length;
 		size_type m_range_start;
@@ -141,7 +183,12 @@ namespace libtorrent
 
 		enum { read_status, read_header, read_body, error_state } m_state;
 
-		std::multimap<std::string, std::string> m_header;
+		// all header fields in the order they were received. reset()
+		// keeps the capacity, so a parser that's reused for every
+		// response doesn't allocate once it's warmed up
+		std::vector<header_field> m_header_fields;
+		int m_known_headers[num_known_headers];
+
 		buffer::const_interval m_recv_buffer;
 		int m_body_start_pos;
 
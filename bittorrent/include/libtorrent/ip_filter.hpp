@@ -35,14 +35,18 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include <set>
 #include <vector>
+#include <utility>
 
 #ifdef _MSC_VER
 #pragma warning(push, 1)
+#include <intrin.h>
 #endif
 
 #include <boost/limits.hpp>
 #include <boost/utility.hpp>
 #include <boost/tuple/tuple.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/cstdint.hpp>
 
 #ifdef _MSC_VER
 #pragma warning(pop)
@@ -133,6 +137,120 @@ namespace detail
 	inline boost::uint16_t max_addr<boost::uint16_t>()
 	{ return (std::numeric_limits<boost::uint16_t>::max)(); }
 
+	// an IPv6 address as two integers, most significant first.
+	// Comparing two of these doesn't loop over the bytes
+	struct uint128
+	{
+		boost::uint64_t hi;
+		boost::uint64_t lo;
+	};
+
+	inline bool operator<(uint128 const& lhs, uint128 const& rhs)
+	{ return (lhs.hi < rhs.hi) | ((lhs.hi == rhs.hi) & (lhs.lo < rhs.lo)); }
+
+	inline bool operator==(uint128 const& lhs, uint128 const& rhs)
+	{ return (lhs.hi == rhs.hi) & (lhs.lo == rhs.lo); }
+
+	template<>
+	inline boost::uint32_t zero<boost::uint32_t>() { return 0; }
+
+	template<>
+	inline uint128 zero<uint128>() { uint128 r = {0, 0}; return r; }
+
+	inline boost::uint32_t plus_one(boost::uint32_t val) { return val + 1; }
+	inline boost::uint32_t minus_one(boost::uint32_t val) { return val - 1; }
+
+	inline uint128 plus_one(uint128 val)
+	{
+		++val.lo;
+		if (val.lo == 0) ++val.hi;
+		return val;
+	}
+
+	inline uint128 minus_one(uint128 val)
+	{
+		if (val.lo == 0) --val.hi;
+		--val.lo;
+		return val;
+	}
+
+	template<>
+	inline boost::uint32_t max_addr<boost::uint32_t>()
+	{ return (std::numeric_limits<boost::uint32_t>::max)(); }
+
+	template<>
+	inline uint128 max_addr<uint128>()
+	{
+		boost::uint64_t const m = (std::numeric_limits<boost::uint64_t>::max)();
+		uint128 r = {m, m};
+		return r;
+	}
+
+	// the 1-based index of the lowest set bit in v. v may not be 0
+	inline int find_first_set(boost::uint32_t v)
+	{
+		TORRENT_ASSERT(v != 0);
+#if defined __GNUC__
+		return __builtin_ffs(v);
+#elif defined _MSC_VER
+		unsigned long i;
+		_BitScanForward(&i, v);
+		return int(i) + 1;
+#else
+		int i = 1;
+		for (; (v & 1) == 0; v >>= 1) ++i;
+		return i;
+#endif
+	}
+
+	// an immutable filter for one address type, built by ip_filter.
+	// The start of every range is kept in one array, laid out in
+	// Eytzinger (breadth first) order, slot 0 unused. The binary search
+	// then walks the array from the front and the loop compiles without
+	// branches. Each range ends where the next one starts. Next to every
+	// start, the access flags of the range *before* it are stored, since
+	// the search finds the first start past the address.
+	template<class Key>
+	class flat_filter
+	{
+	public:
+
+		flat_filter(): m_keys(1), m_prev_access(1), m_last_access(0) {}
+
+		// ranges is (start, access) sorted by start, and the
+		// first range starts at 0
+		void build(std::vector<std::pair<Key, int> > const& ranges);
+
+		// returns the ranges in the same form, sorted
+		void ranges(std::vector<std::pair<Key, int> >& ret) const;
+
+		int size() const { return int(m_keys.size()) - 1; }
+
+		int access(Key const& addr) const
+		{
+			boost::uint32_t const n = boost::uint32_t(m_keys.size() - 1);
+			boost::uint32_t i = 1;
+			while (i <= n)
+				i = 2 * i + !(addr < m_keys[i]);
+			// undo the trailing right turns and the last left turn,
+			// that's the first range starting past addr
+			i >>= find_first_set(~i);
+			return i == 0 ? m_last_access : m_prev_access[i];
+		}
+
+	private:
+
+		void fill(std::vector<std::pair<Key, int> > const& ranges
+			, int& pos, boost::uint32_t k);
+		void walk(std::vector<std::pair<Key, int> >& ret, boost::uint32_t k) const;
+
+		std::vector<Key> m_keys;
+		std::vector<int> m_prev_access;
+
+		// the access flags of the last range
+		int m_last_access;
+	};
+
 	// this is the generic implementation of
 	// a filter for a specific address type.
 	// it works with IPv4 and IPv6
@@ -267,8 +385,20 @@ struct TORRENT_EXPORT ip_filter
 	};
 
 	// both addresses MUST be of the same type (i.e. both must
-	// be either IPv4 or both must be IPv6)
+	// be either IPv4 or both must be IPv6). The rule is only
+	// recorded, where rules overlap the one added last wins.
+	// The lookup tables are built by compile(), or by the
+	// first call to access() or export_filter()
 	void add_rule(address first, address last, int flags);
+
+	// builds the lookup tables from the rules added so far, in
+	// O(n log n). The tables are immutable and shared by all copies
+	// of the filter, copying a compiled filter is cheap. Calling
+	// access() on a filter with rules that haven't been compiled
+	// yet modifies it, so compile a filter before sharing it
+	// between threads
+	void compile();
+
 	int access(address const& addr) const;
 
 #if TORRENT_USE_IPV6
@@ -284,10 +414,31 @@ struct TORRENT_EXPORT ip_filter
 	
 private:
 
-	detail::filter_impl<address_v4::bytes_type> m_filter4;
+	void compile_rules() const;
+
+	template <class Key>
+	struct rule
+	{
+		Key first;
+		Key last;
+		int flags;
+	};
+
+	struct tables
+	{
+		detail::flat_filter<boost::uint32_t> v4;
+#if TORRENT_USE_IPV6
+		detail::flat_filter<detail::uint128> v6;
+#endif
+	};
+
+	// rules added since the last compile
+	mutable std::vector<rule<boost::uint32_t> > m_rules4;
 #if TORRENT_USE_IPV6
-	detail::filter_impl<address_v6::bytes_type> m_filter6;
+	mutable std::vector<rule<detail::uint128> > m_rules6;
 #endif
+
+	mutable boost::shared_ptr<const tables> m_tables;
 };
 
 class TORRENT_EXPORT port_filter
@@ -59,12 +59,30 @@ unsigned long TORRENT_EXTRA_EXPORT rc4_encrypt(unsigned char *out, unsigned long
 
 namespace libtorrent
 {
+	// a private DH key and the public key that goes with it
+	struct dh_key_pair
+	{
+		char secret[96];
+		char key[96];
+	};
+
 	class TORRENT_EXTRA_EXPORT dh_key_exchange
 	{
 	public:
+		// generates a new key pair
 		dh_key_exchange();
+
+		// uses a key pair that was generated up-front
+		explicit dh_key_exchange(dh_key_pair const& k);
+
 		bool good() const { return true; }
 
+		// computes k.key from the private key in k.secret. This is
+		// the expensive part of setting up a key exchange. It
+		// doesn't touch any shared state, so it may be called
+		// from any thread
+		static void compute_public_key(dh_key_pair& k);
+
 		// Get local public key, always 96 bytes
 		char const* get_local_key() const;
 
@@ -648,6 +648,11 @@ namespace libtorrent
 
 		virtual void on_connected() = 0;
 		virtual void on_tick() {}
+
+		// called right before the send buffer is handed to the socket.
+		// Connections that transform outgoing bytes in place (e.g. RC4)
+		// do it here, in one pass over everything queued since the last send
+		virtual void encrypt_pending_buffer() {}
 	
 		virtual void on_receive(error_code const& error
 			, std::size_t bytes_transferred) = 0;
@@ -664,12 +669,16 @@ namespace libtorrent
 			}
 			TORRENT_ASSERT(!m_disk_recv_buffer);
 			TORRENT_ASSERT(m_disk_recv_buffer_size == 0);
-			int rcv_pos = (std::min)(m_recv_pos, int(m_recv_buffer.size()));
-			return buffer::interval(&m_recv_buffer[0]
-				, &m_recv_buffer[0] + rcv_pos);
+			int rcv_pos = (std::min)(m_recv_pos, int(m_recv_buffer.size()) - m_recv_start);
+			return buffer::interval(&m_recv_buffer[0] + m_recv_start
+				, &m_recv_buffer[0] + m_recv_start + rcv_pos);
 		}
 
 		std::pair<buffer::interval, buffer::interval> wr_recv_buffers(int bytes);
+
+		// the last 'bytes' bytes of the send buffer
+		void wr_send_buffers(int bytes, std::vector<asio::mutable_buffer>& vec)
+		{ m_send_buffer.build_mutable_iovec(bytes, vec); }
 #endif
 		
 		buffer::const_interval receive_buffer() const
@@ -679,9 +688,9 @@ namespace libtorrent
 				TORRENT_ASSERT(m_recv_pos == 0);
 				return buffer::interval(0,0);
 			}
-			int rcv_pos = (std::min)(m_recv_pos, int(m_recv_buffer.size()));
-			return buffer::const_interval(&m_recv_buffer[0]
-				, &m_recv_buffer[0] + rcv_pos);
+			int rcv_pos = (std::min)(m_recv_pos, int(m_recv_buffer.size()) - m_recv_start);
+			return buffer::const_interval(&m_recv_buffer[0] + m_recv_start
+				, &m_recv_buffer[0] + m_recv_start + rcv_pos);
 		}
 
 		bool allocate_disk_receive_buffer(int disk_buffer_size);
@@ -736,6 +745,10 @@ namespace libtorrent
 		sliding_average<20> m_piece_rate;
 		sliding_average<20> m_send_rate;
 
+		// the total time spent handling messages from this peer, in
+		// microseconds. It's only counted while metrics are collected
+		size_type m_parse_time;
+
 		void set_timeout(int s) { m_timeout = s; }
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
@@ -956,6 +969,13 @@ namespace libtorrent
 		// we've received so far
 		int m_recv_pos;
 
+		// the offset in m_recv_buffer where the current message
+		// starts. Cutting a message off the front of the receive
+		// buffer moves this forward instead of moving the rest of
+		// the buffer down. It's reset to 0 whenever the buffer
+		// runs empty
+		int m_recv_start;
+
 		int m_disk_recv_buffer_size;
 
 		// the number of bytes we are currently reading
@@ -235,6 +235,10 @@ namespace libtorrent
 		int estimated_reciprocation_rate;
 
 		tcp::endpoint local_endpoint;
+
+		// the total time spent handling messages from this peer, in
+		// microseconds, while session_settings::collect_metrics was set
+		size_type parse_time;
 	};
 
 	struct TORRENT_EXPORT peer_list_entry
@@ -0,0 +1,149 @@
+/*
+
+Copyright (c) 2012, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_RAM_STORAGE_HPP_INCLUDED
+#define TORRENT_RAM_STORAGE_HPP_INCLUDED
+
+#include <vector>
+#include <list>
+#include <string>
+#include <boost/noncopyable.hpp>
+#include <boost/intrusive_ptr.hpp>
+
+#ifndef TORRENT_DISABLE_POOL_ALLOCATOR
+#include <boost/pool/pool.hpp>
+#endif
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/storage.hpp"
+#include "libtorrent/allocator.hpp"
+#include "libtorrent/file.hpp"
+
+namespace libtorrent
+{
+	// a storage that keeps the pieces in memory instead of in files. The
+	// pieces are allocated whole from a pool of page aligned buffers, the
+	// same way disk_buffer_pool hands out blocks, and parts of a piece that
+	// haven't been written read back as zeros.
+	//
+	// max_memory bounds the piece data kept in RAM, 0 means no bound. Once
+	// it's reached, and spill is set, the least recently used pieces are
+	// written to a file in the save path and read from there until they're
+	// overwritten. Without spill, writing a new piece past the bound fails
+	// with errors::no_memory. The spill file is removed with the storage.
+	//
+	// nothing survives the storage, so there is never any resume data and
+	// a torrent starts out empty. Like all storages, it's only used from
+	// the disk thread
+	class TORRENT_EXPORT ram_storage : public storage_interface, boost::noncopyable
+	{
+	public:
+		ram_storage(file_storage const& fs, std::string const& path
+			, size_type max_memory, bool spill);
+		~ram_storage();
+
+		bool initialize(bool allocate_files);
+		bool has_any_file() { return false; }
+		int readv(file::iovec_t const* bufs, int slot, int offset, int num_bufs);
+		int writev(file::iovec_t const* bufs, int slot, int offset, int num_bufs);
+		int read(char* buf, int slot, int offset, int size);
+		int write(char const* buf, int slot, int offset, int size);
+		size_type physical_offset(int slot, int offset);
+		bool move_storage(std::string const& save_path);
+		bool verify_resume_data(lazy_entry const& rd, error_code& error) { return false; }
+		bool write_resume_data(entry& rd) const { return false; }
+		bool move_slot(int src_slot, int dst_slot);
+		bool swap_slots(int slot1, int slot2);
+		bool swap_slots3(int slot1, int slot2, int slot3);
+		bool release_files();
+		bool rename_file(int index, std::string const& new_filename) { return false; }
+		bool delete_files();
+
+		// the number of bytes of piece data held in RAM and in the
+		// spill file
+		size_type memory_usage() const
+		{ return size_type(m_resident) * m_files.piece_length(); }
+		size_type spilled_bytes() const
+		{ return size_type(m_num_spilled) * m_files.piece_length(); }
+
+	private:
+
+		struct piece_entry
+		{
+			piece_entry(): data(0), spill_slot(-1) {}
+			// the piece, if it's in RAM
+			char* data;
+			// where the piece is in the spill file, or -1
+			int spill_slot;
+			// the piece's position in m_lru, if data is set
+			std::list<int>::iterator lru;
+		};
+
+		char* allocate_piece();
+		void free_piece(piece_entry& e);
+		// moves the least recently used piece to the spill file.
+		// Returns false if there's nothing to evict, or on error
+		bool evict_one();
+		bool open_spill_file();
+		void release_spill_file();
+		void swap_entries(int slot1, int slot2);
+
+		file_storage const& m_files;
+		std::string m_save_path;
+
+		// the most pieces to keep in RAM, 0 means no limit
+		int m_max_resident;
+		bool m_spill;
+
+		// indexed by slot
+		std::vector<piece_entry> m_pieces;
+
+		// the slots that are in RAM, least recently used first
+		std::list<int> m_lru;
+		int m_resident;
+
+		boost::intrusive_ptr<file> m_spill_file;
+		std::string m_spill_path;
+		// the spill file slots that have been handed out, and the
+		// ones that are free again
+		int m_spill_slots;
+		std::vector<int> m_free_spill_slots;
+		int m_num_spilled;
+
+#ifndef TORRENT_DISABLE_POOL_ALLOCATOR
+		boost::pool<page_aligned_allocator> m_pool;
+#endif
+	};
+}
+
+#endif // TORRENT_RAM_STORAGE_HPP_INCLUDED
+
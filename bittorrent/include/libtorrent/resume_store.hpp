@@ -0,0 +1,157 @@
+/*
+
+Copyright (c) 2012, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_RESUME_STORE_HPP_INCLUDED
+#define TORRENT_RESUME_STORE_HPP_INCLUDED
+
+#include <map>
+#include <vector>
+#include <string>
+#include <boost/noncopyable.hpp>
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/file.hpp"
+#include "libtorrent/peer_id.hpp"
+#include "libtorrent/size_type.hpp"
+#include "libtorrent/error_code.hpp"
+
+namespace libtorrent
+{
+	class entry;
+
+	// a single file holding the resume data of every torrent in a session,
+	// keyed by info-hash, as well as the session state. Records are only ever
+	// appended to the file, a later record for a key supersedes the earlier
+	// ones. This makes updating the resume data of one torrent a single
+	// write. When opened, the file is memory mapped and indexed, so looking
+	// up the resume data of a torrent doesn't touch the disk.
+	//
+	// The layout of the file (integers are big endian):
+	//
+	//   header: "LTRS" | version (uint32)
+	//   record: key (20 bytes) | size (uint32) | adler32 of payload (uint32)
+	//           | payload, padded to a multiple of 8 bytes
+	//
+	// a size of 0xffffffff marks the key as erased. A torn record at the end
+	// of the file (from a crash while appending) is dropped when opening it.
+	//
+	// This class is not thread safe.
+	class TORRENT_EXPORT resume_store : boost::noncopyable
+	{
+	public:
+
+		enum { version = 1 };
+
+		resume_store();
+		~resume_store();
+
+		// opens the store, creating it if it doesn't exist
+		void open(std::string const& path, error_code& ec);
+		void close();
+		bool is_open() const { return m_file.is_open(); }
+
+		// copies the latest record for the key into buf. Returns false
+		// if there is no record for the key
+		bool get(sha1_hash const& key, std::vector<char>& buf) const;
+		bool has(sha1_hash const& key) const
+		{ return m_index.find(key) != m_index.end(); }
+
+		void put(sha1_hash const& key, char const* buf, int size, error_code& ec);
+		void put(sha1_hash const& key, entry const& e, error_code& ec);
+		void erase(sha1_hash const& key, error_code& ec);
+
+		// adds the content of a (bencoded) resume file to the store under
+		// the key and deletes the file. This is the migration path from
+		// saving one .resume file per torrent. The content is also
+		// returned in buf
+		bool import_file(sha1_hash const& key, std::string const& path
+			, std::vector<char>& buf, error_code& ec);
+
+		// returns true if more than half of the file is taken up by
+		// superseded or erased records
+		bool need_compact() const;
+
+		// rewrites the store with only the latest record for every key.
+		// If any record can't be read, the store is left as it is and
+		// ec is set
+		void compact(error_code& ec);
+
+		// the key the session state is stored under
+		static sha1_hash session_state_key() { return sha1_hash(); }
+
+		int num_records() const { return int(m_index.size()); }
+		size_type size() const { return m_size; }
+		size_type garbage() const { return m_garbage; }
+
+	private:
+
+		struct record
+		{
+			// the file offset of the payload
+			size_type offset;
+			int size;
+		};
+
+		void map_file(error_code& ec);
+		void unmap_file();
+		bool read(size_type offset, char* buf, int size) const;
+		void index_records(size_type file_size);
+		static size_type append_record(file& f, size_type offset
+			, sha1_hash const& key, char const* buf, int size
+			, bool erased, error_code& ec);
+
+		typedef std::map<sha1_hash, record> index_t;
+		index_t m_index;
+
+		std::string m_path;
+		file m_file;
+
+		// the end of the last valid record, where the
+		// next record is appended
+		size_type m_size;
+
+		// the number of bytes taken up by superseded
+		// and erased records
+		size_type m_garbage;
+
+		// the file mapped into memory when it was opened. Records
+		// appended after that are read from the file
+		char* m_mapping;
+		size_type m_mapped_size;
+#ifdef TORRENT_WINDOWS
+		HANDLE m_map_handle;
+#endif
+	};
+}
+
+#endif // TORRENT_RESUME_STORE_HPP_INCLUDED
+
@@ -205,6 +205,10 @@ namespace libtorrent
 #endif
 		torrent_handle add_torrent(add_torrent_params const& params, error_code& ec);
 		void async_add_torrent(add_torrent_params const& params);
+
+		// adds all the torrents in one call to the network thread. Each
+		// one posts its own add_torrent_alert, just like async_add_torrent
+		void async_add_torrents(std::vector<add_torrent_params> const& params);
 		
 #ifndef BOOST_NO_EXCEPTIONS
 #ifndef TORRENT_NO_DEPRECATE
@@ -256,6 +260,11 @@ namespace libtorrent
 		void get_cache_info(sha1_hash const& ih
 			, std::vector<cached_piece_info>& ret) const;
 
+		// posts a session_stats_alert with a snapshot of the session's
+		// metrics. They're all 0 unless session_settings::collect_metrics
+		// is set
+		void post_session_stats();
+
 		feed_handle add_feed(feed_settings const& feed);
 		void remove_feed(feed_handle h);
 		void get_feeds(std::vector<feed_handle>& f) const;
@@ -289,6 +298,10 @@ namespace libtorrent
 
 #ifndef TORRENT_DISABLE_GEO_IP
 		int as_for_ip(address const& addr);
+		// the databases are read and compiled on a thread of their own,
+		// these return before that's done. Until the new database is
+		// installed, the previous one (if any) stays in use, so AS and
+		// country lookups made right after a load don't see it yet
 		void load_asnum_db(char const* file);
 		void load_country_db(char const* file);
 #if TORRENT_USE_WSTRING
@@ -367,6 +380,8 @@ namespace libtorrent
 		};
 
 		void remove_torrent(const torrent_handle& h, int options = none);
+		// invalid handles are skipped
+		void remove_torrents(std::vector<torrent_handle> const& h, int options = none);
 
 		void set_settings(session_settings const& s);
 		session_settings settings() const;
@@ -0,0 +1,130 @@
+/*
+
+Copyright (c) 2012, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_SESSION_METRICS_HPP_INCLUDED
+#define TORRENT_SESSION_METRICS_HPP_INCLUDED
+
+#include <boost/cstdint.hpp>
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/assert.hpp"
+
+namespace libtorrent
+{
+	// counters and latency histograms for the session's hot paths. They
+	// are only updated while session_settings::collect_metrics is set.
+	//
+	// the network thread and the disk thread each update their own
+	// session_metrics, so there's no locking and no shared cache lines
+	// on the hot paths. session::post_session_stats() adds them up into
+	// a session_stats_alert. Since a snapshot is read while the other
+	// thread keeps updating its copy, a value may be a few samples
+	// behind (or, on 32 bit systems, momentarily torn)
+	//
+	// the counter_t and histogram_t values index counters and histograms
+	// and are stable. New metrics are only ever added at the end
+	struct TORRENT_EXPORT session_metrics
+	{
+		enum counter_t
+		{
+			// disk jobs that completed with an error
+			disk_job_errors,
+			// blocks returned by the piece picker
+			picked_blocks,
+			// bandwidth requests that weren't rate limited and
+			// didn't have to wait in the queue
+			bandwidth_immediate_requests,
+			// queued bandwidth requests that ran out of rounds and
+			// were handed what they got so far
+			bandwidth_partial_requests,
+
+			num_counters
+		};
+
+		// all histograms are of microseconds
+		enum histogram_t
+		{
+			// the time from issuing a disk job until it completes,
+			// by the kind of job
+			disk_read_latency,
+			disk_write_latency,
+			disk_hash_latency,
+			disk_other_latency,
+			// the time spent in one call to piece_picker::pick_pieces()
+			picker_time,
+			// the time a bandwidth request waits in the queue
+			bandwidth_wait_time,
+			// round trip times of acked uTP packets
+			utp_rtt,
+			// the time spent handling one bittorrent message
+			message_parse_time,
+
+			num_histograms
+		};
+
+		// bucket 0 counts samples of 0 microseconds, bucket n counts
+		// samples in [2^(n-1), 2^n), and the last bucket counts
+		// everything from 2^(num_buckets-2) up, which is about 4 seconds
+		enum { num_buckets = 24 };
+
+		session_metrics();
+
+		void inc(int c, boost::int64_t v = 1)
+		{
+			TORRENT_ASSERT(c >= 0 && c < num_counters);
+			counters[c] += v;
+		}
+
+		void sample(int h, boost::int64_t microseconds)
+		{
+			TORRENT_ASSERT(h >= 0 && h < num_histograms);
+			++histograms[h][bucket(microseconds)];
+		}
+
+		// adds the values of m to this
+		void add(session_metrics const& m);
+
+		// the number of samples in histogram h
+		boost::uint64_t num_samples(int h) const;
+
+		static int bucket(boost::int64_t microseconds);
+
+		static char const* counter_name(int c);
+		static char const* histogram_name(int h);
+
+		boost::uint64_t counters[num_counters];
+		boost::uint64_t histograms[num_histograms][num_buckets];
+	};
+}
+
+#endif // TORRENT_SESSION_METRICS_HPP_INCLUDED
+
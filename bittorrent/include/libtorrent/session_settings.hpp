@@ -367,10 +367,9 @@ namespace libtorrent
 		// of physical RAM in the machine.
 		int cache_size;
 
-		// this is the number of disk buffer blocks (16 kiB)
-		// that should be allocated at a time. It must be
-		// at least 1. Lower number saves memory at the expense
-		// of more heap allocations
+		// this used to be the number of disk buffer blocks (16 kiB)
+		// allocated at a time. It's ignored now, disk buffers are
+		// carved out of 2 MiB regions (see disk_cache_large_pages)
 		int cache_buffer_chunk_size;
 
 		// the number of seconds a write cache entry sits
@@ -378,6 +377,18 @@ namespace libtorrent
 		// to disk. Default is 5 minutes.
 		int cache_expiry;
 
+		// when true, the disk thread tunes the cache once a second from
+		// how it's doing. The read cache's share of cache_size follows
+		// its hit ratio, and gives way when written blocks had to be
+		// read back to be hashed. Idle write blocks are flushed sooner
+		// (down to a quarter of cache_expiry) while the disk has time
+		// to spare. The write queue limit moves between a quarter and
+		// four times max_queued_disk_bytes, growing when it fills up
+		// while the disk keeps up, and shrinking when the disk is
+		// saturated or writes get slower. cache_status reports the
+		// limits in effect
+		bool adaptive_disk_cache;
+
 		// when true, the disk I/O thread uses the disk
 		// cache for caching blocks read from disk too
 		bool use_read_cache;
@@ -564,6 +575,15 @@ namespace libtorrent
 		bool lock_disk_cache;
 #endif
 
+		// when set, the 2 MiB regions disk buffers are carved out of are
+		// allocated as large pages, where the OS allows it. On windows
+		// that requires the account to hold SeLockMemoryPrivilege, which
+		// the session enables when this is turned on, and the pages can't
+		// be swapped out. If that fails, a performance_alert is posted.
+		// Regions that can't get large pages fall back to normal ones,
+		// see disk_pool_status::large_page_failures
+		bool disk_cache_large_pages;
+
 		// the number of times to reject requests while being
 		// choked before disconnecting a peer for being malicious
 		int max_rejects;
@@ -588,6 +608,19 @@ namespace libtorrent
 		// the checking rate to 1.6 MiB per second
 		int file_checks_delay_per_block;
 
+		// the number of threads used to hash pieces during a full
+		// file check. 0 means one thread per CPU core
+		int file_check_threads;
+
+		// the number of bytes each file check thread reads and
+		// hashes in one go, ahead of the check itself. Setting
+		// this to 0 disables the read-ahead and hashes every
+		// piece on the disk thread. The batches in flight, for all
+		// torrents being checked, are limited to half of cache_size,
+		// so the read-ahead is shrunk when there are many check
+		// threads or checks
+		int file_check_read_ahead;
+
 		enum disk_cache_algo_t
 		{ lru, largest_contiguous, avoid_readback };
 
@@ -757,6 +790,13 @@ namespace libtorrent
 		// we have none of the files and go straight to download
 		bool no_recheck_incomplete_resume;
 
+		// when set, the resume data records a checksum of a few small
+		// samples of each file. If a file's timestamp no longer matches
+		// the resume data, but its size and samples do, the file is
+		// assumed to be unchanged. Files that did change only cause the
+		// pieces overlapping them to be checked, not the whole torrent
+		bool resume_file_samples;
+
 		// when this is true, libtorrent will take actions to make sure no
 		// privacy sensitive information is leaked out from the client. This
 		// mode is assumed to be combined with using a proxy for all your
@@ -931,6 +971,22 @@ namespace libtorrent
 
 		// when true, web seeds sending bad data will be banned
 		bool ban_web_seeds;
+
+		// the number of Diffie-Hellman key pairs for encrypted
+		// connections to keep precomputed on a background thread.
+		// When the pool runs dry, keys are generated on the network
+		// thread. 0 turns the pool off
+		int dh_key_pool_size;
+
+		// when true, the shared secret of an encrypted handshake is
+		// computed on the key pool's thread, and the connection waits
+		// for it without blocking the network thread
+		bool async_dh_secret;
+
+		// when true, the network and disk threads keep the counters and
+		// latency histograms in session_metrics up to date. They can be
+		// read with session::post_session_stats()
+		bool collect_metrics;
 	};
 
 #ifndef TORRENT_DISABLE_DHT
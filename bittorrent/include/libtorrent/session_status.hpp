@@ -81,6 +81,19 @@ namespace libtorrent
 		int num_close_wait;
 	};
 
+	struct file_pool_status
+	{
+		// the number of files currently held open
+		// by the file pool
+		int num_open;
+		// the number of files opened, closed and
+		// evicted (closed to make room for another
+		// file) since the session started
+		size_type total_opens;
+		size_type total_closes;
+		size_type total_evictions;
+	};
+
 	struct TORRENT_EXPORT session_status
 	{
 		bool has_incoming_connections;
@@ -113,6 +126,20 @@ namespace libtorrent
 		size_type total_redundant_bytes;
 		size_type total_failed_bytes;
 
+		// the number of bytes the peer connections copied or moved
+		// in memory after reading them from the socket. Divided by
+		// total_payload_download, this is the number of copies made
+		// per payload byte received
+		size_type total_recv_copied_bytes;
+
+		// the 50th, 90th and 99th percentile of the time, in
+		// milliseconds, from connecting to completing the encrypted
+		// part of the handshake, over the most recent 1000 encrypted
+		// connections
+		int handshake_latency_p50;
+		int handshake_latency_p90;
+		int handshake_latency_p99;
+
 		int num_peers;
 		int num_unchoked;
 		int allowed_upload_slots;
@@ -141,6 +168,8 @@ namespace libtorrent
 
 		utp_status utp_stats;
 
+		file_pool_status file_pool_stats;
+
 		int peerlist_size;
 	};
 
@@ -0,0 +1,97 @@
+/*
+
+Copyright (c) 2012, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_STATUS_TABLE_HPP_INCLUDED
+#define TORRENT_STATUS_TABLE_HPP_INCLUDED
+
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/torrent_handle.hpp"
+
+namespace libtorrent
+{
+	// the session's table of torrent_status_records. The network thread
+	// is the only writer, and any thread may read, without locking.
+	//
+	// each record is guarded by a sequence counter (a seqlock). The
+	// writer makes the counter odd while it's writing the record, and
+	// even again when it's done. A reader copies the record and retries
+	// if the counter was odd or changed while it was copying.
+	//
+	// records live in fixed size chunks that are never moved or freed
+	// before the table is, so a reader can't race with a reallocation.
+	// A slot is only handed to another torrent once the torrent that
+	// had it is destructed, and a reader keeps the torrent alive while
+	// it reads
+	struct TORRENT_EXTRA_EXPORT status_table : boost::noncopyable
+	{
+		status_table();
+		~status_table();
+
+		// network thread only. allocate() returns -1 if the table is full
+		int allocate();
+		void release(int slot);
+		void write(int slot, torrent_status_record const& st);
+
+		// may be called from any thread. Returns false if nothing has
+		// been written to the slot since it was allocated
+		bool read(int slot, torrent_status_record& st) const;
+
+	private:
+
+		enum { chunk_size = 1024, max_chunks = 4096 };
+
+		struct entry
+		{
+			volatile boost::uint32_t seq;
+			bool valid;
+			torrent_status_record rec;
+		};
+
+		void begin_write(entry& e);
+		void end_write(entry& e);
+
+		entry* m_chunks[max_chunks];
+		int m_num_chunks;
+
+		// the number of slots that have been handed out at some point
+		int m_size;
+
+		// released slots, to be reused
+		std::vector<int> m_free;
+	};
+}
+
+#endif // TORRENT_STATUS_TABLE_HPP_INCLUDED
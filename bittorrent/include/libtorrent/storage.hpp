@@ -34,6 +34,9 @@ POSSIBILITY OF SUCH DAMAGE.
 #define TORRENT_STORAGE_HPP_INCLUDE
 
 #include <vector>
+#include <deque>
+#include <map>
+#include <set>
 #include <sys/types.h>
 #include <sys/stat.h>
 
@@ -138,6 +141,14 @@ namespace libtorrent
 		// write storage dependent fast resume entries
 		virtual bool write_resume_data(entry& rd) const = 0;
 
+		// called when verify_resume_data() rejected the resume data because
+		// some file's size or timestamp didn't match. Sets one entry per file
+		// to true if that file changed since the resume data was saved, in
+		// which case only the pieces overlapping the changed files are checked.
+		// Returning false means it can't be determined, and all files are checked
+		virtual bool changed_files(lazy_entry const& rd, std::vector<bool>& changed)
+		{ return false; }
+
 		// moves (or copies) the content in src_slot to dst_slot
 		virtual bool move_slot(int src_slot, int dst_slot) = 0;
 
@@ -207,6 +218,7 @@ namespace libtorrent
 		bool swap_slots3(int slot1, int slot2, int slot3);
 		bool verify_resume_data(lazy_entry const& rd, error_code& error);
 		bool write_resume_data(entry& rd) const;
+		bool changed_files(lazy_entry const& rd, std::vector<bool>& changed);
 
 		// this identifies a read or write operation
 		// so that default_storage::readwritev() knows what to
@@ -240,6 +252,10 @@ namespace libtorrent
 		boost::intrusive_ptr<file> open_file(file_storage::iterator fe, int mode
 			, error_code& ec) const;
 
+		// caches a file's sample, see m_file_samples
+		void remember_sample(int index, size_type size, std::time_t mtime
+			, boost::uint32_t sample) const;
+
 		std::vector<boost::uint8_t> m_file_priority;
 		std::string m_save_path;
 		// the file pool is typically stored in
@@ -249,6 +265,18 @@ namespace libtorrent
 
 		int m_page_size;
 		bool m_allocate_files;
+
+		// the last sample taken of each file, and the size and timestamp
+		// the file had then. write_resume_data() only samples the files
+		// that changed since. A sample of 0 means there is none
+		struct file_sample
+		{
+			file_sample(): size(-1), mtime(0), sample(0) {}
+			size_type size;
+			std::time_t mtime;
+			boost::uint32_t sample;
+		};
+		mutable std::vector<file_sample> m_file_samples;
 	};
 
 	// this storage implementation does not write anything to disk
@@ -285,6 +313,39 @@ namespace libtorrent
 
 	struct disk_io_thread;
 
+	// a run of consecutive slots read ahead by the full check. The
+	// disk thread reads the slots with large sequential reads and one
+	// of the disk_io_thread's check threads hashes them, while the
+	// disk thread goes on identifying the pieces of earlier batches
+	struct check_batch : boost::noncopyable
+	{
+		check_batch(int first, int num)
+			: first_slot(first), num_slots(num), num_read(0)
+			, piece_length(0), small_piece_size(0), num_bytes(0)
+			, done(false) {}
+		int first_slot;
+		int num_slots;
+		// the number of slots (counted from first_slot) that were
+		// read completely. The slots after that failed to be read
+		// and are checked the slow way, to report the error
+		int num_read;
+		int piece_length;
+		// the size of the last piece. Slots of any other size are
+		// also hashed up to this size, to identify the last piece
+		int small_piece_size;
+		// the slots, back to back. Freed once hashed
+		aligned_holder buffer;
+		int num_bytes;
+		// the full piece hash and the small hash, for every slot
+		std::vector<std::pair<sha1_hash, sha1_hash> > hashes;
+		// set by the check thread once the hashes are filled in.
+		// protected by the disk_io_thread's check mutex
+		bool done;
+	};
+
+	// hashes the slots read into the batch and frees its buffer
+	TORRENT_EXTRA_EXPORT void hash_check_batch(check_batch& b);
+
 	class TORRENT_EXTRA_EXPORT piece_manager
 		: public intrusive_ptr_base<piece_manager>
 		, boost::noncopyable
@@ -372,6 +433,22 @@ namespace libtorrent
 
 		storage_interface* get_storage_impl() { return m_storage.get(); }
 
+		// for smart ban. Once enabled, every block written to disk is also
+		// hashed on its own, salted with salt, while it's still in memory.
+		// The block hashes of a piece that fails its hash check, and those
+		// of the same piece once it passes, are kept until they're taken
+		// with take_block_hashes(), so the blocks don't have to be read back
+		void enable_block_hashes(int salt);
+
+		// ret is indexed by block. Blocks that weren't hashed (because
+		// they were written before hashing was enabled, for instance)
+		// are all zeros. Returns false if there are no hashes for piece
+		bool take_block_hashes(int piece, std::vector<sha1_hash>& ret);
+
+		// forgets the block hashes of a piece, and that it failed, when
+		// it's going to be downloaded again after a disk error
+		void drop_block_hashes(int piece);
+
 	private:
 
 		std::string save_path() const;
@@ -394,7 +471,12 @@ namespace libtorrent
 	
 		// helper functions for check_dastresume	
 		int check_no_fastresume(error_code& error);
+		// forgets what an interrupted check left behind, so the
+		// next one starts from scratch
+		void reset_check();
 		int check_init_storage(error_code& error);
+		int check_changed_files(lazy_entry const& rd
+			, std::vector<bool> const& changed, error_code& error);
 		
 		// if error is set and return value is 'no_error' or 'need_full_check'
 		// the error message indicates that the fast resume data was rejected
@@ -422,6 +504,11 @@ namespace libtorrent
 		int hash_for_slot(int slot, partial_hash& h, int piece_size
 			, int small_piece_size = 0, sha1_hash* small_hash = 0);
 
+		// looks up the hashes for the slot in the read-ahead batches,
+		// queuing more batches as the check progresses. Returns false
+		// if the slot has to be hashed with hash_for_slot instead
+		bool read_ahead_hash(int slot, sha1_hash& large_hash, sha1_hash& small_hash);
+
 		void hint_read_impl(int piece_index, int offset, int size);
 
 		int read_impl(
@@ -436,6 +523,15 @@ namespace libtorrent
 			, int offset
 			, int num_bufs);
 
+		// records the hash of every whole block in bufs, if block
+		// hashes are enabled
+		void hash_blocks(file::iovec_t const* bufs, int piece_index
+			, int offset, int num_bufs);
+
+		// called once the piece has been hash checked, to drop or keep
+		// its block hashes
+		void finish_block_hashes(int piece, bool passed);
+
 		size_type physical_offset(int piece_index, int offset);
 
 		void finalize_file(int index);
@@ -542,6 +638,31 @@ namespace libtorrent
 		// disk-io thread.
 		std::map<int, partial_hash> m_piece_hasher;
 
+		// the smart ban block hashes, indexed by piece and then block.
+		// These are written by the disk-io thread and taken by the
+		// network thread, and protected by m_mutex
+		std::map<int, std::vector<sha1_hash> > m_block_hashes;
+
+		// pieces that have failed the hash check. When they pass, their
+		// block hashes are kept as well, to tell the bad blocks apart
+		std::set<int> m_failed_block_hashes;
+
+		// the salt the block hashes are computed with. Block hashing
+		// is enabled when m_block_hashes_enabled is set
+		int m_block_hash_salt;
+		bool m_block_hashes_enabled;
+
+		// when only the pieces overlapping files that changed since the
+		// resume data was saved are checked, this holds the state of
+		// every piece. Empty for regular full checks
+		enum { resume_check_piece, resume_have_piece, resume_missing_piece };
+		std::vector<boost::uint8_t> m_resume_pieces;
+
+		// the batches of slots queued for the file check threads
+		// during the full check, in slot order. Only accessed from
+		// the disk-io thread
+		std::deque<boost::shared_ptr<check_batch> > m_check_batches;
+
 		disk_io_thread& m_io_thread;
 
 		// the reason for this to be a void pointer
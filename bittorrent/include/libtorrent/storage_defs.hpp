@@ -34,6 +34,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #define TORRENT_STORAGE_DEFS_HPP_INCLUDE
 
 #include "libtorrent/config.hpp"
+#include "libtorrent/size_type.hpp"
 #include <boost/function.hpp>
 #include <string>
 
@@ -65,6 +66,16 @@ namespace libtorrent
 		file_storage const&, file_storage const* mapped, std::string const&, file_pool&
 		, std::vector<boost::uint8_t> const&);
 
+	// keeps the pieces in RAM, see ram_storage
+	TORRENT_EXPORT storage_interface* ram_storage_constructor(
+		file_storage const&, file_storage const* mapped, std::string const&, file_pool&
+		, std::vector<boost::uint8_t> const&);
+
+	// like ram_storage_constructor, but each storage keeps at most max_memory
+	// bytes of pieces in RAM, and spills the rest to a file if spill is set
+	TORRENT_EXPORT storage_constructor_type bounded_ram_storage_constructor(
+		size_type max_memory, bool spill);
+
 }
 
 #endif
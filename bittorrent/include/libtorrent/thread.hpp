@@ -58,6 +58,9 @@ namespace libtorrent
 
 	TORRENT_EXPORT void sleep(int milliseconds);
 
+	// the number of cores, or 1 if it can't be determined
+	TORRENT_EXPORT int hardware_concurrency();
+
 	struct TORRENT_EXTRA_EXPORT condition
 	{
 		condition();
@@ -124,6 +124,13 @@ namespace libtorrent
 		sha1_hash const& info_hash() const
 		{ return m_torrent_file->info_hash(); }
 
+		// copies of name() and info_hash() as of the last time the
+		// network thread updated them. Unlike everything else in here,
+		// these may be called from any thread
+		std::string name_snapshot() const;
+		sha1_hash info_hash_snapshot() const;
+		void update_snapshot();
+
 		// starts the announce timer
 		void start();
 
@@ -225,13 +232,22 @@ namespace libtorrent
 
 		void second_tick(stat& accumulator, int tick_interval_ms);
 
+		// writes our status to the session's status table
+		void publish_status();
+		// fills in the record the way status() with no flags would, but
+		// straight from our members, without the strings and bitfields
+		void status_record(torrent_status_record& st);
+		int status_slot() const { return m_status_slot; }
+
 		std::string name() const;
 
 		stat statistics() const { return m_stat; }
 		void add_stats(stat const& s);
 		size_type bytes_left() const;
 		int block_bytes_wanted(piece_block const& p) const;
-		void bytes_done(torrent_status& st, bool accurate) const;
+		// Status is torrent_status or torrent_status_record
+		template <class Status>
+		void bytes_done(Status& st, bool accurate) const;
 		size_type quantized_bytes_done() const;
 
 		void ip_filter_updated() { m_policy.ip_filter_updated(); }
@@ -303,6 +319,14 @@ namespace libtorrent
 		void reset_piece_deadline(int piece);
 		void update_piece_priorities();
 
+		// streaming mode. Keeps a window of window_size pieces ahead
+		// of the playback cursor with increasing deadlines, each piece
+		// deadline_step milliseconds after the previous one. A window_size
+		// of 0 disables streaming mode
+		void set_streaming_mode(int window_size, int deadline_step);
+		void advance_streaming_cursor(int piece);
+		bool is_streaming() const { return m_streaming_window > 0; }
+
 		void status(torrent_status* st, boost::uint32_t flags);
 
 		// this torrent changed state, if the user is subscribing to
@@ -641,6 +665,10 @@ namespace libtorrent
 		// piece_failed is called when a piece fails the hash check
 		void piece_failed(int index);
 
+		// piece_error is called when a piece couldn't be written or
+		// checked because of a disk error. It lets the extensions know
+		void piece_error(int index);
+
 		// this will restore the piece picker state for a piece
 		// by re marking all the requests to blocks in this piece
 		// that are still outstanding in peers' download queues.
@@ -821,6 +849,10 @@ namespace libtorrent
 		void queue_torrent_check();
 		void dequeue_torrent_check();
 
+		// identifies the device the torrent's files are on. Torrents
+		// on different devices may be checked at the same time
+		boost::uint64_t checking_device() const { return m_checking_device; }
+
 		void clear_in_state_update()
 		{ m_in_state_updates = false; }
 
@@ -882,6 +914,7 @@ namespace libtorrent
 		void remove_time_critical_piece(int piece, bool finished = false);
 		void remove_time_critical_pieces(std::vector<int> const& priority);
 		void request_time_critical_pieces();
+		void update_streaming_window();
 
 		policy m_policy;
 
@@ -1051,6 +1084,12 @@ namespace libtorrent
 		// longer be used and will be reset
 		boost::scoped_ptr<std::string> m_name;
 
+		// guards the snapshot, which torrent_handle reads
+		// without going through the network thread
+		mutable mutex m_snapshot_mutex;
+		std::string m_name_snapshot;
+		sha1_hash m_info_hash_snapshot;
+
 		storage_constructor_type m_storage_constructor;
 
 		// the posix time this torrent was added and when
@@ -1081,6 +1120,19 @@ namespace libtorrent
 		// the average piece download time deviation
 		boost::uint32_t m_piece_time_deviation;
 
+		// streaming mode state. m_streaming_cursor is the piece the
+		// player is currently reading, m_streaming_window is the number
+		// of pieces ahead of it that have deadlines set (0 means streaming
+		// is disabled) and m_streaming_deadline is the number of milliseconds
+		// between the deadlines of two consecutive pieces in the window
+		int m_streaming_cursor;
+		int m_streaming_window;
+		int m_streaming_deadline;
+
+		// the device of the save path, as of when the torrent was
+		// last queued for checking. 0 if it couldn't be determined
+		boost::uint64_t m_checking_device;
+
 		// the number of bytes that has been
 		// downloaded that failed the hash-test
 		boost::uint32_t m_total_failed_bytes;
@@ -1090,6 +1142,10 @@ namespace libtorrent
 		// monotonically increasing number for each added torrent
 		int m_sequence_number;
 
+		// our record in the session's status table, or -1
+		// if the table was full
+		int m_status_slot;
+
 		// ==============================
 		// The following members are specifically
 		// ordered to make the 24 bit members
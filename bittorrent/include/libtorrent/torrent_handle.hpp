@@ -73,6 +73,7 @@ namespace libtorrent
 	struct peer_info;
 	struct peer_list_entry;
 	struct torrent_status;
+	struct torrent_status_record;
 
 	typedef std::tr1::shared_ptr< peer_info > PeerInfoPtr;
 	typedef std::vector< PeerInfoPtr > PeerInfos;
@@ -163,6 +164,7 @@ namespace libtorrent
 		friend struct aux::session_impl;
 		friend struct feed;
 		friend class torrent;
+		friend class handle_batch;
 		friend std::size_t hash_value(torrent_handle const& th);
 
 		torrent_handle() {}
@@ -187,12 +189,27 @@ namespace libtorrent
 		// the flags specify which fields are calculated. By default everything
 		// is included, you may save CPU by not querying fields you don't need
 		torrent_status status(boost::uint32_t flags = 0xffffffff) const;
+
+		// the status as of the last second tick, read from the session's
+		// status table. Unlike status(), this doesn't wait for the network
+		// thread and doesn't allocate. Returns false if the handle is
+		// invalid or the status hasn't been published yet
+		bool status_record(torrent_status_record& st) const;
+
 		void get_download_queue(std::vector<partial_piece_info>& queue) const;
 
 		enum deadline_flags { alert_when_available = 1 };
 		void set_piece_deadline(int index, int deadline, int flags = 0) const;
 		void reset_piece_deadline(int index) const;
 
+		// streaming mode keeps window_size pieces ahead of the playback
+		// cursor under deadline, deadline_step milliseconds apart. Pieces
+		// in the window are pulled into the read cache as they complete.
+		// window_size 0 turns streaming off
+		void set_streaming_mode(int window_size, int deadline_step = 1000) const;
+		// moves the playback cursor to the given piece
+		void advance_streaming_cursor(int piece) const;
+
 		void set_priority(int prio) const;
 		
 #ifndef TORRENT_NO_DEPRECATE
@@ -668,6 +685,91 @@ namespace libtorrent
 		int listen_port;
 	};
 
+	// the fixed size fields of torrent_status, as the network thread
+	// publishes them once a second. See torrent_status for what they
+	// mean. This is a plain struct so that it can be copied out of the
+	// status table without locking or allocating
+	struct TORRENT_EXPORT torrent_status_record
+	{
+		void assign(torrent_status const& st);
+
+		torrent_status::state_t state;
+		bool paused;
+		bool auto_managed;
+		bool sequential_download;
+		bool is_seeding;
+		bool is_finished;
+		bool has_metadata;
+		bool has_incoming;
+		bool seed_mode;
+		bool upload_mode;
+		bool share_mode;
+		bool super_seeding;
+		bool need_save_resume;
+		bool ip_filter_applies;
+
+		float progress;
+		int progress_ppm;
+
+		size_type total_download;
+		size_type total_upload;
+		size_type total_payload_download;
+		size_type total_payload_upload;
+		size_type total_failed_bytes;
+		size_type total_redundant_bytes;
+
+		int download_rate;
+		int upload_rate;
+		int download_payload_rate;
+		int upload_payload_rate;
+
+		int num_seeds;
+		int num_peers;
+		int num_complete;
+		int num_incomplete;
+		int list_seeds;
+		int list_peers;
+		int connect_candidates;
+
+		int num_pieces;
+		size_type total_done;
+		size_type total_wanted_done;
+		size_type total_wanted;
+
+		int distributed_full_copies;
+		int distributed_fraction;
+		float distributed_copies;
+
+		int block_size;
+		int num_uploads;
+		int num_connections;
+		int uploads_limit;
+		int connections_limit;
+		storage_mode_t storage_mode;
+		int up_bandwidth_queue;
+		int down_bandwidth_queue;
+
+		size_type all_time_upload;
+		size_type all_time_download;
+		int active_time;
+		int finished_time;
+		int seeding_time;
+		int seed_rank;
+		int last_scrape;
+		int sparse_regions;
+		int priority;
+
+		time_t added_time;
+		time_t completed_time;
+		time_t last_seen_complete;
+		int time_since_upload;
+		int time_since_download;
+		int queue_position;
+
+		sha1_hash info_hash;
+		int listen_port;
+	};
+
 }
 
 #endif // TORRENT_TORRENT_HANDLE_HPP_INCLUDED
@@ -37,6 +37,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <string>
 #include <utility>
 #include <ctime>
+#include <map>
 
 #ifdef _MSC_VER
 #pragma warning(push, 1)
@@ -73,6 +74,7 @@ namespace libtorrent
 	class tracker_manager;
 	struct timeout_handler;
 	struct tracker_connection;
+	class udp_tracker_connection;
 	namespace aux { struct session_impl; }
 
 	// returns -1 if gzip header is invalid or the header size in bytes
@@ -230,7 +232,7 @@ namespace libtorrent
 		tracker_request const& tracker_req() const { return m_req; }
 
 		void fail_disp(error_code ec) { fail(ec); }
-		void fail(error_code const& ec, int code = -1, char const* msg = ""
+		virtual void fail(error_code const& ec, int code = -1, char const* msg = ""
 			, int interval = 0, int min_interval = 0);
 		virtual void start() = 0;
 		virtual void close();
@@ -267,10 +269,7 @@ namespace libtorrent
 	{
 	public:
 
-		tracker_manager(aux::session_impl& ses, proxy_settings const& ps)
-			: m_ses(ses)
-			, m_proxy(ps)
-			, m_abort(false) {}
+		tracker_manager(aux::session_impl& ses, proxy_settings const& ps);
 		~tracker_manager();
 
 		void queue_request(
@@ -294,15 +293,72 @@ namespace libtorrent
 		// this is only used for SOCKS packets, since
 		// they may be addressed to hostname
 		bool incoming_udp(error_code const& e, char const* hostname, char const* buf, int size);
-		
+
+		// the following functions are used by udp_tracker_connection and
+		// may only be called from the network thread
+
+		// picks a fresh transaction id for c, which incoming packets are
+		// dispatched on, and forgets the previous one
+		int new_transaction_id(boost::intrusive_ptr<udp_tracker_connection> const& c);
+		void remove_transaction_id(int tid);
+
+		// returns true and sets id if we have an unexpired connection
+		// id for the tracker at a
+		bool udp_connection_id(address const& a, boost::int64_t& id);
+
+		// if another connection is already exchanging a connection id
+		// with the tracker at a, c is queued up to be restarted once that
+		// completes and true is returned. Otherwise the caller is expected
+		// to send the connect message itself
+		bool wait_for_udp_connect(address const& a
+			, boost::intrusive_ptr<udp_tracker_connection> const& c);
+		void udp_connect_done(address const& a, boost::int64_t id);
+		void udp_connect_failed(address const& a);
+
+		// scrapes are held back for a short while, to let scrapes of
+		// other torrents to the same tracker join them in a single packet
+		void queue_udp_scrape(udp::endpoint const& ep
+			, boost::intrusive_ptr<udp_tracker_connection> const& c);
+
 	private:
 
+		void on_scrape_batch_timer(error_code const& ec);
+
 		typedef mutex mutex_t;
 		mutable mutex_t m_mutex;
 
 		typedef std::list<boost::intrusive_ptr<tracker_connection> >
 			tracker_connections_t;
 		tracker_connections_t m_connections;
+
+		typedef std::map<int, boost::intrusive_ptr<udp_tracker_connection> >
+			udp_conns_t;
+		// udp tracker connections indexed by their current transaction id
+		udp_conns_t m_udp_conns;
+
+		struct udp_connection_entry
+		{
+			// defined out of line, where udp_tracker_connection is complete
+			udp_connection_entry();
+			~udp_connection_entry();
+			boost::int64_t connection_id;
+			ptime expires;
+			// set while a connect message is outstanding
+			bool connecting;
+			// connections waiting for the outstanding connect to complete
+			std::vector<boost::intrusive_ptr<udp_tracker_connection> > waiters;
+		};
+
+		// connection ids for udp trackers, by tracker address
+		std::map<address, udp_connection_entry> m_udp_connection_cache;
+
+		typedef std::map<udp::endpoint
+			, std::vector<boost::intrusive_ptr<udp_tracker_connection> > >
+			scrape_queue_t;
+		// scrapes waiting for m_scrape_timer, by tracker endpoint
+		scrape_queue_t m_scrape_queue;
+		deadline_timer m_scrape_timer;
+		bool m_scrape_timer_armed;
 		aux::session_impl& m_ses;
 		proxy_settings const& m_proxy;
 		bool m_abort;
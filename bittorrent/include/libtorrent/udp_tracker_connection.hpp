@@ -77,6 +77,8 @@ namespace libtorrent
 
 		void start();
 		void close();
+		void fail(error_code const& ec, int code = -1, char const* msg = ""
+			, int interval = 0, int min_interval = 0);
 
 #if !defined TORRENT_VERBOSE_LOGGING \
 	&& !defined TORRENT_LOGGING \
@@ -107,6 +109,7 @@ namespace libtorrent
 		bool on_connect_response(char const* buf, int size);
 		bool on_announce_response(char const* buf, int size);
 		bool on_scrape_response(char const* buf, int size);
+		void scrape_response(int complete, int downloaded, int incomplete);
 
 		void send_udp_connect();
 		void send_udp_announce();
@@ -125,17 +128,24 @@ namespace libtorrent
 		aux::session_impl& m_ses;
 		int m_attempts;
 
-		struct connection_cache_entry
-		{
-			boost::int64_t connection_id;
-			ptime expires;
-		};
+		// the connection id we send requests with, once the
+		// connect message has been answered
+		boost::int64_t m_connection_id;
 
-		static std::map<address, connection_cache_entry> m_connection_cache;
-		static mutex m_cache_mutex;
+		// if this connection leads a scrape batch, these are the other
+		// connections whose info-hashes are sent along with ours
+		std::vector<boost::intrusive_ptr<udp_tracker_connection> > m_scrape_batch;
 
 		action_t m_state;
 
+		// set when we're the connection exchanging a connection
+		// id with the tracker on behalf of all others
+		bool m_connect_leader;
+
+		// set once this scrape has been handed to the tracker_manager
+		// to be batched up with others
+		bool m_scrape_queued;
+
 		proxy_settings m_proxy;
 	};
 
@@ -44,6 +44,7 @@ namespace libtorrent
 	class udp_socket;
 	class utp_stream;
 	struct utp_socket_impl;
+	struct session_metrics;
 
 	typedef boost::function<void(boost::shared_ptr<socket_type> const&)> incoming_utp_callback_t;
 
@@ -85,6 +86,10 @@ namespace libtorrent
 		void set_sock_buf(int size);
 		int num_sockets() const { return m_utp_sockets.size(); }
 
+		// the metrics to record round trip times into, or 0
+		void set_metrics(session_metrics* m) { m_metrics = m; }
+		session_metrics* metrics() const { return m_metrics; }
+
 	private:
 		udp_socket& m_sock;
 		incoming_utp_callback_t m_cb;
@@ -111,6 +116,8 @@ namespace libtorrent
 		// the buffer size of the socket. This is used
 		// to now lower the buffer size
 		int m_sock_buf_size;
+
+		session_metrics* m_metrics;
 	};
 }
 
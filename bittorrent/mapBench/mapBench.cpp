@@ -0,0 +1,297 @@
+// mapBench.cpp : compares tuple_map and hash_tuple_map on the tables the
+// wintorrent session keeps, to reproduce the numbers behind the switch to
+// hash_tuple_map.
+//
+// both maps hold ( tag, entry ) pairs like TorrentSessionImpl::Torrents. The
+// entry stands in for TorrentEntry: it's indexed by its handle, and building
+// one from a handle is what tuple_map::find<1>() does for every lookup. In
+// the session that conversion calls torrent_handle::status(), a round trip to
+// the network thread. Here it's a plain copy, unless --status-cost asks for
+// some work per conversion, so the numbers are a lower bound for tuple_map.
+//
+// the phases are timed separately:
+//   insert   adds every torrent
+//   handle   looks torrents up by handle, in random order
+//   tag      looks torrents up by tag, in random order
+//   at       walks all torrents by position, after each of --churn single
+//            erase + insert pairs (tuple_map rebuilds its index then)
+//   erase    removes every torrent by handle
+//
+// the exit code is 0 when both maps found the same torrents, 2 otherwise.
+
+#include "tuple_map.hpp"
+#include "hash_tuple_map.hpp"
+
+#include <boost/functional/hash.hpp>
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+namespace
+{
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	struct options
+	{
+		options()
+			: torrents(100000)
+			, lookups(1000000)
+			, churn(100)
+			, status_cost(0)
+		{}
+
+		int torrents;
+		// per lookup phase
+		int lookups;
+		int churn;
+		// the number of rounds of busy work in each entry conversion
+		int status_cost;
+	};
+
+	options opt;
+
+	void print_usage()
+	{
+		fputs( "usage: mapBench [options]\n"
+			"  --torrents N       number of torrents (100000)\n"
+			"  --lookups N        lookups per phase (1000000)\n"
+			"  --churn N          erase + insert + walk rounds (100)\n"
+			"  --status-cost N    work per entry conversion (0)\n", stderr );
+	}
+
+	bool parse_options( int argc, char * argv[], options & o )
+	{
+		for( int i = 1; i < argc; ++i )
+		{
+			std::string arg = argv[i];
+
+			if( i + 1 >= argc )
+				return false;
+
+			int v = atoi( argv[++i] );
+
+			if( arg == "--torrents" ) o.torrents = v;
+			else if( arg == "--lookups" ) o.lookups = v;
+			else if( arg == "--churn" ) o.churn = v;
+			else if( arg == "--status-cost" ) o.status_cost = v;
+			else return false;
+		}
+
+		return o.torrents > 0 && o.lookups >= 0 && o.churn >= 0 && o.status_cost >= 0;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// the torrent_handle and TorrentEntry stand-ins
+
+	struct bench_handle
+	{
+		bench_handle() : id(0) {}
+		explicit bench_handle( unsigned id ) : id(id) {}
+
+		unsigned id;
+
+		bool operator<( bench_handle const & other ) const { return id < other.id; }
+		bool operator==( bench_handle const & other ) const { return id == other.id; }
+	};
+
+	std::size_t hash_value( bench_handle const & h ) { return boost::hash_value( h.id ); }
+
+	volatile unsigned status_sink = 0;
+
+	struct bench_entry
+	{
+		bench_entry() : progress(0) {}
+		bench_entry( bench_handle const & handle ) : handle_(handle), progress(handle.id)
+		{
+			for( int i = 0; i < opt.status_cost; ++i )
+				status_sink += progress * i;
+		}
+
+		bench_handle handle_;
+		unsigned progress;
+
+		bool operator<( bench_entry const & other ) const { return handle_ < other.handle_; }
+		bool operator==( bench_entry const & other ) const { return handle_ == other.handle_; }
+	};
+}
+
+template<>
+struct hash_tuple_key< bench_entry >
+{
+	typedef bench_handle type;
+	static type const & get( bench_entry const & e ) { return e.handle_; }
+};
+
+namespace
+{
+	typedef tuple_map< std::string, bench_entry > tree_map;
+	typedef hash_tuple_map< std::string, bench_entry > hashed_map;
+
+	//////////////////////////////////////////////////////////////////////////
+	// the parts of the interface the two maps don't share
+
+	tree_map::tuple const * find_handle( tree_map const & m, bench_handle const & h )
+	{ return m.find<1>( h ); }
+
+	hashed_map::tuple const * find_handle( hashed_map const & m, bench_handle const & h )
+	{ return m.find<1>( h ); }
+
+	bool erase_handle( tree_map & m, bench_handle const & h )
+	{ return m.erase<1>( bench_entry( h ) ); }
+
+	bool erase_handle( hashed_map & m, bench_handle const & h )
+	{ return m.erase<1>( h ); }
+
+	tree_map::tuple const * at( tree_map const & m, size_t idx )
+	{ return m.at<0>( idx ); }
+
+	hashed_map::tuple const * at( hashed_map const & m, size_t idx )
+	{ return m.at( idx ); }
+
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	double now_ms()
+	{
+		static LARGE_INTEGER freq = { 0 };
+		if( freq.QuadPart == 0 )
+			QueryPerformanceFrequency( &freq );
+
+		LARGE_INTEGER t;
+		QueryPerformanceCounter( &t );
+		return double( t.QuadPart ) * 1000.0 / double( freq.QuadPart );
+	}
+
+	std::string tag_for( int i )
+	{
+		char tag[64];
+		_snprintf( tag, sizeof(tag), "C:\\torrents\\mapBench %d.torrent", i );
+		return tag;
+	}
+
+	// handles are spread out, like the pointers behind real ones
+	bench_handle handle_for( int i ) { return bench_handle( unsigned(i) * 2654435761u + 1 ); }
+
+	struct result
+	{
+		result() : insert(0), handle(0), tag(0), at(0), erase(0), found(0) {}
+
+		double insert;
+		double handle;
+		double tag;
+		double at;
+		double erase;
+		// what the phases found, to compare the maps
+		__int64 found;
+	};
+
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	template< typename Map >
+	result run( std::vector<int> const & order )
+	{
+		result r;
+		Map m;
+
+		double start = now_ms();
+		for( int i = 0; i < opt.torrents; ++i )
+			m.insert( tag_for( i ), bench_entry( handle_for( i ) ) );
+		r.insert = now_ms() - start;
+
+		start = now_ms();
+		for( size_t i = 0; i < order.size(); ++i )
+		{
+			typename Map::tuple const * t = find_handle( m, handle_for( order[i] ) );
+			if( t ) r.found += std::tr1::get<1>( *t ).progress;
+		}
+		r.handle = now_ms() - start;
+
+		std::vector<std::string> tags;
+		tags.reserve( order.size() );
+		for( size_t i = 0; i < order.size(); ++i )
+			tags.push_back( tag_for( order[i] ) );
+
+		start = now_ms();
+		for( size_t i = 0; i < tags.size(); ++i )
+		{
+			typename Map::tuple const * t = m.template find<0>( tags[i] );
+			if( t ) r.found += std::tr1::get<1>( *t ).progress;
+		}
+		r.tag = now_ms() - start;
+
+		// like state_update_alert and print_debug(), which walk the table
+		// by position while torrents come and go
+		start = now_ms();
+		for( int round = 0; round < opt.churn; ++round )
+		{
+			int i = order.empty() ? 0 : order[round % order.size()];
+			erase_handle( m, handle_for( i ) );
+			m.insert( tag_for( i ), bench_entry( handle_for( i ) ) );
+
+			for( size_t idx = 0; idx < m.size(); ++idx )
+			{
+				typename Map::tuple const * t = at( m, idx );
+				if( t ) r.found += std::tr1::get<1>( *t ).progress & 1;
+			}
+		}
+		r.at = now_ms() - start;
+
+		start = now_ms();
+		for( int i = 0; i < opt.torrents; ++i )
+			r.found += erase_handle( m, handle_for( i ) ) ? 1 : 0;
+		r.erase = now_ms() - start;
+
+		return r;
+	}
+
+	void print_result( char const * name, result const & r )
+	{
+		printf( "%-16s insert %9.1f ms  handle %9.1f ms  tag %9.1f ms  at %9.1f ms  erase %9.1f ms\n"
+			, name, r.insert, r.handle, r.tag, r.at, r.erase );
+	}
+}
+
+int main( int argc, char * argv[] )
+{
+	if( !parse_options( argc, argv, opt ) )
+	{
+		print_usage();
+		return 1;
+	}
+
+	// the same random lookup order for both maps
+	std::vector<int> order( opt.lookups );
+	unsigned seed = 0x12345678;
+	for( int i = 0; i < opt.lookups; ++i )
+	{
+		seed = seed * 1103515245 + 12345;
+		order[i] = int( ( seed >> 8 ) % unsigned( opt.torrents ) );
+	}
+
+	printf( "%d torrents, %d lookups, %d churn rounds, status cost %d\n"
+		, opt.torrents, opt.lookups, opt.churn, opt.status_cost );
+
+	result tree = run< tree_map >( order );
+	print_result( "tuple_map", tree );
+
+	result hashed = run< hashed_map >( order );
+	print_result( "hash_tuple_map", hashed );
+
+	printf( "result: handle_speedup=%.1f tag_speedup=%.1f at_speedup=%.1f\n"
+		, hashed.handle > 0 ? tree.handle / hashed.handle : 0.0
+		, hashed.tag > 0 ? tree.tag / hashed.tag : 0.0
+		, hashed.at > 0 ? tree.at / hashed.at : 0.0 );
+
+	if( tree.found != hashed.found )
+	{
+		fprintf( stderr, "the maps disagree: %I64d vs %I64d\n", tree.found, hashed.found );
+		return 2;
+	}
+
+	return 0;
+}
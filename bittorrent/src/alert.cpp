@@ -121,7 +121,8 @@ namespace libtorrent {
 			"using bittyrant unchoker with no upload rate limit set",
 			"the disk queue limit is too high compared to the cache size. The disk queue eats into the cache size",
 			"too few ports allowed for outgoing connections",
-			"too few file descriptors are allowed for this process. connection limit lowered"
+			"too few file descriptors are allowed for this process. connection limit lowered",
+			"large pages are unavailable, the disk cache uses normal pages"
 		};
 
 		return torrent_alert::message() + ": performance warning: "
@@ -623,5 +624,13 @@ namespace libtorrent {
 		return msg;
 	}
 
+	std::string session_stats_alert::message() const
+	{
+		char msg[100];
+		snprintf(msg, sizeof(msg), "session stats (%d counters, %d histograms)"
+			, int(session_metrics::num_counters), int(session_metrics::num_histograms));
+		return msg;
+	}
+
 } // namespace libtorrent
 
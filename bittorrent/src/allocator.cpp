@@ -42,6 +42,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #else
 #include <stdlib.h> // valloc/free
 #include <unistd.h> // _SC_PAGESIZE
+#include <sys/mman.h> // mmap/madvise
 #endif
 
 #if TORRENT_USE_MEMALIGN || TORRENT_USE_POSIX_MEMALIGN
@@ -159,6 +160,113 @@ namespace libtorrent
 #endif
 	}
 
+#if !defined TORRENT_WINDOWS && !defined TORRENT_BEOS && !defined TORRENT_DEBUG_BUFFERS
+	namespace
+	{
+		// maps bytes at an address aligned to 2 MiB, so that transparent
+		// huge pages can back all of it. The slack around the aligned
+		// range is unmapped again
+		char* map_aligned(std::size_t bytes)
+		{
+			const std::size_t alignment = 2 * 1024 * 1024;
+			void* p = mmap(0, bytes + alignment, PROT_READ | PROT_WRITE
+				, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (p == MAP_FAILED) return 0;
+
+			char* ret = (char*)p;
+			std::size_t head = (alignment - std::size_t(ret) % alignment) % alignment;
+			if (head > 0) munmap(ret, head);
+			munmap(ret + head + bytes, alignment - head);
+			return ret + head;
+		}
+	}
+#endif
+
+	bool large_page_allocator::enable_large_pages()
+	{
+#if defined TORRENT_DEBUG_BUFFERS || defined TORRENT_BEOS
+		return false;
+#elif defined TORRENT_WINDOWS
+		if (GetLargePageMinimum() == 0) return false;
+
+		HANDLE token;
+		if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+			return false;
+
+		TOKEN_PRIVILEGES tp;
+		tp.PrivilegeCount = 1;
+		tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+		bool ret = LookupPrivilegeValueA(0, "SeLockMemoryPrivilege", &tp.Privileges[0].Luid)
+			&& AdjustTokenPrivileges(token, FALSE, &tp, 0, 0, 0)
+			// AdjustTokenPrivileges succeeds without enabling anything
+			// if the account doesn't hold the privilege
+			&& GetLastError() == ERROR_SUCCESS;
+		CloseHandle(token);
+		return ret;
+#elif defined MAP_HUGETLB || defined MADV_HUGEPAGE
+		// nothing to enable. Whether there are huge pages to be had
+		// is up to how the system is configured
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	char* large_page_allocator::malloc(size_type bytes, bool& large_pages)
+	{
+#if defined TORRENT_DEBUG_BUFFERS || defined TORRENT_BEOS
+		large_pages = false;
+		return page_aligned_allocator::malloc(bytes);
+#elif defined TORRENT_WINDOWS
+		if (large_pages)
+		{
+			// this fails unless SeLockMemoryPrivilege is enabled, see
+			// enable_large_pages(), and the size is a multiple of the
+			// large page size
+			SIZE_T large_page = GetLargePageMinimum();
+			if (large_page > 0 && bytes % large_page == 0)
+			{
+				void* ret = VirtualAlloc(0, bytes, MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES
+					, PAGE_READWRITE);
+				if (ret) return (char*)ret;
+			}
+		}
+		large_pages = false;
+		return page_aligned_allocator::malloc(bytes);
+#else
+#ifdef MAP_HUGETLB
+		if (large_pages)
+		{
+			// this fails unless huge pages have been reserved
+			void* ret = mmap(0, bytes, PROT_READ | PROT_WRITE
+				, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+			if (ret != MAP_FAILED) return (char*)ret;
+		}
+#endif
+		bool want_large_pages = large_pages;
+		large_pages = false;
+
+		char* ret = map_aligned(bytes);
+#ifdef MADV_HUGEPAGE
+		// if transparent huge pages are enabled, ask for them instead
+		if (ret && want_large_pages) madvise(ret, bytes, MADV_HUGEPAGE);
+#endif
+		return ret;
+#endif
+	}
+
+	void large_page_allocator::free(char* const block, size_type bytes, bool large_pages)
+	{
+#if defined TORRENT_DEBUG_BUFFERS || defined TORRENT_BEOS
+		page_aligned_allocator::free(block);
+#elif defined TORRENT_WINDOWS
+		// both large and normal regions come from VirtualAlloc()
+		VirtualFree(block, 0, MEM_RELEASE);
+#else
+		// both large and normal regions are mapped
+		munmap(block, bytes);
+#endif
+	}
 
 }
 
@@ -44,6 +44,7 @@ namespace libtorrent
 		: m_queued_bytes(0)
 		, m_channel(channel)
 		, m_abort(false)
+		, m_metrics(0)
 	{
 #ifdef TORRENT_VERBOSE_BANDWIDTH_LIMIT
 		if (log)
@@ -113,8 +114,10 @@ namespace libtorrent
 			// bandwidth channels, or it doesn't belong to any
 			// channels. There's no point in adding it to
 			// the queue, just satisfy the request immediately
+			if (m_metrics) m_metrics->inc(session_metrics::bandwidth_immediate_requests);
 			return blk;
 		}
+		if (m_metrics) bwr.queued = time_now_hires();
 		m_queued_bytes += blk;
 		m_queue.push_back(bwr);
 		return 0;
@@ -202,6 +205,8 @@ namespace libtorrent
 			{
 				a += i->request_size - i->assigned;
 				TORRENT_ASSERT(i->assigned <= i->request_size);
+				if (m_metrics && i->assigned < i->request_size)
+					m_metrics->inc(session_metrics::bandwidth_partial_requests);
 				tm.push_back(*i);
 				i = m_queue.erase(i);
 			}
@@ -212,6 +217,19 @@ namespace libtorrent
 			m_queued_bytes -= a;
 		}
 
+		if (m_metrics && !tm.empty())
+		{
+			ptime now = time_now_hires();
+			for (queue_t::iterator i = tm.begin(), end(tm.end()); i != end; ++i)
+			{
+				// requests queued before metrics were turned on
+				// don't have a time
+				if (i->queued == min_time()) continue;
+				m_metrics->sample(session_metrics::bandwidth_wait_time
+					, total_microseconds(now - i->queued));
+			}
+		}
+
 		while (!tm.empty())
 		{
 			bw_request& bwr = tm.back();
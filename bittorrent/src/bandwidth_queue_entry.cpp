@@ -44,6 +44,7 @@ namespace libtorrent
 		, assigned(0)
 		, request_size(blk)
 		, ttl(20)
+		, queued(min_time())
 	{
 		TORRENT_ASSERT(priority > 0);
 		std::memset(channel, 0, sizeof(channel));
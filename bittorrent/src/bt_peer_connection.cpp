@@ -116,6 +116,8 @@ namespace libtorrent
 #ifndef TORRENT_DISABLE_ENCRYPTION
 		, m_encrypted(false)
 		, m_rc4_encrypted(false)
+		, m_unencrypted_bytes(0)
+		, m_handshake_start(time_now_hires())
 		, m_sync_bytes_read(0)
 #endif
 #if defined TORRENT_DEBUG || TORRENT_RELEASE_ASSERTS
@@ -153,6 +155,8 @@ namespace libtorrent
 #ifndef TORRENT_DISABLE_ENCRYPTION
 		, m_encrypted(false)
 		, m_rc4_encrypted(false)
+		, m_unencrypted_bytes(0)
+		, m_handshake_start(time_now_hires())
 		, m_sync_bytes_read(0)
 #endif		
 #if defined TORRENT_DEBUG || TORRENT_RELEASE_ASSERTS
@@ -216,6 +220,8 @@ namespace libtorrent
 		peer_log("*** outgoing encryption policy: %s", policy_name[out_enc_policy]);
 #endif
 
+		m_handshake_start = time_now_hires();
+
 		if (out_enc_policy == pe_settings::forced)
 		{
 			write_pe1_2_dhkey();
@@ -440,7 +446,13 @@ namespace libtorrent
 			peer_log("*** initiating encrypted handshake");
 #endif
 
-		m_dh_key_exchange.reset(new (std::nothrow) dh_key_exchange);
+		// prefer a key pair from the pool, generating one
+		// here would stall the network thread
+		dh_key_pair k;
+		if (m_ses.m_dh_key_pool.pop(k))
+			m_dh_key_exchange.reset(new (std::nothrow) dh_key_exchange(k));
+		else
+			m_dh_key_exchange.reset(new (std::nothrow) dh_key_exchange);
 		if (!m_dh_key_exchange || !m_dh_key_exchange->good())
 		{
 			disconnect(errors::no_memory);
@@ -655,10 +667,31 @@ namespace libtorrent
 		if (m_encrypted && m_rc4_encrypted)
 		{
 			// if we're encrypting this buffer, we need to make a copy
-			// since we'll mutate it
-			char* buf = (char*)malloc(size);
-			memcpy(buf, buffer, size);
-			bt_peer_connection::append_send_buffer(buf, size, boost::bind(&::free, _1));
+			// since we'll mutate it. Small buffers are cheaper to copy
+			// into the send buffer chain, large ones are copied into
+			// pooled disk buffers rather than a fresh heap allocation
+			int const block_size = m_ses.m_disk_thread.block_size();
+			if (size < block_size / 4)
+			{
+				send_buffer(buffer, size);
+				return;
+			}
+
+			while (size > 0)
+			{
+				char* buf = m_ses.allocate_disk_buffer("send buffer");
+				if (buf == 0)
+				{
+					disconnect(errors::no_memory);
+					return;
+				}
+				int buf_size = (std::min)(block_size, size);
+				memcpy(buf, buffer, buf_size);
+				bt_peer_connection::append_send_buffer(buf, buf_size
+					, boost::bind(&aux::session_impl::free_disk_buffer, boost::ref(m_ses), _1));
+				buffer += buf_size;
+				size -= buf_size;
+			}
 		}
 		else
 #endif
@@ -667,10 +700,25 @@ namespace libtorrent
 		}
 	}
 
-	void encrypt(char* buf, int len, void* userdata)
+	namespace
+	{
+		// the destructor of a shared send buffer. Destroying the bound
+		// copy of holder is what releases the buffer
+		void release_shared_buffer(boost::shared_ptr<void const> const&, char*) {}
+	}
+
+	void bt_peer_connection::append_shared_send_buffer(char const* buffer, int size
+		, boost::shared_ptr<void const> const& holder)
 	{
-		rc4_handler* rc4 = (rc4_handler*)userdata;
-		rc4->encrypt(buf, len);
+#ifndef TORRENT_DISABLE_ENCRYPTION
+		if (m_encrypted && m_rc4_encrypted)
+		{
+			send_buffer(buffer, size);
+			return;
+		}
+#endif
+		peer_connection::append_send_buffer(const_cast<char*>(buffer), size
+			, boost::bind(&release_shared_buffer, holder, _1), true);
 	}
 
 	void bt_peer_connection::send_buffer(char const* buf, int size, int flags
@@ -681,18 +729,95 @@ namespace libtorrent
 		TORRENT_ASSERT(buf);
 		TORRENT_ASSERT(size > 0);
 		
-		void* userdata = 0;
-		void (*fun)(char*, int, void*) = 0;
 #ifndef TORRENT_DISABLE_ENCRYPTION
+		// this has to be recorded before the bytes are queued, since
+		// queuing them may trigger a send
 		if (m_encrypted && m_rc4_encrypted)
+			m_unencrypted_bytes += size;
+#endif
+		
+		peer_connection::send_buffer(buf, size, flags);
+	}
+
+#ifndef TORRENT_DISABLE_ENCRYPTION
+	void bt_peer_connection::encrypt_pending_buffer()
+	{
+		if (m_unencrypted_bytes == 0) return;
+		TORRENT_ASSERT(m_enc_handler);
+		TORRENT_ASSERT(m_unencrypted_bytes <= send_buffer_size());
+
+		wr_send_buffers(m_unencrypted_bytes, m_encrypt_vec);
+		for (std::vector<asio::mutable_buffer>::iterator i = m_encrypt_vec.begin()
+			, end(m_encrypt_vec.end()); i != end; ++i)
 		{
-			fun = encrypt;
-			userdata = m_enc_handler.get();
+			m_enc_handler->encrypt(asio::buffer_cast<char*>(*i)
+				, asio::buffer_size(*i));
 		}
+		m_unencrypted_bytes = 0;
+	}
 #endif
-		
-		peer_connection::send_buffer(buf, size, flags, fun, userdata);
+
+#ifndef TORRENT_DISABLE_ENCRYPTION
+	void bt_peer_connection::on_dh_secret_async(int ret)
+	{
+		if (is_disconnecting()) return;
+		on_dh_secret(ret);
+		if (is_disconnecting()) return;
+		// receiving stopped while we were waiting for the secret
+		setup_receive(read_async);
+	}
+
+	void bt_peer_connection::on_dh_secret(int ret)
+	{
+		INVARIANT_CHECK;
+
+		TORRENT_ASSERT(m_state == read_pe_dhkey);
+		if (ret == -1)
+		{
+			disconnect(errors::no_memory);
+			return;
+		}
+
+#ifdef TORRENT_VERBOSE_LOGGING
+		peer_log("*** received DH key");
+#endif
+
+		// PadA/B can be a max of 512 bytes, and 20 bytes more for
+		// the sync hash (if incoming), or 8 bytes more for the
+		// encrypted verification constant (if outgoing). Instead
+		// of requesting the maximum possible, request the maximum
+		// possible to ensure we do not overshoot the standard
+		// handshake.
+
+		if (is_outgoing())
+		{
+			m_state = read_pe_syncvc;
+			write_pe3_sync();
+
+			// initial payload is the standard handshake, this is
+			// always rc4 if sent here. m_rc4_encrypted is flagged
+			// again according to peer selection.
+			m_rc4_encrypted = true;
+			m_encrypted = true;
+			write_handshake();
+			encrypt_pending_buffer();
+			m_rc4_encrypted = false;
+			m_encrypted = false;
+
+			// vc,crypto_select,len(pad),pad, encrypt(handshake)
+			// 8+4+2+0+handshake_len
+			reset_recv_buffer(8+4+2+0+handshake_len);
+		}
+		else
+		{
+			// already written dh key
+			m_state = read_pe_synchash;
+			// synchash,skeyhash,vc,crypto_provide,len(pad),pad,encrypt(handshake)
+			reset_recv_buffer(20+20+8+4+2+0+handshake_len);
+		}
+		TORRENT_ASSERT(!packet_finished());
 	}
+#endif
 
 	int bt_peer_connection::get_syncoffset(char const* src, int src_size,
 		char const* target, int target_size) const
@@ -1878,8 +2003,19 @@ namespace libtorrent
 		size_type cur_payload_dl = m_statistics.last_payload_downloaded();
 		size_type cur_protocol_dl = m_statistics.last_protocol_downloaded();
 #endif
+		session_metrics* metrics = m_ses.metrics();
+		ptime parse_start;
+		if (metrics) parse_start = time_now_hires();
+
 		// call the correct handler for this packet type
 		(this->*m_message_handler[packet_type])(received);
+
+		if (metrics)
+		{
+			boost::int64_t parse_time = total_microseconds(time_now_hires() - parse_start);
+			metrics->sample(session_metrics::message_parse_time, parse_time);
+			m_parse_time += parse_time;
+		}
 #ifdef TORRENT_DEBUG
 		TORRENT_ASSERT(m_statistics.last_payload_downloaded() - cur_payload_dl >= 0);
 		TORRENT_ASSERT(m_statistics.last_protocol_downloaded() - cur_protocol_dl >= 0);
@@ -2426,50 +2562,17 @@ namespace libtorrent
 			if (!is_outgoing()) write_pe1_2_dhkey();
 			if (is_disconnecting()) return;
 			
-			// read dh key, generate shared secret
-			if (m_dh_key_exchange->compute_secret(recv_buffer.begin) == -1)
-			{
-				disconnect(errors::no_memory);
+			// read dh key, generate shared secret. Unless it's done on
+			// the key pool's thread, in which case we stop receiving until
+			// it's ready. The receive buffer is full, so no more reads are
+			// issued until the buffer is reset in on_dh_secret()
+			if (m_ses.settings().async_dh_secret
+				&& m_ses.m_dh_key_pool.async_compute_secret(m_dh_key_exchange.get()
+					, recv_buffer.begin, boost::bind(&bt_peer_connection::on_dh_secret_async
+					, boost::intrusive_ptr<bt_peer_connection>(this), _1)))
 				return;
-			}
 
-#ifdef TORRENT_VERBOSE_LOGGING
-			peer_log("*** received DH key");
-#endif
-						
-			// PadA/B can be a max of 512 bytes, and 20 bytes more for
-			// the sync hash (if incoming), or 8 bytes more for the
-			// encrypted verification constant (if outgoing). Instead
-			// of requesting the maximum possible, request the maximum
-			// possible to ensure we do not overshoot the standard
-			// handshake.
-
-			if (is_outgoing())
-			{
-				m_state = read_pe_syncvc;
-				write_pe3_sync();
-
-				// initial payload is the standard handshake, this is
-				// always rc4 if sent here. m_rc4_encrypted is flagged
-				// again according to peer selection.
-				m_rc4_encrypted = true;
-				m_encrypted = true;
-				write_handshake();
-				m_rc4_encrypted = false;
-				m_encrypted = false;
-
-				// vc,crypto_select,len(pad),pad, encrypt(handshake)
-				// 8+4+2+0+handshake_len
-				reset_recv_buffer(8+4+2+0+handshake_len);
-			}
-			else
-			{
-				// already written dh key
-				m_state = read_pe_synchash;
-				// synchash,skeyhash,vc,crypto_provide,len(pad),pad,encrypt(handshake)
-				reset_recv_buffer(20+20+8+4+2+0+handshake_len);
-			}
-			TORRENT_ASSERT(!packet_finished());
+			on_dh_secret(m_dh_key_exchange->compute_secret(recv_buffer.begin));
 			return;
 		}
 
@@ -2869,6 +2972,7 @@ namespace libtorrent
 
 			// everything that arrives after this is encrypted
 			m_encrypted = true;
+			m_ses.record_handshake_latency(total_milliseconds(time_now_hires() - m_handshake_start));
 
 			m_state = read_protocol_identifier;
 			cut_receive_buffer(0, 20);
@@ -2898,6 +3002,8 @@ namespace libtorrent
 #endif
 			}
 
+			m_ses.record_handshake_latency(total_milliseconds(time_now_hires() - m_handshake_start));
+
 			// payload stream, start with 20 handshake bytes
 			m_state = read_protocol_identifier;
 			reset_recv_buffer(20);
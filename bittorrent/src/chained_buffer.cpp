@@ -135,6 +135,36 @@ namespace libtorrent
 		return m_tmp_vec;
 	}
 
+	void chained_buffer::build_mutable_iovec(int bytes, std::vector<asio::mutable_buffer>& vec)
+	{
+		TORRENT_ASSERT(bytes <= m_bytes);
+		vec.clear();
+		if (bytes <= 0) return;
+
+		// walk backwards from the end until we've covered
+		// enough bytes, then emit the buffers front to back
+		std::list<buffer_t>::iterator i = m_vec.end();
+		int skip = 0;
+		for (int left = bytes; left > 0;)
+		{
+			TORRENT_ASSERT(i != m_vec.begin());
+			--i;
+			if (i->used_size >= left)
+			{
+				skip = i->used_size - left;
+				break;
+			}
+			left -= i->used_size;
+		}
+
+		vec.push_back(asio::mutable_buffer(i->start + skip, i->used_size - skip));
+		for (++i; i != m_vec.end(); ++i)
+		{
+			if (i->used_size == 0) continue;
+			vec.push_back(asio::mutable_buffer(i->start, i->used_size));
+		}
+	}
+
 	chained_buffer::~chained_buffer()
 	{
 #if defined TORRENT_DEBUG || TORRENT_RELEASE_ASSERTS
@@ -34,9 +34,14 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/file_pool.hpp"
 #include "libtorrent/storage.hpp"
 #include "libtorrent/escape_string.hpp"
+#include "libtorrent/thread.hpp"
 
 #include <boost/bind.hpp>
 #include <boost/next_prior.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <deque>
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -160,103 +165,319 @@ namespace libtorrent
 		char* m_piece;
 	};
 
+	namespace
+	{
+		// a run of consecutive pieces, read from disk in one call
+		struct hash_chunk : boost::noncopyable
+		{
+			hash_chunk(int capacity)
+				: buffer(capacity), first_piece(0), num_pieces(0), size(0), pending(0) {}
+			piece_holder buffer;
+			int first_piece;
+			int num_pieces;
+			int size;
+			// the number of pieces in this chunk not hashed yet,
+			// plus one if it's still waiting for the file hasher.
+			// The chunk can't be read into until this is 0
+			int pending;
+		};
+
+		// the thread calling set_piece_hashes() reads the pieces into a
+		// ring of chunks. Every piece is hashed by one of the hashing
+		// threads. The file hashes have to be computed in order, so
+		// they're calculated by a thread of their own. The piece hashes
+		// are handed back to the caller, in order, along with the progress
+		// callback
+		struct hash_pipeline : boost::noncopyable
+		{
+			hash_pipeline(create_torrent& t, int num_threads, int num_chunks, int chunk_size)
+				: m_t(t)
+				, m_piece_hashes(t.num_pieces())
+				, m_piece_done(t.num_pieces(), false)
+				, m_abort(false)
+			{
+				for (int i = 0; i < num_chunks; ++i)
+					m_chunks.push_back(boost::shared_ptr<hash_chunk>(new hash_chunk(chunk_size)));
+
+				for (int i = 0; i < num_threads; ++i)
+				{
+					m_threads.push_back(boost::shared_ptr<thread>(
+						new thread(boost::bind(&hash_pipeline::piece_thread_fun, this))));
+				}
+
+				if (t.should_add_file_hashes())
+				{
+					m_file_hashes.resize(t.files().num_files());
+					m_threads.push_back(boost::shared_ptr<thread>(
+						new thread(boost::bind(&hash_pipeline::file_thread_fun, this))));
+				}
+			}
+
+			~hash_pipeline()
+			{
+				mutex::scoped_lock l(m_mutex);
+				m_abort = true;
+				m_queue_cond.signal_all(l);
+				l.unlock();
+
+				for (std::vector<boost::shared_ptr<thread> >::iterator i = m_threads.begin()
+					, end(m_threads.end()); i != end; ++i)
+					(*i)->join();
+			}
+
+			// waits for the chunk to be free and returns it. Progress
+			// is reported while waiting
+			hash_chunk& next_chunk(int index, int& next_piece
+				, boost::function<void(int)> const& f)
+			{
+				hash_chunk& c = *m_chunks[index % m_chunks.size()];
+				mutex::scoped_lock l(m_mutex);
+				while (c.pending > 0)
+				{
+					m_done_cond.wait(l);
+					report_progress(l, next_piece, f);
+				}
+				return c;
+			}
+
+			// hands a chunk that has been read to the hashing threads,
+			// and reports what's been hashed while it was read. When the
+			// hashers keep up with the disk, the reader never waits, so
+			// this is where most of the progress is reported
+			void post(hash_chunk& c, int& next_piece
+				, boost::function<void(int)> const& f)
+			{
+				mutex::scoped_lock l(m_mutex);
+				TORRENT_ASSERT(c.pending == 0);
+				c.pending = c.num_pieces;
+				for (int i = 0; i < c.num_pieces; ++i)
+					m_piece_queue.push_back(std::make_pair(&c, i));
+				if (!m_file_hashes.empty())
+				{
+					++c.pending;
+					m_file_queue.push_back(&c);
+				}
+				m_queue_cond.signal_all(l);
+				report_progress(l, next_piece, f);
+			}
+
+			// waits for all pieces up to end to be hashed
+			void wait(int& next_piece, int end, boost::function<void(int)> const& f)
+			{
+				mutex::scoped_lock l(m_mutex);
+				report_progress(l, next_piece, f);
+				while (next_piece < end)
+				{
+					m_done_cond.wait(l);
+					report_progress(l, next_piece, f);
+				}
+			}
+
+			void set_file_hashes()
+			{
+				// the file hasher is done once every chunk has been released
+				mutex::scoped_lock l(m_mutex);
+				for (std::vector<boost::shared_ptr<hash_chunk> >::iterator i = m_chunks.begin()
+					, end(m_chunks.end()); i != end; ++i)
+				{
+					while ((*i)->pending > 0) m_done_cond.wait(l);
+				}
+				l.unlock();
+
+				for (int i = 0; i < int(m_file_hashes.size()); ++i)
+				{
+					if (m_t.files().at(i).pad_file) continue;
+					m_t.set_file_hash(i, m_file_hashes[i]);
+				}
+			}
+
+		private:
+
+			// sets the hashes of the pieces finished in order and calls
+			// the progress callback for them. The callback is called without
+			// holding the mutex
+			void report_progress(mutex::scoped_lock& l, int& next_piece
+				, boost::function<void(int)> const& f)
+			{
+				int end = next_piece;
+				while (end < int(m_piece_done.size()) && m_piece_done[end]) ++end;
+				if (end == next_piece) return;
+
+				l.unlock();
+				for (; next_piece < end; ++next_piece)
+				{
+					m_t.set_hash(next_piece, m_piece_hashes[next_piece]);
+					f(next_piece);
+				}
+				l.lock();
+			}
+
+			void piece_thread_fun()
+			{
+				mutex::scoped_lock l(m_mutex);
+				for (;;)
+				{
+					while (m_piece_queue.empty() && !m_abort)
+						m_queue_cond.wait(l);
+					if (m_abort) return;
+
+					hash_chunk& c = *m_piece_queue.front().first;
+					int i = m_piece_queue.front().second;
+					m_piece_queue.pop_front();
+					l.unlock();
+
+					int piece = c.first_piece + i;
+					int offset = i * m_t.piece_length();
+					hasher h(c.buffer.bytes() + offset, m_t.piece_size(piece));
+					m_piece_hashes[piece] = h.final();
+
+					l.lock();
+					m_piece_done[piece] = true;
+					--c.pending;
+					m_done_cond.signal_all(l);
+				}
+			}
+
+			void file_thread_fun()
+			{
+				hasher filehash;
+				int file_idx = 0;
+				size_type left_in_file = m_t.files().at(0).size;
+
+				mutex::scoped_lock l(m_mutex);
+				for (;;)
+				{
+					while (m_file_queue.empty() && !m_abort)
+						m_queue_cond.wait(l);
+					if (m_abort) return;
+
+					hash_chunk& c = *m_file_queue.front();
+					m_file_queue.pop_front();
+					l.unlock();
+
+					int left_in_chunk = c.size;
+					while (left_in_chunk > 0 && file_idx < int(m_file_hashes.size()))
+					{
+						int to_hash_for_file = int((std::min)(size_type(left_in_chunk), left_in_file));
+						if (to_hash_for_file > 0)
+							filehash.update(c.buffer.bytes() + c.size - left_in_chunk, to_hash_for_file);
+						left_in_file -= to_hash_for_file;
+						left_in_chunk -= to_hash_for_file;
+						// this also takes care of empty files
+						while (left_in_file == 0 && file_idx < int(m_file_hashes.size()))
+						{
+							m_file_hashes[file_idx] = filehash.final();
+							filehash.reset();
+							++file_idx;
+							if (file_idx < int(m_file_hashes.size()))
+								left_in_file = m_t.files().at(file_idx).size;
+						}
+					}
+
+					l.lock();
+					--c.pending;
+					m_done_cond.signal_all(l);
+				}
+			}
+
+			create_torrent& m_t;
+
+			// protects everything below, except the chunk buffers.
+			// A chunk's buffer is only touched by the reader while
+			// pending is 0, and only read by the hashers otherwise
+			mutex m_mutex;
+			// signalled when jobs are queued and on abort
+			condition m_queue_cond;
+			// signalled when a job completes
+			condition m_done_cond;
+
+			std::vector<boost::shared_ptr<hash_chunk> > m_chunks;
+			// chunk and index of the piece within it
+			std::deque<std::pair<hash_chunk*, int> > m_piece_queue;
+			std::deque<hash_chunk*> m_file_queue;
+
+			std::vector<sha1_hash> m_piece_hashes;
+			std::vector<bool> m_piece_done;
+			std::vector<sha1_hash> m_file_hashes;
+
+			std::vector<boost::shared_ptr<thread> > m_threads;
+			bool m_abort;
+		};
+
+		void set_piece_hashes_impl(create_torrent& t, std::string const& path
+			, boost::function<void(int)> const& f, error_code& ec)
+		{
+			file_pool fp;
+			boost::scoped_ptr<storage_interface> st(
+				default_storage_constructor(const_cast<file_storage&>(t.files()), 0, path, fp
+				, std::vector<boost::uint8_t>()));
+
+			int num = t.num_pieces();
+			if (num == 0) return;
+
+			// read the files in chunks of at least 4 MiB, to keep the
+			// reads sequential and large. Make the ring deep enough to
+			// keep all hashing threads busy while the next chunk is
+			// read, without letting it grow past 256 MiB for large pieces
+			int pieces_per_chunk = (std::max)(1, (4 * 1024 * 1024) / t.piece_length());
+			int chunk_size = pieces_per_chunk * t.piece_length();
+			int num_threads = hardware_concurrency();
+			int num_chunks = (std::min)(num_threads + 2
+				, (std::max)(3, (256 * 1024 * 1024) / chunk_size));
+
+			hash_pipeline pipeline(t, num_threads, num_chunks, chunk_size);
+
+			int next_piece = 0;
+			for (int i = 0, piece = 0; piece < num; ++i)
+			{
+				hash_chunk& c = pipeline.next_chunk(i, next_piece, f);
+
+				c.first_piece = piece;
+				c.num_pieces = (std::min)(pieces_per_chunk, num - piece);
+				c.size = int((std::min)(t.files().total_size()
+					- size_type(piece) * t.piece_length()
+					, size_type(c.num_pieces) * t.piece_length()));
+
+				// read hits the disk and will block. Progress is
+				// reported in between reads
+				st->read(c.buffer.bytes(), piece, 0, c.size);
+				if (st->error())
+				{
+					ec = st->error();
+					return;
+				}
+
+				pipeline.post(c, next_piece, f);
+				piece += c.num_pieces;
+			}
+
+			pipeline.wait(next_piece, num, f);
+			if (t.should_add_file_hashes()) pipeline.set_file_hashes();
+		}
+	}
+
 #if TORRENT_USE_WSTRING
 	void set_piece_hashes(create_torrent& t, std::wstring const& p
 		, boost::function<void(int)> const& f, error_code& ec)
 	{
-		file_pool fp;
 		std::string utf8;
 		wchar_utf8(p, utf8);
 #if TORRENT_USE_UNC_PATHS
 		utf8 = canonicalize_path(utf8);
 #endif
-		boost::scoped_ptr<storage_interface> st(
-			default_storage_constructor(const_cast<file_storage&>(t.files()), 0, utf8, fp
-			, std::vector<boost::uint8_t>()));
-
-		// calculate the hash for all pieces
-		int num = t.num_pieces();
-		std::vector<char> buf(t.piece_length());
-		for (int i = 0; i < num; ++i)
-		{
-			// read hits the disk and will block. Progress should
-			// be updated in between reads
-			st->read(&buf[0], i, 0, t.piece_size(i));
-			if (st->error())
-			{
-				ec = st->error();
-				return;
-			}
-			hasher h(&buf[0], t.piece_size(i));
-			t.set_hash(i, h.final());
-			f(i);
-		}
+		set_piece_hashes_impl(t, utf8, f, ec);
 	}
 #endif
 
 	void set_piece_hashes(create_torrent& t, std::string const& p
 		, boost::function<void(int)> f, error_code& ec)
 	{
-		file_pool fp;
 #if TORRENT_USE_UNC_PATHS
 		std::string path = canonicalize_path(p);
 #else
 		std::string const& path = p;
 #endif
-		boost::scoped_ptr<storage_interface> st(
-			default_storage_constructor(const_cast<file_storage&>(t.files()), 0, path, fp
-			, std::vector<boost::uint8_t>()));
-
-		// if we're calculating file hashes as well, use this hasher
-		hasher filehash;
-		int file_idx = 0;
-		size_type left_in_file = t.files().at(0).size;
-
-		// calculate the hash for all pieces
-		int num = t.num_pieces();
-		piece_holder buf(t.piece_length());
-		for (int i = 0; i < num; ++i)
-		{
-			// read hits the disk and will block. Progress should
-			// be updated in between reads
-			st->read(buf.bytes(), i, 0, t.piece_size(i));
-			if (st->error())
-			{
-				ec = st->error();
-				return;
-			}
-			
-			if (t.should_add_file_hashes())
-			{
-				int left_in_piece = t.piece_size(i);
-				int this_piece_size = left_in_piece;
-				// the number of bytes from this file we just read
-				while (left_in_piece > 0)
-				{
-					int to_hash_for_file = int((std::min)(size_type(left_in_piece), left_in_file));
-					if (to_hash_for_file > 0)
-					{
-						int offset = this_piece_size - left_in_piece;
-						filehash.update(buf.bytes() + offset, to_hash_for_file);
-					}
-					left_in_file -= to_hash_for_file;
-					left_in_piece -= to_hash_for_file;
-					if (left_in_file == 0)
-					{
-						if (!t.files().at(file_idx).pad_file)
-							t.set_file_hash(file_idx, filehash.final());
-						filehash.reset();
-						file_idx++;
-						if (file_idx >= t.files().num_files()) break;
-						left_in_file = t.files().at(file_idx).size;
-					}
-				}
-			}
-
-			hasher h(buf.bytes(), t.piece_size(i));
-			t.set_hash(i, h.final());
-			f(i);
-		}
+		set_piece_hashes_impl(t, path, f, ec);
 	}
 
 	create_torrent::~create_torrent() {}
@@ -0,0 +1,183 @@
+/*
+
+Copyright (c) 2012, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_DISABLE_ENCRYPTION
+
+#include <boost/bind.hpp>
+#include <cstring>
+
+#ifdef TORRENT_USE_GCRYPT
+#include <gcrypt.h>
+#endif
+
+#include "libtorrent/dh_key_pool.hpp"
+#include "libtorrent/hasher.hpp"
+#include "libtorrent/random.hpp"
+#include "libtorrent/time.hpp"
+#include "libtorrent/assert.hpp"
+
+namespace libtorrent
+{
+	dh_key_pool::dh_key_pool(io_service& ios)
+		: m_ios(ios)
+		, m_size(0)
+		, m_abort(false)
+	{
+		// seed the pool's generator from the global one, but run it
+		// through SHA-1 together with the time. Seeding it with the
+		// raw output would just continue the same sequence
+		hasher h;
+		for (int i = 0; i < 4; ++i)
+		{
+			boost::uint32_t r = random();
+			h.update((char const*)&r, sizeof(r));
+		}
+		boost::int64_t now = total_microseconds(time_now_hires() - min_time());
+		h.update((char const*)&now, sizeof(now));
+		sha1_hash seed = h.final();
+		std::memcpy(m_rand, &seed[0], sizeof(m_rand));
+		if (m_rand[0] == 0) m_rand[0] = 1;
+	}
+
+	dh_key_pool::~dh_key_pool()
+	{
+		abort();
+	}
+
+	void dh_key_pool::set_size(int n)
+	{
+		TORRENT_ASSERT(n >= 0);
+		mutex::scoped_lock l(m_mutex);
+		if (m_abort) return;
+		m_size = n;
+		if (int(m_keys.size()) > n) m_keys.resize(n);
+		if (n > 0) start_thread(l);
+		m_cond.signal_all(l);
+	}
+
+	bool dh_key_pool::pop(dh_key_pair& k)
+	{
+		mutex::scoped_lock l(m_mutex);
+		if (m_keys.empty()) return false;
+		k = m_keys.back();
+		m_keys.pop_back();
+		// wake up the thread to refill
+		m_cond.signal_all(l);
+		return true;
+	}
+
+	bool dh_key_pool::async_compute_secret(dh_key_exchange* e, char const* remote_key
+		, boost::function<void(int)> const& handler)
+	{
+		TORRENT_ASSERT(e);
+		mutex::scoped_lock l(m_mutex);
+		if (m_abort) return false;
+		m_jobs.push_back(secret_job());
+		secret_job& j = m_jobs.back();
+		j.exchange = e;
+		std::memcpy(j.remote_key, remote_key, sizeof(j.remote_key));
+		j.handler = handler;
+		start_thread(l);
+		m_cond.signal_all(l);
+		return true;
+	}
+
+	void dh_key_pool::abort()
+	{
+		mutex::scoped_lock l(m_mutex);
+		m_abort = true;
+		m_cond.signal_all(l);
+		l.unlock();
+
+		if (m_thread) m_thread->join();
+		m_thread.reset();
+
+		// the handlers may hold references to peer connections,
+		// release them here, on the network thread
+		m_jobs.clear();
+		m_keys.clear();
+	}
+
+	void dh_key_pool::start_thread(mutex::scoped_lock& l)
+	{
+		if (m_thread) return;
+		m_thread.reset(new thread(boost::bind(&dh_key_pool::thread_fun, this)));
+	}
+
+	boost::uint32_t dh_key_pool::next_random()
+	{
+		// xorshift, the same generator as random()
+		boost::uint32_t t = m_rand[0] ^ (m_rand[0] << 11);
+		m_rand[0] = m_rand[1];
+		m_rand[1] = m_rand[2];
+		m_rand[2] = m_rand[3];
+		return m_rand[3] = m_rand[3] ^ (m_rand[3] >> 19) ^ (t ^ (t >> 8));
+	}
+
+	void dh_key_pool::thread_fun()
+	{
+		mutex::scoped_lock l(m_mutex);
+		for (;;)
+		{
+			while (!m_abort && m_jobs.empty() && int(m_keys.size()) >= m_size)
+				m_cond.wait(l);
+
+			if (m_abort) return;
+
+			if (!m_jobs.empty())
+			{
+				secret_job j = m_jobs.front();
+				m_jobs.pop_front();
+				l.unlock();
+				int ret = j.exchange->compute_secret(j.remote_key);
+				m_ios.post(boost::bind(j.handler, ret));
+				l.lock();
+				continue;
+			}
+
+			dh_key_pair k;
+#ifdef TORRENT_USE_GCRYPT
+			gcry_randomize(k.secret, sizeof(k.secret), GCRY_STRONG_RANDOM);
+#else
+			for (int i = 0; i < int(sizeof(k.secret)); ++i)
+				k.secret[i] = next_random();
+#endif
+			l.unlock();
+			dh_key_exchange::compute_public_key(k);
+			l.lock();
+			if (int(m_keys.size()) < m_size) m_keys.push_back(k);
+		}
+	}
+}
+
+#endif // TORRENT_DISABLE_ENCRYPTION
+
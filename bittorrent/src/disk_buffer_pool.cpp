@@ -44,11 +44,18 @@ POSSIBILITY OF SUCH DAMAGE.
 
 namespace libtorrent
 {
+	namespace
+	{
+		// the size of the regions blocks are carved out of
+		const int region_size = 2 * 1024 * 1024;
+	}
+
 	disk_buffer_pool::disk_buffer_pool(int block_size)
 		: m_block_size(block_size)
 		, m_in_use(0)
 #ifndef TORRENT_DISABLE_POOL_ALLOCATOR
-		, m_pool(block_size, m_settings.cache_buffer_chunk_size)
+		, m_blocks_per_region((std::max)(region_size / block_size, 1))
+		, m_large_page_failures(0)
 #endif
 	{
 #if defined TORRENT_DISK_STATS || defined TORRENT_STATS
@@ -66,13 +73,21 @@ namespace libtorrent
 #endif
 	}
 
-#if defined TORRENT_DEBUG || TORRENT_RELEASE_ASSERTS
 	disk_buffer_pool::~disk_buffer_pool()
 	{
+#if defined TORRENT_DEBUG || TORRENT_RELEASE_ASSERTS
 		TORRENT_ASSERT(m_magic == 0x1337);
 		m_magic = 0;
-	}
 #endif
+#ifndef TORRENT_DISABLE_POOL_ALLOCATOR
+		for (region_map_t::iterator i = m_regions.begin()
+			, end(m_regions.end()); i != end; ++i)
+		{
+			large_page_allocator::free(i->first
+				, m_blocks_per_region * m_block_size, i->second.large_pages);
+		}
+#endif
+	}
 
 #if defined TORRENT_DEBUG || TORRENT_RELEASE_ASSERTS || defined TORRENT_DISK_STATS
 	bool disk_buffer_pool::is_disk_buffer(char* buffer
@@ -86,7 +101,12 @@ namespace libtorrent
 #ifdef TORRENT_DISABLE_POOL_ALLOCATOR
 		return true;
 #else
-		return m_pool.is_from(buffer);
+		region_map_t::const_iterator i = m_regions.upper_bound(buffer);
+		if (i == m_regions.begin()) return false;
+		--i;
+		int offset = buffer - i->first;
+		return offset < m_blocks_per_region * m_block_size
+			&& (offset % m_block_size) == 0;
 #endif
 	}
 
@@ -104,31 +124,54 @@ namespace libtorrent
 #ifdef TORRENT_DISABLE_POOL_ALLOCATOR
 		char* ret = page_aligned_allocator::malloc(m_block_size);
 #else
-		char* ret = (char*)m_pool.malloc();
-		m_pool.set_next_size(m_settings.cache_buffer_chunk_size);
+		char* ret = allocate_blocks(1);
 #endif
-		++m_in_use;
+		if (ret == 0) return 0;
+		on_allocated(ret, 1, category, l);
+		return ret;
+	}
+
+	char* disk_buffer_pool::allocate_buffers(int num_blocks, char const* category)
+	{
+		TORRENT_ASSERT(num_blocks > 0);
+#ifdef TORRENT_DISABLE_POOL_ALLOCATOR
+		// every block is an allocation of its own
+		return 0;
+#else
+		mutex::scoped_lock l(m_pool_mutex);
+		TORRENT_ASSERT(m_magic == 0x1337);
+		char* ret = allocate_blocks(num_blocks);
+		if (ret == 0) return 0;
+		on_allocated(ret, num_blocks, category, l);
+		return ret;
+#endif
+	}
+
+	void disk_buffer_pool::on_allocated(char* buf, int num_blocks, char const* category
+		, mutex::scoped_lock& l)
+	{
+		m_in_use += num_blocks;
 #if TORRENT_USE_MLOCK
 		if (m_settings.lock_disk_cache)
 		{
 #ifdef TORRENT_WINDOWS
-			VirtualLock(ret, m_block_size);
+			VirtualLock(buf, num_blocks * m_block_size);
 #else
-			mlock(ret, m_block_size);
+			mlock(buf, num_blocks * m_block_size);
 #endif		
 		}
 #endif
 
 #if defined TORRENT_DISK_STATS || defined TORRENT_STATS
-		++m_allocations;
+		m_allocations += num_blocks;
 #endif
 #ifdef TORRENT_DISK_STATS
-		++m_categories[category];
-		m_buf_to_category[ret] = category;
+		m_categories[category] += num_blocks;
+		for (int i = 0; i < num_blocks; ++i)
+			m_buf_to_category[buf + i * m_block_size] = category;
 		m_log << log_time() << " " << category << ": " << m_categories[category] << "\n";
 #endif
-		TORRENT_ASSERT(ret == 0 || is_disk_buffer(ret, l));
-		return ret;
+		TORRENT_ASSERT(is_disk_buffer(buf, l));
 	}
 
 #ifdef TORRENT_DISK_STATS
@@ -200,7 +243,7 @@ namespace libtorrent
 #ifdef TORRENT_DISABLE_POOL_ALLOCATOR
 		page_aligned_allocator::free(buf);
 #else
-		m_pool.free(buf);
+		free_block(buf);
 #endif
 		--m_in_use;
 	}
@@ -210,8 +253,119 @@ namespace libtorrent
 		TORRENT_ASSERT(m_magic == 0x1337);
 #ifndef TORRENT_DISABLE_POOL_ALLOCATOR
 		mutex::scoped_lock l(m_pool_mutex);
-		m_pool.release_memory();
+		// give the regions without any blocks in use back
+		for (region_map_t::iterator i = m_regions.begin(); i != m_regions.end();)
+		{
+			if (i->second.num_used > 0)
+			{
+				++i;
+				continue;
+			}
+			m_partial_regions.erase(i->first);
+			large_page_allocator::free(i->first
+				, m_blocks_per_region * m_block_size, i->second.large_pages);
+			m_regions.erase(i++);
+		}
 #endif
 	}
+
+	disk_pool_status disk_buffer_pool::pool_status() const
+	{
+		disk_pool_status ret;
+#ifndef TORRENT_DISABLE_POOL_ALLOCATOR
+		mutex::scoped_lock l(m_pool_mutex);
+		ret.blocks_per_region = m_blocks_per_region;
+		ret.large_page_failures = m_large_page_failures;
+		for (region_map_t::const_iterator i = m_regions.begin()
+			, end(m_regions.end()); i != end; ++i)
+		{
+			region const& r = i->second;
+			++ret.regions;
+			if (r.large_pages) ++ret.large_page_regions;
+			ret.free_blocks += m_blocks_per_region - r.num_used;
+			if (r.num_used > 0 && r.num_used < m_blocks_per_region)
+				++ret.partial_regions;
+			if (r.num_used == m_blocks_per_region) continue;
+
+			int run = 0;
+			for (int b = 0; b < m_blocks_per_region; ++b)
+			{
+				run = r.used.get_bit(b) ? 0 : run + 1;
+				ret.largest_free_run = (std::max)(ret.largest_free_run, run);
+			}
+		}
+#endif
+		return ret;
+	}
+
+#ifndef TORRENT_DISABLE_POOL_ALLOCATOR
+	char* disk_buffer_pool::allocate_blocks(int num_blocks)
+	{
+		if (num_blocks > m_blocks_per_region) return 0;
+
+		for (std::set<char*>::iterator i = m_partial_regions.begin()
+			, end(m_partial_regions.end()); i != end; ++i)
+		{
+			region& r = m_regions[*i];
+			if (m_blocks_per_region - r.num_used < num_blocks) continue;
+
+			int run = 0;
+			for (int b = 0; b < m_blocks_per_region; ++b)
+			{
+				if (r.used.get_bit(b))
+				{
+					run = 0;
+					continue;
+				}
+				if (++run < num_blocks) continue;
+
+				char* base = *i;
+				int first = b - num_blocks + 1;
+				for (int k = first; k <= b; ++k) r.used.set_bit(k);
+				r.num_used += num_blocks;
+				if (r.num_used == m_blocks_per_region) m_partial_regions.erase(i);
+				return base + first * m_block_size;
+			}
+		}
+
+		char* base = add_region();
+		if (base == 0) return 0;
+		region& r = m_regions[base];
+		for (int k = 0; k < num_blocks; ++k) r.used.set_bit(k);
+		r.num_used = num_blocks;
+		if (r.num_used == m_blocks_per_region) m_partial_regions.erase(base);
+		return base;
+	}
+
+	void disk_buffer_pool::free_block(char* buf)
+	{
+		region_map_t::iterator i = m_regions.upper_bound(buf);
+		TORRENT_ASSERT(i != m_regions.begin());
+		--i;
+		region& r = i->second;
+		int block = (buf - i->first) / m_block_size;
+		TORRENT_ASSERT(block >= 0 && block < m_blocks_per_region);
+		TORRENT_ASSERT(r.used.get_bit(block));
+		r.used.clear_bit(block);
+		if (r.num_used == m_blocks_per_region) m_partial_regions.insert(i->first);
+		--r.num_used;
+		// empty regions are kept until release_memory(), the
+		// same way the cache kept its memory before
+	}
+
+	char* disk_buffer_pool::add_region()
+	{
+		bool large_pages = m_settings.disk_cache_large_pages;
+		char* base = large_page_allocator::malloc(m_blocks_per_region * m_block_size, large_pages);
+		if (base == 0) return 0;
+		if (m_settings.disk_cache_large_pages && !large_pages) ++m_large_page_failures;
+
+		region& r = m_regions[base];
+		r.large_pages = large_pages;
+		r.used.resize(m_blocks_per_region, false);
+		m_partial_regions.insert(base);
+		return base;
+	}
+#endif
 }
 
@@ -63,6 +63,10 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <linux/unistd.h>
 #endif
 
+#ifndef TORRENT_WINDOWS
+#include <unistd.h> // for sysconf
+#endif
+
 namespace libtorrent
 {
 	bool should_cancel_on_abort(disk_io_job const& j);
@@ -83,10 +87,18 @@ namespace libtorrent
 		, m_last_stats_flip(time_now())
 		, m_physical_ram(0)
 		, m_exceeded_write_queue(false)
+		, m_read_cache_limit(m_settings.cache_size)
+		, m_cache_expiry(m_settings.cache_expiry)
+		, m_write_queue_limit(m_settings.max_queued_disk_bytes)
+		, m_write_queue_hit_limit(false)
+		, m_last_cache_adjust(time_now())
+		, m_average_write_time(-1)
 		, m_ios(ios)
 		, m_queue_callback(queue_callback)
 		, m_work(io_service::work(m_ios))
 		, m_file_pool(fp)
+		, m_abort_check(false)
+		, m_check_buffer_bytes(0)
 		, m_disk_io_thread(boost::bind(&disk_io_thread::thread_fun, this))
 	{
 		// don't do anything in here. Essentially all members
@@ -113,11 +125,115 @@ namespace libtorrent
 	void disk_io_thread::join()
 	{
 		m_disk_io_thread.join();
+
+		// the disk thread won't wait for any more check batches,
+		// stop the check threads
+		mutex::scoped_lock cl(m_check_mutex);
+		m_abort_check = true;
+		m_check_queue.clear();
+		m_check_cond.signal_all(cl);
+		cl.unlock();
+		for (std::vector<boost::shared_ptr<thread> >::iterator i = m_check_threads.begin()
+			, end(m_check_threads.end()); i != end; ++i)
+			(*i)->join();
+		m_check_threads.clear();
+
 		mutex::scoped_lock l(m_queue_mutex);
 		TORRENT_ASSERT(m_abort == true);
 		m_jobs.clear();
 	}
 
+	int disk_io_thread::num_check_threads() const
+	{
+		int ret = m_settings.file_check_threads;
+		if (ret > 0) return ret;
+
+		// default to one thread per core
+		return hardware_concurrency();
+	}
+
+	size_type disk_io_thread::check_buffer_limit() const
+	{
+		// the cache size may still be set to automatic if we
+		// haven't received the settings yet
+		int cache_size = m_settings.cache_size;
+		if (cache_size < 0) cache_size = 1024;
+
+		// let the checks take half the cache, but always allow one
+		// batch, or the read-ahead wouldn't work at all
+		return (std::max)(size_type(cache_size) * m_block_size / 2
+			, size_type(m_settings.file_check_read_ahead));
+	}
+
+	size_type disk_io_thread::check_buffer_left() const
+	{
+		mutex::scoped_lock l(m_check_mutex);
+		return check_buffer_limit() - m_check_buffer_bytes;
+	}
+
+	void disk_io_thread::add_check_batch(boost::shared_ptr<check_batch> const& b)
+	{
+		// if the number of threads is lowered, the extra ones are
+		// just left idle
+		int num_threads = num_check_threads();
+		while (int(m_check_threads.size()) < num_threads)
+		{
+			m_check_threads.push_back(boost::shared_ptr<thread>(
+				new thread(boost::bind(&disk_io_thread::check_thread_fun, this))));
+		}
+
+		mutex::scoped_lock l(m_check_mutex);
+		TORRENT_ASSERT(!b->done);
+		m_check_buffer_bytes += size_type(b->num_slots) * b->piece_length;
+		m_check_queue.push_back(b);
+		m_check_cond.signal_all(l);
+	}
+
+	void disk_io_thread::wait_for_check_batch(check_batch const& b)
+	{
+		mutex::scoped_lock l(m_check_mutex);
+		while (!b.done) m_check_done.wait(l);
+	}
+
+	void disk_io_thread::cancel_check_batches(std::deque<boost::shared_ptr<check_batch> > const& batches)
+	{
+		mutex::scoped_lock l(m_check_mutex);
+		for (std::deque<boost::shared_ptr<check_batch> >::const_iterator i = batches.begin()
+			, end(batches.end()); i != end; ++i)
+		{
+			std::deque<boost::shared_ptr<check_batch> >::iterator j
+				= std::find(m_check_queue.begin(), m_check_queue.end(), *i);
+			if (j == m_check_queue.end()) continue;
+			m_check_queue.erase(j);
+			m_check_buffer_bytes -= size_type((*i)->num_slots) * (*i)->piece_length;
+			(*i)->buffer.reset();
+			(*i)->done = true;
+		}
+	}
+
+	void disk_io_thread::check_thread_fun()
+	{
+		mutex::scoped_lock l(m_check_mutex);
+		for (;;)
+		{
+			while (m_check_queue.empty() && !m_abort_check)
+				m_check_cond.wait(l);
+			if (m_abort_check) return;
+
+			boost::shared_ptr<check_batch> b = m_check_queue.front();
+			m_check_queue.pop_front();
+			l.unlock();
+
+			hash_check_batch(*b);
+
+			l.lock();
+			m_check_buffer_bytes -= size_type(b->num_slots) * b->piece_length;
+			TORRENT_ASSERT(m_check_buffer_bytes >= 0);
+			b->done = true;
+			m_check_done.signal_all(l);
+		}
+	}
+
 	bool disk_io_thread::can_write() const
 	{
 		mutex::scoped_lock l(m_queue_mutex);
@@ -137,6 +253,88 @@ namespace libtorrent
 		m_last_stats_flip = now;
 	}
 
+	void disk_io_thread::adjust_cache(ptime now)
+	{
+		int elapsed = total_milliseconds(now - m_last_cache_adjust);
+		if (elapsed <= 0) return;
+		m_last_cache_adjust = now;
+
+		mutex::scoped_lock l(m_piece_mutex);
+
+		cache_status const& prev = m_last_adjust_stats;
+		cache_status const& cur = m_cache_stats;
+		size_type reads = cur.blocks_read - prev.blocks_read;
+		size_type hits = cur.blocks_read_hit - prev.blocks_read_hit;
+		int read_back = cur.total_read_back - prev.total_read_back;
+		size_type writes = cur.writes - prev.writes;
+		// the fraction of the time the disk thread spent on jobs
+		float busy = float(boost::uint32_t(cur.cumulative_job_time
+			- prev.cumulative_job_time)) / elapsed;
+		int write_time = writes > 0 ? int(size_type(boost::uint32_t(cur.cumulative_write_time
+			- prev.cumulative_write_time)) * 1000 / writes) : -1;
+		m_last_adjust_stats = m_cache_stats;
+
+		// blocks read back to be hashed were flushed before their
+		// piece was complete, so the write cache needs the room.
+		// Otherwise the read cache grows or shrinks by how often
+		// it's hit
+		int cache_size = m_settings.cache_size;
+		int step = (std::max)(cache_size / 16, 1);
+		if (read_back > 0) m_read_cache_limit -= step;
+		else if (reads >= 64 && hits * 5 < reads) m_read_cache_limit -= step;
+		else if (reads >= 64 && hits * 2 > reads) m_read_cache_limit += step;
+		m_read_cache_limit = (std::min)(m_read_cache_limit, cache_size);
+		m_read_cache_limit = (std::max)(m_read_cache_limit, cache_size / 8);
+
+		mutex::scoped_lock jl(m_queue_mutex);
+		int queue_length = m_jobs.size() + m_sorted_read_jobs.size();
+
+		// a write queue that fills up while the disk thread has time to
+		// spare is what holds downloads back. If the disk is saturated,
+		// or writes take much longer than they used to, a longer queue
+		// only adds latency and makes the download rate burstier
+		int base = m_settings.max_queued_disk_bytes;
+		if (base > 0)
+		{
+			bool saturated = busy > 0.9f && queue_length > 0;
+			bool slower = write_time >= 0 && m_average_write_time > 0
+				&& write_time > m_average_write_time * 2;
+			size_type limit = m_write_queue_limit;
+			if (saturated || slower) limit = limit * 3 / 4;
+			else if (m_write_queue_hit_limit) limit = limit * 3 / 2;
+			limit = (std::min)(limit, (std::min)(size_type(base) * 4, size_type(INT_MAX)));
+			m_write_queue_limit = int((std::max)(limit, size_type((std::max)(base / 4, 1))));
+		}
+		m_write_queue_hit_limit = false;
+		jl.unlock();
+
+		if (write_time >= 0)
+		{
+			m_average_write_time = m_average_write_time < 0 ? write_time
+				: (m_average_write_time * 3 + write_time) / 4;
+		}
+
+		// while the disk has time to spare, idle write blocks are
+		// flushed sooner, so they don't add to the next burst
+		int expiry = m_settings.cache_expiry;
+		if (queue_length == 0 && busy < 0.5f)
+			m_cache_expiry = (std::max)(m_cache_expiry / 2, (std::max)(expiry / 4, 1));
+		else
+			m_cache_expiry = (std::min)(m_cache_expiry * 2, expiry);
+	}
+
+	void disk_io_thread::reset_cache_limits()
+	{
+		mutex::scoped_lock l(m_piece_mutex);
+		m_read_cache_limit = m_settings.cache_size;
+		m_cache_expiry = m_settings.cache_expiry;
+		m_last_adjust_stats = m_cache_stats;
+		m_average_write_time = -1;
+
+		mutex::scoped_lock jl(m_queue_mutex);
+		m_write_queue_limit = m_settings.max_queued_disk_bytes;
+	}
+
 	void disk_io_thread::get_cache_info(sha1_hash const& ih, std::vector<cached_piece_info>& ret) const
 	{
 		mutex::scoped_lock l(m_piece_mutex);
@@ -176,6 +374,12 @@ namespace libtorrent
 		}
 	}
 	
+	session_metrics disk_io_thread::metrics() const
+	{
+		mutex::scoped_lock l(m_piece_mutex);
+		return m_metrics;
+	}
+
 	cache_status disk_io_thread::status() const
 	{
 		mutex::scoped_lock l(m_piece_mutex);
@@ -186,6 +390,10 @@ namespace libtorrent
 
 		ret.job_queue_length = m_jobs.size() + m_sorted_read_jobs.size();
 		ret.read_queue_size = m_sorted_read_jobs.size();
+		ret.read_cache_limit = m_read_cache_limit;
+		ret.cache_expiry = m_cache_expiry;
+		ret.write_queue_limit = m_write_queue_limit;
+		ret.buffer_pool = pool_status();
 
 		return ret;
 	}
@@ -254,7 +462,7 @@ namespace libtorrent
 		// flush write cache
 		cache_lru_index_t& widx = m_pieces.get<1>();
 		cache_lru_index_t::iterator i = widx.begin();
-		time_duration cut_off = seconds(m_settings.cache_expiry);
+		time_duration cut_off = seconds(m_cache_expiry);
 		while (i != widx.end() && now - i->expire > cut_off)
 		{
 			TORRENT_ASSERT(i->storage);
@@ -750,8 +958,38 @@ namespace libtorrent
 
 		int ret = 0;
 
+		// if none of the blocks are in the cache yet, try to put them
+		// back to back. Then they're read with a single call, straight
+		// into the cache, without the copy coalesce_reads needs
+		char* run = 0;
+		int run_blocks = (std::min)(blocks_in_piece - start_block, num_blocks);
+		if (run_blocks > 1
+			&& ((options & ignore_cache_size)
+				|| in_use() + run_blocks <= m_settings.cache_size))
+		{
+			bool any_cached = false;
+			for (int i = start_block; i < start_block + run_blocks; ++i)
+				if (p.blocks[i].buf) { any_cached = true; break; }
+
+			if (!any_cached) run = allocate_buffers(run_blocks, "read cache");
+		}
+
+		if (run)
+		{
+			for (int i = start_block; i < start_block + run_blocks; ++i)
+				p.blocks[i].buf = run + (i - start_block) * m_block_size;
+			p.num_blocks += run_blocks;
+			m_cache_stats.cache_size += run_blocks;
+			m_cache_stats.read_cache_size += run_blocks;
+			end_block += run_blocks;
+			num_read += run_blocks;
+			iov[0].iov_base = run;
+			iov[0].iov_len = (std::min)(run_blocks * m_block_size, piece_size - piece_offset);
+			iov_counter = 1;
+		}
+
 		boost::scoped_array<char> buf;
-		for (int i = start_block; i < blocks_in_piece
+		for (int i = start_block; run == 0 && i < blocks_in_piece
 			&& ((options & ignore_cache_size)
 				|| in_use() < m_settings.cache_size); ++i)
 		{
@@ -805,7 +1043,7 @@ namespace libtorrent
 		TORRENT_ASSERT(buffer_size <= piece_size);
 		TORRENT_ASSERT(buffer_size + start_block * m_block_size <= piece_size);
 
-		if (m_settings.coalesce_reads)
+		if (m_settings.coalesce_reads && run == 0)
 			buf.reset(new (std::nothrow) char[buffer_size]);
 
 		if (buf)
@@ -898,6 +1136,14 @@ namespace libtorrent
 				return -2;
 		}
 
+		if (m_cache_stats.read_cache_size + blocks_to_read > m_read_cache_limit)
+		{
+			int clear = m_cache_stats.read_cache_size + blocks_to_read - m_read_cache_limit;
+			if (flush_cache_blocks(l, clear, ignore_t(j.piece, j.storage.get())
+				, dont_flush_write_blocks) < clear)
+				return -2;
+		}
+
 		cached_piece_entry p;
 		p.piece = j.piece;
 		p.storage = j.storage;
@@ -1193,6 +1439,14 @@ namespace libtorrent
 					return -2;
 			}
 
+			if (m_cache_stats.read_cache_size + blocks_to_read > m_read_cache_limit)
+			{
+				int clear = m_cache_stats.read_cache_size + blocks_to_read - m_read_cache_limit;
+				if (flush_cache_blocks(l, clear, ignore_t(p.piece, p.storage.get())
+					, dont_flush_write_blocks) < clear)
+					return -2;
+			}
+
 			int ret = read_into_piece(p, block, 0, blocks_to_read, l);
 			hit = false;
 			if (ret < 0) return ret;
@@ -1319,9 +1573,12 @@ namespace libtorrent
 		if (j.action == disk_io_job::write)
 		{
 			m_queue_buffer_size += j.buffer_size;
-			if (m_queue_buffer_size >= m_settings.max_queued_disk_bytes
+			if (m_queue_buffer_size >= m_write_queue_limit
 				&& m_settings.max_queued_disk_bytes > 0)
+			{
 				m_exceeded_write_queue = true;
+				m_write_queue_hit_limit = true;
+			}
 		}
 /*
 		else if (j.action == disk_io_job::read)
@@ -1441,6 +1698,28 @@ namespace libtorrent
 		return (action_flags[j.action] & buffer_operation) ? true : false;
 	}
 
+	// the session_metrics histogram the latency of each kind of job goes into
+	static const boost::uint8_t job_latency_histogram[] =
+	{
+		session_metrics::disk_read_latency // read
+		, session_metrics::disk_write_latency // write
+		, session_metrics::disk_hash_latency // hash
+		, session_metrics::disk_other_latency // move_storage
+		, session_metrics::disk_other_latency // release_files
+		, session_metrics::disk_other_latency // delete_files
+		, session_metrics::disk_other_latency // check_fastresume
+		, session_metrics::disk_other_latency // check_files
+		, session_metrics::disk_other_latency // save_resume_data
+		, session_metrics::disk_other_latency // rename_file
+		, session_metrics::disk_other_latency // abort_thread
+		, session_metrics::disk_other_latency // clear_read_cache
+		, session_metrics::disk_other_latency // abort_torrent
+		, session_metrics::disk_other_latency // update_settings
+		, session_metrics::disk_read_latency // read_and_hash
+		, session_metrics::disk_read_latency // cache_piece
+		, session_metrics::disk_other_latency // finalize_file
+	};
+
 	void disk_io_thread::thread_fun()
 	{
 #ifdef TORRENT_DISK_STATS
@@ -1602,8 +1881,8 @@ namespace libtorrent
 					if (m_exceeded_write_queue)
 					{
 						int low_watermark = m_settings.max_queued_disk_bytes_low_watermark == 0
-							|| m_settings.max_queued_disk_bytes_low_watermark >= m_settings.max_queued_disk_bytes
-							? size_type(m_settings.max_queued_disk_bytes) * 7 / 8
+							|| m_settings.max_queued_disk_bytes_low_watermark >= m_write_queue_limit
+							? size_type(m_write_queue_limit) * 7 / 8
 							: m_settings.max_queued_disk_bytes_low_watermark;
 
 						if (m_queue_buffer_size < low_watermark
@@ -1731,6 +2010,10 @@ namespace libtorrent
 			disk_buffer_holder holder(*this
 				, operation_has_buffer(j) ? j.buffer : 0);
 
+			if (m_settings.adaptive_disk_cache
+				&& now >= m_last_cache_adjust + seconds(1))
+				adjust_cache(now);
+
 			flush_expired_pieces();
 
 			int ret = 0;
@@ -1795,6 +2078,7 @@ namespace libtorrent
 						else
 							m_settings.cache_size = (int)(m_physical_ram / 8 / m_block_size);
 					}
+					reset_cache_limits();
 					break;
 				}
 				case disk_io_job::abort_torrent:
@@ -2230,6 +2514,7 @@ namespace libtorrent
 
 					ret = (j.storage->info()->hash_for_piece(j.piece) == h)?0:-2;
 					if (ret == -2) j.storage->mark_failed(j.piece);
+					j.storage->finish_block_hashes(j.piece, ret == 0);
 
 					ptime done = time_now_hires();
 					m_hash_time.add_sample(total_microseconds(done - hash_start));
@@ -2462,6 +2747,15 @@ namespace libtorrent
 			m_job_time.add_sample(total_microseconds(done - operation_start));
 			m_cache_stats.cumulative_job_time += total_milliseconds(done - operation_start);
 
+			if (m_settings.collect_metrics)
+			{
+				TORRENT_ASSERT(j.action >= 0 && j.action < int(sizeof(job_latency_histogram)));
+				mutex::scoped_lock l(m_piece_mutex);
+				m_metrics.sample(job_latency_histogram[j.action]
+					, total_microseconds(done - j.start_time));
+				if (j.error) m_metrics.inc(session_metrics::disk_job_errors);
+			}
+
 //			if (!j.callback) std::cerr << "DISK THREAD: no callback specified" << std::endl;
 //			else std::cerr << "DISK THREAD: invoking callback" << std::endl;
 			TORRENT_TRY {
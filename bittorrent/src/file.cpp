@@ -197,6 +197,7 @@ namespace libtorrent
 		s->mtime = ret.st_mtime;
 		s->ctime = ret.st_ctime;
 		s->mode = ret.st_mode;
+		s->device = ret.st_dev;
 	}
 
 	void rename(std::string const& inf, std::string const& newf, error_code& ec)
@@ -32,6 +32,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include <boost/version.hpp>
 #include <boost/bind.hpp>
+#include <boost/functional/hash.hpp>
 #include "libtorrent/pch.hpp"
 #include "libtorrent/assert.hpp"
 #include "libtorrent/file_pool.hpp"
@@ -44,6 +45,7 @@ namespace libtorrent
 	file_pool::file_pool(int size)
 		: m_size(size)
 		, m_low_prio_io(true)
+		, m_num_open(0)
 #if TORRENT_CLOSE_MAY_BLOCK
 		, m_stop_thread(false)
 		, m_closer_thread(boost::bind(&file_pool::closer_thread_fun, this))
@@ -101,6 +103,20 @@ namespace libtorrent
 	}
 #endif
 
+	file_pool::shard& file_pool::shard_for(std::pair<void*, int> const& k)
+	{
+		return m_shards[boost::hash<std::pair<void*, int> >()(k) % num_shards];
+	}
+
+	void file_pool::close_file(lru_file_entry const& e)
+	{
+#if TORRENT_CLOSE_MAY_BLOCK
+		mutex::scoped_lock l(m_closer_mutex);
+		m_queued_for_close.push_back(e.file_ptr);
+		l.unlock();
+#endif
+	}
+
 	boost::intrusive_ptr<file> file_pool::open_file(void* st, std::string const& p
 		, file_storage::iterator fe, file_storage const& fs, int m, error_code& ec)
 	{
@@ -108,13 +124,20 @@ namespace libtorrent
 		TORRENT_ASSERT(is_complete(p));
 		TORRENT_ASSERT((m & file::rw_mask) == file::read_only
 			|| (m & file::rw_mask) == file::read_write);
-		mutex::scoped_lock l(m_mutex);
-		file_set::iterator i = m_files.find(std::make_pair(st, fs.file_index(*fe)));
-		if (i != m_files.end())
+		std::pair<void*, int> k(st, fs.file_index(*fe));
+		shard& sh = shard_for(k);
+		mutex::scoped_lock l(sh.m_mutex);
+		key_index_t& idx = sh.files.get<1>();
+		key_index_t::iterator i = idx.find(k);
+		if (i != idx.end())
 		{
-			lru_file_entry& e = i->second;
+			lru_file_entry const& e = *i;
 			e.last_use = time_now();
 
+			// move the file to the most recently used end of the list
+			lru_index_t& lru = sh.files.get<0>();
+			lru.relocate(lru.end(), sh.files.project<0>(i));
+
 			if (e.key != st && ((e.mode & file::rw_mask) != file::read_only
 				|| (m & file::rw_mask) != file::read_only))
 			{
@@ -140,19 +163,20 @@ namespace libtorrent
 				TORRENT_ASSERT(e.file_ptr->refcount() == 1);
 
 #if TORRENT_CLOSE_MAY_BLOCK
-				mutex::scoped_lock l(m_closer_mutex);
-				m_queued_for_close.push_back(e.file_ptr);
-				l.unlock();
+				close_file(e);
 				e.file_ptr = new file;
 #else
 				e.file_ptr->close();
 #endif
+				++sh.total_closes;
 				std::string full_path = combine_path(p, fs.file_path(*fe));
 				if (!e.file_ptr->open(full_path, m, ec))
 				{
-					m_files.erase(i);
+					idx.erase(i);
+					--m_num_open;
 					return boost::intrusive_ptr<file>();
 				}
+				++sh.total_opens;
 #ifdef TORRENT_WINDOWS
 // file prio is supported on vista and up
 #if _WIN32_WINNT >= 0x0600
@@ -173,13 +197,7 @@ namespace libtorrent
 			return e.file_ptr;
 		}
 		// the file is not in our cache
-		if ((int)m_files.size() >= m_size)
-		{
-			// the file cache is at its maximum size, close
-			// the least recently used (lru) file from it
-			remove_oldest();
-		}
-		lru_file_entry e;
+		lru_file_entry e(st, k.second);
 		e.file_ptr.reset(new (std::nothrow)file);
 		if (!e.file_ptr)
 		{
@@ -190,59 +208,92 @@ namespace libtorrent
 		if (!e.file_ptr->open(full_path, m, ec))
 			return boost::intrusive_ptr<file>();
 		e.mode = m;
-		e.key = st;
-		m_files.insert(std::make_pair(std::make_pair(st, fs.file_index(*fe)), e));
+		sh.files.push_back(e);
+		++sh.total_opens;
+		++m_num_open;
 		TORRENT_ASSERT(e.file_ptr->is_open());
+		l.unlock();
+
+		// if the file cache is above its maximum size, close
+		// the least recently used (lru) files from it. This is
+		// done without holding the shard lock, since evicting may
+		// need to lock any of the other shards
+		while (long(m_num_open) > m_size)
+		{
+			if (!remove_oldest()) break;
+		}
 		return e.file_ptr;
 	}
 
-	void file_pool::remove_oldest()
+	bool file_pool::remove_oldest()
 	{
-		file_set::iterator i = std::min_element(m_files.begin(), m_files.end()
-			, boost::bind(&lru_file_entry::last_use, boost::bind(&file_set::value_type::second, _1))
-				< boost::bind(&lru_file_entry::last_use, boost::bind(&file_set::value_type::second, _2)));
-		if (i == m_files.end()) return;
+		// the least recently used file of each shard is at the
+		// front of its list. Pick the oldest of those
+		int oldest = -1;
+		ptime oldest_use = max_time();
+		for (int n = 0; n < num_shards; ++n)
+		{
+			shard& sh = m_shards[n];
+			mutex::scoped_lock l(sh.m_mutex);
+			if (sh.files.empty()) continue;
+			ptime t = sh.files.get<0>().front().last_use;
+			if (oldest != -1 && t >= oldest_use) continue;
+			oldest = n;
+			oldest_use = t;
+		}
+		if (oldest == -1) return false;
 
-#if TORRENT_CLOSE_MAY_BLOCK
-		mutex::scoped_lock l(m_closer_mutex);
-		m_queued_for_close.push_back(i->second.file_ptr);
-		l.unlock();
-#endif
-		m_files.erase(i);
+		shard& sh = m_shards[oldest];
+		mutex::scoped_lock l(sh.m_mutex);
+		// another thread may have emptied this shard
+		// since we looked at it, in which case we're
+		// below the limit again anyway
+		if (sh.files.empty()) return true;
+
+		lru_index_t& lru = sh.files.get<0>();
+		close_file(lru.front());
+		lru.pop_front();
+		--m_num_open;
+		++sh.total_closes;
+		++sh.total_evictions;
+		return true;
 	}
 
 	void file_pool::release(void* st, int file_index)
 	{
-		mutex::scoped_lock l(m_mutex);
-		file_set::iterator i = m_files.find(std::make_pair(st, file_index));
-		if (i == m_files.end()) return;
-		
-#if TORRENT_CLOSE_MAY_BLOCK
-		mutex::scoped_lock l2(m_closer_mutex);
-		m_queued_for_close.push_back(i->second.file_ptr);
-		l2.unlock();
-#endif
-		m_files.erase(i);
+		std::pair<void*, int> k(st, file_index);
+		shard& sh = shard_for(k);
+		mutex::scoped_lock l(sh.m_mutex);
+		key_index_t& idx = sh.files.get<1>();
+		key_index_t::iterator i = idx.find(k);
+		if (i == idx.end()) return;
+
+		close_file(*i);
+		idx.erase(i);
+		--m_num_open;
+		++sh.total_closes;
 	}
 
 	// closes files belonging to the specified
 	// storage. If 0 is passed, all files are closed
 	void file_pool::release(void* st)
 	{
-		mutex::scoped_lock l(m_mutex);
-		if (st == 0)
+		for (int n = 0; n < num_shards; ++n)
 		{
-			m_files.clear();
-			return;
-		}
-
-		for (file_set::iterator i = m_files.begin();
-			i != m_files.end();)
-		{
-			if (i->second.key == st)
-				m_files.erase(i++);
-			else
-				++i;
+			shard& sh = m_shards[n];
+			mutex::scoped_lock l(sh.m_mutex);
+			lru_index_t& lru = sh.files.get<0>();
+			for (lru_index_t::iterator i = lru.begin(); i != lru.end();)
+			{
+				if (st == 0 || i->key == st)
+				{
+					i = lru.erase(i);
+					--m_num_open;
+					++sh.total_closes;
+				}
+				else
+					++i;
+			}
 		}
 	}
 
@@ -250,13 +301,30 @@ namespace libtorrent
 	{
 		TORRENT_ASSERT(size > 0);
 		if (size == m_size) return;
-		mutex::scoped_lock l(m_mutex);
 		m_size = size;
-		if (int(m_files.size()) <= m_size) return;
+		if (long(m_num_open) <= m_size) return;
 
 		// close the least recently used files
-		while (int(m_files.size()) > m_size)
-			remove_oldest();
+		while (long(m_num_open) > m_size)
+		{
+			if (!remove_oldest()) break;
+		}
+	}
+
+	void file_pool::get_status(file_pool_status& s) const
+	{
+		s.num_open = m_num_open;
+		s.total_opens = 0;
+		s.total_closes = 0;
+		s.total_evictions = 0;
+		for (int n = 0; n < num_shards; ++n)
+		{
+			shard const& sh = m_shards[n];
+			mutex::scoped_lock l(sh.m_mutex);
+			s.total_opens += sh.total_opens;
+			s.total_closes += sh.total_closes;
+			s.total_evictions += sh.total_evictions;
+		}
 	}
 
 }
@@ -0,0 +1,215 @@
+/*
+
+Copyright (c) 2012, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/pch.hpp"
+
+#ifndef TORRENT_DISABLE_GEO_IP
+
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+
+#ifdef WITH_SHIPPED_GEOIP_H
+#include "libtorrent/GeoIP.h"
+#else
+#include <GeoIP.h>
+#endif
+
+#include "libtorrent/geoip_table.hpp"
+
+namespace libtorrent
+{
+	namespace
+	{
+		// leaves of the country database tree hold the country id
+		// offset by this
+		enum { country_begin = 16776960 };
+
+		// flattens the binary tree of a GeoIP database, held in
+		// memory, into (range start, value) pairs, merging adjacent
+		// ranges with the same value
+		struct tree_walker
+		{
+			tree_walker(GeoIP const& gi, geoip_table::db_type t
+				, std::vector<std::pair<boost::uint32_t, int> >& r
+				, std::vector<std::pair<int, std::string> >& n)
+				: buf(gi.cache)
+				, size(boost::uint64_t(gi.size))
+				, record_length(gi.record_length)
+				, segment(gi.databaseSegments[0])
+				, type(t)
+				, nodes_left(gi.databaseSegments[0])
+				, ranges(r)
+				, names(n)
+			{}
+
+			boost::uint32_t read_record(boost::uint64_t offset) const
+			{
+				// records are little endian
+				boost::uint32_t ret = 0;
+				for (int i = record_length - 1; i >= 0; --i)
+					ret = (ret << 8) | buf[offset + i];
+				return ret;
+			}
+
+			// returns false if the tree is corrupt. depth is the bit
+			// the children of node branch on, as in _GeoIP_seek_record
+			bool walk(boost::uint32_t node, int depth, boost::uint32_t prefix)
+			{
+				// a well formed tree has no more nodes than the segment
+				// size. This bounds the walk if the file has loops in it
+				if (nodes_left-- == 0) return false;
+
+				boost::uint64_t offset = boost::uint64_t(node) * 2 * record_length;
+				if (offset + 2 * record_length > size) return false;
+
+				for (int side = 0; side < 2; ++side)
+				{
+					boost::uint32_t x = read_record(offset + side * record_length);
+					boost::uint32_t start = prefix | (boost::uint32_t(side) << depth);
+					if (x >= segment)
+					{
+						add_range(start, leaf_value(x));
+						continue;
+					}
+					if (depth == 0) return false;
+					if (!walk(x, depth - 1, start)) return false;
+				}
+				return true;
+			}
+
+			int leaf_value(boost::uint32_t x)
+			{
+				if (type == geoip_table::country_db)
+				{
+					x -= country_begin;
+					return x < 253 ? int(x) : 0;
+				}
+
+				// the leaf is an offset into the record section, where
+				// the name is stored as "AS<number> <organization>"
+				if (x == segment) return 0;
+				boost::uint64_t p = boost::uint64_t(x) + (2 * record_length - 1)
+					* boost::uint64_t(segment);
+				if (p >= size) return 0;
+				char const* name = (char const*)buf + p;
+				char const* end = (char const*)std::memchr(name, 0, size_t(size - p));
+				if (end == 0 || end - name < 3 || name[0] != 'A' || name[1] != 'S') return 0;
+
+				int as = std::atoi(name + 2);
+				if (as <= 0) return 0;
+				if (names.empty() || names.back().first != as)
+				{
+					char const* org = std::strchr(name, ' ');
+					names.push_back(std::make_pair(as
+						, std::string(org == 0 ? end : org + 1, end)));
+				}
+				return as;
+			}
+
+			void add_range(boost::uint32_t start, int value)
+			{
+				if (!ranges.empty() && ranges.back().second == value) return;
+				ranges.push_back(std::make_pair(start, value));
+			}
+
+			unsigned char const* buf;
+			boost::uint64_t size;
+			int record_length;
+			boost::uint32_t segment;
+			geoip_table::db_type type;
+			boost::uint32_t nodes_left;
+			std::vector<std::pair<boost::uint32_t, int> >& ranges;
+			std::vector<std::pair<int, std::string> >& names;
+		};
+
+		bool compare_first(std::pair<int, std::string> const& lhs
+			, std::pair<int, std::string> const& rhs)
+		{ return lhs.first < rhs.first; }
+
+		bool same_first(std::pair<int, std::string> const& lhs
+			, std::pair<int, std::string> const& rhs)
+		{ return lhs.first == rhs.first; }
+	}
+
+	bool geoip_table::load(std::string const& file, db_type t)
+	{
+		// read the whole file into memory once, the tree is walked
+		// from there
+		GeoIP* gi = GeoIP_open(file.c_str(), GEOIP_MEMORY_CACHE);
+		if (gi == 0) return false;
+
+		char const expected = t == country_db
+			? char(GEOIP_COUNTRY_EDITION) : char(GEOIP_ASNUM_EDITION);
+		if (gi->cache == 0 || gi->databaseSegments == 0
+			|| gi->databaseType != expected
+			|| gi->record_length < 1 || gi->record_length > 4)
+		{
+			GeoIP_delete(gi);
+			return false;
+		}
+
+		std::vector<std::pair<boost::uint32_t, int> > ranges;
+		std::vector<std::pair<int, std::string> > names;
+		tree_walker w(*gi, t, ranges, names);
+		bool ok = w.walk(0, 31, 0);
+		GeoIP_delete(gi);
+		if (!ok || ranges.empty()) return false;
+
+		std::stable_sort(names.begin(), names.end(), &compare_first);
+		names.erase(std::unique(names.begin(), names.end(), &same_first), names.end());
+
+		m_type = t;
+		m_ranges.build(ranges);
+		m_as_names.swap(names);
+		return true;
+	}
+
+	char const* geoip_table::country_for_ip(boost::uint32_t ip) const
+	{
+		TORRENT_ASSERT(m_type == country_db);
+		int id = m_ranges.access(ip);
+		return id > 0 ? GeoIP_country_code[id] : 0;
+	}
+
+	char const* geoip_table::as_name(int as) const
+	{
+		std::vector<std::pair<int, std::string> >::const_iterator i
+			= std::lower_bound(m_as_names.begin(), m_as_names.end()
+				, std::make_pair(as, std::string()), &compare_first);
+		if (i == m_as_names.end() || i->first != as) return 0;
+		return i->second.c_str();
+	}
+}
+
+#endif // TORRENT_DISABLE_GEO_IP
+
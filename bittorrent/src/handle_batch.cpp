@@ -0,0 +1,129 @@
+/*
+
+Copyright (c) 2012, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/pch.hpp"
+
+#include <boost/bind.hpp>
+
+#include "libtorrent/handle_batch.hpp"
+#include "libtorrent/torrent.hpp"
+#include "libtorrent/aux_/session_impl.hpp"
+
+namespace libtorrent
+{
+	// defined in session.cpp
+	void fun_wrap(bool* done, condition* e, mutex* m, boost::function<void(void)> f);
+
+	namespace
+	{
+		void get_status(torrent& t, torrent_status* ret, boost::uint32_t flags)
+		{ t.status(ret, flags); }
+
+		void get_peers(torrent& t, PeerInfos* ret)
+		{ t.get_peer_info(*ret); }
+
+		void get_trackers(torrent& t, std::vector<announce_entry>* ret)
+		{ *ret = t.trackers(); }
+
+		void get_file_progress(torrent& t, std::vector<size_type>* ret, int flags)
+		{ t.file_progress(*ret, flags); }
+
+		void get_queue(torrent& t, std::vector<partial_piece_info>* ret)
+		{ t.get_download_queue(ret); }
+	}
+
+	void handle_batch::status(torrent_handle const& h, torrent_status& ret
+		, boost::uint32_t flags)
+	{
+		m_calls.push_back(call(h.m_torrent, boost::bind(&get_status, _1, &ret, flags)));
+	}
+
+	void handle_batch::get_peer_info(torrent_handle const& h, PeerInfos& ret)
+	{
+		m_calls.push_back(call(h.m_torrent, boost::bind(&get_peers, _1, &ret)));
+	}
+
+	void handle_batch::trackers(torrent_handle const& h, std::vector<announce_entry>& ret)
+	{
+		m_calls.push_back(call(h.m_torrent, boost::bind(&get_trackers, _1, &ret)));
+	}
+
+	void handle_batch::file_progress(torrent_handle const& h, std::vector<size_type>& ret
+		, int flags)
+	{
+		m_calls.push_back(call(h.m_torrent, boost::bind(&get_file_progress, _1, &ret, flags)));
+	}
+
+	void handle_batch::get_download_queue(torrent_handle const& h
+		, std::vector<partial_piece_info>& ret)
+	{
+		m_calls.push_back(call(h.m_torrent, boost::bind(&get_queue, _1, &ret)));
+	}
+
+	void handle_batch::run()
+	{
+		// all torrents live in the same session. Use the first
+		// one that's still around to find it
+		aux::session_impl* ses = 0;
+		for (std::vector<call>::iterator i = m_calls.begin()
+			, end(m_calls.end()); i != end; ++i)
+		{
+			boost::shared_ptr<torrent> t = i->t.lock();
+			if (!t) continue;
+			ses = &t->session();
+			break;
+		}
+
+		if (ses)
+		{
+			TORRENT_ASSERT(!ses->is_network_thread());
+			bool done = false;
+			mutex::scoped_lock l(ses->mut);
+			ses->m_io_service.post(boost::bind(&fun_wrap, &done, &ses->cond, &ses->mut
+				, boost::function<void(void)>(boost::bind(&handle_batch::execute, this))));
+			do { ses->cond.wait(l); } while(!done);
+		}
+
+		m_calls.clear();
+	}
+
+	void handle_batch::execute()
+	{
+		for (std::vector<call>::iterator i = m_calls.begin()
+			, end(m_calls.end()); i != end; ++i)
+		{
+			boost::shared_ptr<torrent> t = i->t.lock();
+			if (!t) continue;
+			i->f(*t);
+		}
+	}
+}
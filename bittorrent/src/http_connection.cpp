@@ -839,7 +839,20 @@ void http_connection::on_read(error_code const& e
 	}
 
 	if (int(m_recvbuffer.size()) == m_read_pos)
+	{
 		m_recvbuffer.resize((std::min)(m_read_pos + 2048, int(max_bottled_buffer)));
+
+		// the parser's header fields and body are offsets into the
+		// receive buffer, which may just have moved. Point it at the
+		// new one, so the eof and error paths can still use them
+		if (m_read_pos > 0 && (m_bottled || !m_parser.header_finished()))
+		{
+			libtorrent::buffer::const_interval rcv_buf(&m_recvbuffer[0]
+				, &m_recvbuffer[0] + m_read_pos);
+			bool error = false;
+			m_parser.incoming(rcv_buf, error);
+		}
+	}
 	if (m_read_pos == max_bottled_buffer)
 	{
 		callback(asio::error::eof);
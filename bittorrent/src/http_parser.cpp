@@ -35,6 +35,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <cctype>
 #include <algorithm>
 #include <stdlib.h>
+#include <cstring>
 
 #include "libtorrent/config.hpp"
 #include "libtorrent/http_parser.hpp"
@@ -43,6 +44,31 @@ POSSIBILITY OF SUCH DAMAGE.
 
 using namespace libtorrent;
 
+namespace
+{
+	// like read_until(), but returns the field as a range of the
+	// input rather than as a copy
+	std::pair<char const*, char const*> read_field(char const*& str
+		, char delim, char const* end)
+	{
+		TORRENT_ASSERT(str <= end);
+		char const* start = str;
+		while (str != end && *str != delim) ++str;
+		std::pair<char const*, char const*> ret(start, str);
+		// skip the delimiter as well
+		while (str != end && *str == delim) ++str;
+		return ret;
+	}
+
+	char const* known_header_names[] =
+	{
+		"content-length",
+		"content-range",
+		"location",
+		"transfer-encoding"
+	};
+}
+
 namespace libtorrent
 {
 
@@ -77,7 +103,82 @@ namespace libtorrent
 		, m_chunk_header_size(0)
 		, m_partial_chunk_header(0)
 		, m_flags(flags)
-	{}
+	{
+		string_ref empty = {0, 0};
+		m_method = empty;
+		m_path = empty;
+		m_protocol = empty;
+		m_server_message = empty;
+		std::fill(m_known_headers, m_known_headers + num_known_headers, -1);
+	}
+
+	bool http_parser::name_equal(string_ref const& name, char const* key) const
+	{
+		char const* n = m_recv_buffer.begin + name.start;
+		for (int i = 0; i < name.len; ++i, ++key)
+		{
+			if (*key == 0 || to_lower(n[i]) != to_lower(*key)) return false;
+		}
+		return *key == 0;
+	}
+
+	std::string http_parser::header(char const* key) const
+	{
+		for (int k = 0; k < num_known_headers; ++k)
+		{
+			if (strcmp(key, known_header_names[k]) != 0) continue;
+			int i = m_known_headers[k];
+			if (i < 0) return std::string();
+			return get_string(m_header_fields[i].value);
+		}
+
+		for (std::vector<header_field>::const_iterator i = m_header_fields.begin()
+			, end(m_header_fields.end()); i != end; ++i)
+		{
+			if (name_equal(i->name, key)) return get_string(i->value);
+		}
+		return std::string();
+	}
+
+	std::string http_parser::method() const
+	{
+		std::string ret = get_string(m_method);
+		std::transform(ret.begin(), ret.end(), ret.begin(), &to_lower);
+		return ret;
+	}
+
+	std::multimap<std::string, std::string> http_parser::headers() const
+	{
+		std::multimap<std::string, std::string> ret;
+		for (std::vector<header_field>::const_iterator i = m_header_fields.begin()
+			, end(m_header_fields.end()); i != end; ++i)
+		{
+			std::string name = get_string(i->name);
+			std::transform(name.begin(), name.end(), name.begin(), &to_lower);
+			ret.insert(std::make_pair(name, get_string(i->value)));
+		}
+		return ret;
+	}
+
+	int http_parser::add_header(char const* name, char const* name_end
+		, char const* value, char const* value_end)
+	{
+		header_field f;
+		f.name = make_ref(name, name_end);
+		f.value = make_ref(value, value_end);
+		m_header_fields.push_back(f);
+
+		for (int k = 0; k < num_known_headers; ++k)
+		{
+			if (!name_equal(f.name, known_header_names[k])) continue;
+			// header() returns the first one, like the multimap this
+			// replaced did
+			if (m_known_headers[k] < 0)
+				m_known_headers[k] = int(m_header_fields.size()) - 1;
+			return k;
+		}
+		return -1;
+	}
 
 	boost::tuple<int, int> http_parser::incoming(
 		buffer::const_interval recv_buffer, bool& error)
@@ -86,9 +187,12 @@ namespace libtorrent
 		boost::tuple<int, int> ret(0, 0);
 		int start_pos = m_recv_buffer.left();
 
+		// the header fields refer to the buffer, so pick up
+		// where it lives now even if nothing new was received
+		m_recv_buffer = recv_buffer;
+
 		// early exit if there's nothing new in the receive buffer
 		if (start_pos == recv_buffer.left()) return ret;
-		m_recv_buffer = recv_buffer;
 
 		if (m_state == error_state)
 		{
@@ -128,21 +232,26 @@ restart_response:
 			boost::get<1>(ret) += newline - (m_recv_buffer.begin + start_pos);
 			pos = newline;
 
-			m_protocol = read_until(line, ' ', line_end);
-			if (m_protocol.substr(0, 5) == "HTTP/")
+			std::pair<char const*, char const*> f = read_field(line, ' ', line_end);
+			if (f.second - f.first >= 5 && memcmp(f.first, "HTTP/", 5) == 0)
 			{
-				m_status_code = atoi(read_until(line, ' ', line_end).c_str());
-				m_server_message = read_until(line, '\r', line_end);
+				m_protocol = make_ref(f.first, f.second);
+				// the status code is followed by a space or the end of
+				// the line, either of which stops atoi()
+				f = read_field(line, ' ', line_end);
+				m_status_code = atoi(f.first);
+				f = read_field(line, '\r', line_end);
+				m_server_message = make_ref(f.first, f.second);
 			}
 			else
 			{
-				m_method = m_protocol;
-				std::transform(m_method.begin(), m_method.end(), m_method.begin(), &to_lower);
+				m_method = make_ref(f.first, f.second);
 				// the content length is assumed to be 0 for requests
 				m_content_length = 0;
-				m_protocol.clear();
-				m_path = read_until(line, ' ', line_end);
-				m_protocol = read_until(line, ' ', line_end);
+				f = read_field(line, ' ', line_end);
+				m_path = make_ref(f.first, f.second);
+				f = read_field(line, ' ', line_end);
+				m_protocol = make_ref(f.first, f.second);
 				m_status_code = 0;
 			}
 			m_state = read_header;
@@ -153,21 +262,20 @@ restart_response:
 		{
 			TORRENT_ASSERT(!m_finished);
 			char const* newline = std::find(pos, recv_buffer.end, '\n');
-			std::string line;
 
 			while (newline != recv_buffer.end && m_state == read_header)
 			{
 				// if the LF character is preceeded by a CR
-				// charachter, don't copy it into the line string.
+				// charachter, it's not part of the line
+				char const* line = pos;
 				char const* line_end = newline;
 				if (pos != line_end && *(line_end - 1) == '\r') --line_end;
-				line.assign(pos, line_end);
 				++newline;
 				m_recv_pos += newline - pos;
 				pos = newline;
 
-				std::string::size_type separator = line.find(':');
-				if (separator == std::string::npos)
+				char const* separator = std::find(line, line_end, ':');
+				if (separator == line_end)
 				{
 					if (m_status_code == 100)
 					{
@@ -189,24 +297,23 @@ restart_response:
 					break;
 				}
 
-				std::string name = line.substr(0, separator);
-				std::transform(name.begin(), name.end(), name.begin(), &to_lower);
-				++separator;
+				char const* value = separator + 1;
 				// skip whitespace
-				while (separator < line.size()
-					&& (line[separator] == ' ' || line[separator] == '\t'))
-					++separator;
-				std::string value = line.substr(separator, std::string::npos);
-				m_header.insert(std::make_pair(name, value));
-
-				if (name == "content-length")
+				while (value < line_end && (*value == ' ' || *value == '\t'))
+					++value;
+				int known = add_header(line, separator, value, line_end);
+
+				// the value is followed by the line terminator, which stops
+				// strtoll() and string_begins_no_case(). If a header is
+				// repeated, the last one wins here
+				if (known == content_length_header)
 				{
-					m_content_length = strtoll(value.c_str(), 0, 10);
+					m_content_length = strtoll(value, 0, 10);
 				}
-				else if (name == "content-range")
+				else if (known == content_range_header)
 				{
 					bool success = true;
-					char const* ptr = value.c_str();
+					char const* ptr = value;
 
 					// apparently some web servers do not send the "bytes"
 					// in their content-range. Don't treat it as an error
@@ -233,9 +340,9 @@ restart_response:
 					// the http range is inclusive
 					m_content_length = m_range_end - m_range_start + 1;
 				}
-				else if (name == "transfer-encoding")
+				else if (known == transfer_encoding_header)
 				{
-					m_chunked_encoding = string_begins_no_case("chunked", value.c_str());
+					m_chunked_encoding = string_begins_no_case("chunked", value);
 				}
 
 				TORRENT_ASSERT(m_recv_pos <= recv_buffer.left());
@@ -370,24 +477,29 @@ restart_response:
 			return true;
 		}
 
-		// this is the terminator of the stream. Also read headers
-		std::map<std::string, std::string> tail_headers;
+		// this is the terminator of the stream. Also read headers.
+		// They're added to ours as they're parsed, and dropped again if
+		// the trailer turns out to be incomplete. Since they're kept as
+		// offsets into the receive buffer, we can only hold on to them
+		// if buf is part of it
+		bool const keep_headers = buf.begin >= m_recv_buffer.begin
+			&& buf.end <= m_recv_buffer.end;
+		int const num_headers = int(m_header_fields.size());
 		pos = newline;
 		newline = std::find(pos, buf.end, '\n');
 
-		std::string line;
 		while (newline != buf.end)
 		{
 			// if the LF character is preceeded by a CR
-			// charachter, don't copy it into the line string.
+			// charachter, it's not part of the line
+			char const* line = pos;
 			char const* line_end = newline;
 			if (pos != line_end && *(line_end - 1) == '\r') --line_end;
-			line.assign(pos, line_end);
 			++newline;
 			pos = newline;
 
-			std::string::size_type separator = line.find(':');
-			if (separator == std::string::npos)
+			char const* separator = std::find(line, line_end, ':');
+			if (separator == line_end)
 			{
 				// this means we got a blank line,
 				// the header is finished and the body
@@ -396,29 +508,30 @@ restart_response:
 
 				// the newline alone is two bytes
 				TORRENT_ASSERT(newline - buf.begin > 2);
-
-				// we were successfull in parsing the headers.
-				// add them to the headers in the parser
-				for (std::map<std::string, std::string>::const_iterator i = tail_headers.begin();
-					i != tail_headers.end(); ++i)
-					m_header.insert(std::make_pair(i->first, i->second));
-
 				return true;
 			}
 
-			std::string name = line.substr(0, separator);
-			std::transform(name.begin(), name.end(), name.begin(), &to_lower);
-			++separator;
+			if (!keep_headers)
+			{
+				newline = std::find(pos, buf.end, '\n');
+				continue;
+			}
+
+			char const* value = separator + 1;
 			// skip whitespace
-			while (separator < line.size()
-				&& (line[separator] == ' ' || line[separator] == '\t'))
-				++separator;
-			std::string value = line.substr(separator, std::string::npos);
-			tail_headers.insert(std::make_pair(name, value));
-//			fprintf(stderr, "tail_header: %s: %s\n", name.c_str(), value.c_str());
+			while (value < line_end && (*value == ' ' || *value == '\t'))
+				++value;
+			add_header(line, separator, value, line_end);
 
 			newline = std::find(pos, buf.end, '\n');
 		}
+
+		// we didn't get the whole trailer, forget the part we did get
+		m_header_fields.resize(num_headers);
+		for (int k = 0; k < num_known_headers; ++k)
+		{
+			if (m_known_headers[k] >= num_headers) m_known_headers[k] = -1;
+		}
 		return false;
 	}
 
@@ -437,7 +550,11 @@ restart_response:
 	
 	void http_parser::reset()
 	{
-		m_method.clear();
+		string_ref empty = {0, 0};
+		m_method = empty;
+		m_path = empty;
+		m_protocol = empty;
+		m_server_message = empty;
 		m_recv_pos = 0;
 		m_body_start_pos = 0;
 		m_status_code = -1;
@@ -448,7 +565,9 @@ restart_response:
 		m_state = read_status;
 		m_recv_buffer.begin = 0;
 		m_recv_buffer.end = 0;
-		m_header.clear();
+		// keeps the capacity
+		m_header_fields.clear();
+		std::fill(m_known_headers, m_known_headers + num_known_headers, -1);
 		m_chunked_encoding = false;
 		m_chunked_ranges.clear();
 		m_cur_chunk_end = -1;
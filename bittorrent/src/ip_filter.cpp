@@ -34,35 +34,268 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "libtorrent/ip_filter.hpp"
 #include <boost/utility.hpp>
+#include <algorithm>
+#include <queue>
 
 
 namespace libtorrent
 {
+	namespace detail
+	{
+		template <class Key>
+		void flat_filter<Key>::build(std::vector<std::pair<Key, int> > const& ranges)
+		{
+			TORRENT_ASSERT(!ranges.empty());
+			TORRENT_ASSERT(ranges.front().first == zero<Key>());
+			m_keys.resize(ranges.size() + 1);
+			m_prev_access.resize(ranges.size() + 1);
+			m_last_access = ranges.back().second;
+			int pos = 0;
+			fill(ranges, pos, 1);
+			TORRENT_ASSERT(pos == int(ranges.size()));
+		}
+
+		// an in-order walk of the implicit tree visits the
+		// slots in sorted order
+		template <class Key>
+		void flat_filter<Key>::fill(std::vector<std::pair<Key, int> > const& ranges
+			, int& pos, boost::uint32_t k)
+		{
+			if (k >= m_keys.size()) return;
+			fill(ranges, pos, 2 * k);
+			m_keys[k] = ranges[pos].first;
+			m_prev_access[k] = pos == 0 ? 0 : ranges[pos - 1].second;
+			++pos;
+			fill(ranges, pos, 2 * k + 1);
+		}
+
+		template <class Key>
+		void flat_filter<Key>::ranges(std::vector<std::pair<Key, int> >& ret) const
+		{
+			ret.clear();
+			if (m_keys.size() == 1)
+			{
+				ret.push_back(std::make_pair(zero<Key>(), 0));
+				return;
+			}
+			ret.reserve(m_keys.size() - 1);
+			walk(ret, 1);
+			// every slot has the access of the range before it
+			for (int i = 0; i < int(ret.size()) - 1; ++i)
+				ret[i].second = ret[i + 1].second;
+			ret.back().second = m_last_access;
+		}
+
+		template <class Key>
+		void flat_filter<Key>::walk(std::vector<std::pair<Key, int> >& ret
+			, boost::uint32_t k) const
+		{
+			if (k >= m_keys.size()) return;
+			walk(ret, 2 * k);
+			ret.push_back(std::make_pair(m_keys[k], m_prev_access[k]));
+			walk(ret, 2 * k + 1);
+		}
+
+		// the IPv4 table is also used by geoip_table
+		template class flat_filter<boost::uint32_t>;
+	}
+
+	namespace
+	{
+		detail::uint128 to_uint128(address_v6::bytes_type const& b)
+		{
+			detail::uint128 ret = {0, 0};
+			for (int i = 0; i < 8; ++i) ret.hi = (ret.hi << 8) | b[i];
+			for (int i = 8; i < 16; ++i) ret.lo = (ret.lo << 8) | b[i];
+			return ret;
+		}
+
+		address_v6 to_address(detail::uint128 v)
+		{
+			address_v6::bytes_type b;
+			for (int i = 15; i >= 8; --i) { b[i] = v.lo & 0xff; v.lo >>= 8; }
+			for (int i = 7; i >= 0; --i) { b[i] = v.hi & 0xff; v.hi >>= 8; }
+			return address_v6(b);
+		}
+
+		// merges the ranges already in f with the new rules and builds
+		// a new filter in ret. This is a sweep over the start and end
+		// points of all the rules, keeping the rules covering the current
+		// point in a heap by their index, so the latest rule wins
+		template <class Key, class Rule>
+		void compile_filter(detail::flat_filter<Key> const& f
+			, std::vector<Rule> const& rules, detail::flat_filter<Key>& ret)
+		{
+			using namespace detail;
+
+			std::vector<std::pair<Key, int> > ranges;
+			f.ranges(ranges);
+
+			// the current ranges become the rules with the lowest
+			// priority. Unfiltered ranges don't need a rule
+			std::vector<Rule> all;
+			all.reserve(ranges.size() + rules.size());
+			for (int i = 0; i < int(ranges.size()); ++i)
+			{
+				if (ranges[i].second == 0) continue;
+				Rule r;
+				r.first = ranges[i].first;
+				r.last = i + 1 < int(ranges.size())
+					? minus_one(ranges[i + 1].first) : max_addr<Key>();
+				r.flags = ranges[i].second;
+				all.push_back(r);
+			}
+			all.insert(all.end(), rules.begin(), rules.end());
+
+			// positive values start rule n-1, negative ones end rule -n-1
+			std::vector<std::pair<Key, int> > events;
+			events.reserve(all.size() * 2);
+			for (int i = 0; i < int(all.size()); ++i)
+			{
+				events.push_back(std::make_pair(all[i].first, i + 1));
+				if (!(all[i].last == max_addr<Key>()))
+					events.push_back(std::make_pair(plus_one(all[i].last), -i - 1));
+			}
+			std::sort(events.begin(), events.end());
+
+			std::priority_queue<int> active;
+			std::vector<bool> ended(all.size(), false);
+
+			ranges.clear();
+			ranges.push_back(std::make_pair(zero<Key>(), 0));
+			for (int i = 0; i < int(events.size());)
+			{
+				Key const pos = events[i].first;
+				for (; i < int(events.size()) && events[i].first == pos; ++i)
+				{
+					int e = events[i].second;
+					if (e > 0) active.push(e - 1);
+					else ended[-e - 1] = true;
+				}
+				while (!active.empty() && ended[active.top()]) active.pop();
+				int access = active.empty() ? 0 : all[active.top()].flags;
+
+				if (ranges.back().second == access) continue;
+				if (ranges.back().first == pos)
+				{
+					ranges.back().second = access;
+					if (ranges.size() > 1 && ranges[ranges.size() - 2].second == access)
+						ranges.pop_back();
+				}
+				else
+				{
+					ranges.push_back(std::make_pair(pos, access));
+				}
+			}
+			ret.build(ranges);
+		}
+
+		template <class Key, class Addr>
+		void export_ranges(detail::flat_filter<Key> const& f
+			, std::vector<ip_range<Addr> >& ret)
+		{
+			std::vector<std::pair<Key, int> > ranges;
+			f.ranges(ranges);
+			ret.reserve(ranges.size());
+			for (int i = 0; i < int(ranges.size()); ++i)
+			{
+				ip_range<Addr> r;
+				r.first = Addr(ranges[i].first);
+				r.last = Addr(i + 1 < int(ranges.size())
+					? detail::minus_one(ranges[i + 1].first) : detail::max_addr<Key>());
+				r.flags = ranges[i].second;
+				ret.push_back(r);
+			}
+		}
+
+#if TORRENT_USE_IPV6
+		void export_ranges(detail::flat_filter<detail::uint128> const& f
+			, std::vector<ip_range<address_v6> >& ret)
+		{
+			std::vector<std::pair<detail::uint128, int> > ranges;
+			f.ranges(ranges);
+			ret.reserve(ranges.size());
+			for (int i = 0; i < int(ranges.size()); ++i)
+			{
+				ip_range<address_v6> r;
+				r.first = to_address(ranges[i].first);
+				r.last = to_address(i + 1 < int(ranges.size())
+					? detail::minus_one(ranges[i + 1].first) : detail::max_addr<detail::uint128>());
+				r.flags = ranges[i].second;
+				ret.push_back(r);
+			}
+		}
+#endif
+	}
+
 	void ip_filter::add_rule(address first, address last, int flags)
 	{
 		if (first.is_v4())
 		{
 			TORRENT_ASSERT(last.is_v4());
-			m_filter4.add_rule(first.to_v4().to_bytes(), last.to_v4().to_bytes(), flags);
+			rule<boost::uint32_t> r;
+			r.first = first.to_v4().to_ulong();
+			r.last = last.to_v4().to_ulong();
+			r.flags = flags;
+			TORRENT_ASSERT(r.first <= r.last);
+			m_rules4.push_back(r);
 		}
 #if TORRENT_USE_IPV6
 		else if (first.is_v6())
 		{
 			TORRENT_ASSERT(last.is_v6());
-			m_filter6.add_rule(first.to_v6().to_bytes(), last.to_v6().to_bytes(), flags);
+			rule<detail::uint128> r;
+			r.first = to_uint128(first.to_v6().to_bytes());
+			r.last = to_uint128(last.to_v6().to_bytes());
+			r.flags = flags;
+			TORRENT_ASSERT(!(r.last < r.first));
+			m_rules6.push_back(r);
 		}
 #endif
 		else
 			TORRENT_ASSERT(false);
 	}
 
+	void ip_filter::compile()
+	{
+		compile_rules();
+	}
+
+	void ip_filter::compile_rules() const
+	{
+		bool dirty = !m_rules4.empty();
+#if TORRENT_USE_IPV6
+		dirty |= !m_rules6.empty();
+#endif
+		if (!dirty) return;
+
+		// build a new set of tables, the old ones may be
+		// shared with other copies of this filter
+		boost::shared_ptr<tables> t(new tables);
+		static const tables empty_tables;
+		tables const& prev = m_tables ? *m_tables : empty_tables;
+
+		if (m_rules4.empty()) t->v4 = prev.v4;
+		else compile_filter(prev.v4, m_rules4, t->v4);
+		std::vector<rule<boost::uint32_t> >().swap(m_rules4);
+
+#if TORRENT_USE_IPV6
+		if (m_rules6.empty()) t->v6 = prev.v6;
+		else compile_filter(prev.v6, m_rules6, t->v6);
+		std::vector<rule<detail::uint128> >().swap(m_rules6);
+#endif
+		m_tables = t;
+	}
+
 	int ip_filter::access(address const& addr) const
 	{
+		compile_rules();
+		if (!m_tables) return 0;
 		if (addr.is_v4())
-			return m_filter4.access(addr.to_v4().to_bytes());
+			return m_tables->v4.access(boost::uint32_t(addr.to_v4().to_ulong()));
 #if TORRENT_USE_IPV6
 		TORRENT_ASSERT(addr.is_v6());
-		return m_filter6.access(addr.to_v6().to_bytes());
+		return m_tables->v6.access(to_uint128(addr.to_v6().to_bytes()));
 #else
 		return 0;
 #endif
@@ -70,11 +303,18 @@ namespace libtorrent
 
 	ip_filter::filter_tuple_t ip_filter::export_filter() const
 	{
+		compile_rules();
+		static const tables empty_tables;
+		tables const& t = m_tables ? *m_tables : empty_tables;
+
+		std::vector<ip_range<address_v4> > ret4;
+		export_ranges(t.v4, ret4);
 #if TORRENT_USE_IPV6
-		return boost::make_tuple(m_filter4.export_filter<address_v4>()
-			, m_filter6.export_filter<address_v6>());
+		std::vector<ip_range<address_v6> > ret6;
+		export_ranges(t.v6, ret6);
+		return boost::make_tuple(ret4, ret6);
 #else
-		return m_filter4.export_filter<address_v4>();
+		return ret4;
 #endif
 	}
 	
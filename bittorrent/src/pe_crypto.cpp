@@ -71,10 +71,28 @@ namespace libtorrent
 	// Set the prime P and the generator, generate local public key
 	dh_key_exchange::dh_key_exchange()
 	{
+		dh_key_pair k;
 #ifdef TORRENT_USE_GCRYPT
-		// create local key
-		gcry_randomize(m_dh_local_secret, sizeof(m_dh_local_secret), GCRY_STRONG_RANDOM);
+		gcry_randomize(k.secret, sizeof(k.secret), GCRY_STRONG_RANDOM);
+#else
+		for (int i = 0; i < int(sizeof(k.secret)); ++i)
+			k.secret[i] = random();
+#endif
+		compute_public_key(k);
+		memcpy(m_dh_local_secret, k.secret, sizeof(m_dh_local_secret));
+		memcpy(m_dh_local_key, k.key, sizeof(m_dh_local_key));
+	}
 
+	dh_key_exchange::dh_key_exchange(dh_key_pair const& k)
+	{
+		memcpy(m_dh_local_secret, k.secret, sizeof(m_dh_local_secret));
+		memcpy(m_dh_local_key, k.key, sizeof(m_dh_local_key));
+	}
+
+	// key = (2 ^ secret) % prime
+	void dh_key_exchange::compute_public_key(dh_key_pair& k)
+	{
+#ifdef TORRENT_USE_GCRYPT
 		// build gcrypt big ints from the prime and the secret
 		gcry_mpi_t prime = 0;
 		gcry_mpi_t secret = 0;
@@ -83,7 +101,7 @@ namespace libtorrent
 
 		e = gcry_mpi_scan(&prime, GCRYMPI_FMT_USG, dh_prime, sizeof(dh_prime), 0);
 		if (e) goto get_out;
-		e = gcry_mpi_scan(&secret, GCRYMPI_FMT_USG, m_dh_local_secret, sizeof(m_dh_local_secret), 0);
+		e = gcry_mpi_scan(&secret, GCRYMPI_FMT_USG, k.secret, sizeof(k.secret), 0);
 		if (e) goto get_out;
 
 		key = gcry_mpi_new(8);
@@ -95,12 +113,12 @@ namespace libtorrent
 
 		// key is now our local key
 		size_t written;
-		gcry_mpi_print(GCRYMPI_FMT_USG, (unsigned char*)m_dh_local_key
-			, sizeof(m_dh_local_key), &written, key);
+		gcry_mpi_print(GCRYMPI_FMT_USG, (unsigned char*)k.key
+			, sizeof(k.key), &written, key);
 		if (written < 96)
 		{
-			memmove(m_dh_local_key + (sizeof(m_dh_local_key) - written), m_dh_local_key, written);
-			memset(m_dh_local_key, 0, sizeof(m_dh_local_key) - written);
+			memmove(k.key + (sizeof(k.key) - written), k.key, written);
+			memset(k.key, 0, sizeof(k.key) - written);
 		}
 
 get_out:
@@ -109,10 +127,6 @@ get_out:
 		if (secret) gcry_mpi_release(secret);
 
 #elif defined TORRENT_USE_OPENSSL
-		// create local key
-		for (int i = 0; i < sizeof(m_dh_local_secret); ++i)
-			m_dh_local_secret[i] = random();
-
 		BIGNUM* prime = 0;
 		BIGNUM* secret = 0;
 		BIGNUM* key = 0;
@@ -121,7 +135,7 @@ get_out:
 
 		prime = BN_bin2bn(dh_prime, sizeof(dh_prime), 0);
 		if (prime == 0) goto get_out;
-		secret = BN_bin2bn((unsigned char*)m_dh_local_secret, sizeof(m_dh_local_secret), 0);
+		secret = BN_bin2bn((unsigned char*)k.secret, sizeof(k.secret), 0);
 		if (secret == 0) goto get_out;
 
 		key = BN_new();
@@ -134,20 +148,16 @@ get_out:
 		BN_mod_exp(key, key, secret, prime, ctx);
 		BN_CTX_free(ctx);
 
-		// print key to m_dh_local_key
+		// print key to k.key
 		size = BN_num_bytes(key);
-		memset(m_dh_local_key, 0, sizeof(m_dh_local_key) - size);
-		BN_bn2bin(key, (unsigned char*)m_dh_local_key + sizeof(m_dh_local_key) - size);
+		memset(k.key, 0, sizeof(k.key) - size);
+		BN_bn2bin(key, (unsigned char*)k.key + sizeof(k.key) - size);
 
 get_out:
 		if (key) BN_free(key);
 		if (secret) BN_free(secret);
 		if (prime) BN_free(prime);
 #elif defined TORRENT_USE_TOMMATH
-		// create local key
-		for (int i = 0; i < int(sizeof(m_dh_local_secret)); ++i)
-			m_dh_local_secret[i] = random();
-
 		mp_int prime;
 		mp_int secret;
 		mp_int key;
@@ -160,7 +170,7 @@ get_out:
 
 		e = mp_read_unsigned_bin(&prime, dh_prime, sizeof(dh_prime));
 		if (e) goto get_out;
-		e = mp_read_unsigned_bin(&secret, (unsigned char*)m_dh_local_secret, sizeof(m_dh_local_secret));
+		e = mp_read_unsigned_bin(&secret, (unsigned char*)k.secret, sizeof(k.secret));
 		if (e) goto get_out;
 
 		// generator is 2
@@ -171,8 +181,8 @@ get_out:
 
 		// key is now our local key
 		size = mp_unsigned_bin_size(&key);
-		memset(m_dh_local_key, 0, sizeof(m_dh_local_key) - size);
-		mp_to_unsigned_bin(&key, (unsigned char*)m_dh_local_key + sizeof(m_dh_local_key) - size);
+		memset(k.key, 0, sizeof(k.key) - size);
+		mp_to_unsigned_bin(&key, (unsigned char*)k.key + sizeof(k.key) - size);
 
 get_out:
 		mp_clear(&key);
@@ -344,7 +354,11 @@ void rc4_init(const unsigned char* in, unsigned long len, rc4 *state)
 
 unsigned long rc4_encrypt(unsigned char *out, unsigned long outlen, rc4 *state)
 {
-	unsigned char x, y, *s, tmp;
+	// the indices are kept in full width registers and each state
+	// byte is loaded once per output byte, instead of being re-read
+	// after the swap
+	unsigned int x, y, tx, ty;
+	unsigned char *s;
 	unsigned long n;
 
 	TORRENT_ASSERT(out != 0);
@@ -356,10 +370,12 @@ unsigned long rc4_encrypt(unsigned char *out, unsigned long outlen, rc4 *state)
 	s = state->buf;
 	while (outlen--) {
 		x = (x + 1) & 255;
-		y = (y + s[x]) & 255;
-		tmp = s[x]; s[x] = s[y]; s[y] = tmp;
-		tmp = (s[x] + s[y]) & 255;
-		*out++ ^= s[tmp];
+		tx = s[x];
+		y = (y + tx) & 255;
+		ty = s[y];
+		s[x] = (unsigned char)ty;
+		s[y] = (unsigned char)tx;
+		*out++ ^= s[(tx + ty) & 255];
 	}
 	state->x = x;
 	state->y = y;
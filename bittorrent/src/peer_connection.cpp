@@ -118,6 +118,7 @@ namespace libtorrent
 #endif
 		  m_ses(ses)
 		, m_max_out_request_queue(m_ses.settings().max_out_request_queue)
+		, m_parse_time(0)
 		, m_work(ses.m_io_service)
 		, m_last_piece(time_now())
 		, m_last_request(time_now())
@@ -149,6 +150,7 @@ namespace libtorrent
 		, m_packet_size(0)
 		, m_soft_packet_size(0)
 		, m_recv_pos(0)
+		, m_recv_start(0)
 		, m_disk_recv_buffer_size(0)
 		, m_reading_bytes(0)
 		, m_num_invalid_requests(0)
@@ -272,6 +274,7 @@ namespace libtorrent
 #endif
 		  m_ses(ses)
 		, m_max_out_request_queue(m_ses.settings().max_out_request_queue)
+		, m_parse_time(0)
 		, m_work(ses.m_io_service)
 		, m_last_piece(time_now())
 		, m_last_request(time_now())
@@ -302,6 +305,7 @@ namespace libtorrent
 		, m_packet_size(0)
 		, m_soft_packet_size(0)
 		, m_recv_pos(0)
+		, m_recv_start(0)
 		, m_disk_recv_buffer_size(0)
 		, m_reading_bytes(0)
 		, m_num_invalid_requests(0)
@@ -2327,6 +2331,7 @@ namespace libtorrent
 		}
 		disk_buffer_holder holder(m_ses, buffer);
 		std::memcpy(buffer, data, p.length);
+		m_ses.add_recv_copied_bytes(p.length);
 		incoming_piece(p, holder);
 	}
 
@@ -3937,6 +3942,7 @@ namespace libtorrent
 		}
 
 		p.estimated_reciprocation_rate = m_est_reciprocation_rate;
+		p.parse_time = m_parse_time;
 		int upload_capacity = m_ses.settings().upload_rate_limit;
 		if (upload_capacity == 0)
 			upload_capacity = (std::max)(20000, m_ses.m_peak_up_rate + 10000);
@@ -3995,18 +4001,30 @@ namespace libtorrent
 		INVARIANT_CHECK;
 
 		TORRENT_ASSERT(packet_size > 0);
-		TORRENT_ASSERT(int(m_recv_buffer.size()) >= size);
-		TORRENT_ASSERT(int(m_recv_buffer.size()) >= m_recv_pos);
+		TORRENT_ASSERT(int(m_recv_buffer.size()) >= m_recv_start + size);
+		TORRENT_ASSERT(int(m_recv_buffer.size()) >= m_recv_start + m_recv_pos);
 		TORRENT_ASSERT(m_recv_pos >= size + offset);
 		TORRENT_ASSERT(offset >= 0);
 
-		if (size > 0)		
-			std::memmove(&m_recv_buffer[0] + offset, &m_recv_buffer[0] + offset + size, m_recv_pos - size - offset);
+		if (offset == 0)
+		{
+			// cutting from the front is just a matter of
+			// moving the start of the buffer forward
+			m_recv_start += size;
+		}
+		else if (size > 0)
+		{
+			char* start = &m_recv_buffer[0] + m_recv_start;
+			int bytes = m_recv_pos - size - offset;
+			std::memmove(start + offset, start + offset + size, bytes);
+			m_ses.add_recv_copied_bytes(bytes);
+		}
 
 		m_recv_pos -= size;
+		if (m_recv_pos == 0) m_recv_start = 0;
 
 #ifdef TORRENT_DEBUG
-		std::fill(m_recv_buffer.begin() + m_recv_pos, m_recv_buffer.end(), 0);
+		std::fill(m_recv_buffer.begin() + m_recv_start + m_recv_pos, m_recv_buffer.end(), 0);
 #endif
 
 		m_packet_size = packet_size;
@@ -4905,6 +4923,7 @@ namespace libtorrent
 		}
 
 		TORRENT_ASSERT((m_channel_state[upload_channel] & peer_info::bw_network) == 0);
+		encrypt_pending_buffer();
 #ifdef TORRENT_VERBOSE_LOGGING
 		peer_log(">>> ASYNC_WRITE [ bytes: %d ]", amount_to_send);
 #endif
@@ -5031,16 +5050,29 @@ namespace libtorrent
 
 		int regular_buffer_size = m_packet_size - m_disk_recv_buffer_size;
 
-		if (int(m_recv_buffer.size()) < regular_buffer_size)
-			m_recv_buffer.resize(round_up8(regular_buffer_size));
+		if (int(m_recv_buffer.size()) < m_recv_start + regular_buffer_size)
+		{
+			// growing the buffer past its capacity reallocates it.
+			// Move what we have of this message to the front first,
+			// that may leave enough room
+			if (m_recv_start > 0
+				&& m_recv_start + regular_buffer_size > int(m_recv_buffer.capacity()))
+			{
+				std::memmove(&m_recv_buffer[0], &m_recv_buffer[0] + m_recv_start, m_recv_pos);
+				m_ses.add_recv_copied_bytes(m_recv_pos);
+				m_recv_start = 0;
+			}
+			if (int(m_recv_buffer.size()) < m_recv_start + regular_buffer_size)
+				m_recv_buffer.resize(round_up8(m_recv_start + regular_buffer_size));
+		}
 
 		boost::array<asio::mutable_buffer, 2> vec;
 		int num_bufs = 0;
 		if (!m_disk_recv_buffer || regular_buffer_size >= m_recv_pos + max_receive)
 		{
 			// only receive into regular buffer
-			TORRENT_ASSERT(m_recv_pos + max_receive <= int(m_recv_buffer.size()));
-			vec[0] = asio::buffer(&m_recv_buffer[m_recv_pos], max_receive);
+			TORRENT_ASSERT(m_recv_start + m_recv_pos + max_receive <= int(m_recv_buffer.size()));
+			vec[0] = asio::buffer(&m_recv_buffer[m_recv_start + m_recv_pos], max_receive);
 			num_bufs = 1;
 		}
 		else if (m_recv_pos >= regular_buffer_size)
@@ -5059,7 +5091,7 @@ namespace libtorrent
 			TORRENT_ASSERT(max_receive - regular_buffer_size
 				+ m_recv_pos <= m_disk_recv_buffer_size);
 
-			vec[0] = asio::buffer(&m_recv_buffer[m_recv_pos]
+			vec[0] = asio::buffer(&m_recv_buffer[m_recv_start + m_recv_pos]
 				, regular_buffer_size - m_recv_pos);
 			vec[1] = asio::buffer(m_disk_recv_buffer.get()
 				, max_receive - regular_buffer_size + m_recv_pos);
@@ -5120,8 +5152,8 @@ namespace libtorrent
 		TORRENT_ASSERT(regular_buffer_size >= 0);
 		if (!m_disk_recv_buffer || regular_buffer_size >= m_recv_pos)
 		{
-			vec.first = buffer::interval(&m_recv_buffer[0]
-				+ m_recv_pos - bytes, &m_recv_buffer[0] + m_recv_pos);
+			vec.first = buffer::interval(&m_recv_buffer[0] + m_recv_start
+				+ m_recv_pos - bytes, &m_recv_buffer[0] + m_recv_start + m_recv_pos);
 			vec.second = buffer::interval(0,0);
 		}
 		else if (m_recv_pos - bytes >= regular_buffer_size)
@@ -5135,8 +5167,8 @@ namespace libtorrent
 		{
 			TORRENT_ASSERT(m_recv_pos - bytes < regular_buffer_size);
 			TORRENT_ASSERT(m_recv_pos > regular_buffer_size);
-			vec.first = buffer::interval(&m_recv_buffer[0] + m_recv_pos - bytes
-				, &m_recv_buffer[0] + regular_buffer_size);
+			vec.first = buffer::interval(&m_recv_buffer[0] + m_recv_start + m_recv_pos - bytes
+				, &m_recv_buffer[0] + m_recv_start + regular_buffer_size);
 			vec.second = buffer::interval(m_disk_recv_buffer.get()
 				, m_disk_recv_buffer.get() + m_recv_pos - regular_buffer_size);
 		}
@@ -5154,6 +5186,7 @@ namespace libtorrent
 			return;
 		}
 		m_recv_pos = 0;
+		m_recv_start = 0;
 		m_packet_size = packet_size;
 	}
 
@@ -5309,7 +5342,7 @@ namespace libtorrent
 
 			m_last_receive = time_now();
 			m_recv_pos += bytes_transferred;
-			TORRENT_ASSERT(m_recv_pos <= int(m_recv_buffer.size()
+			TORRENT_ASSERT(m_recv_start + m_recv_pos <= int(m_recv_buffer.size()
 				+ m_disk_recv_buffer_size));
 
 #if defined TORRENT_DEBUG || TORRENT_RELEASE_ASSERTS
@@ -5715,6 +5748,8 @@ namespace libtorrent
 		TORRENT_ASSERT(m_queued_time_critical <= int(m_request_queue.size()));
 
 		TORRENT_ASSERT(bool(m_disk_recv_buffer) == (m_disk_recv_buffer_size > 0));
+		TORRENT_ASSERT(m_recv_start >= 0);
+		TORRENT_ASSERT(m_recv_pos > 0 || m_recv_start == 0);
 
 		TORRENT_ASSERT(m_upload_limit >= 0);
 		TORRENT_ASSERT(m_download_limit >= 0);
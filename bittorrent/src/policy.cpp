@@ -221,10 +221,21 @@ namespace libtorrent
 		// the last argument is if we should prefer whole pieces
 		// for this peer. If we're downloading one piece in 20 seconds
 		// then use this mode.
+		session_metrics* metrics = ses.metrics();
+		ptime pick_start;
+		if (metrics) pick_start = time_now_hires();
+
 		p.pick_pieces(*bits, interesting_pieces
 			, num_requests, prefer_whole_pieces, c.peer_info_struct()
 			, state, c.picker_options(), suggested, t.num_peers());
 
+		if (metrics)
+		{
+			metrics->sample(session_metrics::picker_time
+				, total_microseconds(time_now_hires() - pick_start));
+			metrics->inc(session_metrics::picked_blocks, interesting_pieces.size());
+		}
+
 #ifdef TORRENT_VERBOSE_LOGGING
 		c.peer_log("*** PIECE_PICKER [ prefer_whole: %d picked: %d ]"
 			, prefer_whole_pieces, int(interesting_pieces.size()));
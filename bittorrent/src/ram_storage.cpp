@@ -0,0 +1,427 @@
+/*
+
+Copyright (c) 2012, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include "libtorrent/pch.hpp"
+
+#include <cstring>
+#include <algorithm>
+#include <boost/bind.hpp>
+
+#include "libtorrent/ram_storage.hpp"
+#include "libtorrent/storage_defs.hpp"
+#include "libtorrent/error_code.hpp"
+#include "libtorrent/assert.hpp"
+
+namespace libtorrent
+{
+	ram_storage::ram_storage(file_storage const& fs, std::string const& path
+		, size_type max_memory, bool spill)
+		: m_files(fs)
+		, m_save_path(complete(path))
+		, m_max_resident(max_memory > 0
+			? (std::max)(int(max_memory / fs.piece_length()), 1) : 0)
+		, m_spill(spill)
+		, m_pieces(fs.num_pieces())
+		, m_resident(0)
+		, m_spill_slots(0)
+		, m_num_spilled(0)
+#ifndef TORRENT_DISABLE_POOL_ALLOCATOR
+		// grow the pool about a MiB at a time
+		, m_pool(fs.piece_length(), (std::max)(1024 * 1024 / fs.piece_length(), 1))
+#endif
+	{
+		m_spill_path = combine_path(m_save_path, fs.name() + ".spill");
+	}
+
+	ram_storage::~ram_storage()
+	{
+		delete_files();
+	}
+
+	bool ram_storage::initialize(bool allocate_files)
+	{
+		// there is nothing to allocate up front, pieces are
+		// allocated as they are written
+		return false;
+	}
+
+	int ram_storage::readv(file::iovec_t const* bufs, int slot, int offset, int num_bufs)
+	{
+		TORRENT_ASSERT(slot >= 0 && slot < int(m_pieces.size()));
+		piece_entry& e = m_pieces[slot];
+
+		int size = 0;
+		for (int i = 0; i < num_bufs; ++i)
+			size += bufs[i].iov_len;
+		TORRENT_ASSERT(offset + size <= m_files.piece_length());
+
+		if (e.spill_slot >= 0)
+		{
+			// spilled pieces are read straight from the file, they
+			// don't displace what's in RAM
+			TORRENT_ASSERT(e.data == 0);
+			TORRENT_ASSERT(m_spill_file);
+			error_code ec;
+			m_spill_file->readv(size_type(e.spill_slot) * m_files.piece_length() + offset
+				, bufs, num_bufs, ec);
+			if (ec)
+			{
+				set_error(m_spill_path, ec);
+				return -1;
+			}
+			return size;
+		}
+
+		char const* src = e.data ? e.data + offset : 0;
+		for (int i = 0; i < num_bufs; ++i)
+		{
+			if (src)
+			{
+				std::memcpy(bufs[i].iov_base, src, bufs[i].iov_len);
+				src += bufs[i].iov_len;
+			}
+			else
+			{
+				std::memset(bufs[i].iov_base, 0, bufs[i].iov_len);
+			}
+		}
+
+		if (e.data) m_lru.splice(m_lru.end(), m_lru, e.lru);
+		return size;
+	}
+
+	int ram_storage::writev(file::iovec_t const* bufs, int slot, int offset, int num_bufs)
+	{
+		TORRENT_ASSERT(slot >= 0 && slot < int(m_pieces.size()));
+		piece_entry& e = m_pieces[slot];
+
+		int size = 0;
+		for (int i = 0; i < num_bufs; ++i)
+			size += bufs[i].iov_len;
+		TORRENT_ASSERT(offset + size <= m_files.piece_length());
+
+		if (e.spill_slot >= 0)
+		{
+			TORRENT_ASSERT(e.data == 0);
+			TORRENT_ASSERT(m_spill_file);
+			error_code ec;
+			m_spill_file->writev(size_type(e.spill_slot) * m_files.piece_length() + offset
+				, bufs, num_bufs, ec);
+			if (ec)
+			{
+				set_error(m_spill_path, ec);
+				return -1;
+			}
+			return size;
+		}
+
+		if (e.data == 0)
+		{
+			char* data = allocate_piece();
+			if (data == 0) return -1;
+			e.data = data;
+			e.lru = m_lru.insert(m_lru.end(), slot);
+		}
+		else
+		{
+			m_lru.splice(m_lru.end(), m_lru, e.lru);
+		}
+
+		char* dst = e.data + offset;
+		for (int i = 0; i < num_bufs; ++i)
+		{
+			std::memcpy(dst, bufs[i].iov_base, bufs[i].iov_len);
+			dst += bufs[i].iov_len;
+		}
+		return size;
+	}
+
+	int ram_storage::read(char* buf, int slot, int offset, int size)
+	{
+		file::iovec_t b = { buf, size_t(size) };
+		return readv(&b, slot, offset, 1);
+	}
+
+	int ram_storage::write(char const* buf, int slot, int offset, int size)
+	{
+		file::iovec_t b = { const_cast<char*>(buf), size_t(size) };
+		return writev(&b, slot, offset, 1);
+	}
+
+	size_type ram_storage::physical_offset(int slot, int offset)
+	{
+		return size_type(slot) * m_files.piece_length() + offset;
+	}
+
+	bool ram_storage::move_storage(std::string const& sp)
+	{
+		std::string save_path = complete(sp);
+		std::string spill_path = combine_path(save_path, m_files.name() + ".spill");
+
+		if (m_spill_file)
+		{
+			error_code ec;
+			create_directories(save_path, ec);
+			if (ec)
+			{
+				set_error(save_path, ec);
+				return false;
+			}
+
+			m_spill_file->close();
+			rename(m_spill_path, spill_path, ec);
+			if (ec)
+			{
+				set_error(m_spill_path, ec);
+				// the pieces in it are still needed, so put it back
+				error_code ignore;
+				m_spill_file->open(m_spill_path, file::read_write | file::sparse, ignore);
+				return false;
+			}
+
+			if (!m_spill_file->open(spill_path, file::read_write | file::sparse, ec))
+			{
+				set_error(spill_path, ec);
+				return false;
+			}
+		}
+
+		m_save_path = save_path;
+		m_spill_path = spill_path;
+		return true;
+	}
+
+	bool ram_storage::move_slot(int src_slot, int dst_slot)
+	{
+		piece_entry& dst = m_pieces[dst_slot];
+		if (dst.data) free_piece(dst);
+		if (dst.spill_slot >= 0)
+		{
+			m_free_spill_slots.push_back(dst.spill_slot);
+			dst.spill_slot = -1;
+			--m_num_spilled;
+		}
+		swap_entries(src_slot, dst_slot);
+		return false;
+	}
+
+	bool ram_storage::swap_slots(int slot1, int slot2)
+	{
+		swap_entries(slot1, slot2);
+		return false;
+	}
+
+	bool ram_storage::swap_slots3(int slot1, int slot2, int slot3)
+	{
+		// the data in slot1 goes to slot2, slot2 to slot3
+		// and slot3 to slot1
+		swap_entries(slot1, slot2);
+		swap_entries(slot1, slot3);
+		return false;
+	}
+
+	bool ram_storage::release_files()
+	{
+		// the pieces are the storage, they can't be released
+		// without losing them. Only delete_files() does that
+		return false;
+	}
+
+	bool ram_storage::delete_files()
+	{
+		for (std::vector<piece_entry>::iterator i = m_pieces.begin()
+			, end(m_pieces.end()); i != end; ++i)
+		{
+			if (i->data) free_piece(*i);
+		}
+		TORRENT_ASSERT(m_resident == 0);
+		TORRENT_ASSERT(m_lru.empty());
+#ifndef TORRENT_DISABLE_POOL_ALLOCATOR
+		m_pool.release_memory();
+#endif
+		release_spill_file();
+		return false;
+	}
+
+	char* ram_storage::allocate_piece()
+	{
+		if (m_max_resident > 0 && m_resident >= m_max_resident)
+		{
+			if (!m_spill)
+			{
+				set_error(m_save_path, error_code(errors::no_memory, get_libtorrent_category()));
+				return 0;
+			}
+			if (!evict_one()) return 0;
+		}
+
+#ifdef TORRENT_DISABLE_POOL_ALLOCATOR
+		char* ret = page_aligned_allocator::malloc(m_files.piece_length());
+#else
+		char* ret = (char*)m_pool.malloc();
+#endif
+		if (ret == 0)
+		{
+			set_error(m_save_path, error_code(errors::no_memory, get_libtorrent_category()));
+			return 0;
+		}
+		// the parts of the piece that haven't been written
+		// yet read back as zeros
+		std::memset(ret, 0, m_files.piece_length());
+		++m_resident;
+		return ret;
+	}
+
+	void ram_storage::free_piece(piece_entry& e)
+	{
+		TORRENT_ASSERT(e.data);
+		TORRENT_ASSERT(m_resident > 0);
+		m_lru.erase(e.lru);
+#ifdef TORRENT_DISABLE_POOL_ALLOCATOR
+		page_aligned_allocator::free(e.data);
+#else
+		m_pool.free(e.data);
+#endif
+		e.data = 0;
+		--m_resident;
+	}
+
+	bool ram_storage::evict_one()
+	{
+		if (m_lru.empty()) return false;
+		if (!open_spill_file()) return false;
+
+		int slot = m_lru.front();
+		piece_entry& e = m_pieces[slot];
+		TORRENT_ASSERT(e.data);
+		TORRENT_ASSERT(e.spill_slot < 0);
+
+		int spill_slot;
+		if (!m_free_spill_slots.empty())
+		{
+			spill_slot = m_free_spill_slots.back();
+			m_free_spill_slots.pop_back();
+		}
+		else
+		{
+			spill_slot = m_spill_slots++;
+		}
+
+		// always write the whole buffer, so that reading any
+		// part of the piece back never runs past the end of the file
+		file::iovec_t b = { e.data, size_t(m_files.piece_length()) };
+		error_code ec;
+		m_spill_file->writev(size_type(spill_slot) * m_files.piece_length(), &b, 1, ec);
+		if (ec)
+		{
+			m_free_spill_slots.push_back(spill_slot);
+			set_error(m_spill_path, ec);
+			return false;
+		}
+
+		free_piece(e);
+		e.spill_slot = spill_slot;
+		++m_num_spilled;
+		return true;
+	}
+
+	bool ram_storage::open_spill_file()
+	{
+		if (m_spill_file) return true;
+
+		error_code ec;
+		create_directories(m_save_path, ec);
+		if (ec)
+		{
+			set_error(m_save_path, ec);
+			return false;
+		}
+
+		m_spill_file = new file(m_spill_path, file::read_write | file::sparse, ec);
+		if (ec)
+		{
+			m_spill_file.reset();
+			set_error(m_spill_path, ec);
+			return false;
+		}
+		return true;
+	}
+
+	void ram_storage::release_spill_file()
+	{
+		for (std::vector<piece_entry>::iterator i = m_pieces.begin()
+			, end(m_pieces.end()); i != end; ++i)
+			i->spill_slot = -1;
+		m_free_spill_slots.clear();
+		m_spill_slots = 0;
+		m_num_spilled = 0;
+
+		if (!m_spill_file) return;
+		m_spill_file->close();
+		m_spill_file.reset();
+		error_code ec;
+		remove(m_spill_path, ec);
+	}
+
+	void ram_storage::swap_entries(int slot1, int slot2)
+	{
+		TORRENT_ASSERT(slot1 >= 0 && slot1 < int(m_pieces.size()));
+		TORRENT_ASSERT(slot2 >= 0 && slot2 < int(m_pieces.size()));
+		std::swap(m_pieces[slot1], m_pieces[slot2]);
+		if (m_pieces[slot1].data) *m_pieces[slot1].lru = slot1;
+		if (m_pieces[slot2].data) *m_pieces[slot2].lru = slot2;
+	}
+
+	storage_interface* ram_storage_constructor(file_storage const& fs
+		, file_storage const* mapped, std::string const& path, file_pool& fp
+		, std::vector<boost::uint8_t> const&)
+	{
+		return new ram_storage(fs, path, 0, false);
+	}
+
+	namespace
+	{
+		storage_interface* bounded_ram_storage(file_storage const& fs
+			, file_storage const* mapped, std::string const& path, file_pool& fp
+			, std::vector<boost::uint8_t> const&, size_type max_memory, bool spill)
+		{
+			return new ram_storage(fs, path, max_memory, spill);
+		}
+	}
+
+	storage_constructor_type bounded_ram_storage_constructor(size_type max_memory, bool spill)
+	{
+		return boost::bind(&bounded_ram_storage, _1, _2, _3, _4, _5, max_memory, spill);
+	}
+}
+
@@ -0,0 +1,456 @@
+/*
+
+Copyright (c) 2012, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/pch.hpp"
+
+#include <cstring>
+#include <iterator>
+#include <limits>
+
+#include "libtorrent/resume_store.hpp"
+#include "libtorrent/entry.hpp"
+#include "libtorrent/bencode.hpp"
+#include "libtorrent/io.hpp"
+#include "libtorrent/error.hpp"
+#include "libtorrent/assert.hpp"
+
+#ifndef TORRENT_WINDOWS
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+	using libtorrent::size_type;
+
+	enum
+	{
+		header_size = 8,
+		record_header_size = 28,
+		erased_record = 0xffffffff
+	};
+
+	char const store_magic[] = "LTRS";
+
+	boost::uint32_t adler32(char const* buf, int size)
+	{
+		boost::uint32_t a = 1;
+		boost::uint32_t b = 0;
+		for (int i = 0; i < size; ++i)
+		{
+			a = (a + boost::uint8_t(buf[i])) % 65521;
+			b = (b + a) % 65521;
+		}
+		return (b << 16) | a;
+	}
+
+	int padded_size(int size) { return (size + 7) & ~7; }
+}
+
+namespace libtorrent
+{
+	resume_store::resume_store()
+		: m_size(0)
+		, m_garbage(0)
+		, m_mapping(0)
+		, m_mapped_size(0)
+#ifdef TORRENT_WINDOWS
+		, m_map_handle(NULL)
+#endif
+	{}
+
+	resume_store::~resume_store()
+	{
+		close();
+	}
+
+	void resume_store::open(std::string const& path, error_code& ec)
+	{
+		close();
+		m_path = path;
+
+		// if we crashed while compacting, the new file may
+		// be left behind without the old one
+		std::string tmp = path + ".tmp";
+		if (!exists(path) && exists(tmp))
+		{
+			rename(tmp, path, ec);
+			if (ec) return;
+		}
+
+		if (!m_file.open(path, file::read_write, ec)) return;
+		size_type file_size = m_file.get_size(ec);
+		if (ec) return;
+
+		if (file_size < header_size)
+		{
+			// a new store
+			char header[header_size];
+			char* ptr = header;
+			std::memcpy(ptr, store_magic, 4);
+			ptr += 4;
+			detail::write_uint32(version, ptr);
+			file::iovec_t b = { header, header_size };
+			if (m_file.writev(0, &b, 1, ec) != header_size)
+			{
+				if (!ec) ec = error_code(errors::file_too_short, get_libtorrent_category());
+				m_file.close();
+				return;
+			}
+			m_size = header_size;
+			return;
+		}
+
+		// not being able to map the file isn't fatal,
+		// the records are read from the file instead
+		map_file(ec);
+		ec.clear();
+
+		char header[header_size];
+		if (!read(0, header, header_size)
+			|| std::memcmp(header, store_magic, 4) != 0)
+		{
+			ec = error_code(errors::invalid_file_tag, get_libtorrent_category());
+			close();
+			return;
+		}
+		char const* ptr = header + 4;
+		if (detail::read_uint32(ptr) > version)
+		{
+			ec = error_code(errors::invalid_file_tag, get_libtorrent_category());
+			close();
+			return;
+		}
+
+		index_records(file_size);
+
+		if (m_size < file_size)
+		{
+			// drop the torn record at the end. The mapping can't
+			// extend past the end of the file
+			unmap_file();
+			m_file.set_size(m_size, ec);
+			if (ec) return;
+			map_file(ec);
+			ec.clear();
+		}
+	}
+
+	void resume_store::index_records(size_type file_size)
+	{
+		m_index.clear();
+		m_garbage = 0;
+
+		size_type pos = header_size;
+		std::vector<char> payload;
+		while (pos + record_header_size <= file_size)
+		{
+			char header[record_header_size];
+			if (!read(pos, header, record_header_size)) break;
+
+			sha1_hash key;
+			std::memcpy(&key[0], header, 20);
+			char const* ptr = header + 20;
+			boost::uint32_t size = detail::read_uint32(ptr);
+			boost::uint32_t checksum = detail::read_uint32(ptr);
+
+			bool erased = size == erased_record;
+			if (erased) size = 0;
+			if (size > 0x7fffffff) break;
+			size_type end = pos + record_header_size + padded_size(size);
+			if (end > file_size) break;
+
+			payload.resize(size);
+			if (size > 0 && !read(pos + record_header_size, &payload[0], size)) break;
+			if (adler32(size > 0 ? &payload[0] : 0, size) != checksum) break;
+
+			index_t::iterator i = m_index.find(key);
+			if (i != m_index.end())
+			{
+				m_garbage += record_header_size + padded_size(i->second.size);
+				if (erased) m_index.erase(i);
+			}
+
+			if (erased)
+			{
+				m_garbage += record_header_size;
+			}
+			else
+			{
+				record& r = m_index[key];
+				r.offset = pos + record_header_size;
+				r.size = int(size);
+			}
+			pos = end;
+		}
+		m_size = pos;
+	}
+
+	void resume_store::close()
+	{
+		unmap_file();
+		m_file.close();
+		m_index.clear();
+		m_size = 0;
+		m_garbage = 0;
+	}
+
+	void resume_store::map_file(error_code& ec)
+	{
+		TORRENT_ASSERT(m_mapping == 0);
+		size_type size = m_file.get_size(ec);
+		if (ec || size == 0) return;
+		// don't try to map more than we can address
+		if (size > size_type((std::numeric_limits<std::size_t>::max)())) return;
+
+#ifdef TORRENT_WINDOWS
+		m_map_handle = CreateFileMapping(m_file.native_handle(), NULL
+			, PAGE_READONLY, 0, 0, NULL);
+		if (m_map_handle == NULL)
+		{
+			ec.assign(GetLastError(), get_system_category());
+			return;
+		}
+		void* p = MapViewOfFile(m_map_handle, FILE_MAP_READ, 0, 0, 0);
+		if (p == NULL)
+		{
+			ec.assign(GetLastError(), get_system_category());
+			CloseHandle(m_map_handle);
+			m_map_handle = NULL;
+			return;
+		}
+#else
+		void* p = mmap(0, size, PROT_READ, MAP_SHARED, m_file.native_handle(), 0);
+		if (p == MAP_FAILED)
+		{
+			ec.assign(errno, get_posix_category());
+			return;
+		}
+#endif
+		m_mapping = static_cast<char*>(p);
+		m_mapped_size = size;
+	}
+
+	void resume_store::unmap_file()
+	{
+		if (m_mapping == 0) return;
+#ifdef TORRENT_WINDOWS
+		UnmapViewOfFile(m_mapping);
+		CloseHandle(m_map_handle);
+		m_map_handle = NULL;
+#else
+		munmap(m_mapping, m_mapped_size);
+#endif
+		m_mapping = 0;
+		m_mapped_size = 0;
+	}
+
+	bool resume_store::read(size_type offset, char* buf, int size) const
+	{
+		if (offset + size <= m_mapped_size)
+		{
+			std::memcpy(buf, m_mapping + offset, size);
+			return true;
+		}
+		error_code ec;
+		file::iovec_t b = { buf, size };
+		return const_cast<file&>(m_file).readv(offset, &b, 1, ec) == size && !ec;
+	}
+
+	bool resume_store::get(sha1_hash const& key, std::vector<char>& buf) const
+	{
+		index_t::const_iterator i = m_index.find(key);
+		if (i == m_index.end()) return false;
+		buf.resize(i->second.size);
+		if (i->second.size == 0) return true;
+		return read(i->second.offset, &buf[0], i->second.size);
+	}
+
+	size_type resume_store::append_record(file& f, size_type offset
+		, sha1_hash const& key, char const* buf, int size
+		, bool erased, error_code& ec)
+	{
+		TORRENT_ASSERT(size >= 0);
+		char header[record_header_size];
+		std::memcpy(header, &key[0], 20);
+		char* ptr = header + 20;
+		detail::write_uint32(erased ? boost::uint32_t(erased_record) : boost::uint32_t(size), ptr);
+		detail::write_uint32(adler32(buf, size), ptr);
+
+		static char const pad[8] = {0};
+		file::iovec_t b[3] = {
+			{ header, record_header_size }
+			, { (void*)buf, size }
+			, { (void*)pad, padded_size(size) - size } };
+		int num_bufs = 3;
+		if (b[2].iov_len == 0) --num_bufs;
+		if (size == 0)
+		{
+			TORRENT_ASSERT(num_bufs == 2);
+			--num_bufs;
+		}
+		int total = record_header_size + padded_size(size);
+		if (f.writev(offset, b, num_bufs, ec) != total)
+		{
+			if (!ec) ec = error_code(errors::file_too_short, get_libtorrent_category());
+			return 0;
+		}
+		return total;
+	}
+
+	void resume_store::put(sha1_hash const& key, char const* buf, int size, error_code& ec)
+	{
+		TORRENT_ASSERT(is_open());
+		size_type written = append_record(m_file, m_size, key, buf, size, false, ec);
+		if (ec) return;
+
+		index_t::iterator i = m_index.find(key);
+		if (i != m_index.end())
+			m_garbage += record_header_size + padded_size(i->second.size);
+		record& r = m_index[key];
+		r.offset = m_size + record_header_size;
+		r.size = size;
+		m_size += written;
+	}
+
+	void resume_store::put(sha1_hash const& key, entry const& e, error_code& ec)
+	{
+		std::vector<char> buf;
+		bencode(std::back_inserter(buf), e);
+		put(key, buf.empty() ? 0 : &buf[0], int(buf.size()), ec);
+	}
+
+	void resume_store::erase(sha1_hash const& key, error_code& ec)
+	{
+		TORRENT_ASSERT(is_open());
+		index_t::iterator i = m_index.find(key);
+		if (i == m_index.end()) return;
+
+		size_type written = append_record(m_file, m_size, key, 0, 0, true, ec);
+		if (ec) return;
+
+		m_garbage += 2 * record_header_size + padded_size(i->second.size);
+		m_index.erase(i);
+		m_size += written;
+	}
+
+	bool resume_store::import_file(sha1_hash const& key, std::string const& path
+		, std::vector<char>& buf, error_code& ec)
+	{
+		buf.clear();
+		file f(path, file::read_only, ec);
+		if (ec) return false;
+		size_type size = f.get_size(ec);
+		if (ec) return false;
+		if (size <= 0 || size > 0x7fffffff) return false;
+
+		buf.resize(int(size));
+		file::iovec_t b = { &buf[0], buf.size() };
+		if (f.readv(0, &b, 1, ec) != size)
+		{
+			if (!ec) ec = error_code(errors::file_too_short, get_libtorrent_category());
+			buf.clear();
+			return false;
+		}
+		f.close();
+
+		put(key, &buf[0], int(buf.size()), ec);
+		if (ec) return false;
+		remove(path, ec);
+		// the record was imported, failing to remove
+		// the old file isn't an error
+		ec.clear();
+		return true;
+	}
+
+	bool resume_store::need_compact() const
+	{
+		return m_garbage > (m_size - m_garbage);
+	}
+
+	void resume_store::compact(error_code& ec)
+	{
+		TORRENT_ASSERT(is_open());
+
+		std::string tmp = m_path + ".tmp";
+		remove(tmp, ec);
+		ec.clear();
+
+		{
+			file out(tmp, file::read_write, ec);
+			if (ec) return;
+
+			char header[header_size];
+			char* ptr = header;
+			std::memcpy(ptr, store_magic, 4);
+			ptr += 4;
+			detail::write_uint32(version, ptr);
+			file::iovec_t b = { header, header_size };
+			if (out.writev(0, &b, 1, ec) != header_size)
+			{
+				if (!ec) ec = error_code(errors::file_too_short, get_libtorrent_category());
+				return;
+			}
+
+			size_type pos = header_size;
+			std::vector<char> buf;
+			for (index_t::iterator i = m_index.begin(), end(m_index.end()); i != end; ++i)
+			{
+				// a record we fail to read would be lost for good once
+				// the compacted file replaces this one. Keep this one
+				if (!get(i->first, buf))
+				{
+					ec = error_code(errors::file_too_short, get_libtorrent_category());
+					break;
+				}
+				pos += append_record(out, pos, i->first, buf.empty() ? 0 : &buf[0]
+					, int(buf.size()), false, ec);
+				if (ec) return;
+			}
+		}
+
+		if (ec)
+		{
+			error_code ignore;
+			remove(tmp, ignore);
+			return;
+		}
+
+		std::string path = m_path;
+		close();
+		remove(path, ec);
+		if (ec) return;
+		rename(tmp, path, ec);
+		if (ec) return;
+		open(path, ec);
+	}
+}
+
@@ -124,6 +124,14 @@ namespace libtorrent
 		// torrent checking
 		set.file_checks_delay_per_block = 5;
 
+		// don't read ahead or hash in parallel when checking,
+		// it requires buffers for every check thread
+		set.file_check_threads = 1;
+		set.file_check_read_ahead = 0;
+
+		// don't keep a thread busy generating keys up-front
+		set.dh_key_pool_size = 0;
+
 		// only have 4 files open at a time
 		set.file_pool_size = 4;
 
@@ -527,7 +535,11 @@ namespace libtorrent
 
 	void session::set_ip_filter(ip_filter const& f)
 	{
-		TORRENT_ASYNC_CALL1(set_ip_filter, f);
+		// build the lookup tables here, on the calling thread. The
+		// network thread only swaps in the new, shared, tables
+		ip_filter compiled(f);
+		compiled.compile();
+		TORRENT_ASYNC_CALL1(set_ip_filter, compiled);
 	}
 	
 	ip_filter session::get_ip_filter() const
@@ -616,6 +628,17 @@ namespace libtorrent
 		TORRENT_ASYNC_CALL1(async_add_torrent, p);
 	}
 
+	void session::async_add_torrents(std::vector<add_torrent_params> const& params)
+	{
+		if (params.empty()) return;
+		std::vector<add_torrent_params>* p = new std::vector<add_torrent_params>(params);
+		for (std::vector<add_torrent_params>::iterator i = p->begin(); i != p->end(); ++i)
+		{
+			if (i->resume_data) i->resume_data = new std::vector<char>(*i->resume_data);
+		}
+		TORRENT_ASYNC_CALL1(async_add_torrents, p);
+	}
+
 #ifndef BOOST_NO_EXCEPTIONS
 #ifndef TORRENT_NO_DEPRECATE
 	// if the torrent already exists, this will throw duplicate_torrent
@@ -699,6 +722,12 @@ namespace libtorrent
 		TORRENT_ASYNC_CALL2(remove_torrent, h, options);
 	}
 
+	void session::remove_torrents(std::vector<torrent_handle> const& h, int options)
+	{
+		if (h.empty()) return;
+		TORRENT_ASYNC_CALL2(remove_torrents, h, options);
+	}
+
 #ifndef TORRENT_NO_DEPRECATE
 	bool session::listen_on(
 		std::pair<int, int> const& port_range
@@ -757,6 +786,11 @@ namespace libtorrent
 		return m_impl->m_disk_thread.status();
 	}
 
+	void session::post_session_stats()
+	{
+		TORRENT_ASYNC_CALL(post_session_stats);
+	}
+
 #ifndef TORRENT_DISABLE_DHT
 
 	void session::start_dht()
@@ -1155,6 +1189,7 @@ namespace libtorrent
 		, cache_size(1024)
 		, cache_buffer_chunk_size(16)
 		, cache_expiry(300)
+		, adaptive_disk_cache(false)
 		, use_read_cache(true)
 		, explicit_read_cache(0)
 		, explicit_cache_interval(30)
@@ -1201,11 +1236,14 @@ namespace libtorrent
 #ifndef TORRENT_DISABLE_MLOCK
 		, lock_disk_cache(false)
 #endif
+		, disk_cache_large_pages(false)
 		, max_rejects(50)
 		, recv_socket_buffer_size(0)
 		, send_socket_buffer_size(0)
 		, optimize_hashing_for_speed(true)
 		, file_checks_delay_per_block(0)
+		, file_check_threads(0)
+		, file_check_read_ahead(4 * 1024 * 1024)
 		, disk_cache_algorithm(avoid_readback)
 		, read_cache_line_size(32)
 		, write_cache_line_size(32)
@@ -1238,6 +1276,7 @@ namespace libtorrent
 		, max_pex_peers(50)
 		, ignore_resume_timestamps(false)
 		, no_recheck_incomplete_resume(false)
+		, resume_file_samples(true)
 		, anonymous_mode(false)
 		, tick_interval(100)
 		, report_web_seed_downloads(true)
@@ -1278,6 +1317,9 @@ namespace libtorrent
 		, ssl_listen(4433)
 		, tracker_backoff(250)
 		, ban_web_seeds(true)
+		, dh_key_pool_size(64)
+		, async_dh_secret(true)
+		, collect_metrics(false)
 	{}
 
 	session_settings::~session_settings() {}
@@ -333,6 +333,7 @@ namespace aux {
 		TORRENT_SETTING(integer, cache_size)
 		TORRENT_SETTING(integer, cache_buffer_chunk_size)
 		TORRENT_SETTING(integer, cache_expiry)
+		TORRENT_SETTING(boolean, adaptive_disk_cache)
 		TORRENT_SETTING(boolean, use_read_cache)
 		TORRENT_SETTING(boolean, explicit_read_cache)
 		TORRENT_SETTING(integer, disk_io_write_mode)
@@ -372,11 +373,14 @@ namespace aux {
 #ifndef TORRENT_DISABLE_MLOCK
 		TORRENT_SETTING(boolean, lock_disk_cache)
 #endif
+		TORRENT_SETTING(boolean, disk_cache_large_pages)
 		TORRENT_SETTING(integer, max_rejects)
 		TORRENT_SETTING(integer, recv_socket_buffer_size)
 		TORRENT_SETTING(integer, send_socket_buffer_size)
 		TORRENT_SETTING(boolean, optimize_hashing_for_speed)
 		TORRENT_SETTING(integer, file_checks_delay_per_block)
+		TORRENT_SETTING(integer, file_check_threads)
+		TORRENT_SETTING(integer, file_check_read_ahead)
 		TORRENT_SETTING(integer, disk_cache_algorithm)
 		TORRENT_SETTING(integer, read_cache_line_size)
 		TORRENT_SETTING(integer, write_cache_line_size)
@@ -408,6 +412,7 @@ namespace aux {
 		TORRENT_SETTING(integer, max_pex_peers)
 		TORRENT_SETTING(boolean, ignore_resume_timestamps)
 		TORRENT_SETTING(boolean, no_recheck_incomplete_resume)
+		TORRENT_SETTING(boolean, resume_file_samples)
 		TORRENT_SETTING(boolean, anonymous_mode)
 		TORRENT_SETTING(integer, tick_interval)
 		TORRENT_SETTING(integer, upload_rate_limit)
@@ -443,6 +448,9 @@ namespace aux {
 		TORRENT_SETTING(boolean, lock_files)
 		TORRENT_SETTING(integer, ssl_listen)
 		TORRENT_SETTING(integer, tracker_backoff)
+		TORRENT_SETTING(integer, dh_key_pool_size)
+		TORRENT_SETTING(boolean, async_dh_secret)
+		TORRENT_SETTING(boolean, collect_metrics)
 	};
 
 #undef TORRENT_SETTING
@@ -602,6 +610,9 @@ namespace aux {
 #endif
 		, m_alerts(m_io_service, m_settings.alert_queue_size, alert_mask)
 		, m_disk_thread(m_io_service, boost::bind(&session_impl::on_disk_queue, this), m_files)
+#ifndef TORRENT_DISABLE_ENCRYPTION
+		, m_dh_key_pool(m_io_service)
+#endif
 		, m_half_open(m_io_service)
 		, m_download_rate(peer_connection::download_channel)
 #ifdef TORRENT_VERBOSE_BANDWIDTH_LIMIT
@@ -653,13 +664,11 @@ namespace aux {
 		, m_non_filtered_torrents(0)
 #if defined TORRENT_VERBOSE_LOGGING || defined TORRENT_LOGGING || defined TORRENT_ERROR_LOGGING
 		, m_logpath(logpath)
-#endif
-#ifndef TORRENT_DISABLE_GEO_IP
-		, m_asnum_db(0)
-		, m_country_db(0)
 #endif
 		, m_total_failed_bytes(0)
 		, m_total_redundant_bytes(0)
+		, m_total_recv_copied_bytes(0)
+		, m_handshake_latency_cursor(0)
 #if (defined TORRENT_DEBUG || TORRENT_RELEASE_ASSERTS) && defined BOOST_HAS_PTHREADS
 		, m_network_thread(0)
 #endif
@@ -670,6 +679,11 @@ namespace aux {
 		m_disk_queues[0] = 0;
 		m_disk_queues[1] = 0;
 
+#ifndef TORRENT_DISABLE_GEO_IP
+		m_geoip_generation[0] = 0;
+		m_geoip_generation[1] = 0;
+#endif
+
 #ifdef TORRENT_REQUEST_LOGGING
 		char log_filename[200];
 		snprintf(log_filename, sizeof(log_filename), "requests-%d.log", getpid());
@@ -1337,6 +1351,11 @@ namespace aux {
 		TORRENT_ASSERT(!ec);
 #endif
 
+#ifndef TORRENT_DISABLE_ENCRYPTION
+		// start precomputing DH keys before we accept any connections
+		m_dh_key_pool.set_size((std::max)(m_settings.dh_key_pool_size, 0));
+#endif
+
 #if defined TORRENT_LOGGING || defined TORRENT_VERBOSE_LOGGING
 		(*m_logger) << time_now_string() << " open listen port\n";
 #endif
@@ -1515,47 +1534,31 @@ namespace aux {
 	}
 
 #ifndef TORRENT_DISABLE_GEO_IP
-	namespace
-	{
-		struct free_ptr
-		{
-			void* ptr_;
-			free_ptr(void* p): ptr_(p) {}
-			~free_ptr() { free(ptr_); }
-		};
-	}
-
 	char const* session_impl::country_for_ip(address const& a)
 	{
 		TORRENT_ASSERT(is_network_thread());
 
-		if (!a.is_v4() || m_country_db == 0) return 0;
-		return GeoIP_country_code_by_ipnum(m_country_db, a.to_v4().to_ulong());
+		if (!a.is_v4() || !m_country_db) return 0;
+		return m_country_db->country_for_ip(a.to_v4().to_ulong());
 	}
 
 	int session_impl::as_for_ip(address const& a)
 	{
 		TORRENT_ASSERT(is_network_thread());
 
-		if (!a.is_v4() || m_asnum_db == 0) return 0;
-		char* name = GeoIP_name_by_ipnum(m_asnum_db, a.to_v4().to_ulong());
-		if (name == 0) return 0;
-		free_ptr p(name);
-		// GeoIP returns the name as AS??? where ? is the AS-number
-		return atoi(name + 2);
+		if (!a.is_v4() || !m_asnum_db) return 0;
+		return m_asnum_db->as_for_ip(a.to_v4().to_ulong());
 	}
 
 	std::string session_impl::as_name_for_ip(address const& a)
 	{
 		TORRENT_ASSERT(is_network_thread());
 
-		if (!a.is_v4() || m_asnum_db == 0) return std::string();
-		char* name = GeoIP_name_by_ipnum(m_asnum_db, a.to_v4().to_ulong());
+		if (!a.is_v4() || !m_asnum_db) return std::string();
+		char const* name = m_asnum_db->as_name(
+			m_asnum_db->as_for_ip(a.to_v4().to_ulong()));
 		if (name == 0) return std::string();
-		free_ptr p(name);
-		char* tmp = std::strchr(name, ' ');
-		if (tmp == 0) return std::string();
-		return tmp + 1;
+		return name;
 	}
 
 	std::pair<const int, int>* session_impl::lookup_as(int as)
@@ -1572,13 +1575,54 @@ namespace aux {
 		return &(*i);
 	}
 
-	void session_impl::load_asnum_db(std::string file)
+	void session_impl::load_geoip_db(std::string const& file, geoip_table::db_type t)
 	{
 		TORRENT_ASSERT(is_network_thread());
 
-		if (m_asnum_db) GeoIP_delete(m_asnum_db);
-		m_asnum_db = GeoIP_open(file.c_str(), GEOIP_STANDARD);
-//		return m_asnum_db;
+		if (m_abort) return;
+		int generation = ++m_geoip_generation[t];
+		m_geoip_threads[geoip_key(t, generation)].reset(new thread(
+			boost::bind(&session_impl::geoip_loader, this, file, t, generation)));
+	}
+
+	// this runs in a thread of its own. Reading and compiling the
+	// database takes long enough to stall the network thread
+	void session_impl::geoip_loader(std::string file, geoip_table::db_type t
+		, int generation)
+	{
+		boost::shared_ptr<geoip_table> db(new geoip_table);
+		if (!db->load(file, t)) db.reset();
+		m_io_service.post(boost::bind(&session_impl::on_geoip_loaded
+			, this, boost::shared_ptr<geoip_table const>(db), t, generation));
+	}
+
+	void session_impl::on_geoip_loaded(boost::shared_ptr<geoip_table const> db
+		, geoip_table::db_type t, int generation)
+	{
+		TORRENT_ASSERT(is_network_thread());
+
+		// the loader posted this as the last thing it did, so joining
+		// it doesn't block. On abort, it has been joined already
+		geoip_threads_t::iterator i = m_geoip_threads.find(geoip_key(t, generation));
+		if (i != m_geoip_threads.end())
+		{
+			i->second->join();
+			m_geoip_threads.erase(i);
+		}
+
+		// a later load was requested while this one was running
+		if (m_abort || generation != m_geoip_generation[t]) return;
+
+		// like GeoIP_open() used to, a file that fails to load
+		// leaves us without a database
+		if (t == geoip_table::asnum_db) m_asnum_db = db;
+		else m_country_db = db;
+	}
+
+	void session_impl::load_asnum_db(std::string file)
+	{
+		TORRENT_ASSERT(is_network_thread());
+		load_geoip_db(file, geoip_table::asnum_db);
 	}
 
 #if TORRENT_USE_WSTRING
@@ -1586,32 +1630,25 @@ namespace aux {
 	{
 		TORRENT_ASSERT(is_network_thread());
 
-		if (m_asnum_db) GeoIP_delete(m_asnum_db);
 		std::string utf8;
 		wchar_utf8(file, utf8);
-		m_asnum_db = GeoIP_open(utf8.c_str(), GEOIP_STANDARD);
-//		return m_asnum_db;
+		load_geoip_db(utf8, geoip_table::asnum_db);
 	}
 
 	void session_impl::load_country_dbw(std::wstring file)
 	{
 		TORRENT_ASSERT(is_network_thread());
 
-		if (m_country_db) GeoIP_delete(m_country_db);
 		std::string utf8;
 		wchar_utf8(file, utf8);
-		m_country_db = GeoIP_open(utf8.c_str(), GEOIP_STANDARD);
-//		return m_country_db;
+		load_geoip_db(utf8, geoip_table::country_db);
 	}
 #endif // TORRENT_USE_WSTRING
 
 	void session_impl::load_country_db(std::string file)
 	{
 		TORRENT_ASSERT(is_network_thread());
-
-		if (m_country_db) GeoIP_delete(m_country_db);
-		m_country_db = GeoIP_open(file.c_str(), GEOIP_STANDARD);
-//		return m_country_db;
+		load_geoip_db(file, geoip_table::country_db);
 	}
 
 #endif // TORRENT_DISABLE_GEO_IP
@@ -1831,13 +1868,20 @@ namespace aux {
 		m_external_udp_port = 0;
 
 #ifndef TORRENT_DISABLE_GEO_IP
-		if (m_asnum_db) GeoIP_delete(m_asnum_db);
-		if (m_country_db) GeoIP_delete(m_country_db);
-		m_asnum_db = 0;
-		m_country_db = 0;
+		// a load still in progress finishes here. Its result
+		// is posted after m_abort is set, and dropped
+		for (geoip_threads_t::iterator i = m_geoip_threads.begin()
+			, end(m_geoip_threads.end()); i != end; ++i)
+			i->second->join();
+		m_geoip_threads.clear();
+		m_asnum_db.reset();
+		m_country_db.reset();
 #endif
 
 		m_disk_thread.abort();
+#ifndef TORRENT_DISABLE_ENCRYPTION
+		m_dh_key_pool.abort();
+#endif
 	}
 
 	void session_impl::set_port_filter(port_filter const& f)
@@ -1850,6 +1894,8 @@ namespace aux {
 	{
 		INVARIANT_CHECK;
 
+		// f is compiled by session::set_ip_filter(), so
+		// this doesn't copy the filter tables
 		m_ip_filter = f;
 
 		// Close connections whose endpoint is filtered
@@ -1887,8 +1933,11 @@ namespace aux {
 		bool update_disk_io_thread = false;
 		if (m_settings.cache_size != s.cache_size
 			|| m_settings.cache_expiry != s.cache_expiry
+			|| m_settings.adaptive_disk_cache != s.adaptive_disk_cache
 			|| m_settings.optimize_hashing_for_speed != s.optimize_hashing_for_speed
 			|| m_settings.file_checks_delay_per_block != s.file_checks_delay_per_block
+			|| m_settings.file_check_threads != s.file_check_threads
+			|| m_settings.file_check_read_ahead != s.file_check_read_ahead
 			|| m_settings.disk_cache_algorithm != s.disk_cache_algorithm
 			|| m_settings.read_cache_line_size != s.read_cache_line_size
 			|| m_settings.write_cache_line_size != s.write_cache_line_size
@@ -1901,6 +1950,7 @@ namespace aux {
 #ifndef TORRENT_DISABLE_MLOCK
 			|| m_settings.lock_disk_cache != s.lock_disk_cache
 #endif
+			|| m_settings.disk_cache_large_pages != s.disk_cache_large_pages
 			|| m_settings.use_read_cache != s.use_read_cache
 			|| m_settings.disk_io_write_mode != s.disk_io_write_mode
 			|| m_settings.disk_io_read_mode != s.disk_io_read_mode
@@ -1910,13 +1960,29 @@ namespace aux {
 			|| m_settings.no_atime_storage!= s.no_atime_storage
 			|| m_settings.ignore_resume_timestamps != s.ignore_resume_timestamps
 			|| m_settings.no_recheck_incomplete_resume != s.no_recheck_incomplete_resume
+			|| m_settings.resume_file_samples != s.resume_file_samples
 			|| m_settings.low_prio_disk != s.low_prio_disk
-			|| m_settings.lock_files != s.lock_files)
+			|| m_settings.lock_files != s.lock_files
+			|| m_settings.collect_metrics != s.collect_metrics)
 			update_disk_io_thread = true;
 
 		bool connections_limit_changed = m_settings.connections_limit != s.connections_limit;
 		bool unchoke_limit_changed = m_settings.unchoke_slots_limit != s.unchoke_slots_limit;
 
+		// large pages need the right to lock memory enabled before the
+		// disk thread allocates any. The regions that can't get them
+		// are counted in disk_pool_status::large_page_failures
+		if (s.disk_cache_large_pages && !m_settings.disk_cache_large_pages
+			&& !large_page_allocator::enable_large_pages())
+		{
+#if defined TORRENT_LOGGING
+			(*m_logger) << time_now_string() << " *** LARGE PAGES UNAVAILABLE\n";
+#endif
+			if (m_alerts.should_post<performance_alert>())
+				m_alerts.post_alert(performance_alert(
+					torrent_handle(), performance_alert::large_pages_unavailable));
+		}
+
 #ifndef TORRENT_NO_DEPRECATE
 		// support deprecated choker settings
 		if (s.choking_algorithm == session_settings::rate_based_choker)
@@ -2017,6 +2083,12 @@ namespace aux {
 		if (m_settings.cache_buffer_chunk_size <= 0)
 			m_settings.cache_buffer_chunk_size = 1;
 
+		// the rate limiters and uTP sockets don't have a way back to the
+		// session, so they're handed the metrics to record into
+		m_download_rate.m_metrics = metrics();
+		m_upload_rate.m_metrics = metrics();
+		m_utp_socket_manager.set_metrics(metrics());
+
 		update_rate_settings();
 
 		if (connections_limit_changed) update_connections_limit();
@@ -2046,6 +2118,10 @@ namespace aux {
 		if (update_disk_io_thread)
 			update_disk_thread_settings();
 
+#ifndef TORRENT_DISABLE_ENCRYPTION
+		m_dh_key_pool.set_size((std::max)(m_settings.dh_key_pool_size, 0));
+#endif
+
 		if (m_settings.num_optimistic_unchoke_slots >= m_allowed_upload_slots / 2)
 		{
 			if (m_alerts.should_post<performance_alert>())
@@ -2931,6 +3007,18 @@ namespace aux {
 		return port;
 	}
 
+	void session_impl::record_handshake_latency(int ms)
+	{
+		TORRENT_ASSERT(is_network_thread());
+		if (int(m_handshake_latency.size()) < 1000)
+		{
+			m_handshake_latency.push_back(ms);
+			return;
+		}
+		m_handshake_latency[m_handshake_latency_cursor] = ms;
+		m_handshake_latency_cursor = (m_handshake_latency_cursor + 1) % 1000;
+	}
+
 	// this function is called from the disk-io thread
 	// when the disk queue is low enough to post new
 	// write jobs to it. It will go through all peer
@@ -3233,13 +3321,7 @@ namespace aux {
 		if (num_checking == 0 && num_queued > 0 && !m_paused)
 		{
 			TORRENT_ASSERT(false);
-			check_queue_t::iterator i = std::min_element(m_queued_for_checking.begin()
-				, m_queued_for_checking.end(), boost::bind(&torrent::queue_position, _1)
-				< boost::bind(&torrent::queue_position, _2));
-			if (i != m_queued_for_checking.end())
-			{
-				(*i)->start_checking();
-			}
+			start_queued_checks();
 		}
 
 #ifndef TORRENT_DISABLE_DHT
@@ -4770,6 +4852,16 @@ namespace aux {
 		m_alerts.post_alert_ptr(alert.release());
 	}
 
+	void session_impl::post_session_stats()
+	{
+		TORRENT_ASSERT(is_network_thread());
+
+		session_metrics m = m_metrics;
+		m.add(m_disk_thread.metrics());
+
+		m_alerts.post_alert(session_stats_alert(m));
+	}
+
 	std::vector<torrent_handle> session_impl::get_torrents() const
 	{
 		std::vector<torrent_handle> ret;
@@ -4798,6 +4890,19 @@ namespace aux {
 		delete params;
 	}
 
+	void session_impl::async_add_torrents(std::vector<add_torrent_params>* params)
+	{
+		for (std::vector<add_torrent_params>::iterator i = params->begin()
+			, end(params->end()); i != end; ++i)
+		{
+			error_code ec;
+			torrent_handle handle = add_torrent(*i, ec);
+			m_alerts.post_alert(add_torrent_alert(handle, *i, ec));
+			delete i->resume_data;
+		}
+		delete params;
+	}
+
 	torrent_handle session_impl::add_torrent(add_torrent_params const& p
 		, error_code& ec)
 	{
@@ -4940,7 +5045,8 @@ namespace aux {
 		if (m_abort) return;
 		TORRENT_ASSERT(t->should_check_files());
 		TORRENT_ASSERT(t->state() != torrent_status::checking_files);
-		if (m_queued_for_checking.empty()) t->start_checking();
+		// torrents on different devices are checked in parallel
+		if (!is_checking_device(t->checking_device())) t->start_checking();
 		else t->set_state(torrent_status::queued_for_checking);
 		TORRENT_ASSERT(std::find(m_queued_for_checking.begin()
 			, m_queued_for_checking.end(), t) == m_queued_for_checking.end());
@@ -4955,34 +5061,64 @@ namespace aux {
 
 		if (m_queued_for_checking.empty()) return;
 
-		boost::shared_ptr<torrent> next_check = *m_queued_for_checking.begin();
-		check_queue_t::iterator done = m_queued_for_checking.end();
+		check_queue_t::iterator done = std::find(m_queued_for_checking.begin()
+			, m_queued_for_checking.end(), t);
+		TORRENT_ASSERT(done != m_queued_for_checking.end());
+		if (done == m_queued_for_checking.end()) return;
+
+#ifdef TORRENT_DEBUG
+		// the reason m_paused is in there is because when the session
+		// is paused, all torrents  that are queued ar all of a sudden
+		// not supposed to be queued anymore. The first torrent that gets
+		// removed from the queue will hence trigger this assert, without
+		// the m_paused exception
 		for (check_queue_t::iterator i = m_queued_for_checking.begin()
 			, end(m_queued_for_checking.end()); i != end; ++i)
-		{
-			// the reason m_paused is in there is because when the session
-			// is paused, all torrents  that are queued ar all of a sudden
-			// not supposed to be queued anymore. The first torrent that gets
-			// removed from the queue will hence trigger this assert, without
-			// the m_paused exception
 			TORRENT_ASSERT(*i == t || (*i)->should_check_files() || m_paused);
-			if (*i == t) done = i;
-			else if (next_check == t || next_check->queue_position() > (*i)->queue_position())
-				next_check = *i;
+#endif
+
+		bool was_checking = t->state() == torrent_status::checking_files;
+		m_queued_for_checking.erase(done);
+
+		// only start a new one if we removed one that is checking
+		if (was_checking) start_queued_checks();
+	}
+
+	bool session_impl::is_checking_device(boost::uint64_t device) const
+	{
+		for (check_queue_t::const_iterator i = m_queued_for_checking.begin()
+			, end(m_queued_for_checking.end()); i != end; ++i)
+		{
+			if ((*i)->state() == torrent_status::checking_files
+				&& (*i)->checking_device() == device)
+				return true;
 		}
-		TORRENT_ASSERT(next_check != t || m_queued_for_checking.size() == 1);
-		// only start a new one if we removed the one that is checking
-		TORRENT_ASSERT(done != m_queued_for_checking.end());
-		if (done == m_queued_for_checking.end()) return;
+		return false;
+	}
+
+	void session_impl::start_queued_checks()
+	{
+		if (m_paused) return;
 
-		if (next_check != t
-			&& t->state() == torrent_status::checking_files
-			&& !m_paused)
+		// start the queued torrents in queue order, one per
+		// device that isn't already being checked
+		std::vector<boost::shared_ptr<torrent> > queued;
+		for (check_queue_t::iterator i = m_queued_for_checking.begin()
+			, end(m_queued_for_checking.end()); i != end; ++i)
 		{
-			next_check->start_checking();
+			if ((*i)->state() != torrent_status::queued_for_checking) continue;
+			if (!(*i)->should_check_files()) continue;
+			queued.push_back(*i);
 		}
+		std::sort(queued.begin(), queued.end(), boost::bind(&torrent::queue_position, _1)
+			< boost::bind(&torrent::queue_position, _2));
 
-		m_queued_for_checking.erase(done);
+		for (std::vector<boost::shared_ptr<torrent> >::iterator i = queued.begin()
+			, end(queued.end()); i != end; ++i)
+		{
+			if (is_checking_device((*i)->checking_device())) continue;
+			(*i)->start_checking();
+		}
 	}
 
 	void session_impl::remove_torrent(const torrent_handle& h, int options)
@@ -4999,6 +5135,15 @@ namespace aux {
 		tptr->set_queue_position(-1);
 	}
 
+	void session_impl::remove_torrents(std::vector<torrent_handle> const& h, int options)
+	{
+		for (std::vector<torrent_handle>::const_iterator i = h.begin()
+			, end(h.end()); i != end; ++i)
+		{
+			remove_torrent(*i, options);
+		}
+	}
+
 	void session_impl::remove_torrent_impl(boost::shared_ptr<torrent> tptr, int options)
 	{
 		INVARIANT_CHECK;
@@ -5256,6 +5401,25 @@ namespace aux {
 		s.allowed_upload_slots = m_allowed_upload_slots;
 
 		s.total_redundant_bytes = m_total_redundant_bytes;
+		s.total_recv_copied_bytes = m_total_recv_copied_bytes;
+
+		s.handshake_latency_p50 = 0;
+		s.handshake_latency_p90 = 0;
+		s.handshake_latency_p99 = 0;
+		if (!m_handshake_latency.empty())
+		{
+			std::vector<int> lat(m_handshake_latency);
+			int const n = int(lat.size());
+			int const pct[] = {50, 90, 99};
+			int* out[] = {&s.handshake_latency_p50, &s.handshake_latency_p90
+				, &s.handshake_latency_p99};
+			for (int i = 0; i < 3; ++i)
+			{
+				std::vector<int>::iterator p = lat.begin() + (n - 1) * pct[i] / 100;
+				std::nth_element(lat.begin(), p, lat.end());
+				*out[i] = *p;
+			}
+		}
 		s.total_failed_bytes = m_total_failed_bytes;
 
 		s.up_bandwidth_queue = m_upload_rate.queue_size();
@@ -5338,6 +5502,8 @@ namespace aux {
 
 		m_utp_socket_manager.get_status(s.utp_stats);
 
+		m_files.get_status(s.file_pool_stats);
+
 		int peerlist_size = 0;
 		for (torrent_map::const_iterator i = m_torrents.begin()
 			, end(m_torrents.end()); i != end; ++i)
@@ -6050,8 +6216,9 @@ namespace aux {
 			}
 		}
 
-		// the queue is either empty, or it has exactly one checking torrent in it
-		TORRENT_ASSERT(m_queued_for_checking.empty() || num_checking == 1 || (m_paused && num_checking == 0));
+		// the queue is either empty, or it has at least one checking torrent
+		// in it (one per device)
+		TORRENT_ASSERT(m_queued_for_checking.empty() || num_checking >= 1 || (m_paused && num_checking == 0));
 //		TORRENT_ASSERT(m_queued_for_checking.size() == num_queued_for_checking);
 
 		std::set<int> unique;
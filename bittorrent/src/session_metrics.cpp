@@ -0,0 +1,119 @@
+/*
+
+Copyright (c) 2012, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/pch.hpp"
+
+#include <cstring>
+
+#include "libtorrent/session_metrics.hpp"
+#include "libtorrent/assert.hpp"
+
+namespace libtorrent
+{
+	namespace
+	{
+		// these must be kept in the same order as the enums
+		char const* counter_names[] =
+		{
+			"disk_job_errors",
+			"picked_blocks",
+			"bandwidth_immediate_requests",
+			"bandwidth_partial_requests",
+		};
+
+		char const* histogram_names[] =
+		{
+			"disk_read_latency",
+			"disk_write_latency",
+			"disk_hash_latency",
+			"disk_other_latency",
+			"picker_time",
+			"bandwidth_wait_time",
+			"utp_rtt",
+			"message_parse_time",
+		};
+	}
+
+	session_metrics::session_metrics()
+	{
+		std::memset(counters, 0, sizeof(counters));
+		std::memset(histograms, 0, sizeof(histograms));
+	}
+
+	void session_metrics::add(session_metrics const& m)
+	{
+		for (int i = 0; i < num_counters; ++i)
+			counters[i] += m.counters[i];
+
+		for (int i = 0; i < num_histograms; ++i)
+			for (int j = 0; j < num_buckets; ++j)
+				histograms[i][j] += m.histograms[i][j];
+	}
+
+	boost::uint64_t session_metrics::num_samples(int h) const
+	{
+		TORRENT_ASSERT(h >= 0 && h < num_histograms);
+		boost::uint64_t ret = 0;
+		for (int i = 0; i < num_buckets; ++i)
+			ret += histograms[h][i];
+		return ret;
+	}
+
+	int session_metrics::bucket(boost::int64_t microseconds)
+	{
+		if (microseconds <= 0) return 0;
+
+		// one more than the index of the highest set bit
+		int ret = 1;
+		while (microseconds > 1 && ret < num_buckets - 1)
+		{
+			microseconds >>= 1;
+			++ret;
+		}
+		return ret;
+	}
+
+	char const* session_metrics::counter_name(int c)
+	{
+		TORRENT_ASSERT(sizeof(counter_names) / sizeof(counter_names[0]) == num_counters);
+		if (c < 0 || c >= num_counters) return "";
+		return counter_names[c];
+	}
+
+	char const* session_metrics::histogram_name(int h)
+	{
+		TORRENT_ASSERT(sizeof(histogram_names) / sizeof(histogram_names[0]) == num_histograms);
+		if (h < 0 || h >= num_histograms) return "";
+		return histogram_names[h];
+	}
+}
+
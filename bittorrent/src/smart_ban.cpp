@@ -40,6 +40,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include <boost/shared_ptr.hpp>
 #include <boost/enable_shared_from_this.hpp>
+#include <boost/unordered_map.hpp>
 
 #ifdef _MSC_VER
 #pragma warning(pop)
@@ -122,6 +123,8 @@ namespace
 		smart_ban_plugin(torrent& t)
 			: m_torrent(t)
 			, m_salt(random())
+			, m_clock(0)
+			, m_num_blocks(0)
 		{
 #ifdef TORRENT_LOG_HASH_FAILURES
 			m_log_file = NULL;
@@ -133,52 +136,62 @@ namespace
 		{ fclose(m_log_file); }
 #endif
 
+		void on_files_checked()
+		{
+			// have the disk thread hash the blocks as they're written,
+			// so that a failed piece doesn't have to be read back
+			if (m_torrent.get_storage() == 0) return;
+			m_torrent.filesystem().enable_block_hashes(m_salt);
+		}
+
 		void on_piece_pass(int p)
 		{
 #ifdef TORRENT_LOGGING
 			(*m_torrent.session().m_logger) << time_now_string() << " PIECE PASS [ p: " << p
-				<< " | block_hash_size: " << m_block_hashes.size() << " ]\n";
+				<< " | block_hash_size: " << m_num_blocks << " ]\n";
 #endif
+			// the block hashes of the good data, if this piece failed before.
+			// They're always taken, to release them
+			std::vector<sha1_hash> hashes;
+			if (m_torrent.get_storage())
+				m_torrent.filesystem().take_block_hashes(p, hashes);
+
 			// has this piece failed earlier? If it has, go through the
 			// CRCs from the time it failed and ban the peers that
 			// sent bad blocks
-			std::map<piece_block, block_entry>::iterator i = m_block_hashes.lower_bound(piece_block(p, 0));
-			if (i == m_block_hashes.end() || int(i->first.piece_index) != p) return;
+			piece_map::iterator i = m_block_hashes.find(p);
+			if (i == m_block_hashes.end()) return;
 
+			std::vector<block_entry>& blocks = i->second.blocks;
 			int size = m_torrent.torrent_file().piece_size(p);
 			peer_request r = {p, 0, (std::min)(16*1024, size)};
-			piece_block pb(p, 0);
-			while (size > 0)
+			for (int b = 0; b < int(blocks.size()); ++b)
 			{
-				if (i->first.block_index == pb.block_index)
-				{
-					m_torrent.filesystem().async_read(r, boost::bind(&smart_ban_plugin::on_read_ok_block
-						, shared_from_this(), *i, _1, _2));
-					m_block_hashes.erase(i++);
-				}
-				else
+				r.start = b * 16*1024;
+				r.length = (std::min)(16*1024, size - r.start);
+				block_entry const& e = blocks[b];
+				if (e.peer == 0) continue;
+
+				piece_block pb(p, b);
+				if (b < int(hashes.size()) && !hashes[b].is_all_zeros())
 				{
-					TORRENT_ASSERT(i->first.block_index > pb.block_index);
+					verify_block(pb, e, hashes[b]);
+					continue;
 				}
 
-				if (i == m_block_hashes.end() || int(i->first.piece_index) != p)
-					break;
-
-				r.start += 16*1024;
-				size -= 16*1024;
-				r.length = (std::min)(16*1024, size);
-				++pb.block_index;
+				// this block wasn't hashed while it was written,
+				// fall back to reading it back
+				m_torrent.filesystem().async_read(r, boost::bind(&smart_ban_plugin::on_read_ok_block
+					, shared_from_this(), std::make_pair(pb, e), _1, _2));
 			}
 
-#ifndef NDEBUG
-			// make sure we actually removed all the entries for piece 'p'
-			i = m_block_hashes.lower_bound(piece_block(p, 0));
-			TORRENT_ASSERT(i == m_block_hashes.end() || int(i->first.piece_index) != p);
-#endif
+			m_num_blocks -= i->second.num_recorded;
+			m_block_hashes.erase(i);
 
 			if (m_torrent.is_seed())
 			{
-				std::map<piece_block, block_entry>().swap(m_block_hashes);
+				piece_map().swap(m_block_hashes);
+				m_num_blocks = 0;
 				return;
 			}
 		}
@@ -195,6 +208,11 @@ namespace
 			std::vector<void*> downloaders;
 			m_torrent.picker().get_downloaders(downloaders, p);
 
+			// the hashes of the blocks we got, computed by the disk
+			// thread as they were written
+			std::vector<sha1_hash> hashes;
+			m_torrent.filesystem().take_block_hashes(p, hashes);
+
 			int size = m_torrent.torrent_file().piece_size(p);
 			peer_request r = {p, 0, (std::min)(16*1024, size)};
 			piece_block pb(p, 0);
@@ -203,8 +221,17 @@ namespace
 			{
 				if (*i != 0)
 				{
-					m_torrent.filesystem().async_read(r, boost::bind(&smart_ban_plugin::on_read_failed_block
-						, shared_from_this(), pb, ((policy::peer*)*i)->address(), _1, _2));
+					address a = ((policy::peer*)*i)->address();
+					int b = pb.block_index;
+					if (b < int(hashes.size()) && !hashes[b].is_all_zeros())
+					{
+						add_block_hash(pb, a, hashes[b]);
+					}
+					else
+					{
+						m_torrent.filesystem().async_read(r, boost::bind(&smart_ban_plugin::on_read_failed_block
+							, shared_from_this(), pb, a, _1, _2));
+					}
 				}
 
 				r.start += 16*1024;
@@ -215,6 +242,19 @@ namespace
 			TORRENT_ASSERT(size <= 0);
 		}
 
+		void on_piece_error(int p)
+		{
+			// the piece is downloaded again. Its records would only be
+			// dropped once it passes or fails, which may never happen
+			if (m_torrent.get_storage())
+				m_torrent.filesystem().drop_block_hashes(p);
+
+			piece_map::iterator i = m_block_hashes.find(p);
+			if (i == m_block_hashes.end()) return;
+			m_num_blocks -= i->second.num_recorded;
+			m_block_hashes.erase(i);
+		}
+
 	private:
 
 		// this entry ties a specific block CRC to
@@ -225,6 +265,22 @@ namespace
 			sha1_hash digest;
 		};
 
+		// the blocks of one piece that failed the hash check
+		struct piece_entry
+		{
+			// the value of m_clock when a block was last recorded
+			// for this piece. The stalest piece is evicted first
+			boost::uint32_t last_used;
+			// the number of entries in blocks with a peer
+			int num_recorded;
+			// indexed by block. Blocks without a record have peer 0
+			std::vector<block_entry> blocks;
+		};
+
+		// the most blocks we keep records for. Pieces that fail and
+		// never pass would otherwise pile up
+		enum { max_blocks = 16 * 1024 };
+
 		void on_read_failed_block(piece_block b, address a, int ret, disk_io_job const& j)
 		{
 			TORRENT_ASSERT(m_torrent.session().is_network_thread());
@@ -238,6 +294,16 @@ namespace
 			h.update(j.buffer, j.buffer_size);
 			h.update((char const*)&m_salt, sizeof(m_salt));
 
+#ifdef TORRENT_LOG_HASH_FAILURES
+			log_hash_block(&m_log_file, m_torrent, b.piece_index
+				, b.block_index, a, j.buffer, j.buffer_size, true);
+#endif
+
+			add_block_hash(b, a, h.final());
+		}
+
+		void add_block_hash(piece_block b, address const& a, sha1_hash const& digest)
+		{
 			std::pair<policy::iterator, policy::iterator> range
 				= m_torrent.get_policy().find_peers(a);
 
@@ -245,19 +311,23 @@ namespace
 			if (range.first == range.second) return;
 
 			policy::peer* p = (*range.first);
-			block_entry e = {p, h.final()};
-
-#ifdef TORRENT_LOG_HASH_FAILURES
-			log_hash_block(&m_log_file, m_torrent, b.piece_index
-				, b.block_index, p->address(), j.buffer, j.buffer_size, true);
-#endif
+			block_entry e = {p, digest};
 
-			std::map<piece_block, block_entry>::iterator i = m_block_hashes.lower_bound(b);
+			piece_entry& pe = m_block_hashes[b.piece_index];
+			if (pe.blocks.empty())
+			{
+				block_entry none = {0, sha1_hash()};
+				pe.num_recorded = 0;
+				pe.blocks.resize((m_torrent.torrent_file().piece_size(b.piece_index)
+					+ 16*1024 - 1) / (16*1024), none);
+			}
+			pe.last_used = ++m_clock;
+			block_entry& i = pe.blocks[b.block_index];
 
-			if (i != m_block_hashes.end() && i->first == b && i->second.peer == p)
+			if (i.peer == p)
 			{
 				// this peer has sent us this block before
-				if (i->second.digest != e.digest)
+				if (i.digest != e.digest)
 				{
 					// this time the digest of the block is different
 					// from the first time it sent it
@@ -280,7 +350,7 @@ namespace
 					(*m_torrent.session().m_logger) << time_now_string() << " BANNING PEER [ p: " << b.piece_index
 						<< " | b: " << b.block_index
 						<< " | c: " << client
-						<< " | hash1: " << i->second.digest
+						<< " | hash1: " << i.digest
 						<< " | hash2: " << e.digest
 						<< " | ip: " << p->ip() << " ]\n";
 #endif
@@ -292,8 +362,14 @@ namespace
 				// we don't have to insert it
 				return;
 			}
-			
-			m_block_hashes.insert(i, std::pair<const piece_block, block_entry>(b, e));
+
+			// the first peer to send a block keeps the record
+			if (i.peer != 0) return;
+
+			i = e;
+			++pe.num_recorded;
+			++m_num_blocks;
+			if (m_num_blocks > max_blocks) evict_stalest(b.piece_index);
 
 #ifdef TORRENT_LOGGING
 			char const* client = "-";
@@ -310,7 +386,28 @@ namespace
 				<< " | ip: " << p->ip() << " ]\n";
 #endif
 		}
-		
+
+		// drops the pieces that have gone the longest without a new
+		// record, until we're back under the limit. The piece that's
+		// being recorded is never dropped
+		void evict_stalest(int keep)
+		{
+			while (m_num_blocks > max_blocks && m_block_hashes.size() > 1)
+			{
+				piece_map::iterator stalest = m_block_hashes.end();
+				for (piece_map::iterator i = m_block_hashes.begin()
+					, end(m_block_hashes.end()); i != end; ++i)
+				{
+					if (i->first == keep) continue;
+					if (stalest == m_block_hashes.end()
+						|| boost::int32_t(i->second.last_used - stalest->second.last_used) < 0)
+						stalest = i;
+				}
+				m_num_blocks -= stalest->second.num_recorded;
+				m_block_hashes.erase(stalest);
+			}
+		}
+
 		void on_read_ok_block(std::pair<piece_block, block_entry> b, int ret, disk_io_job const& j)
 		{
 			TORRENT_ASSERT(m_torrent.session().is_network_thread());
@@ -325,15 +422,23 @@ namespace
 			h.update((char const*)&m_salt, sizeof(m_salt));
 			sha1_hash ok_digest = h.final();
 
-			policy::peer* p = b.second.peer;
-
-			if (b.second.digest == ok_digest) return;
-
 #ifdef TORRENT_LOG_HASH_FAILURES
-			log_hash_block(&m_log_file, m_torrent, b.first.piece_index
-				, b.first.block_index, p->address(), j.buffer, j.buffer_size, false);
+			if (b.second.digest != ok_digest)
+				log_hash_block(&m_log_file, m_torrent, b.first.piece_index
+					, b.first.block_index, b.second.peer->address(), j.buffer, j.buffer_size, false);
 #endif
 
+			verify_block(b.first, b.second, ok_digest);
+		}
+
+		// bans the peer that sent the block in e if it doesn't
+		// match the block that passed the piece hash check
+		void verify_block(piece_block b, block_entry const& e, sha1_hash const& ok_digest)
+		{
+			policy::peer* p = e.peer;
+
+			if (e.digest == ok_digest) return;
+
 			if (p == 0) return;
 			if (!m_torrent.get_policy().has_peer(p)) return;
 
@@ -345,11 +450,11 @@ namespace
 				p->connection->get_peer_info(info);
 				client = info.client.c_str();
 			}
-			(*m_torrent.session().m_logger) << time_now_string() << " BANNING PEER [ p: " << b.first.piece_index
-				<< " | b: " << b.first.block_index
+			(*m_torrent.session().m_logger) << time_now_string() << " BANNING PEER [ p: " << b.piece_index
+				<< " | b: " << b.block_index
 				<< " | c: " << client
 				<< " | ok_digest: " << ok_digest
-				<< " | bad_digest: " << b.second.digest
+				<< " | bad_digest: " << e.digest
 				<< " | ip: " << p->ip() << " ]\n";
 #endif
 			m_torrent.get_policy().ban_peer(p);
@@ -359,10 +464,11 @@ namespace
 		
 		torrent& m_torrent;
 
-		// This table maps a piece_block (piece and block index
-		// pair) to a peer and the block CRC. The CRC is calculated
-		// from the data in the block + the salt
-		std::map<piece_block, block_entry> m_block_hashes;
+		// This table maps a piece that failed the hash check to the
+		// peer and the block CRC of each of its blocks. The CRC is
+		// calculated from the data in the block + the salt
+		typedef boost::unordered_map<int, piece_entry> piece_map;
+		piece_map m_block_hashes;
 
 		// This salt is a random value used to calculate the block CRCs
 		// Since the CRC function that is used is not a one way function
@@ -370,6 +476,13 @@ namespace
 		// that is forged to match the CRC of the good data.
 		int m_salt;
 
+		// incremented every time a block is recorded, used to age
+		// the entries in m_block_hashes
+		boost::uint32_t m_clock;
+
+		// the number of blocks with a record in m_block_hashes
+		int m_num_blocks;
+
 #ifdef TORRENT_LOG_HASH_FAILURES
 		FILE* m_log_file;
 #endif
@@ -0,0 +1,152 @@
+/*
+
+Copyright (c) 2012, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/pch.hpp"
+
+#include "libtorrent/status_table.hpp"
+#include "libtorrent/assert.hpp"
+
+#if defined TORRENT_WINDOWS || defined TORRENT_CYGWIN
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#endif
+
+namespace libtorrent
+{
+	namespace
+	{
+		// keeps both the compiler and the CPU from moving
+		// memory accesses across it
+		inline void memory_barrier()
+		{
+#if defined TORRENT_WINDOWS || defined TORRENT_CYGWIN
+			MemoryBarrier();
+#else
+			__sync_synchronize();
+#endif
+		}
+	}
+
+	status_table::status_table()
+		: m_num_chunks(0)
+		, m_size(0)
+	{}
+
+	status_table::~status_table()
+	{
+		for (int i = 0; i < m_num_chunks; ++i)
+			delete[] m_chunks[i];
+	}
+
+	int status_table::allocate()
+	{
+		int slot;
+		if (!m_free.empty())
+		{
+			slot = m_free.back();
+			m_free.pop_back();
+		}
+		else
+		{
+			if (m_size == m_num_chunks * chunk_size)
+			{
+				if (m_num_chunks == max_chunks) return -1;
+				entry* c = new entry[chunk_size];
+				for (int i = 0; i < chunk_size; ++i)
+				{
+					c[i].seq = 0;
+					c[i].valid = false;
+				}
+				m_chunks[m_num_chunks++] = c;
+			}
+			slot = m_size++;
+		}
+
+		// the slot may have belonged to another torrent. Readers
+		// of the new one shouldn't see that one's status
+		entry& e = m_chunks[slot / chunk_size][slot % chunk_size];
+		begin_write(e);
+		e.valid = false;
+		end_write(e);
+		return slot;
+	}
+
+	void status_table::release(int slot)
+	{
+		if (slot < 0) return;
+		TORRENT_ASSERT(slot < m_size);
+		m_free.push_back(slot);
+	}
+
+	void status_table::write(int slot, torrent_status_record const& st)
+	{
+		if (slot < 0) return;
+		TORRENT_ASSERT(slot < m_size);
+		entry& e = m_chunks[slot / chunk_size][slot % chunk_size];
+		begin_write(e);
+		e.rec = st;
+		e.valid = true;
+		end_write(e);
+	}
+
+	bool status_table::read(int slot, torrent_status_record& st) const
+	{
+		if (slot < 0) return false;
+		entry const& e = m_chunks[slot / chunk_size][slot % chunk_size];
+
+		for (;;)
+		{
+			boost::uint32_t seq = e.seq;
+			if (seq & 1) continue;
+			memory_barrier();
+			bool valid = e.valid;
+			st = e.rec;
+			memory_barrier();
+			if (e.seq == seq) return valid;
+		}
+	}
+
+	void status_table::begin_write(entry& e)
+	{
+		TORRENT_ASSERT((e.seq & 1) == 0);
+		e.seq = e.seq + 1;
+		memory_barrier();
+	}
+
+	void status_table::end_write(entry& e)
+	{
+		memory_barrier();
+		e.seq = e.seq + 1;
+	}
+}
@@ -210,6 +210,37 @@ namespace libtorrent
 		return true;
 	}
 
+	// hashes three small samples of the file, at the start, in the middle
+	// and at the end. This is used to tell whether a file whose timestamp
+	// changed still has the content it had when the resume data was saved.
+	// Returns 0 if the file couldn't be read
+	boost::uint32_t sample_file(std::string const& path, size_type size)
+	{
+		if (size <= 0) return 0;
+
+		error_code ec;
+		file f(path, file::read_only, ec);
+		if (ec) return 0;
+
+		const int sample_size = 4096;
+		char buf[sample_size];
+		size_type offsets[] = { 0, size / 2, size - sample_size };
+		hasher h;
+		for (int i = 0; i < 3; ++i)
+		{
+			size_type offset = (std::max)(offsets[i], size_type(0));
+			int len = int((std::min)(size_type(sample_size), size - offset));
+			file::iovec_t b = { buf, len };
+			if (f.readv(offset, &b, 1, ec) != len || ec) return 0;
+			h.update(buf, len);
+		}
+		sha1_hash digest = h.final();
+		return (boost::uint32_t(digest[0]) << 24)
+			| (boost::uint32_t(digest[1]) << 16)
+			| (boost::uint32_t(digest[2]) << 8)
+			| boost::uint32_t(digest[3]);
+	}
+
 	void storage_interface::set_error(std::string const& file, error_code const& ec) const
 	{
 		m_error_file = file;
@@ -311,6 +342,33 @@ namespace libtorrent
 	}
 #endif
 
+	void hash_check_batch(check_batch& b)
+	{
+		b.hashes.resize(b.num_read);
+		char const* buf = b.buffer.get();
+		int left = b.num_bytes;
+		for (int i = 0; i < b.num_read; ++i)
+		{
+			int size = (std::min)(b.piece_length, left);
+			hasher h;
+			if (size != b.small_piece_size)
+			{
+				h.update(buf, b.small_piece_size);
+				b.hashes[i].second = hasher(h).final();
+				h.update(buf + b.small_piece_size, size - b.small_piece_size);
+			}
+			else
+			{
+				h.update(buf, size);
+			}
+			b.hashes[i].first = h.final();
+			buf += size;
+			left -= size;
+		}
+		TORRENT_ASSERT(left == 0);
+		b.buffer.reset();
+	}
+
 	int piece_manager::hash_for_slot(int slot, partial_hash& ph, int piece_size
 		, int small_piece_size, sha1_hash* small_hash)
 	{
@@ -604,10 +662,115 @@ namespace libtorrent
 			p.push_back(entry(i->second));
 			fl.push_back(entry(p));
 		}
+
+		if (m_settings && settings().resume_file_samples)
+		{
+			entry::list_type& sl = rd["file samples"].list();
+			m_file_samples.resize(files().num_files());
+			std::vector<std::pair<size_type, std::time_t> >::iterator fs
+				= file_sizes.begin();
+			std::vector<file_sample>::iterator cached = m_file_samples.begin();
+			for (file_storage::iterator i = files().begin()
+				, end(files().end()); i != end; ++i, ++fs, ++cached)
+			{
+				if (i->pad_file)
+				{
+					sl.push_back(entry(size_type(0)));
+					continue;
+				}
+
+				// only read the files that changed since they were last sampled
+				if (cached->sample == 0 || cached->size != fs->first
+					|| cached->mtime != fs->second)
+				{
+					cached->size = fs->first;
+					cached->mtime = fs->second;
+					cached->sample = sample_file(combine_path(m_save_path
+						, files().file_path(*i)), fs->first);
+				}
+				sl.push_back(entry(size_type(cached->sample)));
+			}
+		}
 		
 		return false;
 	}
 
+	void default_storage::remember_sample(int index, size_type size
+		, std::time_t mtime, boost::uint32_t sample) const
+	{
+		file_sample& f = m_file_samples[index];
+		f.size = size;
+		f.mtime = mtime;
+		f.sample = sample;
+	}
+
+	bool default_storage::changed_files(lazy_entry const& rd, std::vector<bool>& changed)
+	{
+		lazy_entry const* file_sizes = rd.dict_find_list("file sizes");
+		if (file_sizes == 0 || file_sizes->list_size() != files().num_files())
+			return false;
+
+		lazy_entry const* samples = 0;
+		if (m_settings && settings().resume_file_samples)
+		{
+			samples = rd.dict_find_list("file samples");
+			if (samples && samples->list_size() != files().num_files()) samples = 0;
+		}
+		bool ignore_timestamps = m_settings && settings().ignore_resume_timestamps;
+
+		changed.clear();
+		changed.resize(files().num_files(), false);
+		if (samples) m_file_samples.resize(files().num_files());
+		int index = 0;
+		for (file_storage::iterator i = files().begin()
+			, end(files().end()); i != end; ++i, ++index)
+		{
+			if (i->pad_file) continue;
+
+			lazy_entry const* e = file_sizes->list_at(index);
+			if (e->type() != lazy_entry::list_t
+				|| e->list_size() != 2
+				|| e->list_at(0)->type() != lazy_entry::int_t
+				|| e->list_at(1)->type() != lazy_entry::int_t)
+				return false;
+			size_type size = e->list_int_value_at(0);
+			std::time_t time = std::time_t(e->list_int_value_at(1));
+			if (size > i->size) return false;
+
+			std::string path = combine_path(m_save_path, files().file_path(*i));
+			file_status s;
+			error_code ec;
+			stat_file(path, &s, ec);
+			if (ec)
+			{
+				s.file_size = 0;
+				s.mtime = 0;
+			}
+
+			boost::uint32_t sample = samples
+				? boost::uint32_t(samples->list_int_value_at(index)) : 0;
+
+			// the same rules as match_filesizes() uses in full allocation mode
+			if (s.file_size >= size
+				&& (ignore_timestamps || (s.mtime <= time + 5 * 60 && s.mtime >= time - 1)))
+			{
+				// the file is as it was saved, so is its sample
+				if (sample != 0 && s.file_size == size && s.mtime == time)
+					remember_sample(index, size, time, sample);
+				continue;
+			}
+
+			// the timestamp changed, but the content may not have
+			if (sample != 0 && s.file_size == size && sample_file(path, size) == sample)
+			{
+				remember_sample(index, size, s.mtime, sample);
+				continue;
+			}
+			changed[index] = true;
+		}
+		return true;
+	}
+
 	int default_storage::sparse_end(int slot) const
 	{
 		TORRENT_ASSERT(slot >= 0);
@@ -1468,6 +1631,8 @@ ret:
 		, m_scratch_piece(-1)
 		, m_last_piece(-1)
 		, m_storage_constructor(sc)
+		, m_block_hash_salt(0)
+		, m_block_hashes_enabled(false)
 		, m_io_thread(io)
 		, m_torrent(torrent)
 	{
@@ -1699,6 +1864,100 @@ ret:
 		return ph.h.final();
 	}
 
+	void piece_manager::enable_block_hashes(int salt)
+	{
+		mutex::scoped_lock l(m_mutex);
+		m_block_hash_salt = salt;
+		m_block_hashes_enabled = true;
+	}
+
+	bool piece_manager::take_block_hashes(int piece, std::vector<sha1_hash>& ret)
+	{
+		mutex::scoped_lock l(m_mutex);
+		std::map<int, std::vector<sha1_hash> >::iterator i = m_block_hashes.find(piece);
+		if (i == m_block_hashes.end()) return false;
+		ret.swap(i->second);
+		m_block_hashes.erase(i);
+		return true;
+	}
+
+	void piece_manager::drop_block_hashes(int piece)
+	{
+		mutex::scoped_lock l(m_mutex);
+		m_block_hashes.erase(piece);
+		// otherwise the retry's hashes would be kept when it passes,
+		// and compared against as if the piece had failed before
+		m_failed_block_hashes.erase(piece);
+	}
+
+	void piece_manager::hash_blocks(file::iovec_t const* bufs, int piece_index
+		, int offset, int num_bufs)
+	{
+		mutex::scoped_lock l(m_mutex);
+		if (!m_block_hashes_enabled) return;
+		int salt = m_block_hash_salt;
+		l.unlock();
+
+		// the blocks smart ban tracks
+		int const block_size = 16 * 1024;
+		if (offset % block_size != 0) return;
+
+		int piece_size = m_files.piece_size(piece_index);
+		int block = offset / block_size;
+		int block_left = (std::min)(block_size, piece_size - offset);
+
+		std::vector<std::pair<int, sha1_hash> > hashes;
+		hasher h;
+		for (file::iovec_t const* i = bufs, *end(bufs + num_bufs); i < end; ++i)
+		{
+			char const* buf = (char const*)i->iov_base;
+			int len = i->iov_len;
+			while (len > 0)
+			{
+				TORRENT_ASSERT(block_left > 0);
+				int n = (std::min)(len, block_left);
+				h.update(buf, n);
+				buf += n;
+				len -= n;
+				block_left -= n;
+				if (block_left > 0) continue;
+
+				h.update((char const*)&salt, sizeof(salt));
+				hashes.push_back(std::make_pair(block, h.final()));
+				h.reset();
+				++block;
+				block_left = (std::min)(block_size, piece_size - block * block_size);
+			}
+		}
+		// a partial block at the end is not hashed
+		if (hashes.empty()) return;
+
+		int blocks_in_piece = (piece_size + block_size - 1) / block_size;
+		l.lock();
+		std::vector<sha1_hash>& v = m_block_hashes[piece_index];
+		v.resize(blocks_in_piece);
+		for (std::vector<std::pair<int, sha1_hash> >::iterator i = hashes.begin()
+			, end(hashes.end()); i != end; ++i)
+		{
+			TORRENT_ASSERT(i->first < blocks_in_piece);
+			v[i->first] = i->second;
+		}
+	}
+
+	void piece_manager::finish_block_hashes(int piece, bool passed)
+	{
+		mutex::scoped_lock l(m_mutex);
+		if (!passed)
+		{
+			if (m_block_hashes_enabled) m_failed_block_hashes.insert(piece);
+			return;
+		}
+		// a piece that passes the first time around has
+		// no use for its block hashes
+		if (m_failed_block_hashes.erase(piece) == 0)
+			m_block_hashes.erase(piece);
+	}
+
 	int piece_manager::move_storage_impl(std::string const& save_path)
 	{
 		if (m_storage->move_storage(save_path))
@@ -1802,6 +2061,8 @@ ret:
 
 		if (m_storage->settings().disable_hash_checks) return ret;
 
+		hash_blocks(iov, piece_index, offset, num_bufs);
+
 #if defined TORRENT_PARTIAL_HASH_LOG && TORRENT_USE_IOSTREAM
 		std::ofstream out("partial_hash.log", std::ios::app);
 #endif
@@ -2002,8 +2263,20 @@ ret:
 		}
 	}
 
+	void piece_manager::reset_check()
+	{
+		// a check that was paused or aborted may have left the pieces
+		// it took from the resume data and batches read ahead of it.
+		// Reusing them would mark pieces as had without hashing them
+		m_io_thread.cancel_check_batches(m_check_batches);
+		m_check_batches.clear();
+		std::vector<boost::uint8_t>().swap(m_resume_pieces);
+	}
+
 	int piece_manager::check_no_fastresume(error_code& error)
 	{
+		reset_check();
+
 		bool has_files = false;
 		if (!m_storage->settings().no_recheck_incomplete_resume)
 		{
@@ -2044,6 +2317,40 @@ ret:
 		return check_init_storage(error);
 	}
 	
+	int piece_manager::check_changed_files(lazy_entry const& rd
+		, std::vector<bool> const& changed, error_code& error)
+	{
+		TORRENT_ASSERT(int(changed.size()) == m_files.num_files());
+		lazy_entry const* pieces = rd.dict_find_string("pieces");
+		TORRENT_ASSERT(pieces && pieces->string_length() == m_files.num_pieces());
+
+		int num_pieces = m_files.num_pieces();
+		char const* have_pieces = pieces->string_ptr();
+		m_resume_pieces.resize(num_pieces);
+		for (int i = 0; i < num_pieces; ++i)
+			m_resume_pieces[i] = (have_pieces[i] & 1) ? resume_have_piece : resume_missing_piece;
+
+		// every piece overlapping a changed file is checked
+		int index = 0;
+		for (file_storage::iterator i = m_files.begin()
+			, end(m_files.end()); i != end; ++i, ++index)
+		{
+			if (!changed[index] || i->size == 0) continue;
+			int first = m_files.map_file(index, 0, 1).piece;
+			int last = m_files.map_file(index, i->size - 1, 1).piece;
+			for (int p = first; p <= last; ++p)
+				m_resume_pieces[p] = resume_check_piece;
+		}
+
+		m_state = state_full_check;
+		m_piece_to_slot.clear();
+		m_piece_to_slot.resize(num_pieces, has_no_slot);
+		m_slot_to_piece.clear();
+		m_slot_to_piece.resize(num_pieces, unallocated);
+		TORRENT_ASSERT(error);
+		return need_full_check;
+	}
+
 	int piece_manager::check_init_storage(error_code& error)
 	{
 		if (m_storage->initialize(m_storage_mode == storage_mode_allocate))
@@ -2082,6 +2389,7 @@ ret:
 		TORRENT_ASSERT(m_files.piece_length() > 0);
 		
 		m_current_slot = 0;
+		reset_check();
 
 		// if we don't have any resume data, return
 		if (rd.type() == lazy_entry::none_t) return check_no_fastresume(error);
@@ -2106,7 +2414,28 @@ ret:
 			storage_mode = storage_mode_sparse;
 
 		if (!m_storage->verify_resume_data(rd, error))
-			return check_no_fastresume(error);
+		{
+			// if the resume data was rejected because some files changed,
+			// the pieces that don't overlap those files are still good. This
+			// requires a full allocation storage and the have bitmask
+			std::vector<bool> changed;
+			lazy_entry const* pieces = rd.dict_find_string("pieces");
+			if (storage_mode == internal_storage_mode_compact_deprecated
+				|| m_storage_mode == internal_storage_mode_compact_deprecated
+				|| (error != error_code(errors::mismatching_file_size, get_libtorrent_category())
+					&& error != error_code(errors::mismatching_file_timestamp, get_libtorrent_category()))
+				|| pieces == 0
+				|| pieces->string_length() != m_files.num_pieces()
+				|| !m_storage->changed_files(rd, changed))
+				return check_no_fastresume(error);
+
+			if (std::find(changed.begin(), changed.end(), true) != changed.end())
+				return check_changed_files(rd, changed, error);
+
+			// all the files still have the content they had when the
+			// resume data was saved, only their timestamps changed
+			error.clear();
+		}
 
 		// assume no piece is out of place (i.e. in a slot
 		// other than the one it should be in)
@@ -2428,6 +2757,8 @@ ret:
 
 			// clear the memory we've been using
 			std::multimap<sha1_hash, int>().swap(m_hash_to_piece);
+			std::vector<boost::uint8_t>().swap(m_resume_pieces);
+			m_check_batches.clear();
 
 			if (m_storage_mode != internal_storage_mode_compact_deprecated)
 			{
@@ -2482,6 +2813,112 @@ ret:
 		return ret;
 	}
 
+	bool piece_manager::read_ahead_hash(int slot, sha1_hash& large_hash
+		, sha1_hash& small_hash)
+	{
+		// in compact mode, and once a piece has been found out of
+		// place, the check moves slots around, which would invalidate
+		// the data we've read ahead
+		int read_ahead = m_storage->settings().file_check_read_ahead;
+		if (m_storage_mode == internal_storage_mode_compact_deprecated
+			|| m_out_of_place || read_ahead <= 0)
+		{
+			m_check_batches.clear();
+			return false;
+		}
+
+		// drop the batches the check has moved past. skip_file()
+		// may have skipped several of them. Batches still being
+		// hashed are kept alive by the check threads
+		while (!m_check_batches.empty()
+			&& m_check_batches.front()->first_slot
+			+ m_check_batches.front()->num_slots <= slot)
+			m_check_batches.pop_front();
+		if (!m_check_batches.empty() && m_check_batches.front()->first_slot > slot)
+			m_check_batches.clear();
+
+		// keep one batch per check thread in flight, in addition to
+		// the one being consumed. Only read one new batch per call, to
+		// not hold up other disk jobs for too long
+		int next_slot = m_check_batches.empty() ? slot
+			: m_check_batches.back()->first_slot + m_check_batches.back()->num_slots;
+		// don't read the pieces we're taking from the resume data
+		while (!m_resume_pieces.empty() && next_slot < m_files.num_pieces()
+			&& m_resume_pieces[next_slot] != resume_check_piece)
+			++next_slot;
+		// the batches' buffers are counted against the cache size, across
+		// all torrents being checked, so many check threads with a large
+		// read-ahead won't allocate more than the user asked the disk
+		// cache to use. When nothing is in flight, one batch is always
+		// allowed, in case a piece is larger than the limit
+		int piece_length = m_files.piece_length();
+		size_type buffer_limit = m_io_thread.check_buffer_limit();
+		size_type buffer_left = m_io_thread.check_buffer_left();
+		if (int(m_check_batches.size()) <= m_io_thread.num_check_threads()
+			&& (buffer_left >= piece_length || buffer_left == buffer_limit)
+			&& next_slot < m_files.num_pieces())
+		{
+			int num_slots = (std::max)(read_ahead / piece_length, 1);
+			if (buffer_left < size_type(num_slots) * piece_length)
+				num_slots = int((std::max)(buffer_left / piece_length, size_type(1)));
+			num_slots = (std::min)(num_slots, m_files.num_pieces() - next_slot);
+			if (!m_resume_pieces.empty())
+			{
+				for (int i = 1; i < num_slots; ++i)
+				{
+					if (m_resume_pieces[next_slot + i] == resume_check_piece) continue;
+					num_slots = i;
+					break;
+				}
+			}
+
+			boost::shared_ptr<check_batch> b(new check_batch(next_slot, num_slots));
+			b->piece_length = piece_length;
+			b->small_piece_size = m_files.piece_size(m_files.num_pieces() - 1);
+			b->buffer.reset(page_aligned_allocator::malloc(num_slots * piece_length));
+			for (; b->num_read < num_slots; ++b->num_read)
+			{
+				int size = m_files.piece_size(next_slot + b->num_read);
+				file::iovec_t buf = {b->buffer.get() + b->num_bytes, size};
+				if (m_storage->readv(&buf, next_slot + b->num_read, 0, 1) != size) break;
+				b->num_bytes += size;
+			}
+			// the slot that failed to be read is read again with
+			// hash_for_slot() once the check gets to it. That's when
+			// the error is reported (or the file skipped)
+			clear_error();
+
+			// let the OS start reading the batch after this one, to
+			// keep the drive busy while we're hashing or serving
+			// torrents on other drives
+			int hint_end = (std::min)(next_slot + 2 * num_slots, m_files.num_pieces());
+			for (int i = next_slot + num_slots; i < hint_end; ++i)
+				m_storage->hint_read(i, 0, m_files.piece_size(i));
+
+			if (b->num_read > 0)
+			{
+				m_io_thread.add_check_batch(b);
+			}
+			else
+			{
+				b->buffer.reset();
+				b->done = true;
+			}
+			m_check_batches.push_back(b);
+		}
+
+		if (m_check_batches.empty()) return false;
+
+		check_batch& b = *m_check_batches.front();
+		TORRENT_ASSERT(slot >= b.first_slot && slot < b.first_slot + b.num_slots);
+		if (slot - b.first_slot >= b.num_read) return false;
+
+		m_io_thread.wait_for_check_batch(b);
+		large_hash = b.hashes[slot - b.first_slot].first;
+		small_hash = b.hashes[slot - b.first_slot].second;
+		return true;
+	}
+
 	// -1 = error, 0 = ok, >0 = skip this many pieces
 	int piece_manager::check_one_piece(int& have_piece)
 	{
@@ -2500,42 +2937,65 @@ ret:
 				m_hash_to_piece.insert(std::pair<const sha1_hash, int>(m_info->hash_for_piece(i), i));
 		}
 
-		partial_hash ph;
-		int num_read = 0;
-		int piece_size = m_files.piece_size(m_current_slot);
-		int small_piece_size = m_files.piece_size(m_files.num_pieces() - 1);
-		bool read_short = true;
-		sha1_hash small_hash;
-		if (piece_size == small_piece_size)
-		{
-			num_read = hash_for_slot(m_current_slot, ph, piece_size, 0, 0);
-		}
-		else
+		// pieces that don't overlap any file that changed since the
+		// resume data was saved are taken from the resume data
+		if (!m_resume_pieces.empty()
+			&& m_resume_pieces[m_current_slot] != resume_check_piece)
 		{
-			num_read = hash_for_slot(m_current_slot, ph, piece_size
-				, small_piece_size, &small_hash);
+			if (m_resume_pieces[m_current_slot] == resume_have_piece)
+			{
+				have_piece = m_current_slot;
+				m_piece_to_slot[m_current_slot] = m_current_slot;
+				m_slot_to_piece[m_current_slot] = m_current_slot;
+			}
+			else
+			{
+				m_slot_to_piece[m_current_slot] = unassigned;
+			}
+			return 0;
 		}
-		read_short = num_read != piece_size;
 
-		if (read_short)
-		{
-			if (m_storage->error()
+		sha1_hash small_hash;
+		sha1_hash large_hash;
+		if (!read_ahead_hash(m_current_slot, large_hash, small_hash))
+		{
+			partial_hash ph;
+			int num_read = 0;
+			int piece_size = m_files.piece_size(m_current_slot);
+			int small_piece_size = m_files.piece_size(m_files.num_pieces() - 1);
+			bool read_short = true;
+			if (piece_size == small_piece_size)
+			{
+				num_read = hash_for_slot(m_current_slot, ph, piece_size, 0, 0);
+			}
+			else
+			{
+				num_read = hash_for_slot(m_current_slot, ph, piece_size
+					, small_piece_size, &small_hash);
+			}
+			read_short = num_read != piece_size;
+
+			if (read_short)
+			{
+				if (m_storage->error()
 #ifdef TORRENT_WINDOWS
-				&& m_storage->error() != error_code(ERROR_PATH_NOT_FOUND, get_system_category())
-				&& m_storage->error() != error_code(ERROR_FILE_NOT_FOUND, get_system_category())
-				&& m_storage->error() != error_code(ERROR_HANDLE_EOF, get_system_category())
-				&& m_storage->error() != error_code(ERROR_INVALID_HANDLE, get_system_category()))
+					&& m_storage->error() != error_code(ERROR_PATH_NOT_FOUND, get_system_category())
+					&& m_storage->error() != error_code(ERROR_FILE_NOT_FOUND, get_system_category())
+					&& m_storage->error() != error_code(ERROR_HANDLE_EOF, get_system_category())
+					&& m_storage->error() != error_code(ERROR_INVALID_HANDLE, get_system_category()))
 #else
-				&& m_storage->error() != error_code(ENOENT, get_posix_category()))
+					&& m_storage->error() != error_code(ENOENT, get_posix_category()))
 #endif
-			{
-				return -1;
+				{
+					return -1;
+				}
+				// if the file is incomplete, skip the rest of it
+				return skip_file();
 			}
-			// if the file is incomplete, skip the rest of it
-			return skip_file();
+
+			large_hash = ph.h.final();
 		}
 
-		sha1_hash large_hash = ph.h.final();
 		int piece_index = identify_data(large_hash, small_hash, m_current_slot);
 
 		if (piece_index >= 0) have_piece = piece_index;
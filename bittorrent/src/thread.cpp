@@ -37,6 +37,10 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <kernel/OS.h>
 #endif
 
+#if !defined TORRENT_WINDOWS && !defined TORRENT_BEOS
+#include <unistd.h> // for sysconf
+#endif
+
 namespace libtorrent
 {
 	void sleep(int milliseconds)
@@ -50,6 +54,19 @@ namespace libtorrent
 #endif
 	}
 
+	int hardware_concurrency()
+	{
+		int ret = 0;
+#if defined TORRENT_WINDOWS
+		SYSTEM_INFO si;
+		GetSystemInfo(&si);
+		ret = si.dwNumberOfProcessors;
+#elif defined _SC_NPROCESSORS_ONLN
+		ret = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+		return ret > 0 ? ret : 1;
+	}
+
 #ifdef BOOST_HAS_PTHREADS
 
 	condition::condition()
@@ -370,9 +370,14 @@ namespace libtorrent
 		, m_available_free_upload(0)
 		, m_average_piece_time(0)
 		, m_piece_time_deviation(0)
+		, m_streaming_cursor(0)
+		, m_streaming_window(0)
+		, m_streaming_deadline(0)
+		, m_checking_device(0)
 		, m_total_failed_bytes(0)
 		, m_total_redundant_bytes(0)
 		, m_sequence_number(seq)
+		, m_status_slot(ses.m_status_table.allocate())
 		, m_upload_mode_time(0)
 		, m_state(torrent_status::checking_resume_data)
 		, m_storage_mode(p.storage_mode)
@@ -583,6 +588,8 @@ namespace libtorrent
 
 		if (settings().prefer_udp_trackers)
 			prioritize_udp_trackers();
+
+		update_snapshot();
 	}
 
 #if 0
@@ -901,6 +908,8 @@ namespace libtorrent
 			set_state(torrent_status::downloading_metadata);
 			start_announcing();
 		}
+
+		publish_status();
 	}
 
 	void torrent::start_download_url()
@@ -986,6 +995,8 @@ namespace libtorrent
 		
 		INVARIANT_CHECK;
 
+		m_ses.m_status_table.release(m_status_slot);
+
 #if defined TORRENT_VERBOSE_LOGGING || defined TORRENT_ERROR_LOGGING || defined TORRENT_LOGGING
 		log_to_all_peers("DESTRUCTING TORRENT");
 #endif
@@ -1129,7 +1140,11 @@ namespace libtorrent
 		if (j.action == disk_io_job::write)
 		{
 			// we failed to write j.piece to disk tell the piece picker
-			if (has_picker() && j.piece >= 0) picker().write_failed(block_finished);
+			if (has_picker() && j.piece >= 0)
+			{
+				picker().write_failed(block_finished);
+				piece_error(j.piece);
+			}
 		}
 
 		if (j.error ==
@@ -1323,6 +1338,28 @@ namespace libtorrent
 		return "";
 	}
 
+	std::string torrent::name_snapshot() const
+	{
+		mutex::scoped_lock l(m_snapshot_mutex);
+		return m_name_snapshot;
+	}
+
+	sha1_hash torrent::info_hash_snapshot() const
+	{
+		mutex::scoped_lock l(m_snapshot_mutex);
+		return m_info_hash_snapshot;
+	}
+
+	// the name and the info-hash only change when the torrent_info
+	// is replaced or gets its metadata, both of which end in init()
+	void torrent::update_snapshot()
+	{
+		std::string n = name();
+		mutex::scoped_lock l(m_snapshot_mutex);
+		m_name_snapshot.swap(n);
+		m_info_hash_snapshot = info_hash();
+	}
+
 #ifndef TORRENT_DISABLE_EXTENSIONS
 
 	void torrent::add_extension(boost::shared_ptr<torrent_plugin> ext)
@@ -1572,6 +1609,8 @@ namespace libtorrent
 
 		m_block_size_shift = root2((std::min)(int(block_size()), m_torrent_file->piece_length()));
 
+		update_snapshot();
+
 		if (m_torrent_file->num_pieces() > piece_picker::max_pieces)
 		{
 			set_error(errors::too_many_pieces_in_torrent, "");
@@ -1968,6 +2007,12 @@ namespace libtorrent
 		TORRENT_ASSERT(m_ses.is_network_thread());
 		if (m_queued_for_checking) return;
 		m_queued_for_checking = true;
+
+		file_status s;
+		error_code ec;
+		stat_file(m_save_path, &s, ec);
+		m_checking_device = ec ? 0 : s.device;
+
 		m_ses.queue_check_torrent(shared_from_this());
 	}
 
@@ -2510,7 +2555,10 @@ namespace libtorrent
 			ae->verified = true;
 			ae->updating = false;
 			ae->fails = 0;
-			ae->next_announce = now + seconds(interval);
+			// add a little jitter to the interval, to keep torrents that
+			// were started together from hitting the tracker in lockstep
+			ae->next_announce = now + seconds(interval
+				+ random() % (interval / 16 + 1));
 			ae->min_announce = now + seconds(min_interval);
 			int tracker_index = ae - &m_trackers[0];
 			m_last_working_tracker = prioritize_tracker(tracker_index);
@@ -2816,7 +2864,8 @@ namespace libtorrent
 	}
 
 	// fills in total_wanted, total_wanted_done and total_done
-	void torrent::bytes_done(torrent_status& st, bool accurate) const
+	template <class Status>
+	void torrent::bytes_done(Status& st, bool accurate) const
 	{
 		INVARIANT_CHECK;
 
@@ -3096,7 +3145,21 @@ namespace libtorrent
 			TORRENT_ASSERT(passed_hash_check == -1);
 			m_picker->restore_piece(index);
 			restore_piece_state(index);
+			piece_error(index);
+		}
+	}
+
+	void torrent::piece_error(int index)
+	{
+#ifndef TORRENT_DISABLE_EXTENSIONS
+		for (extension_list_t::iterator i = m_extensions.begin()
+			, end(m_extensions.end()); i != end; ++i)
+		{
+			TORRENT_TRY {
+				(*i)->on_piece_error(index);
+			} TORRENT_CATCH (std::exception&) {}
 		}
+#endif
 	}
 
 	void torrent::update_sparse_piece_prio(int i, int start, int end)
@@ -3194,6 +3257,19 @@ namespace libtorrent
 
 		remove_time_critical_piece(index, true);
 
+		// in streaming mode, pieces inside the playback window are
+		// about to be read by the player. Pull them into the read
+		// cache right away, while they're likely to still be in the
+		// OS page cache, rather than on the first player request
+		if (m_streaming_window > 0
+			&& index >= m_streaming_cursor
+			&& index < m_streaming_cursor + m_streaming_window
+			&& m_owning_storage.get())
+		{
+			filesystem().async_cache(index
+				, boost::function<void(int, disk_io_job const&)>());
+		}
+
 		bool was_finished = m_picker->num_filtered() + num_have()
 			== torrent_file().num_pieces();
 
@@ -3774,6 +3850,78 @@ namespace libtorrent
 		}
 	}
 
+	void torrent::set_streaming_mode(int window_size, int deadline_step)
+	{
+		TORRENT_ASSERT(m_ses.is_network_thread());
+		if (window_size < 0) window_size = 0;
+		if (deadline_step < 0) deadline_step = 0;
+
+		// clear the deadlines of the current window. If the window
+		// shrinks, the pieces falling out of it are no longer critical
+		if (valid_metadata())
+		{
+			int end = (std::min)(m_streaming_cursor + m_streaming_window
+				, m_torrent_file->num_pieces());
+			for (int i = m_streaming_cursor + window_size; i < end; ++i)
+				remove_time_critical_piece(i);
+		}
+
+		m_streaming_window = window_size;
+		m_streaming_deadline = deadline_step;
+
+		update_streaming_window();
+	}
+
+	void torrent::advance_streaming_cursor(int piece)
+	{
+		TORRENT_ASSERT(m_ses.is_network_thread());
+		if (piece < 0) piece = 0;
+
+		if (!valid_metadata())
+		{
+			// we don't know the number of pieces yet, just remember
+			// where the player is. The window is set up in files_checked()
+			m_streaming_cursor = piece;
+			return;
+		}
+
+		if (piece >= m_torrent_file->num_pieces())
+			piece = m_torrent_file->num_pieces() - 1;
+
+		// pieces of the old window that don't overlap the new one
+		// should not hog the peers' request queues anymore. This covers
+		// both moving forward and seeking backwards
+		int old_end = (std::min)(m_streaming_cursor + m_streaming_window
+			, m_torrent_file->num_pieces());
+		for (int i = m_streaming_cursor; i < old_end; ++i)
+		{
+			if (i >= piece && i < piece + m_streaming_window) continue;
+			remove_time_critical_piece(i);
+		}
+
+		m_streaming_cursor = piece;
+		update_streaming_window();
+	}
+
+	// sets deadlines on the pieces in the streaming window. The piece
+	// under the cursor is due immediately, and every following piece
+	// m_streaming_deadline milliseconds after the one before it
+	void torrent::update_streaming_window()
+	{
+		TORRENT_ASSERT(m_ses.is_network_thread());
+		if (m_streaming_window == 0) return;
+		if (!valid_metadata() || !has_picker() || is_seed()) return;
+
+		int end = (std::min)(m_streaming_cursor + m_streaming_window
+			, m_torrent_file->num_pieces());
+		for (int i = m_streaming_cursor; i < end; ++i)
+		{
+			if (m_picker->have_piece(i)) continue;
+			if (m_picker->piece_priority(i) == 0) continue;
+			set_piece_deadline(i, (i - m_streaming_cursor) * m_streaming_deadline, 0);
+		}
+	}
+
 	// remove time critical pieces where priority is 0
 	void torrent::remove_time_critical_pieces(std::vector<int> const& priority)
 	{
@@ -6283,6 +6431,10 @@ namespace libtorrent
 
 		m_files_checked = true;
 
+		// if streaming mode was enabled before we had metadata
+		// the deadlines couldn't be set. Do it now
+		update_streaming_window();
+
 		start_announcing();
 	}
 
@@ -6416,10 +6568,8 @@ namespace libtorrent
 			}
 			else
 			{
-				// the case of 2 is in the special case where one switches over from
-				// checking to complete.
+				// there's one checking torrent per device being checked
 				TORRENT_ASSERT(found_active >= 1);
-				TORRENT_ASSERT(found_active <= 2);
 				TORRENT_ASSERT(found >= 1);
 			}
 		}
@@ -7038,6 +7188,7 @@ namespace libtorrent
 #endif
 
 		state_updated();
+		publish_status();
 
 #if defined TORRENT_VERBOSE_LOGGING || defined TORRENT_ERROR_LOGGING || defined TORRENT_LOGGING
 		log_to_all_peers("PAUSING TORRENT");
@@ -7195,6 +7346,7 @@ namespace libtorrent
 			alerts().post_alert(torrent_resumed_alert(get_handle()));
 
 		state_updated();
+		publish_status();
 
 		m_started = time_now();
 		clear_error();
@@ -7424,6 +7576,9 @@ namespace libtorrent
 			// if the rate is 0, there's no update because of network transfers
 			if (m_stat.low_pass_upload_rate() > 0 || m_stat.low_pass_download_rate() > 0)
 				state_updated();
+			// the status record is read in place of status(), so it has
+			// to follow the rates down while we're paused too
+			publish_status();
 			return;
 		}
 
@@ -7523,6 +7678,17 @@ namespace libtorrent
 		// if the rate is 0, there's no update because of network transfers
 		if (m_stat.low_pass_upload_rate() > 0 || m_stat.low_pass_download_rate() > 0)
 			state_updated();
+
+		publish_status();
+	}
+
+	void torrent::publish_status()
+	{
+		if (m_status_slot < 0) return;
+
+		torrent_status_record st;
+		status_record(st);
+		m_ses.m_status_table.write(m_status_slot, st);
 	}
 
 	void torrent::recalc_share_mode()
@@ -8245,6 +8411,7 @@ namespace libtorrent
 		m_state = s;
 
 		state_updated();
+		publish_status();
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
 		for (extension_list_t::iterator i = m_extensions.begin()
@@ -8502,6 +8669,123 @@ namespace libtorrent
 		}
 	}
 
+	void torrent::status_record(torrent_status_record& st)
+	{
+		st.info_hash = info_hash();
+
+		st.listen_port = 0;
+#ifdef TORRENT_USE_OPENSSL
+		if (is_ssl_torrent()) st.listen_port = m_ses.ssl_listen_port();
+#endif
+
+		st.has_incoming = m_has_incoming;
+		st.seed_mode = m_seed_mode;
+		st.added_time = m_added_time;
+		st.completed_time = m_completed_time;
+		st.last_seen_complete = 0;
+		st.last_scrape = m_last_scrape;
+		st.share_mode = m_share_mode;
+		st.upload_mode = m_upload_mode;
+		st.up_bandwidth_queue = 0;
+		st.down_bandwidth_queue = 0;
+		st.priority = m_priority;
+
+		st.num_peers = (int)std::count_if(m_connections.begin(), m_connections.end()
+			, !boost::bind(&peer_connection::is_connecting, _1));
+
+		st.list_peers = m_policy.num_peers();
+		st.list_seeds = m_policy.num_seeds();
+		st.connect_candidates = m_policy.num_connect_candidates();
+		st.seed_rank = seed_rank(settings());
+
+		st.all_time_upload = m_total_uploaded;
+		st.all_time_download = m_total_downloaded;
+
+		st.finished_time = m_finished_time;
+		st.active_time = m_active_time;
+		st.seeding_time = m_seeding_time;
+		st.time_since_upload = m_last_upload;
+		st.time_since_download = m_last_download;
+
+		st.storage_mode = (storage_mode_t)m_storage_mode;
+
+		st.num_complete = (m_complete == 0xffffff) ? -1 : m_complete;
+		st.num_incomplete = (m_incomplete == 0xffffff) ? -1 : m_incomplete;
+		st.paused = is_torrent_paused();
+		st.auto_managed = m_auto_managed;
+		st.sequential_download = m_sequential_download;
+		st.is_seeding = is_seed();
+		st.is_finished = is_finished();
+		st.super_seeding = m_super_seeding;
+		st.has_metadata = valid_metadata();
+		bytes_done(st, false);
+
+		st.total_payload_download = m_stat.total_payload_download();
+		st.total_payload_upload = m_stat.total_payload_upload();
+		st.total_download = m_stat.total_payload_download()
+			+ m_stat.total_protocol_download();
+		st.total_upload = m_stat.total_payload_upload()
+			+ m_stat.total_protocol_upload();
+		st.total_failed_bytes = m_total_failed_bytes;
+		st.total_redundant_bytes = m_total_redundant_bytes;
+
+		st.download_rate = m_stat.download_rate();
+		st.upload_rate = m_stat.upload_rate();
+		st.download_payload_rate = m_stat.download_payload_rate();
+		st.upload_payload_rate = m_stat.upload_payload_rate();
+
+		st.num_uploads = m_num_uploads;
+		st.uploads_limit = m_max_uploads == (1<<24)-1 ? -1 : m_max_uploads;
+		st.num_connections = int(m_connections.size());
+		st.connections_limit = m_max_connections == (1<<24)-1 ? -1 : m_max_connections;
+
+		st.queue_position = queue_position();
+		st.need_save_resume = need_save_resume_data();
+		st.ip_filter_applies = m_apply_ip_filter;
+
+		st.state = (torrent_status::state_t)m_state;
+
+		// the same as status() without query_distributed_copies
+		st.distributed_full_copies = -1;
+		st.distributed_fraction = -1;
+		st.distributed_copies = -1.f;
+
+		st.sparse_regions = 0;
+		st.num_pieces = 0;
+		st.num_seeds = 0;
+
+		if (!valid_metadata())
+		{
+			st.state = torrent_status::downloading_metadata;
+			st.progress_ppm = m_progress_ppm;
+#if TORRENT_NO_FPU
+			st.progress = 0.f;
+#else
+			st.progress = m_progress_ppm / 1000000.f;
+#endif
+			st.block_size = 0;
+			return;
+		}
+
+		st.block_size = block_size();
+
+		if (m_state == torrent_status::checking_files)
+			st.progress_ppm = m_progress_ppm;
+		else if (st.total_wanted == 0)
+			st.progress_ppm = 1000000;
+		else
+			st.progress_ppm = (int)(st.total_wanted_done * 1000000 / st.total_wanted);
+#if TORRENT_NO_FPU
+		st.progress = st.progress_ppm == 1000000 ? 1.f : 0.f;
+#else
+		st.progress = st.progress_ppm / 1000000.f;
+#endif
+
+		if (has_picker()) st.sparse_regions = m_picker->sparse_regions();
+		st.num_pieces = num_have();
+		st.num_seeds = num_seeds();
+	}
+
 	void torrent::add_redundant_bytes(int b, torrent::wasted_reason_t reason)
 	{
 		TORRENT_ASSERT(m_ses.is_network_thread());
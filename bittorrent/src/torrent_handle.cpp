@@ -146,6 +146,77 @@ namespace libtorrent
 
 	torrent_status::~torrent_status() {}
 
+	void torrent_status_record::assign(torrent_status const& st)
+	{
+#define TORRENT_COPY(x) x = st.x
+		TORRENT_COPY(state);
+		TORRENT_COPY(paused);
+		TORRENT_COPY(auto_managed);
+		TORRENT_COPY(sequential_download);
+		TORRENT_COPY(is_seeding);
+		TORRENT_COPY(is_finished);
+		TORRENT_COPY(has_metadata);
+		TORRENT_COPY(has_incoming);
+		TORRENT_COPY(seed_mode);
+		TORRENT_COPY(upload_mode);
+		TORRENT_COPY(share_mode);
+		TORRENT_COPY(super_seeding);
+		TORRENT_COPY(need_save_resume);
+		TORRENT_COPY(ip_filter_applies);
+		TORRENT_COPY(progress);
+		TORRENT_COPY(progress_ppm);
+		TORRENT_COPY(total_download);
+		TORRENT_COPY(total_upload);
+		TORRENT_COPY(total_payload_download);
+		TORRENT_COPY(total_payload_upload);
+		TORRENT_COPY(total_failed_bytes);
+		TORRENT_COPY(total_redundant_bytes);
+		TORRENT_COPY(download_rate);
+		TORRENT_COPY(upload_rate);
+		TORRENT_COPY(download_payload_rate);
+		TORRENT_COPY(upload_payload_rate);
+		TORRENT_COPY(num_seeds);
+		TORRENT_COPY(num_peers);
+		TORRENT_COPY(num_complete);
+		TORRENT_COPY(num_incomplete);
+		TORRENT_COPY(list_seeds);
+		TORRENT_COPY(list_peers);
+		TORRENT_COPY(connect_candidates);
+		TORRENT_COPY(num_pieces);
+		TORRENT_COPY(total_done);
+		TORRENT_COPY(total_wanted_done);
+		TORRENT_COPY(total_wanted);
+		TORRENT_COPY(distributed_full_copies);
+		TORRENT_COPY(distributed_fraction);
+		TORRENT_COPY(distributed_copies);
+		TORRENT_COPY(block_size);
+		TORRENT_COPY(num_uploads);
+		TORRENT_COPY(num_connections);
+		TORRENT_COPY(uploads_limit);
+		TORRENT_COPY(connections_limit);
+		TORRENT_COPY(storage_mode);
+		TORRENT_COPY(up_bandwidth_queue);
+		TORRENT_COPY(down_bandwidth_queue);
+		TORRENT_COPY(all_time_upload);
+		TORRENT_COPY(all_time_download);
+		TORRENT_COPY(active_time);
+		TORRENT_COPY(finished_time);
+		TORRENT_COPY(seeding_time);
+		TORRENT_COPY(seed_rank);
+		TORRENT_COPY(last_scrape);
+		TORRENT_COPY(sparse_regions);
+		TORRENT_COPY(priority);
+		TORRENT_COPY(added_time);
+		TORRENT_COPY(completed_time);
+		TORRENT_COPY(last_seen_complete);
+		TORRENT_COPY(time_since_upload);
+		TORRENT_COPY(time_since_download);
+		TORRENT_COPY(queue_position);
+		TORRENT_COPY(info_hash);
+		TORRENT_COPY(listen_port);
+#undef TORRENT_COPY
+	}
+
 	template <class R>
 	void fun_ret(R* ret, bool* done, condition* e, mutex* m, boost::function<R(void)> f)
 	{
@@ -278,8 +349,9 @@ namespace libtorrent
 	{
 		INVARIANT_CHECK;
 		const static sha1_hash empty;
-		TORRENT_SYNC_CALL_RET(sha1_hash, empty, info_hash);
-		return r;
+		boost::shared_ptr<torrent> t = m_torrent.lock();
+		if (!t) return empty;
+		return t->info_hash_snapshot();
 	}
 
 	int torrent_handle::max_uploads() const
@@ -539,6 +611,14 @@ namespace libtorrent
 		return st;
 	}
 
+	bool torrent_handle::status_record(torrent_status_record& st) const
+	{
+		INVARIANT_CHECK;
+		boost::shared_ptr<torrent> t = m_torrent.lock();
+		if (!t) return false;
+		return t->session().m_status_table.read(t->status_slot(), st);
+	}
+
 	void torrent_handle::set_sequential_download(bool sd) const
 	{
 		INVARIANT_CHECK;
@@ -548,8 +628,9 @@ namespace libtorrent
 	std::string torrent_handle::name() const
 	{
 		INVARIANT_CHECK;
-		TORRENT_SYNC_CALL_RET(std::string, "", name);
-		return r;
+		boost::shared_ptr<torrent> t = m_torrent.lock();
+		if (!t) return "";
+		return t->name_snapshot();
 	}
 
 	void torrent_handle::piece_availability(std::vector<int>& avail) const
@@ -969,6 +1050,18 @@ namespace libtorrent
 		TORRENT_ASYNC_CALL1(reset_piece_deadline, index);
 	}
 
+	void torrent_handle::set_streaming_mode(int window_size, int deadline_step) const
+	{
+		INVARIANT_CHECK;
+		TORRENT_ASYNC_CALL2(set_streaming_mode, window_size, deadline_step);
+	}
+
+	void torrent_handle::advance_streaming_cursor(int piece) const
+	{
+		INVARIANT_CHECK;
+		TORRENT_ASYNC_CALL1(advance_streaming_cursor, piece);
+	}
+
 	std::size_t hash_value(torrent_status const& ts)
 	{
 		return hash_value(ts.handle);
@@ -34,6 +34,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include <vector>
 #include <cctype>
+#include <algorithm>
 
 #include <boost/bind.hpp>
 
@@ -41,6 +42,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/http_tracker_connection.hpp"
 #include "libtorrent/udp_tracker_connection.hpp"
 #include "libtorrent/aux_/session_impl.hpp"
+#include "libtorrent/random.hpp"
+#include "libtorrent/io.hpp"
 
 using boost::tuples::make_tuple;
 using boost::tuples::tuple;
@@ -50,7 +53,15 @@ namespace
 	enum
 	{
 		minimum_tracker_response_length = 3,
-		http_buffer_size = 2048
+		http_buffer_size = 2048,
+
+		// the number of milliseconds udp scrapes are held back,
+		// waiting for other scrapes to the same tracker
+		udp_scrape_batch_delay = 250,
+
+		// the max number of info-hashes in a single udp scrape.
+		// 74 hashes keeps the request within a 1500 byte MTU
+		udp_max_scrape_batch = 74
 	};
 
 }
@@ -186,6 +197,21 @@ namespace libtorrent
 		m_man.remove_request(this);
 	}
 
+	tracker_manager::tracker_manager(aux::session_impl& ses, proxy_settings const& ps)
+		: m_ses(ses)
+		, m_proxy(ps)
+		, m_scrape_timer(ses.m_io_service)
+		, m_scrape_timer_armed(false)
+		, m_abort(false)
+	{}
+
+	tracker_manager::udp_connection_entry::udp_connection_entry()
+		: connection_id(0)
+		, connecting(false)
+	{}
+
+	tracker_manager::udp_connection_entry::~udp_connection_entry() {}
+
 	tracker_manager::~tracker_manager()
 	{
 		TORRENT_ASSERT(m_abort);
@@ -215,6 +241,155 @@ namespace libtorrent
 		m_connections.erase(i);
 	}
 
+	int tracker_manager::new_transaction_id(
+		boost::intrusive_ptr<udp_tracker_connection> const& c)
+	{
+		TORRENT_ASSERT(m_ses.is_network_thread());
+		if (c->m_transaction_id != 0) m_udp_conns.erase(c->m_transaction_id);
+
+		int tid;
+		do
+		{
+			tid = random() ^ (random() << 16);
+		} while (tid == 0 || m_udp_conns.count(tid));
+
+		m_udp_conns[tid] = c;
+		return tid;
+	}
+
+	void tracker_manager::remove_transaction_id(int tid)
+	{
+		TORRENT_ASSERT(m_ses.is_network_thread());
+		m_udp_conns.erase(tid);
+	}
+
+	bool tracker_manager::udp_connection_id(address const& a, boost::int64_t& id)
+	{
+		TORRENT_ASSERT(m_ses.is_network_thread());
+		std::map<address, udp_connection_entry>::iterator i
+			= m_udp_connection_cache.find(a);
+		if (i == m_udp_connection_cache.end()) return false;
+		udp_connection_entry& e = i->second;
+		if (e.connecting || e.connection_id == 0) return false;
+
+		// we can only use the connection id if it hasn't expired
+		if (time_now() >= e.expires)
+		{
+			m_udp_connection_cache.erase(i);
+			return false;
+		}
+		id = e.connection_id;
+		return true;
+	}
+
+	bool tracker_manager::wait_for_udp_connect(address const& a
+		, boost::intrusive_ptr<udp_tracker_connection> const& c)
+	{
+		TORRENT_ASSERT(m_ses.is_network_thread());
+		udp_connection_entry& e = m_udp_connection_cache[a];
+		if (e.connecting)
+		{
+			e.waiters.push_back(c);
+			return true;
+		}
+		e.connecting = true;
+		e.connection_id = 0;
+		return false;
+	}
+
+	void tracker_manager::udp_connect_done(address const& a, boost::int64_t id)
+	{
+		TORRENT_ASSERT(m_ses.is_network_thread());
+		udp_connection_entry& e = m_udp_connection_cache[a];
+		e.connection_id = id;
+		e.expires = time_now() + seconds(m_ses.m_settings.udp_tracker_token_expiry);
+		e.connecting = false;
+
+		std::vector<boost::intrusive_ptr<udp_tracker_connection> > waiters;
+		waiters.swap(e.waiters);
+		for (std::vector<boost::intrusive_ptr<udp_tracker_connection> >::iterator i
+			= waiters.begin(), end(waiters.end()); i != end; ++i)
+		{
+			if ((*i)->cancelled()) continue;
+			(*i)->start_announce();
+		}
+	}
+
+	void tracker_manager::udp_connect_failed(address const& a)
+	{
+		TORRENT_ASSERT(m_ses.is_network_thread());
+		std::map<address, udp_connection_entry>::iterator i
+			= m_udp_connection_cache.find(a);
+		if (i == m_udp_connection_cache.end()) return;
+
+		std::vector<boost::intrusive_ptr<udp_tracker_connection> > waiters;
+		waiters.swap(i->second.waiters);
+		m_udp_connection_cache.erase(i);
+
+		// restart the waiting connections. The first one will send
+		// a new connect message, the rest will queue up behind it.
+		// When we're shutting down, the leader is closed along with
+		// everyone else, and only the stopped events are still sent.
+		// abort_all_requests() closes the other waiters
+		for (std::vector<boost::intrusive_ptr<udp_tracker_connection> >::iterator w
+			= waiters.begin(), end(waiters.end()); w != end; ++w)
+		{
+			if ((*w)->cancelled()) continue;
+			if (m_abort && (*w)->tracker_req().event != tracker_request::stopped)
+				continue;
+			(*w)->start_announce();
+		}
+	}
+
+	void tracker_manager::queue_udp_scrape(udp::endpoint const& ep
+		, boost::intrusive_ptr<udp_tracker_connection> const& c)
+	{
+		TORRENT_ASSERT(m_ses.is_network_thread());
+		m_scrape_queue[ep].push_back(c);
+		if (m_scrape_timer_armed) return;
+
+		m_scrape_timer_armed = true;
+#if defined TORRENT_ASIO_DEBUGGING
+		add_outstanding_async("tracker_manager::on_scrape_batch_timer");
+#endif
+		error_code ec;
+		m_scrape_timer.expires_from_now(milliseconds(udp_scrape_batch_delay), ec);
+		m_scrape_timer.async_wait(boost::bind(
+			&tracker_manager::on_scrape_batch_timer, this, _1));
+	}
+
+	void tracker_manager::on_scrape_batch_timer(error_code const& ec)
+	{
+#if defined TORRENT_ASIO_DEBUGGING
+		complete_async("tracker_manager::on_scrape_batch_timer");
+#endif
+		m_scrape_timer_armed = false;
+		if (ec || m_abort) return;
+
+		scrape_queue_t queue;
+		queue.swap(m_scrape_queue);
+
+		typedef std::vector<boost::intrusive_ptr<udp_tracker_connection> > conns_t;
+		for (scrape_queue_t::iterator i = queue.begin(), end(queue.end()); i != end; ++i)
+		{
+			conns_t& conns = i->second;
+			conns.erase(std::remove_if(conns.begin(), conns.end()
+				, boost::bind(&timeout_handler::cancelled, _1)), conns.end());
+
+			// the first connection of every batch sends the scrape on
+			// behalf of the others and hands them their results
+			for (conns_t::iterator j = conns.begin(); j != conns.end();)
+			{
+				conns_t::iterator batch_end = conns.end() - j > udp_max_scrape_batch
+					? j + udp_max_scrape_batch : conns.end();
+				boost::intrusive_ptr<udp_tracker_connection> leader = *j;
+				leader->m_scrape_batch.assign(j + 1, batch_end);
+				leader->start_announce();
+				j = batch_end;
+			}
+		}
+	}
+
 	void tracker_manager::queue_request(
 		io_service& ios
 		, connection_queue& cc
@@ -277,29 +452,50 @@ namespace libtorrent
 	bool tracker_manager::incoming_udp(error_code const& e
 		, udp::endpoint const& ep, char const* buf, int size)
 	{
-		for (tracker_connections_t::iterator i = m_connections.begin();
-			i != m_connections.end();)
+		TORRENT_ASSERT(m_ses.is_network_thread());
+		if (e)
 		{
-			boost::intrusive_ptr<tracker_connection> p = *i;
-			++i;
-			// on_receive() may remove the tracker connection from the list
-			if (p->on_receive(e, ep, buf, size)) return true;
+			// errors aren't tied to a transaction, let every connection
+			// to this endpoint have a look at it
+			for (udp_conns_t::iterator i = m_udp_conns.begin();
+				i != m_udp_conns.end();)
+			{
+				boost::intrusive_ptr<udp_tracker_connection> p = i->second;
+				++i;
+				// on_receive() may remove the tracker connection from the map
+				if (p->on_receive(e, ep, buf, size)) return true;
+			}
+			return false;
 		}
-		return false;
+
+		// ignore packets smaller than 8 bytes
+		if (size < 8) return false;
+
+		char const* ptr = buf + 4;
+		int tid = detail::read_int32(ptr);
+		udp_conns_t::iterator i = m_udp_conns.find(tid);
+		if (i == m_udp_conns.end()) return false;
+
+		// on_receive() may remove the tracker connection from the map
+		boost::intrusive_ptr<udp_tracker_connection> p = i->second;
+		return p->on_receive(e, ep, buf, size);
 	}
 
 	bool tracker_manager::incoming_udp(error_code const& e
 		, char const* hostname, char const* buf, int size)
 	{
-		for (tracker_connections_t::iterator i = m_connections.begin();
-			i != m_connections.end();)
-		{
-			boost::intrusive_ptr<tracker_connection> p = *i;
-			++i;
-			// on_receive() may remove the tracker connection from the list
-			if (p->on_receive_hostname(e, hostname, buf, size)) return true;
-		}
-		return false;
+		TORRENT_ASSERT(m_ses.is_network_thread());
+		// ignore packets smaller than 8 bytes
+		if (size < 8) return false;
+
+		char const* ptr = buf + 4;
+		int tid = detail::read_int32(ptr);
+		udp_conns_t::iterator i = m_udp_conns.find(tid);
+		if (i == m_udp_conns.end()) return false;
+
+		// on_receive_hostname() may remove the tracker connection from the map
+		boost::intrusive_ptr<udp_tracker_connection> p = i->second;
+		return p->on_receive_hostname(e, hostname, buf, size);
 	}
 
 	void tracker_manager::abort_all_requests(bool all)
@@ -328,11 +524,15 @@ namespace libtorrent
 		}
 		l.unlock();
 
+		error_code ec;
+		m_scrape_timer.cancel(ec);
+
 		for (tracker_connections_t::iterator i = close_connections.begin()
 			, end(close_connections.end()); i != end; ++i)
 		{
 			(*i)->close();
 		}
+		m_scrape_queue.clear();
 	}
 	
 	bool tracker_manager::empty() const
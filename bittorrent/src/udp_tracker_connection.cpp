@@ -57,11 +57,6 @@ POSSIBILITY OF SUCH DAMAGE.
 namespace libtorrent
 {
 
-	std::map<address, udp_tracker_connection::connection_cache_entry>
-		udp_tracker_connection::m_connection_cache;
-
-	mutex udp_tracker_connection::m_cache_mutex;
-
 	udp_tracker_connection::udp_tracker_connection(
 		io_service& ios
 		, connection_queue& cc
@@ -76,7 +71,10 @@ namespace libtorrent
 		, m_transaction_id(0)
 		, m_ses(ses)
 		, m_attempts(0)
+		, m_connection_id(0)
 		, m_state(action_error)
+		, m_connect_leader(false)
+		, m_scrape_queued(false)
 		, m_proxy(proxy)
 	{
 	}
@@ -227,26 +225,32 @@ namespace libtorrent
 
 	void udp_tracker_connection::start_announce()
 	{
-		mutex::scoped_lock l(m_cache_mutex);
-		std::map<address, connection_cache_entry>::iterator cc
-			= m_connection_cache.find(m_target.address());
-		if (cc != m_connection_cache.end())
-		{
-			// we found a cached entry! Now, we can only
-			// use if if it hasn't expired
-			if (time_now() < cc->second.expires)
-			{
-				if (tracker_req().kind == tracker_request::announce_request)
-					send_udp_announce();
-				else if (tracker_req().kind == tracker_request::scrape_request)
-					send_udp_scrape();
-				return;
-			}
-			// if it expired, remove it from the cache
-			m_connection_cache.erase(cc);
+		if (m_abort || cancelled()) return;
+
+		// scrapes to a known endpoint are handed to the tracker_manager,
+		// which calls us back here once it has batched them up
+		if (tracker_req().kind == tracker_request::scrape_request
+			&& m_hostname.empty() && !m_scrape_queued)
+		{
+			m_scrape_queued = true;
+			m_man.queue_udp_scrape(m_target, self());
+			return;
+		}
+
+		if (m_man.udp_connection_id(m_target.address(), m_connection_id))
+		{
+			if (tracker_req().kind == tracker_request::announce_request)
+				send_udp_announce();
+			else if (tracker_req().kind == tracker_request::scrape_request)
+				send_udp_scrape();
+			return;
 		}
-		l.unlock();
 
+		// if some other request to this tracker is already connecting,
+		// wait for it rather than sending another connect message
+		if (m_man.wait_for_udp_connect(m_target.address(), self())) return;
+
+		m_connect_leader = true;
 		send_udp_connect();
 	}
 
@@ -268,10 +272,38 @@ namespace libtorrent
 		fail(error_code(errors::timed_out));
 	}
 
+	void udp_tracker_connection::fail(error_code const& ec, int code
+		, char const* msg, int interval, int min_interval)
+	{
+		// the connections riding on our scrape fail with us
+		std::vector<boost::intrusive_ptr<udp_tracker_connection> > batch;
+		batch.swap(m_scrape_batch);
+		for (std::vector<boost::intrusive_ptr<udp_tracker_connection> >::iterator i
+			= batch.begin(), end(batch.end()); i != end; ++i)
+		{
+			if ((*i)->cancelled()) continue;
+			(*i)->fail(ec, code, msg, interval, min_interval);
+		}
+		tracker_connection::fail(ec, code, msg, interval, min_interval);
+	}
+
 	void udp_tracker_connection::close()
 	{
 		error_code ec;
 		tracker_connection::close();
+
+		if (m_transaction_id != 0)
+		{
+			m_man.remove_transaction_id(m_transaction_id);
+			m_transaction_id = 0;
+		}
+
+		if (m_connect_leader)
+		{
+			// let the requests waiting for our connect message try on their own
+			m_connect_leader = false;
+			m_man.udp_connect_failed(m_target.address());
+		}
 	}
 
 	bool udp_tracker_connection::on_receive_hostname(error_code const& e
@@ -371,15 +403,13 @@ namespace libtorrent
 		restart_read_timeout();
 		buf += 8; // skip header
 
-		// reset transaction
-		m_transaction_id = 0;
+		// the next request gets a new transaction
+		m_transaction_id = m_man.new_transaction_id(self());
 		m_attempts = 0;
-		boost::uint64_t connection_id = detail::read_int64(buf);
+		m_connection_id = detail::read_int64(buf);
 
-		mutex::scoped_lock l(m_cache_mutex);
-		connection_cache_entry& cce = m_connection_cache[m_target.address()];
-		cce.connection_id = connection_id;
-		cce.expires = time_now() + seconds(m_ses.m_settings.udp_tracker_token_expiry);
+		m_connect_leader = false;
+		m_man.udp_connect_done(m_target.address(), m_connection_id);
 
 		if (tracker_req().kind == tracker_request::announce_request)
 			send_udp_announce();
@@ -407,7 +437,7 @@ namespace libtorrent
 		char* ptr = buf;
 
 		if (m_transaction_id == 0)
-			m_transaction_id = random() ^ (random() << 16);
+			m_transaction_id = m_man.new_transaction_id(self());
 
 		detail::write_uint32(0x417, ptr);
 		detail::write_uint32(0x27101980, ptr); // connection_id
@@ -437,38 +467,46 @@ namespace libtorrent
 	void udp_tracker_connection::send_udp_scrape()
 	{
 		if (m_transaction_id == 0)
-			m_transaction_id = random() ^ (random() << 16);
+			m_transaction_id = m_man.new_transaction_id(self());
 
 		if (m_abort) return;
 
-		std::map<address, connection_cache_entry>::iterator i
-			= m_connection_cache.find(m_target.address());
-		// this isn't really supposed to happen
-		TORRENT_ASSERT(i != m_connection_cache.end());
-		if (i == m_connection_cache.end()) return;
-
-		char buf[8 + 4 + 4 + 20];
+		// BEP 15 lets us ask for up to about 74 info-hashes per scrape,
+		// our own is followed by the ones of the batch we're leading
+		TORRENT_ASSERT(m_scrape_batch.size() < 74);
+		char buf[8 + 4 + 4 + 20 * 74];
 		char* out = buf;
 
-		detail::write_int64(i->second.connection_id, out); // connection_id
+		detail::write_int64(m_connection_id, out); // connection_id
 		detail::write_int32(action_scrape, out); // action (scrape)
 		detail::write_int32(m_transaction_id, out); // transaction_id
 		// info_hash
 		std::copy(tracker_req().info_hash.begin(), tracker_req().info_hash.end(), out);
 		out += 20;
-		TORRENT_ASSERT(out - buf == sizeof(buf));
+		for (std::vector<boost::intrusive_ptr<udp_tracker_connection> >::iterator i
+			= m_scrape_batch.begin(), end(m_scrape_batch.end()); i != end; ++i)
+		{
+			sha1_hash const& ih = (*i)->tracker_req().info_hash;
+			std::copy(ih.begin(), ih.end(), out);
+			out += 20;
+			// the batch delay and our connect round-trip shouldn't count
+			// against the followers. Their wait for the response starts now
+			(*i)->restart_read_timeout();
+		}
+		int len = out - buf;
+		TORRENT_ASSERT(len <= int(sizeof(buf)));
 
 		error_code ec;
 		if (!m_hostname.empty())
 		{
-			m_ses.m_udp_socket.send_hostname(m_hostname.c_str(), m_target.port(), buf, sizeof(buf), ec);
+			m_ses.m_udp_socket.send_hostname(m_hostname.c_str(), m_target.port(), buf, len, ec);
 		}
 		else
 		{
-			m_ses.m_udp_socket.send(m_target, buf, sizeof(buf), ec);
+			m_ses.m_udp_socket.send(m_target, buf, len, ec);
 		}
 		m_state = action_scrape;
-		sent_bytes(sizeof(buf) + 28); // assuming UDP/IP header
+		sent_bytes(len + 28); // assuming UDP/IP header
 		++m_attempts;
 		if (ec)
 		{
@@ -574,28 +612,52 @@ namespace libtorrent
 			return true;
 		}
 
+		// the response has one entry per info-hash we asked for, in the
+		// same order. Ours comes first, followed by the batch's
+		int num_entries = (size - 8) / 12;
+
 		int complete = detail::read_int32(buf);
 		int downloaded = detail::read_int32(buf);
 		int incomplete = detail::read_int32(buf);
 
-		boost::shared_ptr<request_callback> cb = requester();
-		if (!cb)
+		std::vector<boost::intrusive_ptr<udp_tracker_connection> > batch;
+		batch.swap(m_scrape_batch);
+		for (int i = 0; i < int(batch.size()); ++i)
 		{
-			close();
-			return true;
+			udp_tracker_connection& c = *batch[i];
+			if (c.cancelled()) continue;
+			if (i + 1 >= num_entries)
+			{
+				c.fail(error_code(errors::invalid_tracker_response_length));
+				continue;
+			}
+			char const* ptr = buf + i * 12;
+			int c_complete = detail::read_int32(ptr);
+			int c_downloaded = detail::read_int32(ptr);
+			int c_incomplete = detail::read_int32(ptr);
+			c.scrape_response(c_complete, c_downloaded, c_incomplete);
 		}
-		
-		cb->tracker_scrape_response(tracker_req()
-			, complete, incomplete, downloaded, -1);
 
-		close();
+		scrape_response(complete, downloaded, incomplete);
 		return true;
 	}
 
+	void udp_tracker_connection::scrape_response(int complete, int downloaded
+		, int incomplete)
+	{
+		boost::shared_ptr<request_callback> cb = requester();
+		if (cb)
+		{
+			cb->tracker_scrape_response(tracker_req()
+				, complete, incomplete, downloaded, -1);
+		}
+		close();
+	}
+
 	void udp_tracker_connection::send_udp_announce()
 	{
 		if (m_transaction_id == 0)
-			m_transaction_id = random() ^ (random() << 16);
+			m_transaction_id = m_man.new_transaction_id(self());
 
 		if (m_abort) return;
 
@@ -606,13 +668,7 @@ namespace libtorrent
 		const bool stats = req.send_stats;
 		session_settings const& settings = m_ses.settings();
 
-		std::map<address, connection_cache_entry>::iterator i
-			= m_connection_cache.find(m_target.address());
-		// this isn't really supposed to happen
-		TORRENT_ASSERT(i != m_connection_cache.end());
-		if (i == m_connection_cache.end()) return;
-
-		detail::write_int64(i->second.connection_id, out); // connection_id
+		detail::write_int64(m_connection_id, out); // connection_id
 		detail::write_int32(action_announce, out); // action (announce)
 		detail::write_int32(m_transaction_id, out); // transaction_id
 		std::copy(req.info_hash.begin(), req.info_hash.end(), out); // info_hash
@@ -81,33 +81,42 @@ namespace libtorrent { namespace
 		return true;
 	}
 
+	// a bencoded pex message, built once per epoch and shared by all
+	// the connections it's sent to. The send buffers keep a reference
+	// to it until it's been sent
+	typedef boost::shared_ptr<std::vector<char> const> shared_pex_msg;
+
 	struct ut_pex_plugin: torrent_plugin
 	{
 		// randomize when we rebuild the pex message
 		// to evenly spread it out across all torrents
-		ut_pex_plugin(torrent& t): m_torrent(t), m_1_minute(random() % 60), m_peers_in_message(0) {}
+		ut_pex_plugin(torrent& t): m_torrent(t), m_1_minute(random() % 60), m_epoch(0) {}
 	
 		virtual boost::shared_ptr<peer_plugin> new_connection(peer_connection* pc);
 
-		std::vector<char>& get_ut_pex_msg()
-		{
-			return m_ut_pex_msg;
-		}
+		// the messages of the current epoch. The diff holds the peers
+		// added and dropped since the previous epoch, and is empty if
+		// there were none. The full message lists all the peers
+		shared_pex_msg const& diff_msg() const { return m_diff_msg; }
+		shared_pex_msg const& full_msg() const { return m_full_msg; }
 
-		int peers_in_msg() const
-		{
-			return m_peers_in_message;
-		}
+		// incremented every time the messages are rebuilt. 0 means
+		// they haven't been built yet
+		int epoch() const { return m_epoch; }
 
 		// the second tick of the torrent
 		// each minute the new lists of "added" + "added.f" and "dropped"
-		// are calculated here and the pex message is created
-		// each peer connection will use this message
+		// are calculated here and the pex messages are created
+		// each peer connection will use these messages
 		// max_peer_entries limits the packet size
 		virtual void tick()
 		{
 			if (++m_1_minute < 60) return;
+			update();
+		}
 
+		void update()
+		{
 			m_1_minute = 0;
 
 			entry pex;
@@ -126,11 +135,27 @@ namespace libtorrent { namespace
 			std::back_insert_iterator<std::string> plf6_out(plf6);
 #endif
 
+			// the full list, with the dropped strings left empty
+			entry full;
+			full["dropped"].string();
+			std::string& fla = full["added"].string();
+			std::string& flf = full["added.f"].string();
+			std::back_insert_iterator<std::string> fla_out(fla);
+			std::back_insert_iterator<std::string> flf_out(flf);
+#if TORRENT_USE_IPV6
+			full["dropped6"].string();
+			std::string& fla6 = full["added6"].string();
+			std::string& flf6 = full["added6.f"].string();
+			std::back_insert_iterator<std::string> fla6_out(fla6);
+			std::back_insert_iterator<std::string> flf6_out(flf6);
+#endif
+
 			std::set<tcp::endpoint> dropped;
 			m_old_peers.swap(dropped);
 
-			m_peers_in_message = 0;
+			int peers_in_diff = 0;
 			int num_added = 0;
+			int num_full = 0;
 			for (torrent::peer_iterator i = m_torrent.begin()
 				, end(m_torrent.end()); i != end; ++i)
 			{
@@ -138,66 +163,86 @@ namespace libtorrent { namespace
 				if (!send_peer(*peer)) continue;
 
 				tcp::endpoint remote = peer->remote();
-				m_old_peers.insert(remote);
 
-				std::set<tcp::endpoint>::iterator di = dropped.find(remote);
-				if (di == dropped.end())
-				{
-					// don't write too big of a package
-					if (num_added >= max_peer_entries) break;
-
-					// only send proper bittorrent peers
-					if (peer->type() != peer_connection::bittorrent_connection)
-						continue;
-
-					bt_peer_connection* p = static_cast<bt_peer_connection*>(peer);
-
-					// if the peer has told us which port its listening on,
-					// use that port. But only if we didn't connect to the peer.
-					// if we connected to it, use the port we know works
-					policy::peer *pi = 0;
-					if (!p->is_outgoing() && (pi = peer->peer_info_struct()) && pi->port > 0)
-						remote.port(pi->port);
-
-					// no supported flags to set yet
-					// 0x01 - peer supports encryption
-					// 0x02 - peer is a seed
-					// 0x04 - supports uTP. This is only a positive flags
-					//        passing 0 doesn't mean the peer doesn't
-					//        support uTP
-					// 0x08 - supports holepunching protocol. If this
-					//        flag is received from a peer, it can be
-					//        used as a rendezvous point in case direct
-					//        connections to the peer fail
-					int flags = p->is_seed() ? 2 : 0;
+				// if this was in the previous message, it wasn't dropped
+				bool added = dropped.erase(remote) == 0;
+
+				// a new peer is only remembered once it's been written
+				// to the diff, or the connections following the diffs
+				// would never hear about the ones past the cap
+				if (!added) m_old_peers.insert(remote);
+				tcp::endpoint const key = remote;
+
+				// don't write too big of a package
+				if (num_full >= max_peer_entries
+					&& (!added || num_added >= max_peer_entries))
+					continue;
+
+				// only send proper bittorrent peers
+				if (peer->type() != peer_connection::bittorrent_connection)
+					continue;
+
+				bt_peer_connection* p = static_cast<bt_peer_connection*>(peer);
+
+				// if the peer has told us which port its listening on,
+				// use that port. But only if we didn't connect to the peer.
+				// if we connected to it, use the port we know works
+				policy::peer *pi = 0;
+				if (!p->is_outgoing() && (pi = peer->peer_info_struct()) && pi->port > 0)
+					remote.port(pi->port);
+
+				// no supported flags to set yet
+				// 0x01 - peer supports encryption
+				// 0x02 - peer is a seed
+				// 0x04 - supports uTP. This is only a positive flags
+				//        passing 0 doesn't mean the peer doesn't
+				//        support uTP
+				// 0x08 - supports holepunching protocol. If this
+				//        flag is received from a peer, it can be
+				//        used as a rendezvous point in case direct
+				//        connections to the peer fail
+				int flags = p->is_seed() ? 2 : 0;
 #ifndef TORRENT_DISABLE_ENCRYPTION
-					flags |= p->supports_encryption() ? 1 : 0;
+				flags |= p->supports_encryption() ? 1 : 0;
 #endif
-					flags |= p->get_socket()->get<utp_stream>() ? 4 :  0;
-					flags |= p->supports_holepunch() ? 8 : 0;
+				flags |= p->get_socket()->get<utp_stream>() ? 4 :  0;
+				flags |= p->supports_holepunch() ? 8 : 0;
 
-					// i->first was added since the last time
+				if (num_full < max_peer_entries)
+				{
 					if (remote.address().is_v4())
 					{
-						detail::write_endpoint(remote, pla_out);
-						detail::write_uint8(flags, plf_out);
+						detail::write_endpoint(remote, fla_out);
+						detail::write_uint8(flags, flf_out);
 					}
 #if TORRENT_USE_IPV6
 					else
 					{
-						detail::write_endpoint(remote, pla6_out);
-						detail::write_uint8(flags, plf6_out);
+						detail::write_endpoint(remote, fla6_out);
+						detail::write_uint8(flags, flf6_out);
 					}
 #endif
-					++num_added;
-					++m_peers_in_message;
+					++num_full;
 				}
+
+				if (!added || num_added >= max_peer_entries) continue;
+
+				// remote was added since the last time
+				if (remote.address().is_v4())
+				{
+					detail::write_endpoint(remote, pla_out);
+					detail::write_uint8(flags, plf_out);
+				}
+#if TORRENT_USE_IPV6
 				else
 				{
-					// this was in the previous message
-					// so, it wasn't dropped
-					dropped.erase(di);
+					detail::write_endpoint(remote, pla6_out);
+					detail::write_uint8(flags, plf6_out);
 				}
+#endif
+				m_old_peers.insert(key);
+				++num_added;
+				++peers_in_diff;
 			}
 
 			for (std::set<tcp::endpoint>::const_iterator i = dropped.begin()
@@ -209,11 +254,20 @@ namespace libtorrent { namespace
 				else
 					detail::write_endpoint(*i, pld6_out);
 #endif
-				++m_peers_in_message;
+				++peers_in_diff;
 			}
 
-			m_ut_pex_msg.clear();
-			bencode(std::back_inserter(m_ut_pex_msg), pex);
+			// the connections may still hold on to the previous
+			// messages, so these are new buffers
+			boost::shared_ptr<std::vector<char> > msg(new std::vector<char>);
+			if (peers_in_diff > 0) bencode(std::back_inserter(*msg), pex);
+			m_diff_msg = msg;
+
+			msg.reset(new std::vector<char>);
+			bencode(std::back_inserter(*msg), full);
+			m_full_msg = msg;
+
+			++m_epoch;
 		}
 
 	private:
@@ -221,8 +275,9 @@ namespace libtorrent { namespace
 
 		std::set<tcp::endpoint> m_old_peers;
 		int m_1_minute;
-		std::vector<char> m_ut_pex_msg;
-		int m_peers_in_message;
+		shared_pex_msg m_diff_msg;
+		shared_pex_msg m_full_msg;
+		int m_epoch;
 	};
 
 
@@ -234,7 +289,7 @@ namespace libtorrent { namespace
 			, m_tp(tp)
 			, m_1_minute(60)
 			, m_message_index(0)
-			, m_first_time(true)
+			, m_last_epoch(0)
 		{
 			const int num_pex_timers = sizeof(m_last_pex)/sizeof(m_last_pex[0]);
 			for (int i = 0; i < num_pex_timers; ++i)
@@ -424,38 +479,52 @@ namespace libtorrent { namespace
 			if (!m_message_index) return;	// no handshake yet
 			if (++m_1_minute <= 60) return;
 
-			if (m_first_time)
+			// the first message goes out right away
+			if (m_tp.epoch() == 0) m_tp.update();
+
+			int epoch = m_tp.epoch();
+			// no new message since the last one we sent
+			if (epoch == m_last_epoch) return;
+
+			if (m_last_epoch == epoch - 1 && m_last_epoch != 0)
 			{
-				send_ut_peer_list();
-				m_first_time = false;
+				// we sent the previous epoch's message, so the diff
+				// brings this peer up to date. It's empty if there
+				// were no changes to our peer set
+				if (!m_tp.diff_msg()->empty())
+					send_ut_pex_msg(m_tp.diff_msg(), "PEX_DIFF");
 			}
 			else
 			{
-				send_ut_peer_diff();
+				// this is either the first message to this peer, or
+				// it missed an epoch. Either way it needs the full list
+				send_ut_pex_msg(m_tp.full_msg(), "PEX_FULL");
 			}
+			m_last_epoch = epoch;
 			m_1_minute = 0;
 		}
 
-		void send_ut_peer_diff()
+		void send_ut_pex_msg(shared_pex_msg const& pex_msg, char const* type)
 		{
-			// if there's no change in out peer set, don't send anything
-			if (m_tp.peers_in_msg() == 0) return;
-
-			std::vector<char> const& pex_msg = m_tp.get_ut_pex_msg();
+			TORRENT_ASSERT(!pex_msg->empty());
 
 			char msg[6];
 			char* ptr = msg;
 
-			detail::write_uint32(1 + 1 + pex_msg.size(), ptr);
+			detail::write_uint32(1 + 1 + pex_msg->size(), ptr);
 			detail::write_uint8(bt_peer_connection::msg_extended, ptr);
 			detail::write_uint8(m_message_index, ptr);
 			m_pc.send_buffer(msg, sizeof(msg));
-			m_pc.send_buffer(&pex_msg[0], pex_msg.size());
+
+			// the message itself is shared with the other connections
+			TORRENT_ASSERT(m_pc.type() == peer_connection::bittorrent_connection);
+			static_cast<bt_peer_connection&>(m_pc).append_shared_send_buffer(
+				&(*pex_msg)[0], pex_msg->size(), pex_msg);
 
 #ifdef TORRENT_VERBOSE_LOGGING
 			lazy_entry m;
 			error_code ec;
-			int ret = lazy_bdecode(&pex_msg[0], &pex_msg[0] + pex_msg.size(), m, ec);
+			int ret = lazy_bdecode(&(*pex_msg)[0], &(*pex_msg)[0] + pex_msg->size(), m, ec);
 			TORRENT_ASSERT(ret == 0);
 			TORRENT_ASSERT(!ec);
 			int num_dropped = 0;
@@ -468,97 +537,8 @@ namespace libtorrent { namespace
 			if (e) num_added += e->string_length() / 18;
 			e = m.dict_find_string("dropped6");
 			if (e) num_dropped += e->string_length() / 18;
-			m_pc.peer_log("==> PEX_DIFF [ dropped: %d added: %d msg_size: %d ]"
-				, num_dropped, num_added, int(pex_msg.size()));
-#endif
-		}
-
-		void send_ut_peer_list()
-		{
-			entry pex;
-			// leave the dropped string empty
-			pex["dropped"].string();
-			std::string& pla = pex["added"].string();
-			std::string& plf = pex["added.f"].string();
-			std::back_insert_iterator<std::string> pla_out(pla);
-			std::back_insert_iterator<std::string> plf_out(plf);
-
-#if TORRENT_USE_IPV6
-			pex["dropped6"].string();
-			std::string& pla6 = pex["added6"].string();
-			std::string& plf6 = pex["added6.f"].string();
-			std::back_insert_iterator<std::string> pla6_out(pla6);
-			std::back_insert_iterator<std::string> plf6_out(plf6);
-#endif
-
-			int num_added = 0;
-			for (torrent::peer_iterator i = m_torrent.begin()
-				, end(m_torrent.end()); i != end; ++i)
-			{
-				peer_connection* peer = *i;
-				if (!send_peer(*peer)) continue;
-
-				// don't write too big of a package
-				if (num_added >= max_peer_entries) break;
-
-				// only send proper bittorrent peers
-				if (peer->type() != peer_connection::bittorrent_connection)
-					continue;
-
-				bt_peer_connection* p = static_cast<bt_peer_connection*>(peer);
-
-				// no supported flags to set yet
-				// 0x01 - peer supports encryption
-				// 0x02 - peer is a seed
-				// 0x04 - supports uTP. This is only a positive flags
-				//        passing 0 doesn't mean the peer doesn't
-				//        support uTP
-				// 0x08 - supports holepunching protocol. If this
-				//        flag is received from a peer, it can be
-				//        used as a rendezvous point in case direct
-				//        connections to the peer fail
-				int flags = p->is_seed() ? 2 : 0;
-#ifndef TORRENT_DISABLE_ENCRYPTION
-				flags |= p->supports_encryption() ? 1 : 0;
-#endif
-				flags |= p->get_socket()->get<utp_stream>() ? 4 :  0;
-				flags |= p->supports_holepunch() ? 8 : 0;
-
-				tcp::endpoint remote = peer->remote();
-
-				policy::peer *pi = 0;
-				if (!p->is_outgoing() && (pi = peer->peer_info_struct()) && pi->port > 0)
-					remote.port(pi->port);
-
-				// i->first was added since the last time
-				if (remote.address().is_v4())
-				{
-					detail::write_endpoint(remote, pla_out);
-					detail::write_uint8(flags, plf_out);
-				}
-#if TORRENT_USE_IPV6
-				else
-				{
-					detail::write_endpoint(remote, pla6_out);
-					detail::write_uint8(flags, plf6_out);
-				}
-#endif
-				++num_added;
-			}
-			std::vector<char> pex_msg;
-			bencode(std::back_inserter(pex_msg), pex);
-
-			char msg[6];
-			char* ptr = msg;
-
-			detail::write_uint32(1 + 1 + pex_msg.size(), ptr);
-			detail::write_uint8(bt_peer_connection::msg_extended, ptr);
-			detail::write_uint8(m_message_index, ptr);
-			m_pc.send_buffer(msg, sizeof(msg));
-			m_pc.send_buffer(&pex_msg[0], pex_msg.size());
-
-#ifdef TORRENT_VERBOSE_LOGGING
-			m_pc.peer_log("==> PEX_FULL [ added: %d msg_size: %d ]", num_added, int(pex_msg.size()));
+			m_pc.peer_log("==> %s [ dropped: %d added: %d msg_size: %d ]"
+				, type, num_dropped, num_added, int(pex_msg->size()));
 #endif
 		}
 
@@ -591,11 +571,10 @@ namespace libtorrent { namespace
 		int m_1_minute;
 		int m_message_index;
 
-		// this is initialized to true, and set to
-		// false after the first pex message has been sent.
-		// it is used to know if a diff message or a full
-		// message should be sent.
-		bool m_first_time;
+		// the epoch of the last pex message we sent, 0 if we haven't
+		// sent one yet. A diff is only good for a peer that got the
+		// previous epoch's message, everyone else gets the full list
+		int m_last_epoch;
 	};
 
 	boost::shared_ptr<peer_plugin> ut_pex_plugin::new_connection(peer_connection* pc)
@@ -52,6 +52,7 @@ namespace libtorrent
 		, m_sett(sett)
 		, m_last_route_update(min_time())
 		, m_sock_buf_size(0)
+		, m_metrics(0)
 	{}
 
 	utp_socket_manager::~utp_socket_manager()
@@ -38,6 +38,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/timestamp_history.hpp"
 #include "libtorrent/error.hpp"
 #include "libtorrent/random.hpp"
+#include "libtorrent/session_metrics.hpp"
 #include <boost/cstdint.hpp>
 
 #define TORRENT_UTP_LOG 0
@@ -1884,6 +1885,9 @@ void utp_socket_impl::ack_packet(packet* p, ptime const& receive_time
 
 	m_rtt.add_sample(rtt / 1000);
 	if (rtt < min_rtt) min_rtt = rtt;
+	if (session_metrics* m = m_sm->metrics())
+		m->sample(session_metrics::utp_rtt, rtt);
+
 	free(p);
 }
 
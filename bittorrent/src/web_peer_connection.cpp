@@ -732,6 +732,7 @@ namespace libtorrent
 					TORRENT_ASSERT(m_piece.size() == m_received_in_piece);
 					m_piece.resize(piece_size + copy_size);
 					std::memcpy(&m_piece[0] + piece_size, recv_buffer.begin, copy_size);
+					m_ses.add_recv_copied_bytes(copy_size);
 					TORRENT_ASSERT(int(m_piece.size()) <= front_request.length);
 					recv_buffer.begin += copy_size;
 					m_received_body += copy_size;
@@ -796,6 +797,7 @@ namespace libtorrent
 						TORRENT_ASSERT(m_piece.size() == m_received_in_piece);
 						m_piece.resize(piece_size + copy_size);
 						std::memcpy(&m_piece[0] + piece_size, recv_buffer.begin, copy_size);
+						m_ses.add_recv_copied_bytes(copy_size);
 						recv_buffer.begin += copy_size;
 						m_received_body += copy_size;
 						m_body_start += copy_size;
@@ -0,0 +1,570 @@
+// swarmBench.cpp : runs a swarm of in-process sessions over loopback and
+// reports throughput, CPU per GB and the hot-path latencies.
+//
+// every session gets its own listen port on 127.0.0.1. The seeds have the
+// whole torrent in seed mode, and every leecher connects to all seeds and
+// to the leechers before it. Storage is disabled_storage, so the disk
+// thread is exercised but no file is ever touched, and hash checks are
+// turned off since the pieces never hold real data.
+//
+// with --ram, every session uses ram_storage instead. The torrent then
+// has real hashes over generated data, the seeds are filled with it
+// before the clock starts, and the leechers check every piece. No file
+// is touched either, but each session holds the whole torrent in memory.
+//
+// to keep runs comparable, the torrent is generated from the options
+// alone, the random generator is seeded from --seed, and DHT, LSD, UPnP
+// and NAT-PMP are never started. Run it several times with --runs and
+// compare the medians.
+
+#include "libtorrent/session.hpp"
+#include "libtorrent/alert_types.hpp"
+#include "libtorrent/create_torrent.hpp"
+#include "libtorrent/torrent_info.hpp"
+#include "libtorrent/storage.hpp"
+#include "libtorrent/hasher.hpp"
+#include "libtorrent/bencode.hpp"
+#include "libtorrent/random.hpp"
+#include "libtorrent/time.hpp"
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <deque>
+#include <set>
+#include <string>
+#include <algorithm>
+#include <iterator>
+
+#ifdef _DEBUG
+#pragma comment (lib, "libtorrent_d.lib")
+#else
+#pragma comment (lib, "libtorrent.lib")
+#endif
+
+#pragma comment (lib, "WS2_32.lib")
+#pragma comment (lib, "libeay32.lib")
+#pragma comment (lib, "ssleay32.lib")
+
+using namespace libtorrent;
+
+namespace
+{
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	struct options
+	{
+		options()
+			: seeds(1)
+			, leechers(4)
+			, piece_size(256)
+			, size(256)
+			, encrypt(false)
+			, utp(false)
+			, ram(false)
+			, rate_limit(0)
+			, timeout(120)
+			, runs(1)
+			, seed(1)
+			, port(47000)
+		{}
+
+		int seeds;
+		int leechers;
+		// in KiB
+		int piece_size;
+		// in MiB
+		int size;
+		bool encrypt;
+		bool utp;
+		// use ram_storage and real piece data
+		bool ram;
+		// per session, in KiB/s. 0 is unlimited
+		int rate_limit;
+		// in seconds
+		int timeout;
+		int runs;
+		boost::uint32_t seed;
+		int port;
+	};
+
+	struct run_result
+	{
+		run_result()
+			: finished(false)
+			, seconds(0)
+			, cpu_seconds(0)
+			, downloaded(0)
+		{}
+
+		bool finished;
+		double seconds;
+		double cpu_seconds;
+		size_type downloaded;
+		session_metrics metrics;
+
+		double throughput() const { return seconds > 0 ? downloaded / seconds : 0; }
+
+		double cpu_per_gb() const
+		{
+			return downloaded > 0 ? cpu_seconds / ( double( downloaded ) / ( 1024 * 1024 * 1024 ) ) : 0;
+		}
+	};
+
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	void print_usage()
+	{
+		fputs( "usage: swarmBench [options]\n"
+			"  --seeds N          number of seeding sessions (1)\n"
+			"  --leechers N       number of downloading sessions (4)\n"
+			"  --piece-size KiB   piece size (256)\n"
+			"  --size MiB         torrent size (256)\n"
+			"  --encrypt          force RC4 encrypted connections\n"
+			"  --utp              connect over uTP instead of TCP\n"
+			"  --ram              keep real data in ram_storage and check hashes\n"
+			"  --rate-limit KiB/s upload and download limit per session (0)\n"
+			"  --timeout s        give up on a run after this long (120)\n"
+			"  --runs N           number of runs (1)\n"
+			"  --seed N           random seed (1)\n"
+			"  --port N           first listen port (47000)\n", stderr );
+	}
+
+	bool parse_options( int argc, char * argv[], options & o )
+	{
+		for( int i = 1; i < argc; ++i )
+		{
+			std::string arg = argv[i];
+
+			if( arg == "--encrypt" ) { o.encrypt = true; continue; }
+			if( arg == "--utp" ) { o.utp = true; continue; }
+			if( arg == "--ram" ) { o.ram = true; continue; }
+
+			if( i + 1 >= argc )
+				return false;
+
+			int v = atoi( argv[++i] );
+
+			if( arg == "--seeds" ) o.seeds = v;
+			else if( arg == "--leechers" ) o.leechers = v;
+			else if( arg == "--piece-size" ) o.piece_size = v;
+			else if( arg == "--size" ) o.size = v;
+			else if( arg == "--rate-limit" ) o.rate_limit = v;
+			else if( arg == "--timeout" ) o.timeout = v;
+			else if( arg == "--runs" ) o.runs = v;
+			else if( arg == "--seed" ) o.seed = boost::uint32_t( v );
+			else if( arg == "--port" ) o.port = v;
+			else return false;
+		}
+
+		return o.seeds > 0 && o.leechers > 0 && o.piece_size >= 16
+			&& o.size > 0 && o.timeout > 0 && o.runs > 0;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// the CPU time used by all threads of the process, in seconds
+
+	double process_cpu_time()
+	{
+		FILETIME creation, exit, kernel, user;
+		if( !GetProcessTimes( GetCurrentProcess(), &creation, &exit, &kernel, &user ) )
+			return 0;
+
+		ULARGE_INTEGER k, u;
+		k.LowPart = kernel.dwLowDateTime;
+		k.HighPart = kernel.dwHighDateTime;
+		u.LowPart = user.dwLowDateTime;
+		u.HighPart = user.dwHighDateTime;
+
+		// FILETIMEs count 100 ns intervals
+		return double( k.QuadPart + u.QuadPart ) / 10000000.0;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// the contents of a piece with --ram. It only depends on the piece index
+
+	void piece_data( int piece, int size, std::vector<char> & buf )
+	{
+		buf.resize( size );
+
+		// xorshift, the high bit keeps the state from starting at 0
+		boost::uint32_t x = 0x80000000 | boost::uint32_t( piece );
+
+		for( int i = 0; i < size; ++i )
+		{
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+			buf[i] = char( x );
+		}
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// the torrent only depends on the options, so every run of the same
+	// options downloads the same thing
+
+	boost::intrusive_ptr<torrent_info> make_torrent( options const & o )
+	{
+		file_storage fs;
+		fs.add_file( "swarmBench/data", size_type( o.size ) * 1024 * 1024 );
+
+		create_torrent ct( fs, o.piece_size * 1024 );
+		ct.set_creator( "swarmBench" );
+
+		if( o.ram )
+		{
+			std::vector<char> piece;
+
+			for( int i = 0; i < ct.num_pieces(); ++i )
+			{
+				piece_data( i, ct.piece_size( i ), piece );
+				ct.set_hash( i, hasher( &piece[0], int( piece.size() ) ).final() );
+			}
+		}
+
+		std::vector<char> buf;
+		bencode( std::back_inserter( buf ), ct.generate() );
+
+		error_code ec;
+		boost::intrusive_ptr<torrent_info> ti( new torrent_info( &buf[0], int( buf.size() ), ec ) );
+
+		if( ec )
+		{
+			fprintf( stderr, "failed to create torrent: %s\n", ec.message().c_str() );
+			return boost::intrusive_ptr<torrent_info>();
+		}
+
+		return ti;
+	}
+
+	session_settings bench_settings( options const & o )
+	{
+		session_settings s = high_performance_seed();
+
+		// everyone is on 127.0.0.1
+		s.allow_multiple_connections_per_ip = true;
+		s.ignore_limits_on_local_network = false;
+
+		// without --ram the pieces are never written anywhere
+		s.disable_hash_checks = !o.ram;
+
+		s.enable_outgoing_utp = o.utp;
+		s.enable_incoming_utp = o.utp;
+		s.enable_outgoing_tcp = !o.utp;
+		s.enable_incoming_tcp = !o.utp;
+
+		s.upload_rate_limit = o.rate_limit * 1024;
+		s.download_rate_limit = o.rate_limit * 1024;
+		s.rate_limit_utp = true;
+
+		s.collect_metrics = true;
+
+		return s;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// hands a seed all the pieces with add_piece, a few at a time so the
+	// disk buffers in flight stay bounded. Returns false on timeout
+
+	bool fill_seed( torrent_handle const & h, torrent_info const & ti, options const & o )
+	{
+		ptime deadline = time_now_hires() + seconds( o.timeout );
+
+		// pieces can only be added once the torrent is past checking
+		while( h.status( 0 ).state != torrent_status::downloading )
+		{
+			if( time_now_hires() >= deadline )
+				return false;
+			Sleep( 10 );
+		}
+
+		std::vector<char> buf;
+		int next = 0;
+
+		for(;;)
+		{
+			torrent_status st = h.status( 0 );
+			if( st.is_seeding )
+				return true;
+
+			if( time_now_hires() >= deadline )
+				return false;
+
+			while( next < ti.num_pieces() && next - st.num_pieces < 64 )
+			{
+				piece_data( next, ti.piece_size( next ), buf );
+				h.add_piece( next, &buf[0] );
+				++next;
+			}
+
+			Sleep( 10 );
+		}
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	bool run_swarm( options const & o, boost::intrusive_ptr<torrent_info> const & ti, run_result & r )
+	{
+		int num_sessions = o.seeds + o.leechers;
+
+		std::vector<session*> sessions;
+		std::vector<torrent_handle> handles;
+		std::vector<int> ports;
+
+		pe_settings pe;
+		pe.out_enc_policy = o.encrypt ? pe_settings::forced : pe_settings::disabled;
+		pe.in_enc_policy = o.encrypt ? pe_settings::forced : pe_settings::disabled;
+		pe.allowed_enc_level = pe_settings::rc4;
+
+		for( int i = 0; i < num_sessions; ++i )
+		{
+			// no DHT, LSD, UPnP or NAT-PMP
+			session * ses = new session( fingerprint( "SB", 0, 0, 0, 0 ), 0
+				, alert::status_notification | alert::error_notification );
+
+			// the first session seeds the random generator when it's
+			// constructed, override it
+			if( i == 0 )
+				random_seed( o.seed );
+
+			ses->set_settings( bench_settings( o ) );
+			ses->set_pe_settings( pe );
+
+			error_code ec;
+			ses->listen_on( std::make_pair( o.port, o.port + 1000 ), ec, "127.0.0.1" );
+
+			if( ec )
+			{
+				fprintf( stderr, "session %d failed to listen: %s\n", i, ec.message().c_str() );
+				delete ses;
+				break;
+			}
+
+			sessions.push_back( ses );
+			ports.push_back( ses->listen_port() );
+
+			add_torrent_params p;
+			p.ti = ti;
+			p.save_path = ".";
+			p.storage = o.ram ? ram_storage_constructor : disabled_storage_constructor;
+			p.flags = i < o.seeds && !o.ram ? add_torrent_params::flag_seed_mode : 0;
+
+			torrent_handle h = ses->add_torrent( p, ec );
+
+			if( ec )
+			{
+				fprintf( stderr, "session %d failed to add the torrent: %s\n", i, ec.message().c_str() );
+				break;
+			}
+
+			handles.push_back( h );
+		}
+
+		bool ok = int( handles.size() ) == num_sessions;
+
+		for( int i = 0; ok && o.ram && i < o.seeds; ++i )
+		{
+			if( !fill_seed( handles[i], *ti, o ) )
+			{
+				fprintf( stderr, "seed %d timed out receiving the pieces\n", i );
+				ok = false;
+			}
+		}
+
+		double cpu_start = process_cpu_time();
+		ptime start = time_now_hires();
+
+		if( ok )
+		{
+			// leechers connect to all seeds and to the leechers before them
+			for( int i = o.seeds; i < num_sessions; ++i )
+			{
+				for( int j = 0; j < i; ++j )
+					handles[i].connect_peer( tcp::endpoint( address_v4::from_string( "127.0.0.1" ), ports[j] ) );
+			}
+
+			std::set<int> finished;
+			ptime deadline = start + seconds( o.timeout );
+
+			while( int( finished.size() ) < o.leechers && time_now_hires() < deadline )
+			{
+				Sleep( 10 );
+
+				for( int i = o.seeds; i < num_sessions; ++i )
+				{
+					std::deque<alert*> alerts;
+					sessions[i]->pop_alerts( &alerts );
+
+					for( std::deque<alert*>::iterator a = alerts.begin(); a != alerts.end(); ++a )
+					{
+						if( alert_cast<torrent_finished_alert>( *a ) )
+							finished.insert( i );
+						delete *a;
+					}
+				}
+			}
+
+			r.finished = int( finished.size() ) == o.leechers;
+		}
+
+		r.seconds = total_microseconds( time_now_hires() - start ) / 1000000.0;
+		r.cpu_seconds = process_cpu_time() - cpu_start;
+
+		for( int i = o.seeds; i < int( handles.size() ); ++i )
+			r.downloaded += handles[i].status( 0 ).total_payload_download;
+
+		// collect the metrics of every session
+		for( int i = 0; i < int( sessions.size() ); ++i )
+		{
+			sessions[i]->post_session_stats();
+
+			bool got_stats = false;
+			while( !got_stats && sessions[i]->wait_for_alert( seconds( 5 ) ) )
+			{
+				std::deque<alert*> alerts;
+				sessions[i]->pop_alerts( &alerts );
+
+				for( std::deque<alert*>::iterator a = alerts.begin(); a != alerts.end(); ++a )
+				{
+					if( session_stats_alert const * sa = alert_cast<session_stats_alert>( *a ) )
+					{
+						r.metrics.add( sa->metrics );
+						got_stats = true;
+					}
+					delete *a;
+				}
+			}
+		}
+
+		// shut all sessions down in parallel
+		std::vector<session_proxy> proxies;
+		for( int i = 0; i < int( sessions.size() ); ++i )
+		{
+			proxies.push_back( sessions[i]->abort() );
+			delete sessions[i];
+		}
+
+		return ok;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// the upper bound of a histogram bucket, in microseconds
+
+	boost::int64_t bucket_limit( int b )
+	{
+		return b == 0 ? 0 : boost::int64_t( 1 ) << b;
+	}
+
+	// the upper bound of the bucket holding the given fraction of the samples
+	boost::int64_t percentile( session_metrics const & m, int h, double fraction )
+	{
+		boost::uint64_t total = m.num_samples( h );
+		boost::uint64_t limit = boost::uint64_t( total * fraction );
+		boost::uint64_t seen = 0;
+
+		for( int b = 0; b < session_metrics::num_buckets; ++b )
+		{
+			seen += m.histograms[h][b];
+			if( seen > limit || seen == total )
+				return bucket_limit( b );
+		}
+
+		return bucket_limit( session_metrics::num_buckets - 1 );
+	}
+
+	void print_result( int run, run_result const & r )
+	{
+		printf( "run %d: %s in %.2f s, %.1f MiB/s, %.2f CPU s/GiB\n"
+			, run, r.finished ? "done" : "TIMED OUT", r.seconds
+			, r.throughput() / ( 1024 * 1024 ), r.cpu_per_gb() );
+
+		for( int h = 0; h < session_metrics::num_histograms; ++h )
+		{
+			boost::uint64_t n = r.metrics.num_samples( h );
+			if( n == 0 )
+				continue;
+
+			printf( "  %-22s n: %-10I64u p50: <%-8I64d p90: <%-8I64d p99: <%I64d us\n"
+				, session_metrics::histogram_name( h ), n
+				, percentile( r.metrics, h, 0.5 )
+				, percentile( r.metrics, h, 0.9 )
+				, percentile( r.metrics, h, 0.99 ) );
+		}
+
+		for( int c = 0; c < session_metrics::num_counters; ++c )
+			printf( "  %-22s %I64u\n", session_metrics::counter_name( c ), r.metrics.counters[c] );
+	}
+
+	double median( std::vector<double> v )
+	{
+		std::sort( v.begin(), v.end() );
+		return v[v.size() / 2];
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+
+int main( int argc, char * argv[] )
+{
+	options o;
+
+	if( !parse_options( argc, argv, o ) )
+	{
+		print_usage();
+		return 1;
+	}
+
+	boost::intrusive_ptr<torrent_info> ti = make_torrent( o );
+	if( !ti )
+		return 1;
+
+	printf( "%d seeds, %d leechers, %d MiB in %d KiB pieces over %s%s"
+		, o.seeds, o.leechers, o.size, o.piece_size
+		, o.utp ? "uTP" : "TCP", o.encrypt ? " (RC4)" : "" );
+
+	if( o.ram )
+		printf( ", in ram_storage" );
+
+	if( o.rate_limit > 0 )
+		printf( ", limited to %d KiB/s", o.rate_limit );
+
+	printf( "\n" );
+
+	std::vector<double> throughput;
+	std::vector<double> cpu_per_gb;
+	int failed = 0;
+
+	for( int run = 0; run < o.runs; ++run )
+	{
+		run_result r;
+
+		if( !run_swarm( o, ti, r ) )
+			return 1;
+
+		print_result( run, r );
+
+		if( !r.finished )
+		{
+			++failed;
+			continue;
+		}
+
+		throughput.push_back( r.throughput() / ( 1024 * 1024 ) );
+		cpu_per_gb.push_back( r.cpu_per_gb() );
+	}
+
+	// one line that's easy to pick out of the output and compare
+	if( !throughput.empty() )
+	{
+		printf( "median: throughput_mibs=%.1f cpu_s_per_gib=%.2f runs=%d timed_out=%d\n"
+			, median( throughput ), median( cpu_per_gb ), int( throughput.size() ), failed );
+	}
+
+	return failed > 0 ? 2 : 0;
+}
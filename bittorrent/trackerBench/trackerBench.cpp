@@ -0,0 +1,511 @@
+// trackerBench.cpp : runs one session with many torrents against a fake UDP
+// tracker on loopback and reports how the announces and scrapes reached it.
+//
+// the fake tracker speaks BEP 15 and counts the connect, announce and scrape
+// packets it receives, and how many info-hashes each scrape carries. Every
+// torrent is added without metadata and announces once. Then all of them are
+// scraped at the same time, which should go out as a few batched scrape
+// packets reusing the connection id of the announces.
+//
+// the tracker answers every scrape entry with counts derived from the
+// info-hash, so the bench can tell whether each torrent of a batch was handed
+// its own entry. With --delay, the tracker holds every reply back, to see
+// that the requests riding on another one's connect and scrape don't time
+// out while they wait.
+//
+// the exit code is 0 when every torrent got its announce and scrape reply
+// with the right counts, 2 otherwise.
+
+#include "libtorrent/session.hpp"
+#include "libtorrent/alert_types.hpp"
+#include "libtorrent/storage.hpp"
+#include "libtorrent/hasher.hpp"
+#include "libtorrent/thread.hpp"
+#include "libtorrent/time.hpp"
+#include "libtorrent/io.hpp"
+
+#include <boost/bind.hpp>
+
+#include <winsock2.h>
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <deque>
+#include <set>
+#include <string>
+
+#ifdef _DEBUG
+#pragma comment (lib, "libtorrent_d.lib")
+#else
+#pragma comment (lib, "libtorrent.lib")
+#endif
+
+#pragma comment (lib, "WS2_32.lib")
+#pragma comment (lib, "libeay32.lib")
+#pragma comment (lib, "ssleay32.lib")
+
+using namespace libtorrent;
+
+namespace
+{
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	struct options
+	{
+		options()
+			: torrents(500)
+			, delay(0)
+			, timeout(60)
+			, port(48000)
+		{}
+
+		int torrents;
+		// how long the tracker holds back every reply, in milliseconds
+		int delay;
+		// per phase, in seconds
+		int timeout;
+		// the tracker's port. The session listens on the ports above it
+		int port;
+	};
+
+	void print_usage()
+	{
+		fputs( "usage: trackerBench [options]\n"
+			"  --torrents N       number of torrents (500)\n"
+			"  --delay ms         tracker reply delay (0)\n"
+			"  --timeout s        give up on a phase after this long (60)\n"
+			"  --port N           tracker port (48000)\n", stderr );
+	}
+
+	bool parse_options( int argc, char * argv[], options & o )
+	{
+		for( int i = 1; i < argc; ++i )
+		{
+			std::string arg = argv[i];
+
+			if( i + 1 >= argc )
+				return false;
+
+			int v = atoi( argv[++i] );
+
+			if( arg == "--torrents" ) o.torrents = v;
+			else if( arg == "--delay" ) o.delay = v;
+			else if( arg == "--timeout" ) o.timeout = v;
+			else if( arg == "--port" ) o.port = v;
+			else return false;
+		}
+
+		return o.torrents > 0 && o.delay >= 0 && o.timeout > 0 && o.port > 0;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// the counts the tracker reports for an info-hash
+
+	int seeds_for( sha1_hash const & ih ) { return boost::uint8_t( ih[0] ); }
+	int downloaders_for( sha1_hash const & ih ) { return boost::uint8_t( ih[1] ); }
+
+	//////////////////////////////////////////////////////////////////////////
+	// a BEP 15 tracker on 127.0.0.1 that counts what it receives
+
+	struct tracker_stats
+	{
+		tracker_stats()
+			: connects(0)
+			, announces(0)
+			, scrapes(0)
+			, scraped_hashes(0)
+			, largest_scrape(0)
+			, bad_connection_id(0)
+		{}
+
+		int connects;
+		int announces;
+		// scrape packets, and the info-hashes in them
+		int scrapes;
+		int scraped_hashes;
+		int largest_scrape;
+		// requests with a connection id we never handed out
+		int bad_connection_id;
+	};
+
+	class fake_tracker
+	{
+	public:
+
+		fake_tracker( int port, int delay )
+			: port_( port )
+			, delay_( delay )
+			, socket_( INVALID_SOCKET )
+			, abort_( false )
+			, next_connection_id_( 0x1000 )
+		{}
+
+		~fake_tracker() { stop(); }
+
+		bool start()
+		{
+			socket_ = socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
+			if( socket_ == INVALID_SOCKET )
+				return false;
+
+			sockaddr_in addr;
+			memset( &addr, 0, sizeof(addr) );
+			addr.sin_family = AF_INET;
+			addr.sin_port = htons( u_short( port_ ) );
+			addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+
+			if( bind( socket_, (sockaddr*)&addr, sizeof(addr) ) != 0 )
+			{
+				closesocket( socket_ );
+				socket_ = INVALID_SOCKET;
+				return false;
+			}
+
+			thread_.reset( new thread( boost::bind( &fake_tracker::thread_fun, this ) ) );
+			return true;
+		}
+
+		void stop()
+		{
+			if( !thread_ )
+				return;
+
+			{
+				mutex::scoped_lock l( mutex_ );
+				abort_ = true;
+			}
+
+			thread_->join();
+			thread_.reset();
+			closesocket( socket_ );
+			socket_ = INVALID_SOCKET;
+		}
+
+		tracker_stats stats()
+		{
+			mutex::scoped_lock l( mutex_ );
+			return stats_;
+		}
+
+	private:
+
+		enum { action_connect, action_announce, action_scrape, action_error };
+
+		void thread_fun()
+		{
+			char buf[1500];
+
+			for(;;)
+			{
+				{
+					mutex::scoped_lock l( mutex_ );
+					if( abort_ )
+						return;
+				}
+
+				// wake up every now and then to see if we're done
+				fd_set read_set;
+				FD_ZERO( &read_set );
+				FD_SET( socket_, &read_set );
+				timeval tv = { 0, 100000 };
+
+				if( select( 0, &read_set, 0, 0, &tv ) <= 0 )
+					continue;
+
+				sockaddr_in from;
+				int from_len = sizeof(from);
+				int size = recvfrom( socket_, buf, sizeof(buf), 0, (sockaddr*)&from, &from_len );
+
+				if( size < 16 )
+					continue;
+
+				std::vector<char> reply;
+				handle_packet( buf, size, reply );
+
+				if( reply.empty() )
+					continue;
+
+				if( delay_ > 0 )
+					Sleep( delay_ );
+
+				sendto( socket_, &reply[0], int( reply.size() ), 0, (sockaddr*)&from, from_len );
+			}
+		}
+
+		void handle_packet( char const * buf, int size, std::vector<char> & reply )
+		{
+			char const * ptr = buf;
+			boost::uint64_t connection_id = detail::read_uint64( ptr );
+			int action = detail::read_int32( ptr );
+			boost::int32_t transaction = detail::read_int32( ptr );
+
+			mutex::scoped_lock l( mutex_ );
+
+			if( action == action_connect )
+			{
+				++stats_.connects;
+				connection_ids_.insert( next_connection_id_ );
+
+				reply.resize( 16 );
+				char * out = &reply[0];
+				detail::write_int32( action_connect, out );
+				detail::write_int32( transaction, out );
+				detail::write_uint64( next_connection_id_, out );
+				++next_connection_id_;
+				return;
+			}
+
+			if( !connection_ids_.count( connection_id ) )
+			{
+				++stats_.bad_connection_id;
+
+				static char const msg[] = "unknown connection id";
+				reply.resize( 8 + sizeof(msg) - 1 );
+				char * out = &reply[0];
+				detail::write_int32( action_error, out );
+				detail::write_int32( transaction, out );
+				memcpy( out, msg, sizeof(msg) - 1 );
+				return;
+			}
+
+			if( action == action_announce && size >= 98 )
+			{
+				++stats_.announces;
+
+				sha1_hash ih;
+				memcpy( &ih[0], ptr, 20 );
+
+				reply.resize( 20 );
+				char * out = &reply[0];
+				detail::write_int32( action_announce, out );
+				detail::write_int32( transaction, out );
+				detail::write_int32( 1800, out ); // interval
+				detail::write_int32( downloaders_for( ih ), out );
+				detail::write_int32( seeds_for( ih ), out );
+				return;
+			}
+
+			if( action == action_scrape )
+			{
+				int num_hashes = ( size - 16 ) / 20;
+
+				++stats_.scrapes;
+				stats_.scraped_hashes += num_hashes;
+				stats_.largest_scrape = (std::max)( stats_.largest_scrape, num_hashes );
+
+				reply.resize( 8 + num_hashes * 12 );
+				char * out = &reply[0];
+				detail::write_int32( action_scrape, out );
+				detail::write_int32( transaction, out );
+
+				for( int i = 0; i < num_hashes; ++i )
+				{
+					sha1_hash ih;
+					memcpy( &ih[0], ptr + i * 20, 20 );
+					detail::write_int32( seeds_for( ih ), out ); // complete
+					detail::write_int32( 0, out ); // downloaded
+					detail::write_int32( downloaders_for( ih ), out ); // incomplete
+				}
+			}
+		}
+
+		int port_;
+		int delay_;
+		SOCKET socket_;
+		boost::shared_ptr<thread> thread_;
+
+		// protects everything below
+		mutex mutex_;
+		bool abort_;
+		tracker_stats stats_;
+		std::set<boost::uint64_t> connection_ids_;
+		boost::uint64_t next_connection_id_;
+	};
+
+	//////////////////////////////////////////////////////////////////////////
+	// the replies of one phase
+
+	struct phase_result
+	{
+		phase_result()
+			: replies(0)
+			, failed(0)
+			, wrong(0)
+			, seconds(0)
+		{}
+
+		int replies;
+		int failed;
+		// scrape replies with another torrent's counts
+		int wrong;
+		double seconds;
+	};
+
+	// whether a reply carries the counts the tracker has for the torrent
+	bool matches( tracker_reply_alert const &, sha1_hash const & ) { return true; }
+
+	bool matches( scrape_reply_alert const & a, sha1_hash const & ih )
+	{
+		return a.complete == seeds_for( ih ) && a.incomplete == downloaders_for( ih );
+	}
+
+	// waits for a reply or failure alert for every torrent. Returns false on
+	// timeout
+	template <class Reply, class Failure>
+	bool wait_for_replies( session & ses, options const & o, phase_result & r )
+	{
+		ptime start = time_now_hires();
+		ptime deadline = start + seconds( o.timeout );
+		std::set<sha1_hash> done;
+
+		while( int( done.size() ) < o.torrents && time_now_hires() < deadline )
+		{
+			if( !ses.wait_for_alert( milliseconds( 100 ) ) )
+				continue;
+
+			std::deque<alert*> alerts;
+			ses.pop_alerts( &alerts );
+
+			for( std::deque<alert*>::iterator a = alerts.begin(); a != alerts.end(); ++a )
+			{
+				if( Reply const * rep = alert_cast<Reply>( *a ) )
+				{
+					sha1_hash ih = rep->handle.info_hash();
+					if( done.insert( ih ).second )
+					{
+						++r.replies;
+						if( !matches( *rep, ih ) )
+							++r.wrong;
+					}
+				}
+				else if( Failure const * f = alert_cast<Failure>( *a ) )
+				{
+					if( done.insert( f->handle.info_hash() ).second )
+						++r.failed;
+				}
+				delete *a;
+			}
+		}
+
+		r.seconds = total_microseconds( time_now_hires() - start ) / 1000000.0;
+		return int( done.size() ) == o.torrents;
+	}
+
+	void print_phase( char const * name, options const & o, phase_result const & r, bool complete )
+	{
+		printf( "%s: %d/%d replies in %.2f s, %d failed, %d wrong%s\n"
+			, name, r.replies, o.torrents, r.seconds, r.failed, r.wrong
+			, complete ? "" : ", TIMED OUT" );
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+
+int main( int argc, char * argv[] )
+{
+	options o;
+
+	if( !parse_options( argc, argv, o ) )
+	{
+		print_usage();
+		return 1;
+	}
+
+	WSADATA wsa;
+	WSAStartup( MAKEWORD( 2, 2 ), &wsa );
+
+	fake_tracker tracker( o.port, o.delay );
+
+	if( !tracker.start() )
+	{
+		fprintf( stderr, "failed to start the tracker on port %d\n", o.port );
+		return 1;
+	}
+
+	// no DHT, LSD, UPnP or NAT-PMP
+	session ses( fingerprint( "TB", 0, 0, 0, 0 ), 0
+		, alert::tracker_notification | alert::error_notification );
+
+	session_settings s = ses.settings();
+	// every torrent posts a reply per phase
+	s.alert_queue_size = o.torrents * 2 + 1000;
+	ses.set_settings( s );
+
+	error_code ec;
+	ses.listen_on( std::make_pair( o.port + 1, o.port + 1000 ), ec, "127.0.0.1" );
+
+	if( ec )
+	{
+		fprintf( stderr, "failed to listen: %s\n", ec.message().c_str() );
+		return 1;
+	}
+
+	char tracker_url[100];
+	_snprintf( tracker_url, sizeof(tracker_url), "udp://127.0.0.1:%d/announce", o.port );
+
+	printf( "%d torrents on %s, reply delay %d ms\n", o.torrents, tracker_url, o.delay );
+
+	// adding a torrent without metadata makes it announce right away
+	std::vector<torrent_handle> handles;
+
+	for( int i = 0; i < o.torrents; ++i )
+	{
+		char name[50];
+		_snprintf( name, sizeof(name), "trackerBench %d", i );
+
+		add_torrent_params p;
+		p.info_hash = hasher( name, int( strlen( name ) ) ).final();
+		p.trackers.push_back( tracker_url );
+		p.save_path = ".";
+		p.storage = disabled_storage_constructor;
+		p.flags = 0;
+
+		torrent_handle h = ses.add_torrent( p, ec );
+
+		if( ec )
+		{
+			fprintf( stderr, "failed to add torrent %d: %s\n", i, ec.message().c_str() );
+			return 1;
+		}
+
+		handles.push_back( h );
+	}
+
+	phase_result announce;
+	bool announced = wait_for_replies<tracker_reply_alert, tracker_error_alert>( ses, o, announce );
+	print_phase( "announce", o, announce, announced );
+
+	tracker_stats after_announce = tracker.stats();
+
+	for( std::vector<torrent_handle>::iterator i = handles.begin(); i != handles.end(); ++i )
+		i->scrape_tracker();
+
+	phase_result scrape;
+	bool scraped = wait_for_replies<scrape_reply_alert, scrape_failed_alert>( ses, o, scrape );
+	print_phase( "scrape", o, scrape, scraped );
+
+	tracker_stats st = tracker.stats();
+
+	printf( "tracker: %d connects, %d announces, %d scrape packets for %d info-hashes"
+		" (largest %d), %d unknown connection ids\n"
+		, st.connects, st.announces, st.scrapes, st.scraped_hashes
+		, st.largest_scrape, st.bad_connection_id );
+
+	// one line that's easy to pick out of the output and compare
+	printf( "result: announce_connects=%d scrape_connects=%d scrape_packets=%d"
+		" hashes_per_scrape=%.1f\n"
+		, after_announce.connects, st.connects - after_announce.connects, st.scrapes
+		, st.scrapes > 0 ? double( st.scraped_hashes ) / st.scrapes : 0.0 );
+
+	session_proxy proxy = ses.abort();
+	tracker.stop();
+
+	bool ok = announced && scraped
+		&& announce.failed == 0 && scrape.failed == 0 && scrape.wrong == 0;
+
+	return ok ? 0 : 2;
+}
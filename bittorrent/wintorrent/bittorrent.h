@@ -247,6 +247,9 @@ namespace libtorrent
 	{
 		torrent_event_finished,
 		torrent_event_add_failed,
+		torrent_event_added,
+		torrent_event_removed,
+		torrent_event_remove_failed,
 		torrent_event_max
 	};
 
@@ -321,6 +324,8 @@ namespace libtorrent
 		// -a <mode>				sets the allocation mode. [sparse|full]
 		// -R <num blocks>			number of blocks per read cache line
 		// -C <limit>				sets the max cache size. Specified in 16kB blocks
+		// -g						back the disk cache with large pages. On windows the account
+		//							needs the "Lock pages in memory" right (SeLockMemoryPrivilege)
 		// -O						Disallow disk job reordering
 		// -j						disable disk read-ahead
 		// -z						disable piece hash checks (used for benchmarking)
@@ -337,6 +342,15 @@ namespace libtorrent
 		void update();
 		bool add(std::string torrent);
 		bool del( std::string torrent, bool delete_torrent_file, bool delete_download_file );
+
+		// adds or removes many torrents at once. .torrent files and their resume data
+		// are loaded on worker threads and handed to the session in batches from update().
+		// every torrent is reported through the EventHandler, with torrent_event_added or
+		// torrent_event_add_failed, and torrent_event_removed or torrent_event_remove_failed.
+		// returns the number of torrents that were accepted
+		int add_many( std::vector<std::string> const & torrents );
+		int del_many( std::vector<std::string> const & torrents, bool delete_torrent_file, bool delete_download_file );
+
 		bool pause( std::string torrent );
 		bool resume( std::string torrent );
 		bool setting( std::vector<std::string> const & params );
@@ -347,6 +361,13 @@ namespace libtorrent
 		void get_metadata( std::string torrent, std::vector<char> & data );
 
 		void set_sequential_down( std::string torrent, bool sequential );
+
+		// streaming playback. window_pieces pieces ahead of the playback position
+		// are requested with deadlines deadline_step_ms apart. 0 window_pieces turns it off
+		void set_streaming( std::string torrent, int window_pieces, int deadline_step_ms = 1000 );
+		// moves the playback position, offset is in bytes from the start of the torrent
+		void advance_streaming( std::string torrent, __int64 offset );
+
 		// prograss, state, tracker, peer, speed, etc info.
 		bool get_status( std::string torrent, TorrentStatus & ts );
 
@@ -384,6 +405,8 @@ namespace libtorrent
 		virtual void update() = 0;
 		virtual bool add(std::string const & torrent) = 0;
 		virtual bool del(std::string const & torrent, bool delete_torrent_file, bool delete_download_file) = 0;
+		virtual int add_many( std::vector<std::string> const & torrents ) = 0;
+		virtual int del_many( std::vector<std::string> const & torrents, bool delete_torrent_file, bool delete_download_file ) = 0;
 		virtual bool pause(std::string const & torrent) = 0;
 		virtual bool resume(std::string const & torrent) = 0;
 		virtual bool setting( std::vector<std::string> const & params, bool isFirst = false ) = 0;
@@ -392,6 +415,8 @@ namespace libtorrent
 		virtual std::string get_magnet( std::string const & torrent ) = 0;
 		virtual void get_metadata( std::string const & torrent, std::vector<char> & data ) = 0;
 		virtual void set_sequential_down( std::string const & torrent, bool sequential ) = 0;
+		virtual void set_streaming( std::string const & torrent, int window_pieces, int deadline_step_ms ) = 0;
+		virtual void advance_streaming( std::string const & torrent, __int64 offset ) = 0;
 		virtual bool get_status( std::string const & torrent, TorrentStatus & ts ) = 0;
 	};
 
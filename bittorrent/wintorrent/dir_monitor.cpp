@@ -0,0 +1,357 @@
+#include "dir_monitor.hpp"
+
+#include "libtorrent/file.hpp"
+#include "libtorrent/utf8.hpp"
+
+#include <boost/bind.hpp>
+
+namespace
+{
+	// the number of milliseconds a new file has to go without
+	// changing before we try to load it
+	const DWORD settle_time = 1000;
+
+	bool is_torrent_file( std::string const & name )
+	{
+		return libtorrent::extension( name ) == ".torrent";
+	}
+}
+
+namespace libtorrent
+{
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	dir_monitor::dir_monitor()
+		: poll_interval_(5)
+		, buffer_(16 * 1024)
+		, stop_event_( CreateEvent( 0, TRUE, FALSE, 0 ) )
+	{}
+
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	dir_monitor::~dir_monitor()
+	{
+		stop();
+		CloseHandle( stop_event_ );
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	void dir_monitor::start( std::string const & dir, int poll_interval )
+	{
+		if( thread_ && dir == dir_ && poll_interval == poll_interval_ )
+			return;
+
+		stop();
+
+		dir_ = dir;
+		poll_interval_ = (std::max)( poll_interval, 1 );
+
+		ResetEvent( stop_event_ );
+		thread_.reset( new thread( boost::bind( &dir_monitor::thread_fun, this ) ) );
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	void dir_monitor::stop()
+	{
+		if( !thread_ )
+			return;
+
+		SetEvent( stop_event_ );
+		thread_->join();
+		thread_.reset();
+
+		known_.clear();
+		failed_.clear();
+		pending_.clear();
+
+		mutex::scoped_lock l( mutex_ );
+		changes_.clear();
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	void dir_monitor::pop_changes( std::deque<change> & changes )
+	{
+		mutex::scoped_lock l( mutex_ );
+		changes_.swap( changes );
+		changes_.clear();
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	void dir_monitor::post( change const & c )
+	{
+		mutex::scoped_lock l( mutex_ );
+		changes_.push_back( c );
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	void dir_monitor::thread_fun()
+	{
+		std::wstring wdir;
+		utf8_wchar( dir_, wdir );
+
+		HANDLE dir = CreateFileW( wdir.c_str(), FILE_LIST_DIRECTORY
+			, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 0, OPEN_EXISTING
+			, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, 0 );
+
+		OVERLAPPED ol;
+		memset( &ol, 0, sizeof(ol) );
+		ol.hEvent = CreateEvent( 0, TRUE, FALSE, 0 );
+
+		bool watching = dir != INVALID_HANDLE_VALUE && read_changes( dir, ol );
+
+		// the files that are there to begin with. The directory is listed
+		// only once the first read is issued, so that files dropped in
+		// while it's being listed still show up as notifications
+		rescan();
+
+		DWORD next_poll = GetTickCount() + poll_interval_ * 1000;
+
+		for(;;)
+		{
+			DWORD timeout = pending_.empty() ? INFINITE : settle_time;
+
+			if( !watching )
+			{
+				DWORD poll = int( next_poll - GetTickCount() ) > 0 ? next_poll - GetTickCount() : 0;
+				timeout = (std::min)( timeout, poll );
+			}
+
+			HANDLE events[2] = { stop_event_, ol.hEvent };
+			DWORD ret = WaitForMultipleObjects( watching ? 2 : 1, events, FALSE, timeout );
+
+			if( ret == WAIT_OBJECT_0 )
+				break;
+
+			if( watching && ret == WAIT_OBJECT_0 + 1 )
+			{
+				DWORD bytes = 0;
+
+				if( !GetOverlappedResult( dir, &ol, &bytes, FALSE ) )
+				{
+					// we can't watch this directory, fall back to polling
+					watching = false;
+					rescan();
+				}
+				else if( bytes == 0 )
+				{
+					// the notification buffer overflowed and we lost
+					// track of what changed. Look at everything
+					rescan();
+				}
+				else
+				{
+					process_notifications( bytes );
+				}
+
+				if( watching )
+					watching = read_changes( dir, ol );
+
+				if( !watching )
+					next_poll = GetTickCount() + poll_interval_ * 1000;
+			}
+			else if( !watching && int( next_poll - GetTickCount() ) <= 0 )
+			{
+				rescan();
+				next_poll = GetTickCount() + poll_interval_ * 1000;
+			}
+
+			parse_pending();
+		}
+
+		if( dir != INVALID_HANDLE_VALUE )
+		{
+			// the buffer must stay around until the read is cancelled
+			if( watching )
+			{
+				DWORD bytes = 0;
+				CancelIo( dir );
+				GetOverlappedResult( dir, &ol, &bytes, TRUE );
+			}
+
+			CloseHandle( dir );
+		}
+
+		CloseHandle( ol.hEvent );
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	bool dir_monitor::read_changes( HANDLE dir, OVERLAPPED & ol )
+	{
+		ResetEvent( ol.hEvent );
+
+		return ReadDirectoryChangesW( dir, &buffer_[0], DWORD( buffer_.size() * sizeof(DWORD) ), FALSE
+			, FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE
+			, 0, &ol, 0 ) != FALSE;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	void dir_monitor::process_notifications( DWORD bytes )
+	{
+		char const * ptr = (char const *)&buffer_[0];
+		char const * end = ptr + bytes;
+
+		while( ptr < end )
+		{
+			FILE_NOTIFY_INFORMATION const * fni = (FILE_NOTIFY_INFORMATION const *)ptr;
+
+			std::wstring wname( fni->FileName, fni->FileNameLength / sizeof(WCHAR) );
+			std::string name;
+			wchar_utf8( wname, name );
+
+			switch( fni->Action )
+			{
+			case FILE_ACTION_ADDED:
+			case FILE_ACTION_RENAMED_NEW_NAME:
+			case FILE_ACTION_MODIFIED:
+				file_changed( name );
+				break;
+			case FILE_ACTION_REMOVED:
+			case FILE_ACTION_RENAMED_OLD_NAME:
+				file_removed( name );
+				break;
+			}
+
+			if( fni->NextEntryOffset == 0 )
+				break;
+
+			ptr += fni->NextEntryOffset;
+		}
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	void dir_monitor::file_changed( std::string const & name )
+	{
+		if( !is_torrent_file( name ) )
+			return;
+
+		// a torrent we already added being rewritten doesn't change anything
+		if( known_.count( name ) )
+			return;
+
+		failed_.erase( name );
+		pending_[name] = GetTickCount();
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	void dir_monitor::file_removed( std::string const & name )
+	{
+		pending_.erase( name );
+		failed_.erase( name );
+
+		if( known_.erase( name ) == 0 )
+			return;
+
+		change c;
+		c.type = change::removed;
+		c.path = combine_path( dir_, name );
+		post( c );
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	void dir_monitor::rescan()
+	{
+		std::set<std::string> present;
+		error_code ec;
+
+		for( directory i( dir_, ec ); !i.done(); i.next( ec ) )
+		{
+			std::string name = i.file();
+			if( !is_torrent_file( name ) )
+				continue;
+
+			present.insert( name );
+
+			if( known_.count( name ) || failed_.count( name ) || pending_.count( name ) )
+				continue;
+
+			// files found by listing are assumed to be complete
+			pending_[name] = GetTickCount() - settle_time;
+		}
+
+		std::vector<std::string> removed;
+
+		for( std::set<std::string>::iterator i = known_.begin(); i != known_.end(); ++i )
+		{
+			if( !present.count( *i ) )
+				removed.push_back( *i );
+		}
+
+		for( std::set<std::string>::iterator i = failed_.begin(); i != failed_.end(); ++i )
+		{
+			if( !present.count( *i ) )
+				removed.push_back( *i );
+		}
+
+		for( std::map<std::string, DWORD>::iterator i = pending_.begin(); i != pending_.end(); ++i )
+		{
+			if( !present.count( i->first ) )
+				removed.push_back( i->first );
+		}
+
+		for( std::vector<std::string>::iterator i = removed.begin(); i != removed.end(); ++i )
+			file_removed( *i );
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	void dir_monitor::parse_pending()
+	{
+		DWORD now = GetTickCount();
+
+		for( std::map<std::string, DWORD>::iterator i = pending_.begin(); i != pending_.end(); )
+		{
+			// parsing a large drop directory takes a while. Don't hold
+			// up stop(), the files left are picked up when we're started
+			// again. The event is manual-reset, so the loop still sees it
+			if( WaitForSingleObject( stop_event_, 0 ) == WAIT_OBJECT_0 )
+				return;
+
+			if( now - i->second < settle_time )
+			{
+				++i;
+				continue;
+			}
+
+			change c;
+			c.type = change::added;
+			c.path = combine_path( dir_, i->first );
+			c.ti = new torrent_info( c.path, c.ec );
+
+			if( c.ec )
+			{
+				c.ti.reset();
+				failed_.insert( i->first );
+			}
+			else
+			{
+				known_.insert( i->first );
+			}
+
+			post( c );
+			pending_.erase( i++ );
+		}
+	}
+}
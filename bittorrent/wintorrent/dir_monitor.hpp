@@ -0,0 +1,92 @@
+#pragma once
+
+#include "libtorrent/torrent_info.hpp"
+#include "libtorrent/thread.hpp"
+#include "libtorrent/error_code.hpp"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/intrusive_ptr.hpp>
+
+#include <string>
+#include <deque>
+#include <set>
+#include <map>
+#include <vector>
+#include <windows.h>
+
+namespace libtorrent
+{
+	//////////////////////////////////////////////////////////////////////////
+	//
+	// watches a directory for .torrent files on a background thread, and
+	// only hands out what changed. New files are parsed on that thread as
+	// well, once they've stopped changing for a moment, so a file that is
+	// still being copied in isn't picked up half written.
+	//
+	// changes are picked up with ReadDirectoryChangesW. If the directory
+	// doesn't support it (some network shares do not), the directory is
+	// listed every poll interval instead. Either way, a listing is only
+	// compared to what was seen before, and only the difference is reported
+
+	class dir_monitor
+	{
+	public:
+		struct change
+		{
+			enum type_t { added, removed };
+
+			type_t type;
+
+			// the full path of the .torrent file
+			std::string path;
+
+			// the parsed torrent, for added files that could be loaded
+			boost::intrusive_ptr<torrent_info> ti;
+
+			// set if an added file failed to load
+			error_code ec;
+		};
+
+		dir_monitor();
+		~dir_monitor();
+
+		// starts watching dir. The .torrent files already in it are reported
+		// as added. Calling it again with the same arguments does nothing
+		void start( std::string const & dir, int poll_interval );
+		void stop();
+
+		// moves the changes seen since the last call into changes
+		void pop_changes( std::deque<change> & changes );
+
+	private:
+		void thread_fun();
+		bool read_changes( HANDLE dir, OVERLAPPED & ol );
+		void process_notifications( DWORD bytes );
+		void rescan();
+		void parse_pending();
+		void file_changed( std::string const & name );
+		void file_removed( std::string const & name );
+		void post( change const & c );
+
+		std::string dir_;
+		int poll_interval_;
+
+		// the following are only used by the monitor thread
+
+		// files that were reported as added, by file name
+		std::set<std::string> known_;
+		// files that failed to load. They're retried once they change
+		std::set<std::string> failed_;
+		// files waiting to settle before they're loaded, and the tick
+		// count of the last change to them
+		std::map<std::string, DWORD> pending_;
+		// the ReadDirectoryChangesW buffer, which must be DWORD aligned
+		std::vector<DWORD> buffer_;
+
+		mutex mutex_;
+		std::deque<change> changes_;
+
+		HANDLE stop_event_;
+		boost::shared_ptr<thread> thread_;
+	};
+}
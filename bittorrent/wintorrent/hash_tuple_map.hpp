@@ -0,0 +1,380 @@
+#ifndef BOOST_PP_IS_ITERATING
+
+#	ifndef HASH_TUPLE_MAP_HPP_INCLUDE
+#		define HASH_TUPLE_MAP_HPP_INCLUDE
+
+#		include <boost/preprocessor/repetition.hpp>
+#		include <boost/preprocessor/arithmetic/sub.hpp>
+#		include <boost/preprocessor/punctuation/comma_if.hpp>
+#		include <boost/preprocessor/iteration/iterate.hpp>
+#		include <boost/unordered_map.hpp>
+#		include <boost/functional/hash.hpp>
+#		include <vector>
+#		include <deque>
+#		include <tuple>
+#		include "lexical_cast.hpp"
+
+//--------------------------------------------------
+//
+// hash_tuple_map is a variant of tuple_map with hashed indices.
+//
+// The tuples live in a slot map: a deque of nodes that never move, with
+// erased nodes recycled through a free list, so tuple pointers stay valid
+// until the tuple itself is erased. A dense vector of the live nodes gives
+// O(1) positional at() without rebuilding anything on insert or erase.
+//
+// Each element is indexed by a hash of its key. The key of an element is
+// the element itself, unless hash_tuple_key is specialized for its type,
+// which lets a lookup by e.g. a handle skip building a whole element.
+//
+// Elements must be default constructible and assignable, since erased
+// nodes are reset and reused. Index iterators follow boost::unordered_map
+// rules: erasing invalidates only the erased element, inserting may rehash.
+//
+// mapBench compares it with tuple_map on tables shaped like the session's.
+
+template< typename T >
+struct hash_tuple_key
+{
+	typedef T type;
+	static T const & get( T const & t ) { return t; }
+};
+
+namespace hash_tuple_map_impl
+{
+	template< typename T >
+	struct KEY_PTR
+	{
+		typedef T type;
+
+		T const * p;
+		KEY_PTR() : p(0)				{}
+		KEY_PTR( T const & p ) : p(&p)	{}
+
+		bool operator==( KEY_PTR const & other ) const {
+			return (p && other.p) ? (*p == *other.p) : (p == other.p);
+		}
+	};
+
+	template< typename T >
+	struct key_hash
+	{
+		std::size_t operator()( KEY_PTR<T> const & k ) const {
+			return k.p ? boost::hash<T>()( *k.p ) : 0;
+		}
+	};
+}
+
+//--------------------------------------------------
+//
+
+#		ifndef TUPLE_ELEM_MAX
+#			define TUPLE_ELEM_MAX	11
+#		endif
+
+#		define dec_tuple_empty(z,n,data) typename Elem##n = data
+
+template< BOOST_PP_ENUM( TUPLE_ELEM_MAX, dec_tuple_empty, std::tr1::_Nil ) >
+class hash_tuple_map {};
+
+#		undef dec_tuple_empty
+
+#		define BOOST_PP_ITERATION_LIMITS (1, TUPLE_ELEM_MAX - 1)
+#		define BOOST_PP_FILENAME_1 "hash_tuple_map.hpp"
+#		include BOOST_PP_ITERATE()
+
+#	endif // HASH_TUPLE_MAP_HPP_INCLUDE
+
+//--------------------------------------------------
+//
+
+#else // BOOST_PP_IS_ITERATING
+
+//--------------------------------------------------
+// the partial specializations below are generated once per element count
+
+#	define n BOOST_PP_ITERATION()
+
+#	define spec_tuple_set( z, n, data ) data
+
+#	define dec_tuple_map( z, n, data ) \
+	typedef typename hash_tuple_key< Elem##n >::type Key##n; \
+	typedef boost::unordered_map< hash_tuple_map_impl::KEY_PTR< Key##n >, tuple * \
+		, hash_tuple_map_impl::key_hash< Key##n > > Map##n; \
+	typedef typename Map##n::iterator iterator_##n; \
+	typedef typename Map##n::const_iterator const_iterator_##n;
+
+#	define dec_elem_param( z, n, data ) \
+	Elem##n e##n
+
+//--------------------------------------------------
+//
+
+template< BOOST_PP_ENUM_PARAMS( n, typename Elem ) >
+class hash_tuple_map<
+	BOOST_PP_ENUM_PARAMS( n, Elem )
+	BOOST_PP_COMMA_IF( n )
+	BOOST_PP_ENUM( BOOST_PP_SUB( TUPLE_ELEM_MAX, n ), spec_tuple_set, std::tr1::_Nil )
+>
+{
+public:
+	//--------------------------------------------------
+	//
+
+	hash_tuple_map() {}
+
+	hash_tuple_map( hash_tuple_map && other )
+		: maps_( std::move(other.maps_) )
+		, nodes_( std::move(other.nodes_) )
+		, dense_( std::move(other.dense_) )
+		, free_( std::move(other.free_) )
+	{}
+
+	~hash_tuple_map() { clear(); }
+
+	typedef std::tr1::tuple< BOOST_PP_ENUM_PARAMS(n, Elem) > tuple;
+	typedef tuple const * value_type;
+
+	//--------------------------------------------------
+	// one hashed index per element
+
+	BOOST_PP_REPEAT( n, dec_tuple_map, ~ );
+	typedef std::tr1::tuple< BOOST_PP_ENUM_PARAMS( n, Map ) > Maps;
+
+	//--------------------------------------------------
+	// returns 0 on success, or the tuple that already holds one of the keys
+
+	tuple const * insert( BOOST_PP_ENUM( n, dec_elem_param, ~ ) )
+	{
+
+#	define tuple_elem_find_spec( z, n, data ) \
+	tuple const * t##n = find_impl<n>( hash_tuple_key< Elem##n >::get( e##n ) ); \
+	if( t##n ) return t##n;
+
+		BOOST_PP_REPEAT( n, tuple_elem_find_spec, ~ );
+
+#	undef tuple_elem_find_spec
+
+		node * t = alloc_node();
+		static_cast< tuple& >( *t ) = tuple( BOOST_PP_ENUM_PARAMS( n, e ) );
+		t->pos = dense_.size();
+		dense_.push_back( t );
+
+#	define tuple_insert_spec( z, n, data ) \
+	insert_impl<n>( t );
+
+		BOOST_PP_REPEAT( n, tuple_insert_spec, ~ );
+
+#	undef tuple_insert_spec
+
+		return 0;
+	}
+
+	//--------------------------------------------------
+	//
+
+	template< int ElemIdx, typename Arg >
+	typename std::tr1::tuple_element< ElemIdx, Maps >::type::const_iterator
+		find_iter( Arg arg ) const
+	{
+		typedef typename std::tr1::tuple_element< ElemIdx, Maps >::type Map;
+
+		Map const & map = std::tr1::get< ElemIdx >( maps_ );
+
+		typename Map::key_type::type key = umtl::lexical_cast< typename Map::key_type::type >(arg);
+
+		return map.find( typename Map::key_type(key) );
+	}
+
+	//--------------------------------------------------
+	//
+
+	template< int ElemIdx, typename Key >
+	tuple const * find( Key key ) const
+	{
+		typedef typename std::tr1::tuple_element< ElemIdx, Maps >::type Map;
+
+		return find_impl< ElemIdx >(
+			umtl::lexical_cast< typename Map::key_type::type >(key) );
+	}
+
+	//--------------------------------------------------
+	// returns true if an element was erased
+
+	template< int ElemIdx >
+	bool erase( typename std::tr1::tuple_element< ElemIdx, Maps >::type::key_type::type const & key )
+	{
+		tuple const * t = find_impl< ElemIdx >( key );
+
+		if( !t )
+			return false;
+
+		erase_tuple( static_cast< node* >( const_cast< tuple* >( t ) ) );
+
+		return true;
+	}
+
+	//--------------------------------------------------
+	//
+
+	template< int ElemIdx >
+	typename std::tr1::tuple_element< ElemIdx, Maps >::type::const_iterator
+		erase( typename std::tr1::tuple_element< ElemIdx, Maps >::type::const_iterator iter )
+	{
+		if( iter == end<ElemIdx>() )
+			return iter;
+
+		typename std::tr1::tuple_element< ElemIdx, Maps >::type::const_iterator next_iter = iter;
+
+		++next_iter;
+
+		if( iter->second )
+			erase_tuple( static_cast< node* >( iter->second ) );
+
+		return next_iter;
+	}
+
+	//--------------------------------------------------
+	//
+
+	void clear()
+	{
+#define tuple_clear_spec( z, n, data ) std::tr1::get<n>( maps_ ).clear();
+
+		BOOST_PP_REPEAT( n, tuple_clear_spec, ~ );
+
+#undef tuple_clear_spec
+
+		dense_.clear();
+		free_.clear();
+		nodes_.clear();
+	}
+
+	//--------------------------------------------------
+	// the same interface as an stl map
+
+	bool empty() const { return dense_.empty(); }
+
+	size_t size() const	{ return dense_.size(); }
+
+	template< int ElemIdx >
+	typename std::tr1::tuple_element< ElemIdx, Maps >::type::const_iterator
+		begin() const { return std::tr1::get<ElemIdx>( maps_ ).begin(); }
+
+	template< int ElemIdx >
+	typename std::tr1::tuple_element< ElemIdx, Maps >::type::const_iterator
+		end() const { return std::tr1::get<ElemIdx>( maps_ ).end(); }
+
+	//--------------------------------------------------
+	// positional access, in no particular order. Erasing moves the last
+	// tuple into the erased position
+
+	tuple const * at( size_t const idx ) const
+	{
+		return idx < dense_.size() ? dense_[idx] : 0;
+	}
+
+	//--------------------------------------------------
+	//
+
+private:
+
+	struct node : tuple
+	{
+		node() : pos(0) {}
+		// the index of this node in dense_
+		size_t pos;
+	};
+
+	Maps maps_;
+
+	// the storage for all tuples. Never shrinks until clear(), which is
+	// what keeps the tuples from moving
+	std::deque< node > nodes_;
+	std::vector< node * > dense_;
+	std::vector< node * > free_;
+
+	node * alloc_node()
+	{
+		if( !free_.empty() )
+		{
+			node * t = free_.back();
+			free_.pop_back();
+			return t;
+		}
+
+		nodes_.push_back( node() );
+		return &nodes_.back();
+	}
+
+	void erase_tuple( node * t )
+	{
+#define tuple_erase_spec( z, n, data ) erase_impl<n>( *t );
+
+		BOOST_PP_REPEAT( n, tuple_erase_spec, ~ );
+
+#undef tuple_erase_spec
+
+		// move the last node into the hole
+		node * last = dense_.back();
+		dense_[t->pos] = last;
+		last->pos = t->pos;
+		dense_.pop_back();
+
+		// drop what the tuple holds, and keep the node for reuse
+		static_cast< tuple& >( *t ) = tuple();
+		free_.push_back( t );
+	}
+
+	template< int MapIdx, typename Key >
+	tuple const * find_impl( Key const & key ) const
+	{
+		typedef typename std::tr1::tuple_element< MapIdx, Maps >::type Map;
+
+		Map const & map = std::tr1::get< MapIdx >( maps_ );
+
+		typename Map::const_iterator iter = map.find( typename Map::key_type( key ) );
+
+		return iter == map.end() ? 0 : iter->second;
+	}
+
+	template< int MapIdx >
+	void insert_impl( node * t )
+	{
+		typedef typename std::tr1::tuple_element< MapIdx, Maps >::type Map;
+		typedef typename Map::key_type KeyType;
+		typedef typename std::tr1::tuple_element< MapIdx, tuple >::type Elem;
+
+		Map & map = std::tr1::get< MapIdx >( maps_ );
+
+		map.insert( std::make_pair( KeyType( hash_tuple_key< Elem >::get(
+			std::tr1::get< MapIdx >( static_cast< tuple& >( *t ) ) ) ), static_cast< tuple* >( t ) ) );
+	}
+
+	template< int MapIdx >
+	void erase_impl( node & t )
+	{
+		typedef typename std::tr1::tuple_element< MapIdx, Maps >::type Map;
+		typedef typename Map::key_type KeyType;
+		typedef typename std::tr1::tuple_element< MapIdx, tuple >::type Elem;
+
+		Map & map = std::tr1::get< MapIdx >( maps_ );
+
+		typename Map::iterator iter = map.find( KeyType( hash_tuple_key< Elem >::get(
+			std::tr1::get< MapIdx >( static_cast< tuple& >( t ) ) ) ) );
+
+		// only remove the index entry if it refers to this tuple
+		if( iter != map.end() && iter->second == &t )
+			map.erase( iter );
+	}
+
+	hash_tuple_map( hash_tuple_map const & other );
+	void operator=( hash_tuple_map const & other );
+};
+
+#	undef dec_tuple_map
+#	undef dec_elem_param
+#	undef spec_tuple_set
+#	undef n
+
+#endif // BOOST_PP_IS_ITERATING
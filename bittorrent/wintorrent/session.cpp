@@ -35,6 +35,20 @@ namespace libtorrent
 	//////////////////////////////////////////////////////////////////////////
 	//
 
+	int TorrentSession::add_many( std::vector<std::string> const & torrents ) {
+		return impl_->add_many( torrents );
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	int TorrentSession::del_many( std::vector<std::string> const & torrents, bool delete_torrent_file, bool delete_download_file ) {
+		return impl_->del_many( torrents, delete_torrent_file, delete_download_file );
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	//
+
 	bool TorrentSession::pause( std::string torrent ) {
 		return impl_->pause( torrent );
 	}
@@ -91,6 +105,20 @@ namespace libtorrent
 	//////////////////////////////////////////////////////////////////////////
 	//
 
+	void TorrentSession::set_streaming( std::string torrent, int window_pieces, int deadline_step_ms ) {
+		impl_->set_streaming( torrent, window_pieces, deadline_step_ms );
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	void TorrentSession::advance_streaming( std::string torrent, __int64 offset ) {
+		impl_->advance_streaming( torrent, offset );
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	//
+
 	bool TorrentSession::get_status( std::string torrent, TorrentStatus & ts )
 	{
 		return impl_->get_status( torrent, ts );
@@ -1,19 +1,121 @@
 #include "session_impl.h"
 #include "debug_print.hpp"
 
+namespace
+{
+	// copies the fields TorrentStatus has in common with torrent_status
+	// and torrent_status_record
+	template< typename Status >
+	void copy_status( Status const & status, libtorrent::TorrentStatus & ts )
+	{
+#define _copy_to_ts( var ) ts.##var = status.##var;
+
+		ts.state = (libtorrent::TorrentStatus::state_t)status.state;
+		_copy_to_ts( paused );
+		_copy_to_ts( auto_managed );
+		_copy_to_ts( sequential_download );
+		_copy_to_ts( is_seeding );
+		_copy_to_ts( is_finished );
+		_copy_to_ts( has_metadata );
+		_copy_to_ts( progress );
+		_copy_to_ts( progress_ppm );
+		_copy_to_ts( total_download );
+		_copy_to_ts( total_upload );
+		_copy_to_ts( total_payload_download );
+		_copy_to_ts( total_payload_upload );
+		_copy_to_ts( total_failed_bytes );
+		_copy_to_ts( total_redundant_bytes );
+		_copy_to_ts( download_rate );
+		_copy_to_ts( upload_rate );
+		_copy_to_ts( download_payload_rate );
+		_copy_to_ts( upload_payload_rate );
+		_copy_to_ts( num_seeds );
+		_copy_to_ts( num_peers );
+		_copy_to_ts( num_complete );
+		_copy_to_ts( num_incomplete );
+		_copy_to_ts( list_seeds );
+		_copy_to_ts( list_peers );
+		_copy_to_ts( connect_candidates );
+		_copy_to_ts( num_pieces );
+		_copy_to_ts( total_done );
+		_copy_to_ts( total_wanted_done );
+		_copy_to_ts( total_wanted );
+		_copy_to_ts( distributed_full_copies );
+		_copy_to_ts( distributed_fraction );
+		_copy_to_ts( distributed_copies );
+		_copy_to_ts( block_size );
+		_copy_to_ts( num_uploads );
+		_copy_to_ts( num_connections );
+		_copy_to_ts( uploads_limit );
+		_copy_to_ts( connections_limit );
+		_copy_to_ts( up_bandwidth_queue );
+		_copy_to_ts( down_bandwidth_queue );
+		_copy_to_ts( all_time_upload );
+		_copy_to_ts( all_time_download );
+		_copy_to_ts( active_time );
+		_copy_to_ts( finished_time );
+		_copy_to_ts( seeding_time );
+		_copy_to_ts( seed_rank );
+		_copy_to_ts( last_scrape );
+		_copy_to_ts( has_incoming );
+		_copy_to_ts( sparse_regions );
+		_copy_to_ts( seed_mode );
+		_copy_to_ts( upload_mode );
+		_copy_to_ts( share_mode );
+		_copy_to_ts( super_seeding );
+		_copy_to_ts( priority );
+		_copy_to_ts( added_time );
+		_copy_to_ts( completed_time );
+		_copy_to_ts( last_seen_complete );
+		_copy_to_ts( time_since_upload );
+		_copy_to_ts( time_since_download );
+		_copy_to_ts( queue_position );
+		_copy_to_ts( need_save_resume );
+		_copy_to_ts( ip_filter_applies );
+		_copy_to_ts( listen_port );
+
+#undef _copy_to_ts
+	}
+
+	// the number of loaded torrents handed to the session in one call
+	const int add_batch_size = 256;
+
+	// milliseconds without a batched add_torrent_alert after which the
+	// outstanding adds are assumed lost
+	const DWORD add_alert_timeout = 30000;
+
+	// true for the same strings add() treats as a .torrent file
+	bool is_torrent_file_path( std::string const & torrent )
+	{
+		if (torrent.size() > 45
+			&& libtorrent::is_hex(torrent.c_str(), 40)
+			&& (strncmp(torrent.c_str() + 40, "@http://", 8) == 0
+			|| strncmp(torrent.c_str() + 40, "@udp://", 7) == 0))
+			return false;
+
+		return std::strstr(torrent.c_str(), "http://") != torrent.c_str()
+			&& std::strstr(torrent.c_str(), "https://") != torrent.c_str()
+			&& std::strstr(torrent.c_str(), "magnet:") != torrent.c_str();
+	}
+}
+
 namespace libtorrent
 {
 	//////////////////////////////////////////////////////////////////////////
 	//
 
 	TorrentSessionImpl::TorrentSessionImpl( int listenPort, std::vector<std::string> const & sessionSettingParam, ErrorHandler error_handler, EventHandler event_handler ) 
-		: listen_port_(listenPort)
+		: session_(fingerprint("LT", LIBTORRENT_VERSION_MAJOR, LIBTORRENT_VERSION_MINOR, 0, 0)
+			, session::add_default_plugins
+			, alert::all_categories
+			& ~(alert::dht_notification
+			+ alert::progress_notification
+			+ alert::debug_notification
+			+ alert::stats_notification))
+		, listen_port_(listenPort)
 		, allocation_mode_( libtorrent::storage_mode_sparse )
-		, save_path_(".")
 		, torrent_upload_limit_(0)
 		, torrent_download_limit_(0)
-		, bind_to_interface_("")
-		, outgoing_interface_("")
 		, poll_interval_(5)
 		, max_connections_per_torrent_(50)
 		, seed_mode_(false)
@@ -22,19 +124,17 @@ namespace libtorrent
 		, start_dht_(true)
 		, start_upnp_(true)
 		, start_lsd_(true)
+		, bind_to_interface_("")
+		, outgoing_interface_("")
+		, save_path_(".")
 		, error_handler_(error_handler)
 		, event_handler_(event_handler)
 		//, active_torrent_(0)
-		, next_dir_scan_(time_now())
+		, loader_( boost::bind( &TorrentSessionImpl::load_resume_data, this, _1, _2 ) )
+		, num_outstanding_adds_(0)
+		, last_add_progress_(0)
 		, num_outstanding_resume_data_(0)
 		, print_debug_(false)
-		, session_(fingerprint("LT", LIBTORRENT_VERSION_MAJOR, LIBTORRENT_VERSION_MINOR, 0, 0)
-			, session::add_default_plugins
-			, alert::all_categories
-			& ~(alert::dht_notification
-			+ alert::progress_notification
-			+ alert::debug_notification
-			+ alert::stats_notification))
 	{
 		load_setting();
 
@@ -96,10 +196,7 @@ namespace libtorrent
 				if (ec)
 					return false;
 
-				std::string filename = combine_path(save_path_, combine_path(".resume"
-					, to_hex(tmp.info_hash.to_string()) + ".resume"));
-
-				if (load_file(filename.c_str(), buf, ec) == 0)
+				if (load_resume_data(tmp.info_hash, buf))
 					p.resume_data = &buf;
 			}
 
@@ -139,20 +236,37 @@ namespace libtorrent
 			return false;
 		}
 
+		add_torrent_file( torrent, t );
+
+		return true;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	void TorrentSessionImpl::add_torrent_file( std::string const & torrent, boost::intrusive_ptr<torrent_info> const & t )
+	{
 		//printf("%s\n", t->name().c_str());
 
 		add_torrent_params p;
-		if (seed_mode_) p.flags |= add_torrent_params::flag_seed_mode;
-		if (disable_storage_) p.storage = disabled_storage_constructor;
-		if (share_mode_) p.flags |= add_torrent_params::flag_share_mode;
-		lazy_entry resume_data;
-
-		std::string filename = combine_path(save_path_, combine_path(".resume", to_hex(t->info_hash().to_string()) + ".resume"));
+		torrent_file_params( torrent, t, p );
 
 		std::vector<char> buf;
-		if (load_file(filename.c_str(), buf, ec) == 0)
+		if (load_resume_data(t->info_hash(), buf))
 			p.resume_data = &buf;
 
+		session_.async_add_torrent(p);
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	void TorrentSessionImpl::torrent_file_params( std::string const & torrent, boost::intrusive_ptr<torrent_info> const & t, add_torrent_params & p )
+	{
+		if (seed_mode_) p.flags |= add_torrent_params::flag_seed_mode;
+		if (disable_storage_) p.storage = disabled_storage_constructor;
+		if (share_mode_) p.flags |= add_torrent_params::flag_share_mode;
+
 		p.ti = t;
 		p.save_path = save_path_;
 		p.storage_mode = (storage_mode_t)allocation_mode_;
@@ -165,15 +279,170 @@ namespace libtorrent
 		tag += "@isfile@tag:" + torrent;
 
 		p.userdata = (void*)_strdup(tag.c_str());
-		session_.async_add_torrent(p);
+	}
 
-		return true;
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	int TorrentSessionImpl::add_many( std::vector<std::string> const & torrents )
+	{
+		std::vector<std::string> files;
+		int num_added = 0;
+
+		for( auto i = torrents.begin(); i != torrents.end(); ++i )
+		{
+			if( is_torrent_file_path( *i ) )
+			{
+				files.push_back( *i );
+				++num_added;
+			}
+			else if( add( *i ) )
+			{
+				// links don't need parsing, they go the usual way
+				++num_added;
+			}
+			else
+			{
+				event_handler_( torrent_event_add_failed, "failed to add torrent: " + *i + "\n" );
+			}
+		}
+
+		loader_.push( files );
+
+		return num_added;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	void TorrentSessionImpl::submit_loaded_torrents()
+	{
+		if( loaded_.empty() )
+		{
+			loader_.pop_results( loaded_ );
+		}
+		else
+		{
+			std::deque<torrent_loader::result> results;
+			loader_.pop_results( results );
+
+			for( auto i = results.begin(); i != results.end(); ++i )
+			{
+				loaded_.push_back( torrent_loader::result() );
+				loaded_.back().swap( *i );
+			}
+		}
+
+		// add_torrent_alert can't be discarded, but if one is lost anyway the
+		// budget below would never open up again. When none has arrived for a
+		// while, give up on the outstanding ones
+		if( num_outstanding_adds_ > 0 && GetTickCount() - last_add_progress_ > add_alert_timeout )
+		{
+			char msg[200];
+			sprintf_s( msg, sizeof(msg), "lost track of %d torrents being added\n", num_outstanding_adds_ );
+			event_handler_( torrent_event_add_failed, msg );
+			num_outstanding_adds_ = 0;
+		}
+
+		std::vector<add_torrent_params> batch;
+
+		while( !loaded_.empty() )
+		{
+			int budget = session_settings_.alert_queue_size / 2 - num_outstanding_adds_;
+
+			if( budget <= 0 )
+				break;
+
+			int num = (std::min)( (std::min)( budget, add_batch_size ), int( loaded_.size() ) );
+
+			batch.clear();
+
+			for( int i = 0; i < num; ++i )
+			{
+				torrent_loader::result & r = loaded_[i];
+
+				if( r.ec )
+				{
+					char msg[1024];
+					sprintf_s( msg, sizeof(msg), "failed to add torrent: %s %s\n", r.path.c_str(), r.ec.message().c_str() );
+					event_handler_( torrent_event_add_failed, msg );
+					continue;
+				}
+
+				batch.push_back( add_torrent_params() );
+				add_torrent_params & p = batch.back();
+				torrent_file_params( r.path, r.ti, p );
+
+				// lets the alert handler tell batched adds apart
+				std::string tag = "@batch" + std::string( (char*)p.userdata );
+				free( p.userdata );
+				p.userdata = (void*)_strdup( tag.c_str() );
+
+				if( r.has_resume_data )
+					p.resume_data = &r.resume_data;
+			}
+
+			// the session copies the resume data, so the results can go now
+			session_.async_add_torrents( batch );
+			if( num_outstanding_adds_ == 0 )
+				last_add_progress_ = GetTickCount();
+			num_outstanding_adds_ += int( batch.size() );
+
+			loaded_.erase( loaded_.begin(), loaded_.begin() + num );
+		}
 	}
 
 	//////////////////////////////////////////////////////////////////////////
 	//
 
 	bool TorrentSessionImpl::del( std::string const & torrent, bool delete_torrent_file, bool delete_download_file )
+	{
+		torrent_handle handle;
+
+		if( !remove_entry( torrent, delete_torrent_file, delete_download_file, handle ) )
+			return false;
+
+		if( handle.is_valid() )
+			session_.remove_torrent( handle, delete_download_file ? session::delete_files : session::none );
+
+		return true;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	int TorrentSessionImpl::del_many( std::vector<std::string> const & torrents, bool delete_torrent_file, bool delete_download_file )
+	{
+		std::vector<torrent_handle> handles;
+		int num_removed = 0;
+
+		for( auto i = torrents.begin(); i != torrents.end(); ++i )
+		{
+			torrent_handle handle;
+
+			if( !remove_entry( *i, delete_torrent_file, delete_download_file, handle ) )
+			{
+				event_handler_( torrent_event_remove_failed, *i );
+				continue;
+			}
+
+			if( handle.is_valid() )
+				handles.push_back( handle );
+
+			++num_removed;
+			event_handler_( torrent_event_removed, *i );
+		}
+
+		session_.remove_torrents( handles, delete_download_file ? session::delete_files : session::none );
+
+		return num_removed;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// forgets about the torrent, and returns its handle for the caller to
+	// remove from the session
+
+	bool TorrentSessionImpl::remove_entry( std::string const & torrent, bool delete_torrent_file, bool delete_download_file, torrent_handle & handle )
 	{
 		std::string const & org_tag = torrent_tags_[torrent];
 
@@ -182,7 +451,7 @@ namespace libtorrent
 		if( entry == torrents_.end<0>() )
 			return false;
 
-		torrent_handle const & handle = std::tr1::get<1>( *entry->second ).handle_;
+		handle = std::tr1::get<1>( *entry->second ).handle_;
 
 		non_files_.erase(handle);
 		
@@ -204,7 +473,13 @@ namespace libtorrent
 
 		if( handle.is_valid() )
 		{
-			session_.remove_torrent( handle, delete_download_file ? session::delete_files : session::none );
+			// the resume data is useless once the files are gone
+			if( delete_download_file && resume_store_.is_open() )
+			{
+				mutex::scoped_lock l( resume_mutex_ );
+				error_code ec;
+				resume_store_.erase( handle.info_hash(), ec );
+			}
 		}
 
 		torrents_.erase<0>(entry);
@@ -300,6 +575,7 @@ namespace libtorrent
 			case 'B': session_settings_.peer_timeout = atoi(arg); break;
 			case 'n': session_settings_.announce_to_all_tiers = true; --i; break;
 			case 'G': seed_mode_ = true; --i; break;
+			case 'g': session_settings_.disk_cache_large_pages = true; --i; break;
 			case 'd': session_settings_.download_rate_limit = atoi(arg) * 1000; break;
 			case 'u': session_settings_.upload_rate_limit = atoi(arg) * 1000; break;
 			case 'S': session_settings_.unchoke_slots_limit = atoi(arg); break;
@@ -307,7 +583,13 @@ namespace libtorrent
 				if (strcmp(arg, "allocate") == 0) allocation_mode_ = storage_mode_allocate;
 				if (strcmp(arg, "sparse") == 0) allocation_mode_ = storage_mode_sparse;
 				break;
-			case 's': save_path_ = arg; break;
+			case 's':
+				{
+					// the torrent loader threads read it in load_resume_data
+					mutex::scoped_lock l( resume_mutex_ );
+					save_path_ = arg;
+				}
+				break;
 			case 'U': torrent_upload_limit_ = atoi(arg) * 1000; break;
 			case 'D': torrent_download_limit_ = atoi(arg) * 1000; break;
 			case 'm': monitor_dir_ = arg; break;
@@ -494,6 +776,11 @@ namespace libtorrent
 
 		session_.set_settings( session_settings_ );
 
+		if( monitor_dir_.empty() )
+			dir_monitor_.stop();
+		else
+			dir_monitor_.start( monitor_dir_, poll_interval_ );
+
 		return true;
 	}
 
@@ -504,7 +791,27 @@ namespace libtorrent
 	{
 		std::vector<char> in;
 		error_code ec;
-		if (load_file(".ses_state", in, ec) == 0)
+
+		resume_store_.open(".session_store", ec);
+		if (ec)
+		{
+			error_handler_( 0, (std::string("failed to open session store: ") + ec.message() ).c_str() );
+			ec.clear();
+		}
+
+		bool loaded = false;
+		if (resume_store_.is_open())
+		{
+			// the session state from earlier versions is moved into the store
+			loaded = resume_store_.get(resume_store::session_state_key(), in)
+				|| resume_store_.import_file(resume_store::session_state_key(), ".ses_state", in, ec);
+		}
+		else
+		{
+			loaded = load_file(".ses_state", in, ec) == 0;
+		}
+
+		if (loaded && !in.empty())
 		{
 			lazy_entry e;
 			if (lazy_bdecode(&in[0], &in[0] + in.size(), e, ec) == 0)
@@ -551,14 +858,9 @@ namespace libtorrent
 
 		print_debug();
 
+		handle_dir_changes();
 
-		if (!monitor_dir_.empty()
-			&& next_dir_scan_ < time_now())
-		{
-			scan_dir();
-
-			next_dir_scan_ = time_now() + seconds(poll_interval_);
-		}
+		submit_loaded_torrents();
 	}
 
 	//////////////////////////////////////////////////////////////////////////
@@ -573,7 +875,19 @@ namespace libtorrent
 
 		char str[1024];
 
-		PeerInfos peer_infos;
+		struct DebugInfo
+		{
+			torrent_status const * status;
+			PeerInfos peer_infos;
+			std::vector<announce_entry> trackers;
+			std::vector<size_type> file_progress;
+		};
+
+		// query all torrents in one trip to the network thread
+		std::vector<DebugInfo> infos;
+		infos.reserve( torrents_.size() );
+
+		handle_batch batch;
 
 		for( auto i = torrents_.begin<0>(); i != torrents_.end<0>(); ++i )
 		{
@@ -582,14 +896,30 @@ namespace libtorrent
 			if( !status.handle.is_valid() )
 				continue;
 
+			infos.push_back( DebugInfo() );
+			DebugInfo & info = infos.back();
+			info.status = &status;
+
+			batch.get_peer_info( status.handle, info.peer_infos );
+			batch.trackers( status.handle, info.trackers );
+
+			if( status.state != torrent_status::seeding && status.has_metadata )
+				batch.file_progress( status.handle, info.file_progress );
+		}
+
+		batch.run();
+
+		for( auto d = infos.begin(); d != infos.end(); ++d )
+		{
+			torrent_status const & status = *d->status;
+
 			torrent_handle const & handle = status.handle;
 
 			out += "====== ";
 			out += handle.name();
 			out += " ======\n";
 
-			//if( status->state != torrent_status::seeding )
-			handle.get_peer_info( peer_infos );
+			PeerInfos & peer_infos = d->peer_infos;
 
 			if( peer_infos.empty() == false )
 			{
@@ -598,7 +928,7 @@ namespace libtorrent
 
 			// tracker
 
-			std::vector<announce_entry> tr = handle.trackers();
+			std::vector<announce_entry> & tr = d->trackers;
 			ptime now = time_now();
 			for (std::vector<announce_entry>::iterator i = tr.begin()
 				, end(tr.end()); i != end; ++i)
@@ -623,10 +953,9 @@ namespace libtorrent
 			}
 			else if( status.has_metadata )
 			{
-				std::vector<size_type> file_progress;
-				handle.file_progress(file_progress);
+				std::vector<size_type> & file_progress = d->file_progress;
 				torrent_info const& info = handle.get_torrent_info();
-				for (int i = 0; i < info.num_files(); ++i)
+				for (int i = 0; i < info.num_files() && i < int(file_progress.size()); ++i)
 				{
 					bool pad_file = info.file_at(i).pad_file;
 					if (pad_file) continue;
@@ -658,49 +987,41 @@ namespace libtorrent
 	//////////////////////////////////////////////////////////////////////////
 	//
 
-	void TorrentSessionImpl::scan_dir()
+	void TorrentSessionImpl::handle_dir_changes()
 	{
-		std::set<std::string> valid;
-
-		using namespace libtorrent;
-
-		if( monitor_dir_.empty() )
-			return;
+		std::deque<dir_monitor::change> changes;
 
-		error_code ec;
+		dir_monitor_.pop_changes( changes );
 
-		for (directory i(monitor_dir_, ec); !i.done(); i.next(ec))
+		for( auto i = changes.begin(); i != changes.end(); ++i )
 		{
-			std::string file = combine_path(monitor_dir_, i.file());
-			if (extension(file) != ".torrent") continue;
-
-			if ( files_.find<0>(file) )
+			if( i->type == dir_monitor::change::added )
 			{
-				valid.insert(file);
+				if( i->ec )
+				{
+					error_handler_( 0, (i->path + ": " + i->ec.message()).c_str() );
+					continue;
+				}
+
+				if( files_.find<0>( i->path ) )
+					continue;
+
+				// the file has been added to the dir, start
+				// downloading it.
+				add_torrent_file( i->path, i->ti );
 				continue;
 			}
 
-			// the file has been added to the dir, start
-			// downloading it.
-			add(file);
-			valid.insert(file);
-		}
+			// remove the torrent whose file is no longer in the directory
+			auto file = files_.find_iter<0>( i->path );
 
-		// remove the torrents that are no longer in the directory
-		for( auto i=valid.begin(); i!=valid.end(); ++i )
-		{
-			auto file = files_.find_iter<0>(*i);
+			if( file == files_.end<0>() )
+				continue;
 
-			if( file != files_.end<0>() )
-			{
-				auto & handle = std::tr1::get<1>( *file->second ).handle_;
-
-				if( !handle.is_valid() )
-				{
-					files_.erase<0>( file );
-					continue;
-				}
+			auto & handle = std::tr1::get<1>( *file->second ).handle_;
 
+			if( handle.is_valid() )
+			{
 				handle.auto_managed(false);
 				handle.pause();
 
@@ -711,40 +1032,10 @@ namespace libtorrent
 					handle.save_resume_data();
 					++num_outstanding_resume_data_;
 				}
-
-				files_.erase<0>(file);
-			}
-		}
-		
-		/*
-		for (FileHandles::iterator i = files_.begin<0>(); !files_.empty() && i != files_.end<0>();)
-		{
-			if (i->first.empty() || valid.find(i->first) != valid.end())
-			{
-				++i;
-				continue;
-			}
-
-			torrent_handle& h = i->second;
-			if (!h.is_valid())
-			{
-				files_.erase(i++);
-				continue;
 			}
 
-			h.auto_managed(false);
-			h.pause();
-			// the alert handler for save_resume_data_alert
-			// will save it to disk
-			if (h.need_save_resume_data())
-			{
-				h.save_resume_data();
-				++num_outstanding_resume_data_;
-			}
-
-			files_.erase(i++);
+			files_.erase<0>( file );
 		}
-		*/
 	}
 
 	//////////////////////////////////////////////////////////////////////////
@@ -830,19 +1121,68 @@ namespace libtorrent
 
 				if (!rd->resume_data) continue;
 
-				torrent_handle h = rd->handle;
-				std::vector<char> out;
-				bencode(std::back_inserter(out), *rd->resume_data);
-				save_file(combine_path(h.save_path(), combine_path(".resume", to_hex(h.info_hash().to_string()) + ".resume")), out);
+				save_resume_data(rd->handle, *rd->resume_data);
 			}
 		}
 
 		entry session_state;
 		session_.save_state(session_state);
 
+		if (resume_store_.is_open())
+		{
+			error_code ec;
+			resume_store_.put(resume_store::session_state_key(), session_state, ec);
+			if (!ec && resume_store_.need_compact())
+				resume_store_.compact(ec);
+		}
+		else
+		{
+			std::vector<char> out;
+			bencode(std::back_inserter(out), session_state);
+			save_file(".ses_state", out);
+		}
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	bool TorrentSessionImpl::load_resume_data( sha1_hash const & info_hash, std::vector<char> & buf )
+	{
+		mutex::scoped_lock l( resume_mutex_ );
+
+		if (resume_store_.is_open() && resume_store_.get(info_hash, buf))
+			return true;
+
+		// resume files from earlier versions are moved into
+		// the store the first time the torrent is added
+		std::string filename = combine_path(save_path_, combine_path(".resume"
+			, to_hex(info_hash.to_string()) + ".resume"));
+
+		error_code ec;
+		if (resume_store_.is_open())
+			return resume_store_.import_file(info_hash, filename, buf, ec);
+
+		return load_file(filename.c_str(), buf, ec) == 0;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	void TorrentSessionImpl::save_resume_data( torrent_handle const & handle, entry const & resume_data )
+	{
+		if (resume_store_.is_open())
+		{
+			mutex::scoped_lock l( resume_mutex_ );
+			error_code ec;
+			resume_store_.put(handle.info_hash(), resume_data, ec);
+			if (ec)
+				error_handler_( 0, (std::string("failed to save resume data: ") + ec.message() ).c_str() );
+			return;
+		}
+
 		std::vector<char> out;
-		bencode(std::back_inserter(out), session_state);
-		save_file(".ses_state", out);
+		bencode(std::back_inserter(out), resume_data);
+		save_file(combine_path(handle.save_path(), combine_path(".resume", to_hex(handle.info_hash().to_string()) + ".resume")), out);
 	}
 
 	//////////////////////////////////////////////////////////////////////////
@@ -922,6 +1262,12 @@ namespace libtorrent
 				free(p->params.userdata);
 			}
 
+			if( tag.compare( 0, 6, "@batch" ) == 0 && num_outstanding_adds_ > 0 )
+			{
+				--num_outstanding_adds_;
+				last_add_progress_ = GetTickCount();
+			}
+
 			if (p->error)
 			{
 				//fprintf(stderr, "failed to add torrent: %s %s\n", filename.c_str(), p->error.message().c_str());
@@ -942,7 +1288,7 @@ namespace libtorrent
 
 				auto insert_faile = torrents_.insert(tag, TorrentEntry(h) );
 
-				auto entry = torrents_.find< 1 >(TorrentEntry(h));
+				auto entry = torrents_.find< 1 >(h);
 
 				torrent_tags_[ tag ] = std::tr1::get<0>( *entry );
 
@@ -981,6 +1327,8 @@ namespace libtorrent
 						}
 					}
 				}
+
+				event_handler_( torrent_event_added, tag );
 			}
 		}
 		else if (torrent_finished_alert* p = alert_cast<torrent_finished_alert>(a))
@@ -1003,12 +1351,10 @@ namespace libtorrent
 			TORRENT_ASSERT(p->resume_data);
 			if (p->resume_data)
 			{
-				std::vector<char> out;
-				bencode(std::back_inserter(out), *p->resume_data);
-				save_file(combine_path(h.save_path(), combine_path(".resume", to_hex(h.info_hash().to_string()) + ".resume")), out);
+				save_resume_data(h, *p->resume_data);
 				if (h.is_valid()
 					&& non_files_.find(h) == non_files_.end()
-					&& !files_.find<1>(TorrentFile("",h)) )
+					&& !files_.find<1>(h) )
 					session_.remove_torrent(h);
 			}
 		}
@@ -1018,9 +1364,15 @@ namespace libtorrent
 			torrent_handle h = p->handle;
 			if (h.is_valid()
 				&& non_files_.find(h) == non_files_.end()
-				&& !files_.find<1>(TorrentFile("",h)) )
+				&& !files_.find<1>(h) )
 				session_.remove_torrent(h);
 		}
+		else if (performance_alert* p = alert_cast<performance_alert>(a))
+		{
+			// -g was given, but the account can't lock memory
+			if (p->warning_code == performance_alert::large_pages_unavailable)
+				error_handler_( 0, p->message().c_str() );
+		}
 		else if (torrent_paused_alert* p = alert_cast<torrent_paused_alert>(a))
 		{
 			// write resume data for the finished torrent
@@ -1060,6 +1412,8 @@ namespace libtorrent
 
 	TorrentSessionImpl::~TorrentSessionImpl()
 	{
+		dir_monitor_.stop();
+		loader_.stop();
 		save_setting();
 	}
 
@@ -1145,87 +1499,70 @@ namespace libtorrent
 	//////////////////////////////////////////////////////////////////////////
 	//
 
-	bool TorrentSessionImpl::get_status( std::string const & torrent, TorrentStatus & ts )
+	void TorrentSessionImpl::set_streaming( std::string const & torrent, int window_pieces, int deadline_step_ms )
 	{
 		auto entry = torrents_.find<0>(torrent);
 
 		if( entry )
 		{
-			torrent_status const & status = std::tr1::get<1>(*entry).status_;
+			torrent_handle const & handle = std::tr1::get<1>(*entry).handle_;
 
-#define _copy_to_ts( var ) ts.##var = status.##var;
+			if( handle.is_valid() )
+			{
+				handle.set_streaming_mode( window_pieces, deadline_step_ms );
+			}
+		}
+	}
 
-			ts.state = (TorrentStatus::state_t)status.state;
-			_copy_to_ts( paused );
-			_copy_to_ts( auto_managed );
-			_copy_to_ts( sequential_download );
-			_copy_to_ts( is_seeding );
-			_copy_to_ts( is_finished );
-			_copy_to_ts( has_metadata );
-			_copy_to_ts( progress );
-			_copy_to_ts( progress_ppm );
-			_copy_to_ts( current_tracker );
-			_copy_to_ts( total_download );
-			_copy_to_ts( total_upload );
-			_copy_to_ts( total_payload_download );
-			_copy_to_ts( total_payload_upload );
-			_copy_to_ts( total_failed_bytes );
-			_copy_to_ts( total_redundant_bytes );
-			_copy_to_ts( download_rate );
-			_copy_to_ts( upload_rate );
-			_copy_to_ts( download_payload_rate );
-			_copy_to_ts( upload_payload_rate );
-			_copy_to_ts( num_seeds );
-			_copy_to_ts( num_peers );
-			_copy_to_ts( num_complete );
-			_copy_to_ts( num_incomplete );
-			_copy_to_ts( list_seeds );
-			_copy_to_ts( list_peers );
-			_copy_to_ts( connect_candidates );
-			_copy_to_ts( num_pieces );
-			_copy_to_ts( total_done );
-			_copy_to_ts( total_wanted_done );
-			_copy_to_ts( total_wanted );
-			_copy_to_ts( distributed_full_copies );
-			_copy_to_ts( distributed_fraction );
-			_copy_to_ts( distributed_copies );
-			_copy_to_ts( block_size );
-			_copy_to_ts( num_uploads );
-			_copy_to_ts( num_connections );
-			_copy_to_ts( uploads_limit );
-			_copy_to_ts( connections_limit );
-			_copy_to_ts( up_bandwidth_queue );
-			_copy_to_ts( down_bandwidth_queue );
-			_copy_to_ts( all_time_upload );
-			_copy_to_ts( all_time_download );
-			_copy_to_ts( active_time );
-			_copy_to_ts( finished_time );
-			_copy_to_ts( seeding_time );
-			_copy_to_ts( seed_rank );
-			_copy_to_ts( last_scrape );
-			_copy_to_ts( has_incoming );
-			_copy_to_ts( sparse_regions );
-			_copy_to_ts( seed_mode );
-			_copy_to_ts( upload_mode );
-			_copy_to_ts( share_mode );
-			_copy_to_ts( super_seeding );
-			_copy_to_ts( priority );
-			_copy_to_ts( added_time );
-			_copy_to_ts( completed_time );
-			_copy_to_ts( last_seen_complete );
-			_copy_to_ts( time_since_upload );
-			_copy_to_ts( time_since_download );
-			_copy_to_ts( queue_position );
-			_copy_to_ts( need_save_resume );
-			_copy_to_ts( ip_filter_applies );
-			_copy_to_ts( listen_port );
+	//////////////////////////////////////////////////////////////////////////
+	//
 
-#undef _copy_to_ts
+	void TorrentSessionImpl::advance_streaming( std::string const & torrent, __int64 offset )
+	{
+		auto entry = torrents_.find<0>(torrent);
 
-			return true;
+		if( entry )
+		{
+			torrent_handle const & handle = std::tr1::get<1>(*entry).handle_;
+
+			if( handle.is_valid() )
+			{
+				torrent_info const & info = handle.get_torrent_info();
+
+				// without metadata there's no piece size to map the offset to
+				if( !info.is_valid() )
+					return;
+
+				handle.advance_streaming_cursor( int( offset / info.piece_length() ) );
+			}
 		}
+	}
 
-		return false;
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	bool TorrentSessionImpl::get_status( std::string const & torrent, TorrentStatus & ts )
+	{
+		auto entry = torrents_.find<0>(torrent);
+
+		if( !entry )
+			return false;
+
+		torrent_status const & status = std::tr1::get<1>(*entry).status_;
+
+		// the status table has the numbers as of the last second tick, without
+		// a trip to the network thread. The tracker isn't in there, so it comes
+		// from the last state update, like everything did before
+		torrent_status_record record;
+
+		if( status.handle.status_record( record ) )
+			copy_status( record, ts );
+		else
+			copy_status( status, ts );
+
+		ts.current_tracker = status.current_tracker;
+
+		return true;
 	}
 
 	//////////////////////////////////////////////////////////////////////////
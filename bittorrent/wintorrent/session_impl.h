@@ -17,8 +17,10 @@
 #include "libtorrent/magnet_uri.hpp"
 #include "libtorrent/bitfield.hpp"
 #include "libtorrent/peer_info.hpp"
+#include "libtorrent/handle_batch.hpp"
 #include "libtorrent/socket_io.hpp" // print_address
 #include "libtorrent/time.hpp"
+#include "libtorrent/resume_store.hpp"
 
 #include "libtorrent/extensions/metadata_transfer.hpp"
 #include "libtorrent/extensions/ut_metadata.hpp"
@@ -28,7 +30,9 @@
 #include <boost/bind.hpp>
 #include <boost/unordered_set.hpp>
 
-#include "tuple_map.hpp"
+#include "hash_tuple_map.hpp"
+#include "dir_monitor.hpp"
+#include "torrent_loader.hpp"
 
 namespace libtorrent
 {
@@ -61,6 +65,27 @@ namespace libtorrent
 		bool operator<( TorrentFile const & other ) const { return handle_ < other.handle_; }
 		bool operator==( TorrentFile const & other ) const { return handle_ == other.handle_; }
 	};
+}
+
+// entries and files are indexed by their handle, so looking one up
+// doesn't have to build a TorrentEntry (and query the torrent's status)
+
+template<>
+struct hash_tuple_key< libtorrent::TorrentEntry >
+{
+	typedef libtorrent::torrent_handle type;
+	static type const & get( libtorrent::TorrentEntry const & e ) { return e.handle_; }
+};
+
+template<>
+struct hash_tuple_key< libtorrent::TorrentFile >
+{
+	typedef libtorrent::torrent_handle type;
+	static type const & get( libtorrent::TorrentFile const & f ) { return f.handle_; }
+};
+
+namespace libtorrent
+{
 
 	//////////////////////////////////////////////////////////////////////////
 	//
@@ -68,8 +93,8 @@ namespace libtorrent
 	class TorrentSessionImpl : public TorrentSessionImplBase
 	{
 	public:
-		typedef tuple_map< std::string, TorrentEntry > Torrents; // first : tag, second : entry
-		typedef tuple_map< std::string, TorrentFile > FileHandles; // first : filepath, second : handle
+		typedef hash_tuple_map< std::string, TorrentEntry > Torrents; // first : tag, second : entry
+		typedef hash_tuple_map< std::string, TorrentFile > FileHandles; // first : filepath, second : handle
 		typedef boost::unordered_set<torrent_handle> NonFileHandles;
 		typedef std::map< std::string, std::string > TorrentTags; // first : overlaped tag, second : org tag;
 
@@ -80,6 +105,8 @@ namespace libtorrent
 		virtual void update();
 		virtual bool add(std::string const & torrent);
 		virtual bool del(std::string const & torrent, bool delete_torrent_file, bool delete_download_file);
+		virtual int add_many( std::vector<std::string> const & torrents );
+		virtual int del_many( std::vector<std::string> const & torrents, bool delete_torrent_file, bool delete_download_file );
 		virtual bool pause(std::string const & torrent);
 		virtual bool resume( std::string const & torrent );
 		virtual bool setting( std::vector<std::string> const & params, bool isFirst = false );
@@ -88,14 +115,22 @@ namespace libtorrent
 		virtual std::string get_magnet( std::string const & torrent );
 		virtual void get_metadata( std::string const & torrent, std::vector<char> & data );
 		virtual void set_sequential_down( std::string const & torrent, bool sequential );
+		virtual void set_streaming( std::string const & torrent, int window_pieces, int deadline_step_ms );
+		virtual void advance_streaming( std::string const & torrent, __int64 offset );
 		virtual bool get_status( std::string const & torrent, TorrentStatus & ts );
 
 	private:
 		bool load_torrent( std::string const & torrent );
+		void add_torrent_file( std::string const & torrent, boost::intrusive_ptr<torrent_info> const & t );
+		void torrent_file_params( std::string const & torrent, boost::intrusive_ptr<torrent_info> const & t, add_torrent_params & p );
+		void submit_loaded_torrents();
+		bool remove_entry( std::string const & torrent, bool delete_torrent_file, bool delete_download_file, torrent_handle & handle );
 		void load_setting();
 		void print_debug();
-		void scan_dir();
+		void handle_dir_changes();
 		void save_setting();
+		bool load_resume_data( sha1_hash const & info_hash, std::vector<char> & buf );
+		void save_resume_data( torrent_handle const & handle, entry const & resume_data );
 
 		// returns true if the alert was handled (and should not be printed to the log)
 		// returns false if the alert was not handled
@@ -105,6 +140,11 @@ namespace libtorrent
 		session_settings session_settings_;
 		proxy_settings proxy_settings_;
 
+		// resume data for all torrents and the session state, in one file
+		resume_store resume_store_;
+		// the torrent loader threads read resume data too
+		mutex resume_mutex_;
+
 		int listen_port_;
 		int allocation_mode_;
 
@@ -141,7 +181,19 @@ namespace libtorrent
 
 		TorrentTags torrent_tags_;
 
-		ptime next_dir_scan_;
+		// watches monitor_dir_ and parses the .torrent files added to it
+		dir_monitor dir_monitor_;
+
+		// loads the .torrent files passed to add_many
+		torrent_loader loader_;
+		// torrents that were loaded but not handed to the session yet
+		std::deque<torrent_loader::result> loaded_;
+		// batched adds whose add_torrent_alert hasn't arrived yet. This is kept
+		// below the alert queue size so that no add_torrent_alert is dropped
+		int num_outstanding_adds_;
+		// GetTickCount() when the last batched add_torrent_alert arrived, or
+		// when the first batch was submitted. See add_alert_timeout
+		DWORD last_add_progress_;
 
 		int num_outstanding_resume_data_;
 
@@ -0,0 +1,125 @@
+#include "torrent_loader.hpp"
+
+#include <boost/bind.hpp>
+
+namespace libtorrent
+{
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	torrent_loader::torrent_loader( ResumeLoader const & load_resume )
+		: load_resume_(load_resume)
+		, num_loading_(0)
+		, abort_(false)
+	{}
+
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	torrent_loader::~torrent_loader()
+	{
+		stop();
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	void torrent_loader::push( std::vector<std::string> const & files )
+	{
+		if( files.empty() )
+			return;
+
+		mutex::scoped_lock l( mutex_ );
+
+		jobs_.insert( jobs_.end(), files.begin(), files.end() );
+		abort_ = false;
+
+		if( threads_.empty() )
+		{
+			int num_threads = (std::max)( hardware_concurrency(), 1 );
+
+			for( int i = 0; i < num_threads; ++i )
+				threads_.push_back( boost::shared_ptr<thread>( new thread( boost::bind( &torrent_loader::thread_fun, this ) ) ) );
+		}
+
+		cond_.signal_all( l );
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	void torrent_loader::pop_results( std::deque<result> & results )
+	{
+		mutex::scoped_lock l( mutex_ );
+		results_.swap( results );
+		results_.clear();
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	int torrent_loader::num_pending() const
+	{
+		mutex::scoped_lock l( mutex_ );
+		return int( jobs_.size() ) + num_loading_;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	void torrent_loader::stop()
+	{
+		std::vector< boost::shared_ptr<thread> > threads;
+
+		{
+			mutex::scoped_lock l( mutex_ );
+			abort_ = true;
+			jobs_.clear();
+			cond_.signal_all( l );
+			threads_.swap( threads );
+		}
+
+		for( auto i = threads.begin(); i != threads.end(); ++i )
+			(*i)->join();
+
+		mutex::scoped_lock l( mutex_ );
+		results_.clear();
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	//
+
+	void torrent_loader::thread_fun()
+	{
+		mutex::scoped_lock l( mutex_ );
+
+		for(;;)
+		{
+			while( jobs_.empty() && !abort_ )
+				cond_.wait( l );
+
+			if( abort_ )
+				return;
+
+			result r;
+			r.path = jobs_.front();
+			jobs_.pop_front();
+			++num_loading_;
+
+			l.unlock();
+
+			r.ti = new torrent_info( r.path, r.ec );
+
+			if( r.ec )
+				r.ti.reset();
+			else if( load_resume_ )
+				r.has_resume_data = load_resume_( r.ti->info_hash(), r.resume_data );
+
+			l.lock();
+
+			--num_loading_;
+			results_.push_back( result() );
+			results_.back().swap( r );
+		}
+	}
+}
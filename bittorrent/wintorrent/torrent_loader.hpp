@@ -0,0 +1,87 @@
+#pragma once
+
+#include "libtorrent/torrent_info.hpp"
+#include "libtorrent/thread.hpp"
+#include "libtorrent/error_code.hpp"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/intrusive_ptr.hpp>
+#include <boost/function.hpp>
+
+#include <string>
+#include <deque>
+#include <vector>
+
+namespace libtorrent
+{
+	//////////////////////////////////////////////////////////////////////////
+	//
+	// loads .torrent files and their resume data on a pool of worker
+	// threads, so that adding many torrents at once doesn't stall the
+	// thread calling into the session. The threads are started the first
+	// time there is something to load
+
+	class torrent_loader
+	{
+	public:
+		struct result
+		{
+			result() : has_resume_data(false) {}
+
+			void swap( result & other )
+			{
+				path.swap( other.path );
+				ti.swap( other.ti );
+				resume_data.swap( other.resume_data );
+				std::swap( has_resume_data, other.has_resume_data );
+				std::swap( ec, other.ec );
+			}
+
+			// the path that was passed to push()
+			std::string path;
+
+			// the parsed torrent, or 0 if ec is set
+			boost::intrusive_ptr<torrent_info> ti;
+
+			std::vector<char> resume_data;
+			bool has_resume_data;
+
+			error_code ec;
+		};
+
+		// called from the worker threads to look up the resume data of
+		// a torrent. It must be safe to call concurrently
+		typedef boost::function< bool( sha1_hash const &, std::vector<char> & ) > ResumeLoader;
+
+		explicit torrent_loader( ResumeLoader const & load_resume );
+		~torrent_loader();
+
+		void push( std::vector<std::string> const & files );
+
+		// moves the torrents loaded since the last call into results,
+		// in the order they finished loading
+		void pop_results( std::deque<result> & results );
+
+		// the number of files that are queued or being loaded
+		int num_pending() const;
+
+		// drops the files that haven't been loaded yet and waits for
+		// the worker threads to exit
+		void stop();
+
+	private:
+		void thread_fun();
+
+		ResumeLoader load_resume_;
+
+		mutable mutex mutex_;
+		condition cond_;
+
+		std::deque<std::string> jobs_;
+		std::deque<result> results_;
+		int num_loading_;
+		bool abort_;
+
+		std::vector< boost::shared_ptr<thread> > threads_;
+	};
+}